@@ -1,7 +1,7 @@
 #!/bin/bash
 # 共通設定・ヘルパー
 
-SERVER_URL="${PROMPT_RELAY_SERVER_URL:-http://localhost:3939}" # プライマリサーバのURL
+SERVER_URL="${PROMPT_RELAY_SERVER_URL:-http://localhost:3939}" # プライマリサーバのURL（mdns:// で ESP32 版を自動選択）
 API_KEY="${PROMPT_RELAY_API_KEY:-}"                          # Bearer トークン認証用（ルームキー、8〜128文字）
 
 # ルームキーバリデーション
@@ -16,6 +16,7 @@ fi
 CURL_AUTH=(-H "Authorization: Bearer ${API_KEY}")
 
 # セカンダリサーバ (ESP32 等、空なら無効)
+# ESP32 をミラーモード (CONFIG_UPSTREAM_URL) で使う場合は設定不要
 SERVER_URL_2="${PROMPT_RELAY_SERVER_URL_2:-}"
 API_KEY_2="${PROMPT_RELAY_API_KEY_2:-${API_KEY}}" # 未設定時はプライマリの API_KEY を継承
 CURL_AUTH_2=()
@@ -33,5 +34,24 @@ HOSTNAME_SHORT=$(hostname -s)
 TMUX_SESSION=$(tmux display-message -p '#{session_name}' 2>/dev/null)
 DISPLAY_HOST="${HOSTNAME_SHORT}${TMUX_SESSION:+:${TMUX_SESSION}}" # 形式: hostname:tmux_session（マルチマシン識別用）
 
+# 送信元ホストをヘッダーでも送る（ESP32 版はボディを読む前にホスト単位で流量制御する）
+CURL_AUTH+=(-H "X-Prompt-Relay-Host: ${DISPLAY_HOST}")
+[ -n "$SERVER_URL_2" ] && CURL_AUTH_2+=(-H "X-Prompt-Relay-Host: ${DISPLAY_HOST}")
+
 DETECT_INTERVAL="${PROMPT_RELAY_DETECT_INTERVAL:-0.1}"
 DETECT_ATTEMPTS="${PROMPT_RELAY_DETECT_ATTEMPTS:-10}"
+
+# PROMPT_RELAY_SERVER_URL=mdns:// のとき、同じネットワークの ESP32 版 (_prompt-relay._tcp) から
+# プライマリサーバを選ぶ（hook/relayd の discover を使う）。引数はペインの識別子 (hostname:session:window.pane)
+# 同じペインは同じサーバを使い続け、新しいペインは未応答の少ないサーバに振り分けられる
+# 見つからない・prompt-relayd が未ビルドの場合は prompt-relay.local を使う
+resolve_server_url() {
+  case "$SERVER_URL" in
+    mdns://*) ;;
+    *) return 0 ;;
+  esac
+  local relayd="${PROMPT_RELAY_DAEMON:-${SCRIPT_DIR}/relayd/build/prompt-relayd}"
+  local url=""
+  [ -x "$relayd" ] && url=$("$relayd" discover --target-id "$1" 2>/dev/null)
+  SERVER_URL="${url:-http://prompt-relay.local:3939}"
+}
@@ -11,6 +11,7 @@ TMUX_TARGET_ID=""
 if [ -n "$TMUX_PANE" ]; then
   TMUX_TARGET_ID="${HOSTNAME_SHORT}:${TMUX_PANE}"
 fi
+resolve_server_url "$TMUX_TARGET_ID"
 
 INPUT=$(cat) # stdin から Notification フックの JSON データを読み取り
 
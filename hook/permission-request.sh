@@ -12,6 +12,9 @@
 #   4. 検出後、サーバへ送信し、応答をポーリングして tmux へ転送
 #   5. 応答送信後、再びフェーズ1に戻り次の連続プロンプトを検出する
 #
+# hook/relayd の prompt-relayd がビルドされていれば 3〜5 は常駐デーモンが行い、
+# このスクリプトは依頼を Unix ソケットで渡して終了する (以下の排他戦略は従来処理のもの)。
+#
 # 排他戦略（PID 後勝ち方式、ロックなし）:
 #   2つの独立した PID ファイルで排他制御を行い、いずれも後発が先行を置き換える。
 #
@@ -56,10 +59,28 @@ TMUX_TARGET="$TMUX_PANE"
 [ -z "$TMUX_TARGET" ] && exit 0
 
 TMUX_TARGET_ID="${HOSTNAME_SHORT}:${TMUX_PANE}"
+resolve_server_url "$TMUX_TARGET_ID"
 
 # stdin から PreToolUse データを読み取る
 INPUT=$(cat)
 
+# --- ネイティブデーモン (hook/relayd) ---
+# ビルド済みなら検出・送信・応答待ち・send-keys を常駐デーモン prompt-relayd に任せて即終了する。
+# デーモンは全ペインを 1 プロセスで扱い、サーバとは keep-alive、tmux とは制御モードで通信するので、
+# プロンプトごとの curl / python3 / tmux の起動がなくなる。初回はここから自動起動する。
+# 渡せなかった場合 (未ビルド・https を TLS なしでビルドした等) は以下の従来処理で続行する
+RELAYD="${PROMPT_RELAY_DAEMON:-${SCRIPT_DIR}/relayd/build/prompt-relayd}"
+if [ -x "$RELAYD" ]; then
+  if printf '%s' "$INPUT" | \
+    PROMPT_RELAY_SERVER_URL="$SERVER_URL" PROMPT_RELAY_API_KEY="$API_KEY" \
+    PROMPT_RELAY_SERVER_URL_2="$SERVER_URL_2" PROMPT_RELAY_API_KEY_2="$API_KEY_2" \
+    "$RELAYD" submit --target "$TMUX_TARGET" --target-id "$TMUX_TARGET_ID" --host "$DISPLAY_HOST" \
+      --timeout "$TIMEOUT" --detect-interval "$DETECT_INTERVAL" --detect-attempts "$DETECT_ATTEMPTS" \
+      >/dev/null 2>&1; then
+    exit 0
+  fi
+fi
+
 # バックグラウンドで全処理を実行（PreToolUse を即座に返すため）
 (
   # --- PID ファイル & 重複防止 ---
@@ -192,7 +213,8 @@ INPUT=$(cat)
       break
     fi
 
-    if [ "$HTTP_STATUS" = "503" ] || [ "$HTTP_STATUS" = "401" ]; then
+    # 429 = 流量制御で拒否（フォールバック通知も同じ制限に掛かるので送らない）
+    if [ "$HTTP_STATUS" = "503" ] || [ "$HTTP_STATUS" = "401" ] || [ "$HTTP_STATUS" = "429" ]; then
       break
     fi
 
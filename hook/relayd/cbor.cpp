@@ -0,0 +1,210 @@
+#include "cbor.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define MAX_DEPTH 64
+
+// server-esp32/main/cbor.h の CborKey と同じ並び (番号 = 添字)
+static const char* const KEY_NAMES[] = {
+    "id", "tool_name", "message", "choices", "created_at", "expires_at", "response",
+    "responded_at", "send_key", "hostname", "number", "text", "tmux_target", "header",
+    "description", "prompt_question", "has_tmux", "tool_input", "timeout", "title", "choice",
+    "ok", "error", "command", "file_path", "source",
+};
+static const int KEY_COUNT = sizeof(KEY_NAMES) / sizeof(KEY_NAMES[0]);
+
+static int key_number(const std::string& name) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (name == KEY_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+// ── エンコード ──
+
+static void put_head(std::string* out, uint8_t major, uint64_t v) {
+    uint8_t m = (uint8_t)(major << 5);
+    if (v < 24) {
+        out->push_back((char)(m | v));
+        return;
+    }
+    int bytes = v <= 0xff ? 1 : v <= 0xffff ? 2 : v <= 0xffffffffu ? 4 : 8;
+    out->push_back((char)(m | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27)));
+    for (int i = bytes - 1; i >= 0; i--) out->push_back((char)(v >> (i * 8)));
+}
+
+static void put_text(std::string* out, const std::string& s) {
+    put_head(out, 3, s.size());
+    *out += s;
+}
+
+static void put_number(std::string* out, const std::string& repr) {
+    // 整数の表記 (小数点・指数なし) で int64 に収まるものは整数で送る
+    if (repr.find_first_of(".eE") == std::string::npos) {
+        errno = 0;
+        char* end;
+        long long n = strtoll(repr.c_str(), &end, 10);
+        if (errno == 0 && *end == '\0' && end != repr.c_str()) {
+            if (n >= 0) put_head(out, 0, (uint64_t)n);
+            else put_head(out, 1, (uint64_t)(-1 - n));
+            return;
+        }
+    }
+    double d = strtod(repr.c_str(), nullptr);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    out->push_back((char)0xfb);
+    for (int i = 7; i >= 0; i--) out->push_back((char)(bits >> (i * 8)));
+}
+
+void cbor_encode(const JsonValue& v, std::string* out) {
+    switch (v.type) {
+        case JsonValue::NUL:    out->push_back((char)0xf6); break;
+        case JsonValue::BOOL:   out->push_back((char)(v.boolean ? 0xf5 : 0xf4)); break;
+        case JsonValue::NUMBER: put_number(out, v.str); break;
+        case JsonValue::STRING: put_text(out, v.str); break;
+        case JsonValue::ARRAY:
+            put_head(out, 4, v.items.size());
+            for (const JsonValue& item : v.items) cbor_encode(item, out);
+            break;
+        case JsonValue::OBJECT:
+            put_head(out, 5, v.items.size());
+            for (size_t i = 0; i < v.items.size(); i++) {
+                int key = key_number(v.keys[i]);
+                if (key >= 0) put_head(out, 0, (uint64_t)key);
+                else put_text(out, v.keys[i]);
+                cbor_encode(v.items[i], out);
+            }
+            break;
+    }
+}
+
+// ── デコード ──
+
+namespace {
+
+struct Decoder {
+    const uint8_t* p;
+    const uint8_t* end;
+    int depth = 0;
+
+    bool head(uint8_t* major, uint8_t* info, uint64_t* arg) {
+        if (p >= end) return false;
+        *major = *p >> 5;
+        *info = *p & 0x1f;
+        p++;
+        if (*info < 24) {
+            *arg = *info;
+            return true;
+        }
+        if (*info > 27) return false;   // 不定長・予約
+        int bytes = 1 << (*info - 24);
+        if (end - p < bytes) return false;
+        *arg = 0;
+        for (int i = 0; i < bytes; i++) *arg = (*arg << 8) | *p++;
+        return true;
+    }
+
+    static double half_to_double(uint16_t h) {
+        int exp = (h >> 10) & 0x1f;
+        int mant = h & 0x3ff;
+        double v = exp == 0 ? ldexp(mant, -24) : exp != 31 ? ldexp(mant + 1024, exp - 25)
+                 : mant == 0 ? HUGE_VAL : NAN;
+        return (h & 0x8000) ? -v : v;
+    }
+
+    bool value(JsonValue* out) {
+        uint8_t major, info;
+        uint64_t arg;
+        if (!head(&major, &info, &arg)) return false;
+        char buf[32];
+        switch (major) {
+            case 0:
+                out->type = JsonValue::NUMBER;
+                snprintf(buf, sizeof(buf), "%" PRIu64, arg);
+                out->str = buf;
+                return true;
+            case 1:
+                if (arg > (uint64_t)INT64_MAX) return false;
+                out->type = JsonValue::NUMBER;
+                snprintf(buf, sizeof(buf), "%" PRId64, -1 - (int64_t)arg);
+                out->str = buf;
+                return true;
+            case 3:
+                if ((uint64_t)(end - p) < arg) return false;
+                out->type = JsonValue::STRING;
+                out->str.assign((const char*)p, arg);
+                p += arg;
+                return true;
+            case 4:
+            case 5: {
+                if (++depth > MAX_DEPTH || arg > (uint64_t)(end - p)) return false;
+                out->type = major == 4 ? JsonValue::ARRAY : JsonValue::OBJECT;
+                for (uint64_t i = 0; i < arg; i++) {
+                    if (major == 5) {
+                        JsonValue key;
+                        if (!value(&key)) return false;
+                        if (key.type == JsonValue::STRING) {
+                            out->keys.push_back(key.str);
+                        } else if (key.type == JsonValue::NUMBER) {
+                            // 表にない番号 (新しいサーバ) は番号のまま名前にする
+                            long k = strtol(key.str.c_str(), nullptr, 10);
+                            out->keys.push_back(k >= 0 && k < KEY_COUNT ? KEY_NAMES[k] : key.str);
+                        } else {
+                            return false;
+                        }
+                    }
+                    out->items.emplace_back();
+                    if (!value(&out->items.back())) return false;
+                }
+                depth--;
+                return true;
+            }
+            case 7: {
+                if (info == 20 || info == 21) {
+                    out->type = JsonValue::BOOL;
+                    out->boolean = info == 21;
+                    return true;
+                }
+                if (info == 22 || info == 23) {
+                    out->type = JsonValue::NUL;
+                    return true;
+                }
+                double d;
+                if (info == 25) {
+                    d = half_to_double((uint16_t)arg);
+                } else if (info == 26) {
+                    float f;
+                    uint32_t bits = (uint32_t)arg;
+                    memcpy(&f, &bits, sizeof(f));
+                    d = f;
+                } else if (info == 27) {
+                    memcpy(&d, &arg, sizeof(d));
+                } else {
+                    return false;
+                }
+                out->type = JsonValue::NUMBER;
+                snprintf(buf, sizeof(buf), "%.17g", d);
+                out->str = buf;
+                return true;
+            }
+            default:
+                return false;       // バイト文字列・タグ
+        }
+    }
+};
+
+}  // namespace
+
+bool cbor_decode(const std::string& data, JsonValue* out) {
+    Decoder d;
+    d.p = (const uint8_t*)data.data();
+    d.end = d.p + data.size();
+    *out = JsonValue();
+    return d.value(out) && d.p == d.end;
+}
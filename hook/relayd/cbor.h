@@ -0,0 +1,17 @@
+#pragma once
+
+#include "json.h"
+
+#include <string>
+
+// ESP32 版サーバとの CBOR (RFC 8949) ワイヤフォーマット (PROMPT_RELAY_CBOR=1 のときだけ使う)
+//
+// JsonValue と相互に変換する。マップのキーは docs/api.md「CBOR ワイヤフォーマット」の表にある
+// 名前なら整数、それ以外 (tool_input の未知のフィールドなど) はテキストのまま送る。
+// 不定長・タグ・バイト文字列は扱わない (サーバも送ってこない)
+
+// NUMBER は整数の表記なら整数、それ以外は倍精度浮動小数点にする
+void cbor_encode(const JsonValue& v, std::string* out);
+
+// 整数キーは名前に戻す。失敗時は false (out は不定)
+bool cbor_decode(const std::string& data, JsonValue* out);
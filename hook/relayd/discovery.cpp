@@ -0,0 +1,483 @@
+#include "discovery.h"
+#include "relayd_log.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char* TAG = "discovery";
+
+#define SERVICE_NAME "_prompt-relay._tcp.local"
+#define MDNS_ADDR "224.0.0.251"
+#define MDNS_PORT 5353
+#define BROWSE_WAIT_MS 300          // 応答を待つ時間 (ESP32 は数十 ms で返す)
+#define CACHE_TTL_MS 5000           // これより古いキャッシュは問い合わせ直す (負荷の値が古くなる)
+#define RELAY_FORGET_MS 60000       // この間応答がなければ一覧から外す (取りこぼしでは外さない)
+#define STICKY_FORGET_MS (24LL * 3600 * 1000)
+#define MAX_STICKY 256
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_PTR 12
+#define DNS_TYPE_TXT 16
+#define DNS_TYPE_SRV 33
+#define DNS_CLASS_IN 1
+#define DNS_CLASS_QU 0x8000         // 応答をユニキャストで求める
+
+// 壁時計 (キャッシュファイルを複数のプロセスで共有するので単調時計は使えない)
+static int64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ── DNS メッセージ ──
+
+static void put_u16(std::string* out, uint16_t v) {
+    out->push_back((char)(v >> 8));
+    out->push_back((char)(v & 0xff));
+}
+
+static void put_name(std::string* out, const char* name) {
+    while (*name) {
+        const char* dot = strchr(name, '.');
+        size_t len = dot ? (size_t)(dot - name) : strlen(name);
+        out->push_back((char)len);
+        out->append(name, len);
+        name += len + (dot ? 1 : 0);
+    }
+    out->push_back('\0');
+}
+
+struct Packet {
+    const uint8_t* data;
+    size_t len;
+};
+
+static bool get_u16(const Packet& p, size_t off, uint16_t* v) {
+    if (off + 2 > p.len) return false;
+    *v = (uint16_t)(p.data[off] << 8 | p.data[off + 1]);
+    return true;
+}
+
+// 圧縮 (ポインタ) を展開して名前を読む。off は名前の直後に進める
+static bool get_name(const Packet& p, size_t* off, std::string* out) {
+    out->clear();
+    size_t pos = *off;
+    bool jumped = false;
+    for (int hops = 0; hops < 32; hops++) {
+        if (pos >= p.len) return false;
+        uint8_t len = p.data[pos];
+        if (len == 0) {
+            if (!jumped) *off = pos + 1;
+            return true;
+        }
+        if ((len & 0xc0) == 0xc0) {
+            if (pos + 2 > p.len) return false;
+            if (!jumped) *off = pos + 2;
+            jumped = true;
+            pos = (size_t)(len & 0x3f) << 8 | p.data[pos + 1];
+            continue;
+        }
+        if (pos + 1 + len > p.len) return false;
+        if (!out->empty()) *out += '.';
+        out->append((const char*)p.data + pos + 1, len);
+        pos += 1 + len;
+    }
+    return false;
+}
+
+static bool name_equal(const std::string& a, const char* b) {
+    return strcasecmp(a.c_str(), b) == 0;
+}
+
+// 応答から集めたもの (インスタンス名 → SRV / TXT、ホスト名 → A)
+struct BrowseState {
+    std::map<std::string, std::string> srv_target;
+    std::map<std::string, uint16_t> srv_port;
+    std::map<std::string, std::map<std::string, std::string>> txt;
+    std::map<std::string, std::string> addr;        // ホスト名 → IPv4
+    std::map<std::string, std::string> source;      // インスタンス名 → 応答の送信元 (A がないとき用)
+    std::vector<std::string> instances;
+};
+
+static void parse_txt(const Packet& p, size_t off, size_t end, std::map<std::string, std::string>* out) {
+    while (off < end) {
+        uint8_t len = p.data[off++];
+        if (off + len > end) break;
+        std::string item((const char*)p.data + off, len);
+        off += len;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) (*out)[item] = "";
+        else (*out)[item.substr(0, eq)] = item.substr(eq + 1);
+    }
+}
+
+static void parse_packet(const Packet& p, const std::string& from, BrowseState* st) {
+    uint16_t flags, qd, an, ns, ar;
+    if (!get_u16(p, 2, &flags) || !(flags & 0x8000)) return;   // 応答のみ
+    if (!get_u16(p, 4, &qd) || !get_u16(p, 6, &an) || !get_u16(p, 8, &ns) || !get_u16(p, 10, &ar)) return;
+
+    size_t off = 12;
+    std::string name;
+    for (int i = 0; i < qd; i++) {
+        if (!get_name(p, &off, &name)) return;
+        off += 4;
+    }
+    for (int i = 0; i < an + ns + ar; i++) {
+        uint16_t type, cls, rdlen;
+        if (!get_name(p, &off, &name) || !get_u16(p, off, &type) || !get_u16(p, off + 2, &cls) ||
+            !get_u16(p, off + 8, &rdlen)) {
+            return;
+        }
+        size_t rd = off + 10;
+        if (rd + rdlen > p.len) return;
+        off = rd + rdlen;
+        if ((cls & 0x7fff) != DNS_CLASS_IN) continue;
+
+        std::string target;
+        size_t pos = rd;
+        switch (type) {
+            case DNS_TYPE_PTR:
+                if (name_equal(name, SERVICE_NAME) && get_name(p, &pos, &target) &&
+                    std::find(st->instances.begin(), st->instances.end(), target) == st->instances.end()) {
+                    st->instances.push_back(target);
+                    st->source[target] = from;
+                }
+                break;
+            case DNS_TYPE_SRV: {
+                uint16_t port;
+                pos = rd + 6;
+                if (rdlen > 6 && get_u16(p, rd + 4, &port) && get_name(p, &pos, &target)) {
+                    st->srv_target[name] = target;
+                    st->srv_port[name] = port;
+                }
+                break;
+            }
+            case DNS_TYPE_TXT:
+                parse_txt(p, rd, rd + rdlen, &st->txt[name]);
+                break;
+            case DNS_TYPE_A:
+                if (rdlen == 4) {
+                    char buf[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, p.data + rd, buf, sizeof(buf));
+                    st->addr[name] = buf;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool discovery_browse(int wait_ms, std::vector<RelayInfo>* out) {
+    out->clear();
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+    // 5353 以外のポートから送る (legacy unicast): 応答はこのソケットに直接返る
+    unsigned char ttl = 255;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    std::string query;
+    put_u16(&query, 0);         // ID
+    put_u16(&query, 0);         // flags
+    put_u16(&query, 1);         // QDCOUNT
+    put_u16(&query, 0);
+    put_u16(&query, 0);
+    put_u16(&query, 0);
+    put_name(&query, SERVICE_NAME);
+    put_u16(&query, DNS_TYPE_PTR);
+    put_u16(&query, DNS_CLASS_IN | DNS_CLASS_QU);
+
+    struct sockaddr_in dst = {};
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(MDNS_PORT);
+    inet_pton(AF_INET, MDNS_ADDR, &dst.sin_addr);
+
+    BrowseState st;
+    int64_t start = wall_ms();
+    int sent = 0;
+    while (true) {
+        int64_t elapsed = wall_ms() - start;
+        if (elapsed >= wait_ms) break;
+        // 取りこぼしに備えて待ち時間の半分でもう一度送る
+        if (sent < 2 && elapsed >= (int64_t)sent * wait_ms / 2) {
+            if (sendto(fd, query.data(), query.size(), 0, (struct sockaddr*)&dst, sizeof(dst)) < 0) {
+                LOGD(TAG, "sendto %s: %s", MDNS_ADDR, strerror(errno));
+            }
+            sent++;
+        }
+        int64_t until = sent < 2 ? (int64_t)sent * wait_ms / 2 : wait_ms;
+        int slice = (int)std::max<int64_t>(until - elapsed, 0);
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, slice) <= 0) continue;
+
+        uint8_t buf[1500];
+        struct sockaddr_in from = {};
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &from_len);
+        if (n <= 0) continue;
+        char src[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &from.sin_addr, src, sizeof(src));
+        parse_packet(Packet{ buf, (size_t)n }, src, &st);
+    }
+    close(fd);
+
+    int64_t now = wall_ms();
+    for (const std::string& inst : st.instances) {
+        auto txt = st.txt.find(inst);
+        auto port = st.srv_port.find(inst);
+        if (txt == st.txt.end() || port == st.srv_port.end()) continue;
+        auto addr = st.addr.find(st.srv_target[inst]);
+        const std::string& ip = addr != st.addr.end() ? addr->second : st.source[inst];
+
+        const auto& kv = txt->second;
+        auto get = [&](const char* key) {
+            auto it = kv.find(key);
+            return it == kv.end() ? std::string() : it->second;
+        };
+        RelayInfo r;
+        r.id = get("id");
+        if (r.id.empty()) r.id = inst;
+        r.pending = atoi(get("pending").c_str());
+        r.used = atoi(get("used").c_str());
+        r.slots = atoi(get("slots").c_str());
+        r.caps = get("caps");
+        // tls を掲げるサーバは HTTPS のみで待ち受けている
+        // (証明書の SAN は prompt-relay.local なので、IP で繋ぐなら make_cert.py --ip で IP も入れておく)
+        bool tls = ("," + r.caps + ",").find(",tls,") != std::string::npos;
+        r.url = (tls ? "https://" : "http://") + ip + ":" + std::to_string(port->second);
+        r.seen_ms = now;
+        out->push_back(r);
+        LOGD(TAG, "found %s at %s (pending %d, used %d/%d)", r.id.c_str(), r.url.c_str(),
+             r.pending, r.used, r.slots);
+    }
+    return true;
+}
+
+// ── キャッシュ ──
+// 1 行 1 件のタブ区切り (ipc と同じく値にタブ・改行は含めない)
+//   PRC1
+//   fetched <ms>
+//   relay   <id> <url> <pending> <used> <slots> <caps> <seen_ms>
+//   sticky  <target_id> <relay id> <last_used_ms>
+
+struct Sticky {
+    std::string relay_id;
+    int64_t used_ms = 0;
+};
+
+struct Cache {
+    int64_t fetched_ms = 0;
+    std::vector<RelayInfo> relays;
+    std::map<std::string, Sticky> sticky;
+};
+
+std::string discovery_cache_path(void) {
+    const char* env = getenv("PROMPT_RELAY_DISCOVERY_CACHE");
+    if (env && *env) return env;
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return std::string(runtime) + "/prompt-relay-discovery";
+    return "/tmp/prompt-relay-discovery-" + std::to_string(getuid());
+}
+
+static std::vector<std::string> split_tabs(const std::string& line) {
+    std::vector<std::string> f;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        f.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos) return f;
+        start = tab + 1;
+    }
+}
+
+static void cache_read(int fd, Cache* c) {
+    std::string text;
+    char buf[4096];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) text.append(buf, n);
+    if (text.compare(0, 5, "PRC1\n") != 0) return;
+
+    size_t start = 5;
+    while (start < text.size()) {
+        size_t nl = text.find('\n', start);
+        if (nl == std::string::npos) break;
+        std::vector<std::string> f = split_tabs(text.substr(start, nl - start));
+        start = nl + 1;
+        if (f[0] == "fetched" && f.size() == 2) {
+            c->fetched_ms = atoll(f[1].c_str());
+        } else if (f[0] == "relay" && f.size() == 8) {
+            RelayInfo r;
+            r.id = f[1];
+            r.url = f[2];
+            r.pending = atoi(f[3].c_str());
+            r.used = atoi(f[4].c_str());
+            r.slots = atoi(f[5].c_str());
+            r.caps = f[6];
+            r.seen_ms = atoll(f[7].c_str());
+            c->relays.push_back(r);
+        } else if (f[0] == "sticky" && f.size() == 4) {
+            c->sticky[f[1]] = Sticky{ f[2], atoll(f[3].c_str()) };
+        }
+    }
+}
+
+static bool safe_field(const std::string& s) {
+    return s.find_first_of("\t\r\n") == std::string::npos;
+}
+
+static void cache_write(int fd, const Cache& c) {
+    std::string text = "PRC1\nfetched\t" + std::to_string(c.fetched_ms) + "\n";
+    for (const RelayInfo& r : c.relays) {
+        if (!safe_field(r.id) || !safe_field(r.url) || !safe_field(r.caps)) continue;
+        text += "relay\t" + r.id + "\t" + r.url + "\t" + std::to_string(r.pending) + "\t" +
+                std::to_string(r.used) + "\t" + std::to_string(r.slots) + "\t" + r.caps + "\t" +
+                std::to_string(r.seen_ms) + "\n";
+    }
+    for (const auto& kv : c.sticky) {
+        if (!safe_field(kv.first)) continue;
+        text += "sticky\t" + kv.first + "\t" + kv.second.relay_id + "\t" +
+                std::to_string(kv.second.used_ms) + "\n";
+    }
+    if (ftruncate(fd, 0) < 0) return;
+    lseek(fd, 0, SEEK_SET);
+    size_t off = 0;
+    while (off < text.size()) {
+        ssize_t n = write(fd, text.data() + off, text.size() - off);
+        if (n <= 0) return;
+        off += n;
+    }
+}
+
+// 古ければ問い合わせ直して一覧を更新する (今回見えなかったサーバもしばらくは残す)
+static void cache_refresh(Cache* c) {
+    int64_t now = wall_ms();
+    if (now - c->fetched_ms < CACHE_TTL_MS && now >= c->fetched_ms) return;
+
+    std::vector<RelayInfo> found;
+    if (!discovery_browse(BROWSE_WAIT_MS, &found)) return;
+    c->fetched_ms = now;
+    for (const RelayInfo& r : found) {
+        auto it = std::find_if(c->relays.begin(), c->relays.end(),
+                               [&](const RelayInfo& x) { return x.id == r.id; });
+        if (it != c->relays.end()) *it = r;
+        else c->relays.push_back(r);
+    }
+    c->relays.erase(std::remove_if(c->relays.begin(), c->relays.end(),
+                                   [&](const RelayInfo& x) { return now - x.seen_ms > RELAY_FORGET_MS; }),
+                    c->relays.end());
+}
+
+// キャッシュファイルを flock で排他して開く (同時に起動したフックが揃って問い合わせない)
+static int cache_open(void) {
+    int fd = open(discovery_cache_path().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    if (flock(fd, LOCK_EX) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool has_room(const RelayInfo& r) {
+    return r.slots == 0 || r.used < r.slots;
+}
+
+// 同じ負荷のサーバの中でターゲットごとにばらけさせる (FNV-1a)
+static uint32_t spread_hash(const std::string& target_id, const std::string& relay_id) {
+    uint32_t h = 2166136261u;
+    for (char ch : target_id + "\n" + relay_id) {
+        h ^= (uint8_t)ch;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+std::string discovery_pick(const std::string& target_id) {
+    int fd = cache_open();
+    if (fd < 0) return "";
+    Cache c;
+    cache_read(fd, &c);
+    cache_refresh(&c);
+    int64_t now = wall_ms();
+
+    int chosen = -1;
+    auto st = c.sticky.find(target_id);
+    if (st != c.sticky.end()) {
+        for (size_t i = 0; i < c.relays.size(); i++) {
+            if (c.relays[i].id == st->second.relay_id && has_room(c.relays[i])) chosen = (int)i;
+        }
+    }
+    if (chosen < 0) {
+        // 未応答が少ない → スロットの使用が少ない → ターゲットごとのハッシュ の順
+        for (size_t i = 0; i < c.relays.size(); i++) {
+            const RelayInfo& r = c.relays[i];
+            if (!has_room(r)) continue;
+            if (chosen < 0) {
+                chosen = (int)i;
+                continue;
+            }
+            const RelayInfo& best = c.relays[chosen];
+            if (r.pending != best.pending) {
+                if (r.pending < best.pending) chosen = (int)i;
+            } else if (r.used != best.used) {
+                if (r.used < best.used) chosen = (int)i;
+            } else if (spread_hash(target_id, r.id) < spread_hash(target_id, best.id)) {
+                chosen = (int)i;
+            }
+        }
+        if (chosen >= 0) {
+            RelayInfo* r = &c.relays[chosen];
+            LOGD(TAG, "%s -> %s (pending %d)", target_id.c_str(), r->id.c_str(), r->pending);
+            // 次の問い合わせまでに起動するセッションが同じサーバに集まらないよう、選んだ分を見込む
+            r->pending++;
+            r->used++;
+        }
+    }
+
+    std::string url;
+    if (chosen >= 0) {
+        url = c.relays[chosen].url;
+        if (!target_id.empty()) c.sticky[target_id] = Sticky{ c.relays[chosen].id, now };
+    }
+
+    // 使われなくなったペインの記録を捨てる
+    for (auto it = c.sticky.begin(); it != c.sticky.end();) {
+        if (now - it->second.used_ms > STICKY_FORGET_MS) it = c.sticky.erase(it);
+        else ++it;
+    }
+    while (c.sticky.size() > MAX_STICKY) {
+        auto oldest = c.sticky.begin();
+        for (auto it = c.sticky.begin(); it != c.sticky.end(); ++it) {
+            if (it->second.used_ms < oldest->second.used_ms) oldest = it;
+        }
+        c.sticky.erase(oldest);
+    }
+
+    cache_write(fd, c);
+    close(fd);
+    return url;
+}
+
+std::vector<RelayInfo> discovery_list(void) {
+    int fd = cache_open();
+    if (fd < 0) return {};
+    Cache c;
+    cache_read(fd, &c);
+    cache_refresh(&c);
+    cache_write(fd, c);
+    close(fd);
+    return c.relays;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// mDNS で同じネットワークの ESP32 版サーバ (_prompt-relay._tcp) を探し、負荷の低いものを選ぶ
+//
+// サーバは TXT に未応答件数・スロットの使用数・機能フラグ・個体 ID を載せている。
+// 問い合わせ結果はキャッシュファイルに数秒間残し、フックの起動ごとに問い合わせない。
+// tmux ターゲットごとに選んだサーバを覚えておき (スティッキー)、そのサーバが見えていて
+// スロットに空きがある間は同じサーバを使う (通知と権限リクエストが別の画面に分かれない)
+
+struct RelayInfo {
+    std::string id;             // TXT id (MAC の下位 3 バイト)
+    std::string url;            // http://<IPv4>:<port> (caps に tls があれば https://)
+    int pending = 0;            // 未応答のリクエスト数
+    int used = 0;               // 使用中のスロット (応答済みで残っているものを含む)
+    int slots = 0;              // スロット数
+    std::string caps;           // 機能フラグ (カンマ区切り)
+    int64_t seen_ms = 0;        // 最後に応答を受けた時刻 (UNIX 時刻 ms)
+};
+
+// 1 回問い合わせ、wait_ms の間に応答したサーバを返す (キャッシュは使わない)
+bool discovery_browse(int wait_ms, std::vector<RelayInfo>* out);
+
+// キャッシュのパス: $PROMPT_RELAY_DISCOVERY_CACHE > $XDG_RUNTIME_DIR/prompt-relay-discovery > /tmp/prompt-relay-discovery-<uid>
+std::string discovery_cache_path(void);
+
+// target_id (hostname:session:window.pane) で使うサーバを選ぶ
+// キャッシュが古ければ問い合わせ直す。見つからなければ空文字列
+std::string discovery_pick(const std::string& target_id);
+
+// キャッシュ (必要なら問い合わせ直したもの) のサーバ一覧
+std::vector<RelayInfo> discovery_list(void);
@@ -0,0 +1,170 @@
+#include "http_async.h"
+#include "relayd_log.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+static const char* TAG = "http";
+
+struct HttpJob {
+    std::string url;
+    std::string method;
+    std::string path;
+    std::vector<std::string> headers;
+    std::string body;
+    HttpDone done;
+    bool ok = false;
+    HttpResponse res;
+};
+
+struct Worker {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<HttpJob*> queue;
+    bool stop = false;
+};
+
+static std::map<std::string, Worker*> s_workers;   // キー: 接続先 (イベントループのスレッドだけが触る)
+static std::mutex s_done_lock;
+static std::vector<HttpJob*> s_done;                // 完了してコールバック待ち
+static int s_pipe[2] = { -1, -1 };
+static int s_pending = 0;
+
+// 完了を積んでイベントループを起こす
+// パイプが一杯なら起床は既に届いているので書けなくてよい (service がまとめて取り出す)
+static void complete(HttpJob* job) {
+    {
+        std::lock_guard<std::mutex> g(s_done_lock);
+        s_done.push_back(job);
+    }
+    char b = 0;
+    while (write(s_pipe[1], &b, 1) < 0 && errno == EINTR) {}
+}
+
+static void worker_main(Worker* w) {
+    while (true) {
+        HttpJob* job;
+        {
+            std::unique_lock<std::mutex> g(w->lock);
+            w->cv.wait(g, [w] { return w->stop || !w->queue.empty(); });
+            if (w->stop) return;
+            job = w->queue.front();
+            w->queue.pop_front();
+        }
+        job->ok = http_request(job->url, job->method.c_str(), job->path, job->headers, job->body, &job->res);
+        complete(job);
+    }
+}
+
+bool http_async_init(void) {
+    if (s_pipe[0] >= 0) return true;
+    if (pipe(s_pipe) != 0) {
+        LOGE(TAG, "pipe: %s", strerror(errno));
+        return false;
+    }
+    for (int fd : s_pipe) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return true;
+}
+
+static Worker* worker_for(const std::string& origin) {
+    Worker*& w = s_workers[origin];
+    if (w) return w;
+    w = new Worker();
+    try {
+        w->thread = std::thread(worker_main, w);
+    } catch (const std::system_error& e) {
+        LOGE(TAG, "cannot start worker for %s: %s", origin.c_str(), e.what());
+        delete w;
+        w = nullptr;
+        s_workers.erase(origin);
+    }
+    return w;
+}
+
+void http_submit(const std::string& url, const char* method, const std::string& path,
+                 std::vector<std::string> headers, std::string body, HttpDone done) {
+    HttpJob* job = new HttpJob();
+    job->url = url;
+    job->method = method;
+    job->path = path;
+    job->headers = std::move(headers);
+    job->body = std::move(body);
+    job->done = std::move(done);
+    s_pending++;
+
+    std::string origin;
+    Worker* w = http_origin(url, &origin) ? worker_for(origin) : nullptr;
+    if (!w) {
+        // 解釈できない URL・スレッドを作れない: 失敗として次の service で返す
+        complete(job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> g(w->lock);
+        w->queue.push_back(job);
+    }
+    w->cv.notify_one();
+}
+
+int http_async_fd(void) {
+    return s_pipe[0];
+}
+
+void http_async_service(void) {
+    char buf[64];
+    while (read(s_pipe[0], buf, sizeof(buf)) > 0) {}
+
+    std::vector<HttpJob*> done;
+    {
+        std::lock_guard<std::mutex> g(s_done_lock);
+        done.swap(s_done);
+    }
+    // コールバックから次のリクエストを投入してよい (s_done は取り出し済み)
+    for (HttpJob* job : done) {
+        s_pending--;
+        if (job->done) job->done(job->ok, job->res);
+        delete job;
+    }
+}
+
+int http_async_pending(void) {
+    return s_pending;
+}
+
+void http_async_stop(void) {
+    for (auto& kv : s_workers) {
+        Worker* w = kv.second;
+        {
+            std::lock_guard<std::mutex> g(w->lock);
+            w->stop = true;
+            for (HttpJob* job : w->queue) delete job;
+            w->queue.clear();
+        }
+        w->cv.notify_one();
+    }
+    for (auto& kv : s_workers) {
+        kv.second->thread.join();
+        delete kv.second;
+    }
+    s_workers.clear();
+
+    for (HttpJob* job : s_done) delete job;
+    s_done.clear();
+    s_pending = 0;
+    for (int& fd : s_pipe) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+}
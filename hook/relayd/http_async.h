@@ -0,0 +1,38 @@
+#pragma once
+
+#include "http_client.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// http_request をデーモンのイベントループから切り離して実行する
+//
+// 接続先 (scheme://host:port) ごとに 1 本のワーカースレッドがキューを順に処理する
+// (keep-alive 接続は従来どおり接続先ごとに 1 本)。終わったリクエストはパイプで知らせ、
+// 完了コールバックはイベントループのスレッドで http_async_service() から呼ぶ。
+// 名前解決・接続・応答待ちで止まるのはそのワーカーだけで、tmux の %output やフックの受け付け、
+// もう一方のサーバへのリクエストは待たされない
+
+// ok: http_request の戻り値 (false なら res.status = 0)
+typedef std::function<void(bool ok, const HttpResponse& res)> HttpDone;
+
+// 完了通知のパイプを作る (イベントループの開始前に 1 回)
+bool http_async_init(void);
+
+// done は空でもよい (送りっぱなし)。コールバックは必ず http_async_service() の中で呼ばれる
+void http_submit(const std::string& url, const char* method, const std::string& path,
+                 std::vector<std::string> headers, std::string body, HttpDone done);
+
+// 完了通知のパイプ (poll で POLLIN を待つ)
+int http_async_fd(void);
+
+// 完了したリクエストのコールバックを呼ぶ
+void http_async_service(void);
+
+// 投入してまだコールバックしていないリクエスト数
+int http_async_pending(void);
+
+// ワーカーを止める。キューに残ったリクエストは送らずに捨て、送信中のものは終わるまで待つ
+// (接続 3 秒 / 送受信 5 秒のタイムアウトで抜ける)
+void http_async_stop(void);
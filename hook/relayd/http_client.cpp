@@ -0,0 +1,458 @@
+#include "http_client.h"
+#include "relayd_log.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef RELAYD_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#define CONNECT_TIMEOUT_MS 3000     // curl --connect-timeout 3 と同じ
+#define IO_TIMEOUT_MS 5000
+#define MAX_RESPONSE_BYTES (1024 * 1024)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // macOS: SIGPIPE はデーモン側で無視している
+#endif
+
+struct Origin {
+    bool tls = false;
+    std::string host;
+    std::string port;
+    std::string prefix;         // URL のパス部分 (エンドポイントの前に付ける)
+    std::string host_header;
+};
+
+struct Conn {
+    std::mutex lock;            // リクエスト中はワーカーが持つ (http_close_idle は持てなければ飛ばす)
+    int fd = -1;
+#ifdef RELAYD_TLS
+    SSL* ssl = nullptr;
+    SSL_SESSION* session = nullptr;     // 再接続で再開するセッション (接続を閉じても残す)
+#endif
+    int64_t last_used_ms = 0;
+    int requests = 0;           // この接続で完了したリクエスト数 (再利用判定用)
+    std::string rbuf;           // 受信済みで未処理のバイト
+};
+
+static std::map<std::string, Conn> s_conns;   // キー: scheme://host:port
+static std::mutex s_conns_lock;                 // s_conns への追加と走査
+
+#ifdef RELAYD_TLS
+static SSL_CTX* s_ssl_ctx = nullptr;
+static std::once_flag s_ssl_once;
+#endif
+
+#ifdef RELAYD_TLS
+// サーバがセッション (チケット) を発行したら接続ごとに覚えておく。1 を返すと所有権を受け取る
+static int on_new_session(SSL* ssl, SSL_SESSION* session) {
+    Conn* c = (Conn*)SSL_get_app_data(ssl);
+    if (!c) return 0;
+    if (c->session) SSL_SESSION_free(c->session);
+    c->session = session;
+    return 1;
+}
+#endif
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool parse_url(const std::string& url, Origin* o) {
+    size_t rest;
+    if (url.compare(0, 7, "http://") == 0) {
+        o->tls = false;
+        rest = 7;
+    } else if (url.compare(0, 8, "https://") == 0) {
+        o->tls = true;
+        rest = 8;
+    } else {
+        return false;
+    }
+    size_t slash = url.find('/', rest);
+    std::string authority = url.substr(rest, slash == std::string::npos ? std::string::npos : slash - rest);
+    o->prefix = slash == std::string::npos ? std::string() : url.substr(slash);
+    if (authority.empty()) return false;
+    o->host_header = authority;
+
+    // [IPv6]:port / host:port / host
+    if (authority[0] == '[') {
+        size_t close = authority.find(']');
+        if (close == std::string::npos) return false;
+        o->host = authority.substr(1, close - 1);
+        o->port = (close + 1 < authority.size() && authority[close + 1] == ':') ? authority.substr(close + 2) : "";
+    } else {
+        size_t colon = authority.rfind(':');
+        o->host = authority.substr(0, colon);
+        o->port = colon == std::string::npos ? "" : authority.substr(colon + 1);
+    }
+    if (o->port.empty()) o->port = o->tls ? "443" : "80";
+    return !o->host.empty();
+}
+
+static std::string origin_key(const Origin& o) {
+    return (o.tls ? "https://" : "http://") + o.host + ":" + o.port;
+}
+
+bool http_origin(const std::string& url, std::string* out) {
+    Origin o;
+    if (!parse_url(url, &o)) return false;
+    *out = origin_key(o);
+    return true;
+}
+
+bool http_url_supported(const std::string& url) {
+    Origin o;
+    if (!parse_url(url, &o)) return false;
+#ifndef RELAYD_TLS
+    if (o.tls) return false;
+#endif
+    return true;
+}
+
+// ── 接続 ──
+
+static void conn_close(Conn* c) {
+#ifdef RELAYD_TLS
+    if (c->ssl) {
+        // 終了済みにしてから解放する (そのまま解放するとセッションが再開不可にされる)
+        SSL_set_quiet_shutdown(c->ssl, 1);
+        SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = nullptr;
+    }
+#endif
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->requests = 0;
+    c->rbuf.clear();
+}
+
+static int tcp_connect(const Origin& o) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    if (getaddrinfo(o.host.c_str(), o.port.c_str(), &hints, &res) != 0) {
+        LOGW("http", "resolve failed: %s", o.host.c_str());
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc < 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                rc = 0;
+            }
+        }
+        if (rc == 0) {
+            fcntl(fd, F_SETFL, flags);
+            struct timeval tv = { IO_TIMEOUT_MS / 1000, (IO_TIMEOUT_MS % 1000) * 1000 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) LOGW("http", "connect failed: %s:%s", o.host.c_str(), o.port.c_str());
+    return fd;
+}
+
+static bool conn_open(Conn* c, const Origin& o) {
+    c->fd = tcp_connect(o);
+    if (c->fd < 0) return false;
+    c->requests = 0;
+#ifdef RELAYD_TLS
+    if (o.tls) {
+        // 接続先ごとのワーカーが同時に初めての TLS 接続をしうる
+        std::call_once(s_ssl_once, [] {
+            s_ssl_ctx = SSL_CTX_new(TLS_client_method());
+            SSL_CTX_set_default_verify_paths(s_ssl_ctx);
+            SSL_CTX_set_verify(s_ssl_ctx, SSL_VERIFY_PEER, nullptr);
+            // セッションは OpenSSL の内部キャッシュではなく接続先ごとに Conn が持つ
+            SSL_CTX_set_session_cache_mode(s_ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(s_ssl_ctx, on_new_session);
+        });
+        c->ssl = SSL_new(s_ssl_ctx);
+        SSL_set_app_data(c->ssl, c);
+        SSL_set_fd(c->ssl, c->fd);
+        SSL_set_tlsext_host_name(c->ssl, o.host.c_str());
+        SSL_set1_host(c->ssl, o.host.c_str());
+        // 前回のセッションがあれば再開を試す (ESP32 では鍵交換と証明書の検証が省ける)
+        if (c->session) SSL_set_session(c->ssl, c->session);
+        if (SSL_connect(c->ssl) != 1) {
+            LOGW("http", "TLS handshake failed: %s (%s)", o.host.c_str(),
+                 ERR_reason_error_string(ERR_get_error()));
+            conn_close(c);
+            // 再開に失敗したセッションは捨てる (次はフルハンドシェイク)
+            if (c->session) {
+                SSL_SESSION_free(c->session);
+                c->session = nullptr;
+            }
+            return false;
+        }
+        LOGD("http", "TLS %s: %s", SSL_session_reused(c->ssl) ? "resumed" : "full handshake", o.host.c_str());
+    }
+#endif
+    return true;
+}
+
+static bool conn_write(Conn* c, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n;
+#ifdef RELAYD_TLS
+        if (c->ssl) n = SSL_write(c->ssl, data.data() + off, (int)(data.size() - off));
+        else
+#endif
+        n = send(c->fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+// 0 = EOF, -1 = エラー・タイムアウト
+static ssize_t conn_read(Conn* c, char* buf, size_t len) {
+    while (true) {
+        ssize_t n;
+#ifdef RELAYD_TLS
+        if (c->ssl) {
+            n = SSL_read(c->ssl, buf, (int)len);
+            if (n <= 0 && SSL_get_error(c->ssl, (int)n) == SSL_ERROR_ZERO_RETURN) return 0;
+            return n < 0 ? -1 : n;
+        }
+#endif
+        n = recv(c->fd, buf, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        return n;
+    }
+}
+
+// rbuf に少なくとも need バイト揃うまで読む
+static bool fill(Conn* c, size_t need) {
+    char buf[4096];
+    while (c->rbuf.size() < need) {
+        ssize_t n = conn_read(c, buf, sizeof(buf));
+        if (n <= 0) return false;
+        c->rbuf.append(buf, n);
+        if (c->rbuf.size() > MAX_RESPONSE_BYTES) return false;
+    }
+    return true;
+}
+
+static bool read_until(Conn* c, const char* delim, size_t* pos) {
+    char buf[4096];
+    while ((*pos = c->rbuf.find(delim)) == std::string::npos) {
+        ssize_t n = conn_read(c, buf, sizeof(buf));
+        if (n <= 0) return false;
+        c->rbuf.append(buf, n);
+        if (c->rbuf.size() > MAX_RESPONSE_BYTES) return false;
+    }
+    return true;
+}
+
+static bool header_is(const std::string& line, const char* name, std::string* value) {
+    size_t n = strlen(name);
+    if (line.size() <= n || strncasecmp(line.c_str(), name, n) != 0 || line[n] != ':') return false;
+    size_t b = n + 1;
+    while (b < line.size() && (line[b] == ' ' || line[b] == '\t')) b++;
+    *value = line.substr(b);
+    return true;
+}
+
+// 応答を 1 つ読む。*got_any: 1 バイトでも受信したか (再送してよいかの判定用)
+static bool read_response(Conn* c, HttpResponse* out, bool* keep_alive, bool* got_any) {
+    size_t hdr_end;
+    *got_any = false;
+    if (!read_until(c, "\r\n\r\n", &hdr_end)) {
+        *got_any = !c->rbuf.empty();
+        return false;
+    }
+    *got_any = true;
+    std::string head = c->rbuf.substr(0, hdr_end);
+    c->rbuf.erase(0, hdr_end + 4);
+
+    // ステータス行
+    size_t eol = head.find("\r\n");
+    std::string status_line = head.substr(0, eol);
+    if (status_line.compare(0, 5, "HTTP/") != 0 || status_line.size() < 12) return false;
+    out->status = atoi(status_line.c_str() + 9);
+    *keep_alive = status_line.compare(0, 8, "HTTP/1.0") != 0;
+
+    long content_length = -1;
+    bool chunked = false;
+    size_t pos = eol == std::string::npos ? head.size() : eol + 2;
+    while (pos < head.size()) {
+        size_t next = head.find("\r\n", pos);
+        if (next == std::string::npos) next = head.size();
+        std::string line = head.substr(pos, next - pos);
+        std::string value;
+        if (header_is(line, "Content-Length", &value)) {
+            content_length = atol(value.c_str());
+        } else if (header_is(line, "Content-Type", &value)) {
+            out->content_type = value;
+        } else if (header_is(line, "Transfer-Encoding", &value)) {
+            chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+        } else if (header_is(line, "Connection", &value)) {
+            if (strcasestr(value.c_str(), "close")) *keep_alive = false;
+            else if (strcasestr(value.c_str(), "keep-alive")) *keep_alive = true;
+        }
+        pos = next + 2;
+    }
+
+    out->body.clear();
+    if (out->status == 204 || out->status == 304 || (out->status >= 100 && out->status < 200)) {
+        return true;
+    }
+    if (chunked) {
+        while (true) {
+            size_t le;
+            if (!read_until(c, "\r\n", &le)) return false;
+            long size = strtol(c->rbuf.c_str(), nullptr, 16);
+            c->rbuf.erase(0, le + 2);
+            if (size < 0 || out->body.size() + size > MAX_RESPONSE_BYTES) return false;
+            if (size == 0) {
+                // トレーラーは読み捨てる
+                size_t te;
+                if (!read_until(c, "\r\n", &te)) return false;
+                while (te != 0) {
+                    c->rbuf.erase(0, te + 2);
+                    if (!read_until(c, "\r\n", &te)) return false;
+                }
+                c->rbuf.erase(0, 2);
+                return true;
+            }
+            if (!fill(c, size + 2)) return false;
+            out->body.append(c->rbuf, 0, size);
+            c->rbuf.erase(0, size + 2);
+        }
+    }
+    if (content_length >= 0) {
+        if (content_length > MAX_RESPONSE_BYTES || !fill(c, content_length)) return false;
+        out->body.assign(c->rbuf, 0, content_length);
+        c->rbuf.erase(0, content_length);
+        return true;
+    }
+    // 長さ指定なし: 切断まで読む
+    char buf[4096];
+    while (true) {
+        ssize_t n = conn_read(c, buf, sizeof(buf));
+        if (n < 0) return false;
+        if (n == 0) break;
+        c->rbuf.append(buf, n);
+        if (c->rbuf.size() > MAX_RESPONSE_BYTES) return false;
+    }
+    out->body.swap(c->rbuf);
+    c->rbuf.clear();
+    *keep_alive = false;
+    return true;
+}
+
+bool http_request(const std::string& url, const char* method, const std::string& path,
+                  const std::vector<std::string>& headers, const std::string& body,
+                  HttpResponse* out) {
+    out->status = 0;
+    out->content_type.clear();
+    out->body.clear();
+
+    Origin o;
+    if (!parse_url(url, &o)) return false;
+#ifndef RELAYD_TLS
+    if (o.tls) return false;
+#endif
+
+    std::string req;
+    req.reserve(256 + body.size());
+    req += method;
+    req += ' ';
+    req += o.prefix + path;
+    req += " HTTP/1.1\r\nHost: ";
+    req += o.host_header;
+    req += "\r\nConnection: keep-alive\r\n";
+    for (const std::string& h : headers) {
+        req += h;
+        req += "\r\n";
+    }
+    if (!body.empty() || strcmp(method, "POST") == 0) {
+        req += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    req += body;
+
+    Conn* c;
+    {
+        std::lock_guard<std::mutex> g(s_conns_lock);
+        c = &s_conns[origin_key(o)];
+    }
+    std::lock_guard<std::mutex> busy(c->lock);
+
+    // 再利用した接続がサーバ側で閉じられていた場合は、何も受信していなければ 1 回だけ張り直す
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (c->fd < 0 && !conn_open(c, o)) return false;
+        bool reused = c->requests > 0;
+        bool keep_alive = false;
+        bool got_any = false;
+        c->rbuf.clear();
+        if (conn_write(c, req) && read_response(c, out, &keep_alive, &got_any)) {
+            c->requests++;
+            c->last_used_ms = now_ms();
+            if (!keep_alive) conn_close(c);
+            return true;
+        }
+        conn_close(c);
+        out->status = 0;
+        if (!reused || got_any) break;
+    }
+    return false;
+}
+
+void http_close_idle(int idle_ms) {
+    int64_t now = now_ms();
+    std::lock_guard<std::mutex> g(s_conns_lock);
+    for (auto& kv : s_conns) {
+        Conn& c = kv.second;
+        if (!c.lock.try_lock()) continue;   // リクエスト中
+        if (c.fd >= 0 && now - c.last_used_ms >= idle_ms) conn_close(&c);
+        c.lock.unlock();
+    }
+}
+
+void http_close_all(void) {
+    std::lock_guard<std::mutex> g(s_conns_lock);
+    for (auto& kv : s_conns) {
+        std::lock_guard<std::mutex> busy(kv.second.lock);
+        conn_close(&kv.second);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// サーバごとに 1 本の keep-alive 接続を張りっぱなしにする HTTP/1.1 クライアント
+// http_request は同期的に返る (接続 3 秒 / 送受信 5 秒でタイムアウト) ので、デーモンは
+// http_async.h のワーカーから呼ぶ。接続先が違えば別スレッドから同時に呼んでよい
+// https:// は OpenSSL 付きでビルドした場合のみ (RELAYD_TLS)
+
+struct HttpResponse {
+    int status = 0;             // 0 = 接続・送受信に失敗
+    std::string content_type;
+    std::string body;
+};
+
+// url は PROMPT_RELAY_SERVER_URL の形式 ("http://host:port" + 任意のパス接頭辞)
+// path は "/permission-request" のようなエンドポイント (url の後ろに連結する)
+// headers は "Name: value" の並び
+bool http_request(const std::string& url, const char* method, const std::string& path,
+                  const std::vector<std::string>& headers, const std::string& body,
+                  HttpResponse* out);
+
+// URL を解釈できるか (https:// を TLS なしでビルドした場合は false)
+bool http_url_supported(const std::string& url);
+
+// 接続を共有する単位 ("scheme://host:port")。解釈できなければ false
+bool http_origin(const std::string& url, std::string* out);
+
+// 指定ミリ秒以上使っていない接続を閉じる (サーバ側のアイドル切断より先に閉じておく)
+// リクエスト中の接続には触らないので、ワーカーが動いている間もイベントループから呼べる
+void http_close_idle(int idle_ms);
+void http_close_all(void);
@@ -0,0 +1,216 @@
+#include "ipc.h"
+#include "relayd_log.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SPAWN_WAIT_MS 1000          // 自動起動したデーモンの listen を待つ上限
+#define SPAWN_POLL_MS 20
+
+static const char* TAG = "ipc";
+
+std::string ipc_socket_path(void) {
+    const char* env = getenv("PROMPT_RELAY_SOCKET");
+    if (env && *env) return env;
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return std::string(runtime) + "/prompt-relayd.sock";
+    return "/tmp/prompt-relayd-" + std::to_string(getuid()) + ".sock";
+}
+
+// ── メッセージ ──
+
+static bool put(std::string* out, const char* key, const std::string& value) {
+    if (value.find_first_of("\t\r\n") != std::string::npos) return false;
+    *out += key;
+    *out += '\t';
+    *out += value;
+    *out += '\n';
+    return true;
+}
+
+bool ipc_encode(const RelaySubmission& sub, std::string* out) {
+    out->assign("PRD1\n");
+    bool ok = put(out, "tmux", sub.tmux_socket) &&
+              put(out, "target", sub.target) &&
+              put(out, "target_id", sub.target_id) &&
+              put(out, "host", sub.display_host) &&
+              put(out, "timeout", std::to_string(sub.timeout_sec)) &&
+              put(out, "detect_interval_ms", std::to_string(sub.detect_interval_ms)) &&
+              put(out, "detect_attempts", std::to_string(sub.detect_attempts)) &&
+              put(out, "cbor", sub.cbor ? "1" : "0");
+    for (int i = 0; ok && i < 2; i++) {
+        if (sub.server_url[i].empty()) continue;
+        // URL とキーはタブ区切りで 1 行に並べる
+        ok = sub.api_key[i].find_first_of("\t\r\n") == std::string::npos &&
+             put(out, "server", sub.server_url[i]);
+        if (ok) {
+            out->pop_back();
+            *out += '\t' + sub.api_key[i] + '\n';
+        }
+    }
+    if (!ok) return false;
+    *out += '\n';
+    *out += sub.input;
+    return true;
+}
+
+bool ipc_decode(const std::string& msg, RelaySubmission* sub) {
+    if (msg.compare(0, 5, "PRD1\n") != 0) return false;
+    size_t pos = 5;
+    int servers = 0;
+    while (true) {
+        size_t nl = msg.find('\n', pos);
+        if (nl == std::string::npos) return false;
+        if (nl == pos) {
+            sub->input = msg.substr(nl + 1);
+            return !sub->target.empty();
+        }
+        std::string line = msg.substr(pos, nl - pos);
+        pos = nl + 1;
+
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) continue;
+        std::string key = line.substr(0, tab);
+        std::string value = line.substr(tab + 1);
+        if (key == "tmux") sub->tmux_socket = value;
+        else if (key == "target") sub->target = value;
+        else if (key == "target_id") sub->target_id = value;
+        else if (key == "host") sub->display_host = value;
+        else if (key == "timeout") sub->timeout_sec = atoi(value.c_str());
+        else if (key == "detect_interval_ms") sub->detect_interval_ms = atoi(value.c_str());
+        else if (key == "detect_attempts") sub->detect_attempts = atoi(value.c_str());
+        else if (key == "cbor") sub->cbor = value == "1";
+        else if (key == "server" && servers < 2) {
+            size_t t2 = value.find('\t');
+            sub->server_url[servers] = value.substr(0, t2);
+            sub->api_key[servers] = t2 == std::string::npos ? "" : value.substr(t2 + 1);
+            servers++;
+        }
+        // 知らないキーは読み飛ばす (フックとデーモンの版違いに備える)
+    }
+}
+
+// ── クライアント ──
+
+static bool make_addr(const std::string& path, struct sockaddr_un* addr) {
+    if (path.size() >= sizeof(addr->sun_path)) return false;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// 他のユーザーが置いたソケットには API キーを渡さない
+static bool socket_is_ours(const std::string& path) {
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && st.st_uid == getuid();
+}
+
+static int try_connect(const std::string& path) {
+    struct sockaddr_un addr;
+    if (!make_addr(path, &addr) || !socket_is_ours(path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// setsid + 二重 fork で端末・フックのパイプから切り離して起動する
+// stdin/stdout/stderr を継承すると Claude Code がパイプの EOF を待ち続けるので必ず付け替える
+static void spawn_daemon(const std::string& self_exe) {
+    pid_t pid = fork();
+    if (pid < 0) return;
+    if (pid == 0) {
+        setsid();
+        if (fork() != 0) _exit(0);
+
+        int devnull = open("/dev/null", O_RDWR);
+        const char* log = getenv("PROMPT_RELAY_DAEMON_LOG");
+        int logfd = (log && *log) ? open(log, O_WRONLY | O_CREAT | O_APPEND, 0600) : -1;
+        dup2(devnull, STDIN_FILENO);
+        dup2(logfd >= 0 ? logfd : devnull, STDOUT_FILENO);
+        dup2(logfd >= 0 ? logfd : devnull, STDERR_FILENO);
+        for (int fd = 3; fd < 1024; fd++) close(fd);
+        if (chdir("/") < 0) _exit(1);
+
+        execl(self_exe.c_str(), self_exe.c_str(), "daemon", (char*)nullptr);
+        _exit(127);
+    }
+    waitpid(pid, nullptr, 0);
+}
+
+bool ipc_submit(const RelaySubmission& sub, const std::string& self_exe) {
+    std::string msg;
+    if (!ipc_encode(sub, &msg) || msg.size() > IPC_MAX_MESSAGE) return false;
+
+    std::string path = ipc_socket_path();
+    int fd = try_connect(path);
+    if (fd < 0) {
+        spawn_daemon(self_exe);
+        for (int waited = 0; fd < 0 && waited < SPAWN_WAIT_MS; waited += SPAWN_POLL_MS) {
+            usleep(SPAWN_POLL_MS * 1000);
+            fd = try_connect(path);
+        }
+        if (fd < 0) return false;
+    }
+
+    size_t off = 0;
+    while (off < msg.size()) {
+        ssize_t n = write(fd, msg.data() + off, msg.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        off += n;
+    }
+    close(fd);
+    return true;
+}
+
+// ── デーモン ──
+
+int ipc_listen(const std::string& path, int* lock_fd) {
+    struct sockaddr_un addr;
+    if (!make_addr(path, &addr)) {
+        LOGE(TAG, "socket path too long: %s", path.c_str());
+        return -1;
+    }
+
+    // 同時に自動起動された場合は先に lock を取った方だけが残る
+    std::string lock_path = path + ".lock";
+    *lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (*lock_fd < 0 || flock(*lock_fd, LOCK_EX | LOCK_NB) < 0) {
+        if (*lock_fd >= 0) close(*lock_fd);
+        *lock_fd = -1;
+        LOGI(TAG, "another daemon is running (%s)", lock_path.c_str());
+        return -2;
+    }
+    fcntl(*lock_fd, F_SETFD, FD_CLOEXEC);
+
+    // lock を持っているので、残っているソケットは前のデーモンの残骸
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    mode_t old = umask(077);
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old);
+    if (rc < 0 || listen(fd, 32) < 0) {
+        LOGE(TAG, "bind %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+// フック (prompt-relayd submit) とデーモンの間の Unix ソケット通信
+//
+// 1 接続 = 1 件の依頼。クライアントは書き終えたら閉じるだけで応答は待たない
+// (デーモンが HTTP で詰まっていてもフックを待たせない)
+//
+//   PRD1\n
+//   <キー>\t<値>\n ...        値にタブ・改行は含めない
+//   \n
+//   <PreToolUse の stdin そのまま>
+
+#define IPC_MAX_MESSAGE (1024 * 1024)
+
+// 1 ペイン分の依頼
+struct RelaySubmission {
+    std::string tmux_socket;        // $TMUX の先頭 (空なら既定のソケット)
+    std::string target;             // session:window.pane
+    std::string target_id;          // hostname:session:window.pane (サーバの tmux_target)
+    std::string display_host;       // hostname:session (X-Prompt-Relay-Host)
+    int timeout_sec = 120;
+    int detect_interval_ms = 100;
+    int detect_attempts = 10;
+    std::string server_url[2];      // [0] プライマリ / [1] セカンダリ (空なら無効)
+    std::string api_key[2];
+    bool cbor = false;              // プライマリとの本文を CBOR にする (PROMPT_RELAY_CBOR=1、ESP32 版のみ)
+    std::string input;
+};
+
+// ソケットのパス: $PROMPT_RELAY_SOCKET > $XDG_RUNTIME_DIR/prompt-relayd.sock > /tmp/prompt-relayd-<uid>.sock
+std::string ipc_socket_path(void);
+
+// 戻り値: false = 値にタブ・改行が含まれる (HTTP ヘッダーにもなるので CR も弾く)
+bool ipc_encode(const RelaySubmission& sub, std::string* out);
+bool ipc_decode(const std::string& msg, RelaySubmission* sub);
+
+// 依頼をデーモンに渡す。デーモンがいなければ self_exe を "daemon" で起動してから渡す
+// 戻り値: false = 渡せなかった (フックは従来の処理に戻る)
+bool ipc_submit(const RelaySubmission& sub, const std::string& self_exe);
+
+// デーモン側: ソケットを作って listen する (二重起動は lock_fd の flock で防ぐ)
+// 戻り値: listen した fd (-1 = 失敗、-2 = 他のデーモンが動いている)
+int ipc_listen(const std::string& path, int* lock_fd);
@@ -0,0 +1,302 @@
+#include "json.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define MAX_DEPTH 64
+
+const JsonValue* JsonValue::get(const char* key) const {
+    if (type != OBJECT) return nullptr;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] == key) return &items[i];
+    }
+    return nullptr;
+}
+
+std::string JsonValue::get_string(const char* key) const {
+    const JsonValue* v = get(key);
+    return (v && v->type == STRING) ? v->str : std::string();
+}
+
+// ── パース ──
+
+namespace {
+
+struct Parser {
+    const char* p;
+    const char* end;
+    int depth = 0;
+
+    void skip_ws() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) return false;
+        p += n;
+        return true;
+    }
+
+    static void put_utf8(std::string* out, unsigned cp) {
+        if (cp < 0x80) {
+            out->push_back((char)cp);
+        } else if (cp < 0x800) {
+            out->push_back((char)(0xC0 | (cp >> 6)));
+            out->push_back((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out->push_back((char)(0xE0 | (cp >> 12)));
+            out->push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out->push_back((char)(0x80 | (cp & 0x3F)));
+        } else {
+            out->push_back((char)(0xF0 | (cp >> 18)));
+            out->push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out->push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out->push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool hex4(unsigned* out) {
+        if (end - p < 4) return false;
+        unsigned v = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = p[i];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else return false;
+        }
+        p += 4;
+        *out = v;
+        return true;
+    }
+
+    bool string(std::string* out) {
+        if (p >= end || *p != '"') return false;
+        p++;
+        out->clear();
+        while (p < end) {
+            char c = *p++;
+            if (c == '"') return true;
+            if ((unsigned char)c < 0x20) return false;
+            if (c != '\\') {
+                out->push_back(c);
+                continue;
+            }
+            if (p >= end) return false;
+            switch (*p++) {
+                case '"':  out->push_back('"'); break;
+                case '\\': out->push_back('\\'); break;
+                case '/':  out->push_back('/'); break;
+                case 'b':  out->push_back('\b'); break;
+                case 'f':  out->push_back('\f'); break;
+                case 'n':  out->push_back('\n'); break;
+                case 'r':  out->push_back('\r'); break;
+                case 't':  out->push_back('\t'); break;
+                case 'u': {
+                    unsigned cp;
+                    if (!hex4(&cp)) return false;
+                    // サロゲートペア
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        const char* save = p;
+                        p += 2;
+                        unsigned lo;
+                        if (hex4(&lo) && lo >= 0xDC00 && lo < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        } else {
+                            p = save;
+                        }
+                    }
+                    put_utf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool number(JsonValue* v) {
+        const char* start = p;
+        if (p < end && *p == '-') p++;
+        if (p >= end || *p < '0' || *p > '9') return false;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        if (p < end && *p == '.') {
+            p++;
+            if (p >= end || *p < '0' || *p > '9') return false;
+            while (p < end && *p >= '0' && *p <= '9') p++;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            if (p < end && (*p == '+' || *p == '-')) p++;
+            if (p >= end || *p < '0' || *p > '9') return false;
+            while (p < end && *p >= '0' && *p <= '9') p++;
+        }
+        v->type = JsonValue::NUMBER;
+        v->str.assign(start, p - start);
+        return true;
+    }
+
+    bool value(JsonValue* v) {
+        skip_ws();
+        if (p >= end) return false;
+        switch (*p) {
+            case '{': return object(v);
+            case '[': return array(v);
+            case '"':
+                v->type = JsonValue::STRING;
+                return string(&v->str);
+            case 't':
+                v->type = JsonValue::BOOL;
+                v->boolean = true;
+                return literal("true");
+            case 'f':
+                v->type = JsonValue::BOOL;
+                v->boolean = false;
+                return literal("false");
+            case 'n':
+                v->type = JsonValue::NUL;
+                return literal("null");
+            default:
+                return number(v);
+        }
+    }
+
+    bool array(JsonValue* v) {
+        if (++depth > MAX_DEPTH) return false;
+        p++;  // '['
+        v->type = JsonValue::ARRAY;
+        skip_ws();
+        if (p < end && *p == ']') {
+            p++;
+            depth--;
+            return true;
+        }
+        while (true) {
+            v->items.emplace_back();
+            if (!value(&v->items.back())) return false;
+            skip_ws();
+            if (p >= end) return false;
+            if (*p == ',') { p++; continue; }
+            if (*p == ']') { p++; break; }
+            return false;
+        }
+        depth--;
+        return true;
+    }
+
+    bool object(JsonValue* v) {
+        if (++depth > MAX_DEPTH) return false;
+        p++;  // '{'
+        v->type = JsonValue::OBJECT;
+        skip_ws();
+        if (p < end && *p == '}') {
+            p++;
+            depth--;
+            return true;
+        }
+        while (true) {
+            skip_ws();
+            std::string key;
+            if (!string(&key)) return false;
+            skip_ws();
+            if (p >= end || *p != ':') return false;
+            p++;
+            JsonValue item;
+            if (!value(&item)) return false;
+            // 重複キーは後勝ち (Python の json.loads と同じ)
+            bool replaced = false;
+            for (size_t i = 0; i < v->keys.size(); i++) {
+                if (v->keys[i] == key) {
+                    v->items[i] = std::move(item);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced) {
+                v->keys.push_back(std::move(key));
+                v->items.push_back(std::move(item));
+            }
+            skip_ws();
+            if (p >= end) return false;
+            if (*p == ',') { p++; continue; }
+            if (*p == '}') { p++; break; }
+            return false;
+        }
+        depth--;
+        return true;
+    }
+};
+
+}  // namespace
+
+bool json_parse(const std::string& text, JsonValue* out) {
+    Parser ps{ text.data(), text.data() + text.size() };
+    *out = JsonValue();
+    if (!ps.value(out)) return false;
+    ps.skip_ws();
+    return ps.p == ps.end;
+}
+
+// ── 出力 ──
+
+void json_append_string(std::string* out, const std::string& s) {
+    out->push_back('"');
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out->append("\\\""); break;
+            case '\\': out->append("\\\\"); break;
+            case '\n': out->append("\\n"); break;
+            case '\r': out->append("\\r"); break;
+            case '\t': out->append("\\t"); break;
+            case '\b': out->append("\\b"); break;
+            case '\f': out->append("\\f"); break;
+            default:
+                if (c < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out->append(esc);
+                } else {
+                    out->push_back((char)c);
+                }
+        }
+    }
+    out->push_back('"');
+}
+
+void json_dump(const JsonValue& v, std::string* out) {
+    switch (v.type) {
+        case JsonValue::NUL:
+            out->append("null");
+            break;
+        case JsonValue::BOOL:
+            out->append(v.boolean ? "true" : "false");
+            break;
+        case JsonValue::NUMBER:
+            out->append(v.str);
+            break;
+        case JsonValue::STRING:
+            json_append_string(out, v.str);
+            break;
+        case JsonValue::ARRAY:
+            out->push_back('[');
+            for (size_t i = 0; i < v.items.size(); i++) {
+                if (i) out->push_back(',');
+                json_dump(v.items[i], out);
+            }
+            out->push_back(']');
+            break;
+        case JsonValue::OBJECT:
+            out->push_back('{');
+            for (size_t i = 0; i < v.items.size(); i++) {
+                if (i) out->push_back(',');
+                json_append_string(out, v.keys[i]);
+                out->push_back(':');
+                json_dump(v.items[i], out);
+            }
+            out->push_back('}');
+            break;
+    }
+}
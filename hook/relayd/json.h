@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// フック入力 (PreToolUse の stdin) とサーバ応答を扱うための最小限の JSON
+// オブジェクトはキーの順序を保持し、数値は元の表記のまま持つ (tool_input をそのまま転送するため)
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = NUL;
+    bool boolean = false;
+    std::string str;                    // STRING の値 / NUMBER の元の表記
+    std::vector<JsonValue> items;       // ARRAY の要素 / OBJECT の値
+    std::vector<std::string> keys;      // OBJECT のキー (items と同じ並び)
+
+    // OBJECT のメンバーを返す (なければ nullptr)
+    const JsonValue* get(const char* key) const;
+    // 文字列メンバーの値 (なければ、または文字列でなければ "")
+    std::string get_string(const char* key) const;
+};
+
+// 失敗時は false (out は不定)
+bool json_parse(const std::string& text, JsonValue* out);
+
+// UTF-8 はそのまま、制御文字と " \ のみエスケープする
+void json_dump(const JsonValue& v, std::string* out);
+void json_append_string(std::string* out, const std::string& s);
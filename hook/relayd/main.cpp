@@ -0,0 +1,249 @@
+// prompt-relayd: permission-request.sh の常駐版
+//
+//   prompt-relayd daemon [-v] [--idle-exit SEC]
+//   prompt-relayd submit --target T --target-id ID --host H [--timeout SEC]
+//                        [--detect-interval SEC] [--detect-attempts N]   < PreToolUse の stdin
+//   prompt-relayd discover [--target-id ID] [--list]       mDNS で見つけたサーバから選んだ URL を出す
+//
+// prompt_parser.py と同じ CLI も持つ (テストで Python 版と突き合わせる)
+//   prompt-relayd detect [--incremental] <pane_content>
+//   prompt-relayd parse <stdin_json> <pane_content> [tmux_target] [hostname] [timeout]
+//   prompt-relayd response <response_json>
+
+#include "discovery.h"
+#include "http_client.h"
+#include "ipc.h"
+#include "pane_screen.h"
+#include "prompt_parser.h"
+#include "relayd.h"
+#include "relayd_log.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#define DEFAULT_IDLE_EXIT_SEC 600
+
+bool g_relayd_verbose = false;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s <daemon|submit|discover|detect|parse|response> [args...]\n"
+            "  daemon [-v] [--idle-exit SEC]\n"
+            "  submit --target T --target-id ID --host H [--timeout SEC]\n"
+            "         [--detect-interval SEC] [--detect-attempts N]   (stdin: hook input)\n"
+            "  discover [-v] [--target-id ID] [--list]\n"
+            "  detect [--incremental] <pane_content>\n"
+            "  parse <stdin_json> <pane_content> [tmux_target] [hostname] [timeout]\n"
+            "  response <response_json>\n",
+            prog);
+}
+
+// 自動起動で exec し直すための自分自身のパス
+static std::string self_exe(const char* argv0) {
+    char buf[PATH_MAX];
+#ifdef __APPLE__
+    uint32_t size = sizeof(buf);
+    if (_NSGetExecutablePath(buf, &size) == 0) {
+        char real[PATH_MAX];
+        if (realpath(buf, real)) return real;
+        return buf;
+    }
+#else
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (n > 0) {
+        buf[n] = '\0';
+        return buf;
+    }
+#endif
+    if (realpath(argv0, buf)) return buf;
+    return argv0;
+}
+
+static const char* env_or(const char* name, const char* fallback) {
+    const char* v = getenv(name);
+    return (v && *v) ? v : fallback;
+}
+
+static int cmd_daemon(int argc, char** argv) {
+    int idle_exit = DEFAULT_IDLE_EXIT_SEC;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            g_relayd_verbose = true;
+        } else if (strcmp(argv[i], "--idle-exit") == 0 && i + 1 < argc) {
+            idle_exit = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    return relayd_run(ipc_socket_path(), idle_exit);
+}
+
+// 戻り値 0 = デーモンに渡した。それ以外はフックが従来のループで処理する
+static int cmd_submit(int argc, char** argv) {
+    RelaySubmission sub;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const char* opt = argv[i];
+        const char* val = argv[i + 1];
+        if (strcmp(opt, "--target") == 0) sub.target = val;
+        else if (strcmp(opt, "--target-id") == 0) sub.target_id = val;
+        else if (strcmp(opt, "--host") == 0) sub.display_host = val;
+        else if (strcmp(opt, "--timeout") == 0) sub.timeout_sec = atoi(val);
+        else if (strcmp(opt, "--detect-interval") == 0) sub.detect_interval_ms = (int)(atof(val) * 1000);
+        else if (strcmp(opt, "--detect-attempts") == 0) sub.detect_attempts = atoi(val);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (sub.target.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // サーバ設定は common.sh で検証済みの値を環境変数で受け取る (API キーを引数に出さない)
+    sub.server_url[0] = env_or("PROMPT_RELAY_SERVER_URL", "http://localhost:3939");
+    sub.api_key[0] = env_or("PROMPT_RELAY_API_KEY", "");
+    sub.server_url[1] = env_or("PROMPT_RELAY_SERVER_URL_2", "");
+    sub.api_key[1] = env_or("PROMPT_RELAY_API_KEY_2", sub.api_key[0].c_str());
+    sub.cbor = strcmp(env_or("PROMPT_RELAY_CBOR", "0"), "1") == 0;
+    // https:// を TLS なしでビルドした場合などは従来の curl に任せる
+    for (int i = 0; i < 2; i++) {
+        if (!sub.server_url[i].empty() && !http_url_supported(sub.server_url[i])) return 3;
+    }
+
+    // $TMUX = "<ソケットパス>,<サーバ PID>,<セッション番号>"
+    std::string tmux_env = env_or("TMUX", "");
+    sub.tmux_socket = tmux_env.substr(0, tmux_env.find(','));
+
+    sub.input.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    return ipc_submit(sub, self_exe(argv[0])) ? 0 : 1;
+}
+
+// discover: PROMPT_RELAY_SERVER_URL=mdns:// のとき common.sh がサーバの URL を決めるのに使う
+// 見つからなければ何も出さずに終了コード 1
+static int cmd_discover(int argc, char** argv) {
+    std::string target_id;
+    bool list = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            g_relayd_verbose = true;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+        } else if (strcmp(argv[i], "--target-id") == 0 && i + 1 < argc) {
+            target_id = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (list) {
+        std::vector<RelayInfo> relays = discovery_list();
+        for (const RelayInfo& r : relays) {
+            printf("%s\t%s\tpending=%d\tused=%d/%d\tcaps=%s\n", r.id.c_str(), r.url.c_str(),
+                   r.pending, r.used, r.slots, r.caps.c_str());
+        }
+        return relays.empty() ? 1 : 0;
+    }
+    std::string url = discovery_pick(target_id);
+    if (url.empty()) return 1;
+    puts(url.c_str());
+    return 0;
+}
+
+// detect --incremental: 差分検出 (pane_screen) の確認用
+// 画面が 1 行ずつ埋まり、上にスクロールして消え、また全体が表示されるまでの各段階を
+// 同じキャッシュに順に流し、毎回の結果が全体の再判定と一致するかを確かめる
+static int cmd_detect_incremental(const std::string& text) {
+    std::vector<std::string> lines;
+    for (size_t start = 0; !text.empty();) {
+        size_t nl = text.find('\n', start);
+        lines.push_back(text.substr(start, nl == std::string::npos ? std::string::npos : nl - start));
+        if (nl == std::string::npos) break;
+        start = nl + 1;
+    }
+
+    std::vector<std::string> steps;
+    std::string shown;
+    for (size_t k = 0; k < lines.size(); k++) {
+        if (k > 0) shown += '\n';
+        shown += lines[k];
+        steps.push_back(shown);
+    }
+    for (size_t k = 1; k < lines.size(); k++) {
+        std::string scrolled;
+        for (size_t j = k; j < lines.size(); j++) scrolled += lines[j] + '\n';
+        scrolled.append(k - 1, '\n');
+        steps.push_back(scrolled);
+    }
+    steps.push_back(text);
+
+    PaneScreen screen;
+    for (size_t i = 0; i < steps.size(); i++) {
+        pane_screen_update(&screen, steps[i]);
+        if (screen.has_prompt != detect_prompt(steps[i])) {
+            fprintf(stderr, "incremental mismatch at step %zu\n", i);
+            return 1;
+        }
+    }
+    puts(screen.has_prompt ? "yes" : "no");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string cmd = argv[1];
+
+    if (cmd == "daemon") return cmd_daemon(argc, argv);
+    if (cmd == "submit") return cmd_submit(argc, argv);
+    if (cmd == "discover") return cmd_discover(argc, argv);
+
+    if (cmd == "detect") {
+        if (argc > 2 && strcmp(argv[2], "--incremental") == 0) {
+            return cmd_detect_incremental(argc > 3 ? argv[3] : "");
+        }
+        puts(detect_prompt(std::string(argc > 2 ? argv[2] : "")) ? "yes" : "no");
+        return 0;
+    }
+    if (cmd == "parse") {
+        std::string stdin_data = argc > 2 ? argv[2] : "{}";
+        std::string pane = argc > 3 ? argv[3] : "";
+        const char* target = argc > 4 ? argv[4] : nullptr;
+        const char* hostname = argc > 5 ? argv[5] : nullptr;
+        int timeout = 0;
+        if (argc > 6) {
+            char* end;
+            long t = strtol(argv[6], &end, 10);
+            if (*argv[6] && *end == '\0') timeout = (int)t;
+        }
+        std::string out;
+        if (!parse_pane(stdin_data, pane, target, hostname, timeout, &out)) {
+            fprintf(stderr, "invalid stdin json\n");
+            return 1;
+        }
+        puts(out.c_str());
+        return 0;
+    }
+    if (cmd == "response") {
+        puts(format_response(parse_response(argc > 2 ? argv[2] : "")).c_str());
+        return 0;
+    }
+
+    fprintf(stderr, "Unknown command: %s\n", cmd.c_str());
+    return 1;
+}
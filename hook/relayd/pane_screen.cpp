@@ -0,0 +1,40 @@
+#include "pane_screen.h"
+
+size_t pane_screen_update(PaneScreen* screen, const std::string& capture) {
+    if (capture == screen->text) return 0;
+
+    // pane_split_lines() と同じく空文字列は 0 行
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (!capture.empty()) {
+        size_t nl = capture.find('\n', start);
+        if (nl == std::string::npos) {
+            lines.push_back(capture.substr(start));
+            break;
+        }
+        lines.push_back(capture.substr(start, nl - start));
+        start = nl + 1;
+    }
+
+    // 同じ位置の行が前回と同じなら判定を使い回す (TUI の再描画は大半の行が変わらない)
+    size_t changed = 0;
+    screen->classes.resize(lines.size());
+    for (size_t k = 0; k < lines.size(); k++) {
+        if (k < screen->lines.size() && screen->lines[k] == lines[k]) continue;
+        screen->classes[k] = classify_prompt_line(lines[k]);
+        changed++;
+    }
+
+    screen->text = capture;
+    screen->lines.swap(lines);
+    // 行の判定が変わっていなくても行数が減ると組み合わせが変わるので、毎回やり直す (整数の比較のみ)
+    screen->has_prompt = detect_prompt(screen->classes);
+    return changed;
+}
+
+void pane_screen_clear(PaneScreen* screen) {
+    screen->text.clear();
+    screen->lines.clear();
+    screen->classes.clear();
+    screen->has_prompt = false;
+}
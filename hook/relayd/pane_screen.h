@@ -0,0 +1,25 @@
+#pragma once
+
+#include "prompt_parser.h"
+
+#include <string>
+#include <vector>
+
+// ペインの可視領域の行キャッシュ (差分検出用)
+//
+// %output でペインの変化を知るたびに可視領域を取り直し、前回と違う行だけ
+// classify_prompt_line() をやり直す。組み合わせの判定 (detect_prompt) は行ごとの
+// 判定結果の配列に対して行うので、1 回の更新のコストは変化した行数にほぼ比例する
+
+struct PaneScreen {
+    std::string text;                   // 直近の capture-pane の出力そのまま
+    std::vector<std::string> lines;     // text を行に分けたもの (UTF-8 のまま比較する)
+    std::vector<PromptLine> classes;    // lines と同じ添字の判定結果
+    bool has_prompt = false;
+};
+
+// capture-pane の出力でキャッシュを更新する
+// 戻り値: 判定し直した行数 (0 = 画面に変化なし)
+size_t pane_screen_update(PaneScreen* screen, const std::string& capture);
+
+void pane_screen_clear(PaneScreen* screen);
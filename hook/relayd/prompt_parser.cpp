@@ -0,0 +1,506 @@
+#include "prompt_parser.h"
+#include "json.h"
+
+#include <cctype>
+#include <cstdio>
+
+// Python の str.isspace() と同じ空白文字
+static bool is_space(char32_t c) {
+    if (c == ' ' || (c >= '\t' && c <= '\r') || (c >= 0x1C && c <= 0x1F)) return true;
+    if (c < 0x85) return false;
+    return c == 0x85 || c == 0xA0 || c == 0x1680 || (c >= 0x2000 && c <= 0x200A) ||
+           c == 0x2028 || c == 0x2029 || c == 0x202F || c == 0x205F || c == 0x3000;
+}
+
+static bool is_digit(char32_t c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_cursor(char32_t c) {
+    return c == U'❯' || c == U'>';
+}
+
+static size_t skip_space(const std::u32string& s, size_t i) {
+    while (i < s.size() && is_space(s[i])) i++;
+    return i;
+}
+
+static std::u32string strip(const std::u32string& s) {
+    size_t b = skip_space(s, 0);
+    size_t e = s.size();
+    while (e > b && is_space(s[e - 1])) e--;
+    return s.substr(b, e - b);
+}
+
+static bool contains(const std::u32string& s, const char32_t* needle) {
+    return s.find(needle) != std::u32string::npos;
+}
+
+static bool starts_with(const std::u32string& s, const char32_t* prefix) {
+    return s.compare(0, std::char_traits<char32_t>::length(prefix), prefix) == 0;
+}
+
+static std::u32string decode_utf8(const std::string& s) {
+    std::u32string out;
+    out.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = s[i];
+        char32_t cp;
+        int extra;
+        if (c < 0x80) { cp = c; extra = 0; }
+        else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; extra = 1; }
+        else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; extra = 2; }
+        else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; extra = 3; }
+        else { out.push_back(0xFFFD); i++; continue; }
+        if (i + extra >= s.size()) { out.push_back(0xFFFD); i++; continue; }
+        bool ok = true;
+        for (int k = 1; k <= extra; k++) {
+            unsigned char cc = s[i + k];
+            if ((cc & 0xC0) != 0x80) { ok = false; break; }
+            cp = (cp << 6) | (cc & 0x3F);
+        }
+        if (!ok) { out.push_back(0xFFFD); i++; continue; }
+        out.push_back(cp);
+        i += extra + 1;
+    }
+    return out;
+}
+
+static std::string encode_utf8(const std::u32string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char32_t cp : s) {
+        if (cp < 0x80) {
+            out.push_back((char)cp);
+        } else if (cp < 0x800) {
+            out.push_back((char)(0xC0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back((char)(0xE0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back((char)(0xF0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+    return out;
+}
+
+PaneLines pane_split_lines(const std::string& text) {
+    PaneLines lines;
+    if (text.empty()) return lines;
+    size_t start = 0;
+    while (true) {
+        size_t nl = text.find('\n', start);
+        if (nl == std::string::npos) {
+            lines.push_back(decode_utf8(text.substr(start)));
+            break;
+        }
+        lines.push_back(decode_utf8(text.substr(start, nl - start)));
+        start = nl + 1;
+    }
+    return lines;
+}
+
+// 番号付き選択肢行 \s*([❯>])?\s*(\d+)\. の先頭一致
+// 戻り値: '.' の次の位置 (不一致なら npos)
+struct ChoiceMatch {
+    char32_t cursor;        // 0 = カーソルなし
+    long number;
+    size_t digits_begin;
+    size_t digits_end;
+};
+
+static size_t match_choice(const std::u32string& s, ChoiceMatch* m) {
+    size_t i = skip_space(s, 0);
+    m->cursor = 0;
+    if (i < s.size() && is_cursor(s[i])) {
+        m->cursor = s[i];
+        i = skip_space(s, i + 1);
+    }
+    m->digits_begin = i;
+    m->number = 0;
+    while (i < s.size() && is_digit(s[i])) {
+        if (m->number < 100000000) m->number = m->number * 10 + (s[i] - '0');
+        i++;
+    }
+    m->digits_end = i;
+    if (i == m->digits_begin || i >= s.size() || s[i] != '.') return std::u32string::npos;
+    return i + 1;
+}
+
+static bool is_sep_of(const std::u32string& line, char32_t ch) {
+    std::u32string s = strip(line);
+    if (s.size() < 10) return false;
+    for (char32_t c : s) {
+        if (c != ch) return false;
+    }
+    return true;
+}
+
+static bool is_solid_sep(const std::u32string& line) { return is_sep_of(line, U'─'); }
+static bool is_dashed_sep(const std::u32string& line) { return is_sep_of(line, U'╌'); }
+
+// ── detect_prompt ──
+
+PromptLine classify_prompt_line(const std::u32string& line) {
+    PromptLine c;
+    ChoiceMatch m;
+    size_t pos = match_choice(line, &m);
+    // \.\s*\S: ピリオドの後に空白以外の文字が必要 (幅が狭いと "2.Yes" になる)
+    if (pos != std::u32string::npos && skip_space(line, pos) < line.size()) {
+        c.kind = PromptLine::CHOICE;
+        c.cursor = m.cursor != 0;
+        c.number = m.number;
+        return c;
+    }
+    std::u32string s = strip(line);
+    if (starts_with(s, U"Esc to") || starts_with(s, U"Enter to")) c.kind = PromptLine::ESC_ENTER;
+    return c;
+}
+
+PromptLine classify_prompt_line(const std::string& line) {
+    return classify_prompt_line(decode_utf8(line));
+}
+
+bool detect_prompt(const std::vector<PromptLine>& lines) {
+    // 末尾から走査して番号付き選択肢行を収集
+    // 折り返しで番号のない継続行が挟まるので、15 行以上連続で番号なしなら停止する
+    std::vector<long> nums;
+    bool has_cursor = false;
+    int gap = 0;
+    size_t scan_start = lines.size();
+
+    for (size_t k = lines.size(); k-- > 0;) {
+        const PromptLine& c = lines[k];
+        if (c.kind == PromptLine::CHOICE) {
+            nums.push_back(c.number);
+            if (c.cursor) has_cursor = true;
+            scan_start = k;
+            gap = 0;
+        } else if (!nums.empty()) {
+            if (++gap >= 15) break;
+        }
+    }
+
+    if (nums.size() < 2 || !has_cursor) return false;
+
+    bool has_esc_enter = false;
+    for (size_t k = scan_start; k < lines.size(); k++) {
+        if (lines[k].kind == PromptLine::ESC_ENTER) {
+            has_esc_enter = true;
+            break;
+        }
+    }
+    if (!has_esc_enter) return false;
+
+    // 末尾から集めたので降順 (3, 2, 1) になっているはず
+    for (size_t k = 1; k < nums.size(); k++) {
+        if (nums[k - 1] != nums[k] + 1) return false;
+    }
+    return true;
+}
+
+bool detect_prompt(const PaneLines& lines) {
+    std::vector<PromptLine> classes;
+    classes.reserve(lines.size());
+    for (const std::u32string& line : lines) classes.push_back(classify_prompt_line(line));
+    return detect_prompt(classes);
+}
+
+bool detect_prompt(const std::string& pane_text) {
+    return detect_prompt(pane_split_lines(pane_text));
+}
+
+// ── parse_pane ──
+
+static bool is_system_choice(const std::u32string& text) {
+    static const char32_t* const SYSTEM_CHOICES[] = {
+        U"type something", U"type something.", U"chat about this",
+    };
+    std::u32string lower = text;
+    for (char32_t& c : lower) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    }
+    std::u32string trimmed = lower;
+    while (!trimmed.empty() && trimmed.back() == '.') trimmed.pop_back();
+    for (const char32_t* sc : SYSTEM_CHOICES) {
+        if (lower == sc || trimmed == sc) return true;
+    }
+    return false;
+}
+
+// re.split(r'\s{3,}', text)[0]
+static std::u32string before_wide_gap(const std::u32string& text) {
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (is_space(text[i])) {
+            if (++run >= 3) return text.substr(0, i + 1 - run);
+        } else {
+            run = 0;
+        }
+    }
+    return text;
+}
+
+// re.search(r'permission to use (\w+)', msg)
+static std::string tool_from_message(const std::string& msg) {
+    static const char NEEDLE[] = "permission to use ";
+    size_t pos = 0;
+    while ((pos = msg.find(NEEDLE, pos)) != std::string::npos) {
+        size_t b = pos + sizeof(NEEDLE) - 1;
+        size_t e = b;
+        while (e < msg.size() && (isalnum((unsigned char)msg[e]) || msg[e] == '_')) e++;
+        if (e > b) return msg.substr(b, e - b);
+        pos++;
+    }
+    return std::string();
+}
+
+struct ParsedChoice {
+    size_t line;
+    long number;
+    std::u32string text;
+};
+
+bool parse_pane(const std::string& stdin_data, const std::string& pane_data,
+                const char* tmux_target, const char* hostname, int timeout,
+                std::string* out_json) {
+    JsonValue d;
+    if (stdin_data.empty()) {
+        d.type = JsonValue::OBJECT;
+    } else if (!json_parse(stdin_data, &d) || d.type != JsonValue::OBJECT) {
+        return false;
+    }
+
+    // ツール名: PreToolUse は tool_name を直接提供
+    std::string tool_name = d.get_string("tool_name");
+    if (tool_name.empty()) {
+        std::string msg = d.get_string("message");
+        tool_name = tool_from_message(msg);
+        if (tool_name.empty()) {
+            tool_name = msg.find("needs your attention") != std::string::npos ? "Question" : "Permission";
+        }
+    }
+
+    std::u32string header;
+    std::string description;
+    std::vector<ParsedChoice> choices;
+    std::u32string prompt_question;
+
+    if (!pane_data.empty()) {
+        PaneLines lines = pane_split_lines(pane_data);
+        const size_t n = lines.size();
+        ChoiceMatch m;
+
+        // ❯ カーソルをアンカーとしてプロンプト領域を特定 (末尾から逆順サーチ)
+        long cursor_idx = -1;
+        for (size_t k = n; k-- > 0;) {
+            if (match_choice(lines[k], &m) != std::u32string::npos && m.cursor == U'❯') {
+                cursor_idx = (long)k;
+                break;
+            }
+        }
+
+        // ❯ より前の最後の ─ 実線セパレータを探す (プロンプト開始点)
+        size_t prompt_start = 0;
+        if (cursor_idx >= 0) {
+            for (long k = cursor_idx - 1; k >= 0; k--) {
+                if (is_solid_sep(lines[k])) {
+                    prompt_start = k + 1;
+                    break;
+                }
+            }
+        }
+
+        // プロンプト領域内のみから選択肢を抽出
+        size_t scan_from = cursor_idx >= 0 ? prompt_start : 0;
+        if (cursor_idx >= 0) {
+            for (long k = cursor_idx; k >= (long)scan_from; k--) {
+                if (match_choice(lines[k], &m) != std::u32string::npos &&
+                    m.digits_end - m.digits_begin == 1 && lines[k][m.digits_begin] == '1') {
+                    scan_from = k;
+                    break;
+                }
+            }
+        }
+        for (size_t k = scan_from; k < n; k++) {
+            size_t pos = match_choice(lines[k], &m);
+            // (.+): ピリオドの後に 1 文字以上
+            if (pos == std::u32string::npos || pos >= lines[k].size()) continue;
+            // 折り返しで別の選択肢が同じ行に混ざる場合があるので、3 個以上の連続空白の手前まで
+            std::u32string text = strip(before_wide_gap(strip(lines[k].substr(pos))));
+            if (!is_system_choice(text)) {
+                choices.push_back({ k, m.number, text });
+            }
+        }
+
+        // ヘッダー領域: prompt_start から最初の ╌ 点線セパレータまで
+        size_t first_choice_idx = choices.empty() ? n : choices[0].line;
+        size_t header_end = first_choice_idx;
+        for (size_t k = prompt_start; k < first_choice_idx; k++) {
+            if (is_dashed_sep(lines[k])) {
+                header_end = k;
+                break;
+            }
+        }
+
+        // ヘッダーと説明を抽出
+        std::vector<std::u32string> desc_lines;
+        for (size_t k = prompt_start; k < header_end; k++) {
+            std::u32string s = strip(lines[k]);
+            if (s.empty()) continue;
+            if ((s[0] == U'☐' || s[0] == U'□') && s.size() > 1 && is_space(s[1])) {
+                header = strip(s.substr(1));
+                continue;
+            }
+            if (contains(s, U"Do you want") || contains(s, U"Enter to select") || contains(s, U"Esc to")) break;
+            if (match_choice(s, &m) != std::u32string::npos) break;
+            if (header.empty()) {
+                header = s;
+            } else {
+                desc_lines.push_back(s);
+            }
+        }
+
+        // 選択肢直前の質問行を抽出
+        for (long k = (long)first_choice_idx - 1; k >= (long)prompt_start; k--) {
+            std::u32string s = strip(lines[k]);
+            if (s.empty()) continue;
+            if (is_dashed_sep(lines[k]) || is_solid_sep(lines[k])) break;
+            if (contains(s, U"Enter to select") || contains(s, U"Esc to")) continue;
+            prompt_question = s;
+            break;
+        }
+
+        // 通知表示用に省略 (モバイル通知の表示幅に合わせた上限)
+        const size_t MAX_LINES = 3;
+        const size_t MAX_LINE_LEN = 80;
+        std::u32string joined;
+        for (size_t k = 0; k < desc_lines.size() && k < MAX_LINES; k++) {
+            if (k) joined.push_back('\n');
+            if (desc_lines[k].size() > MAX_LINE_LEN) {
+                joined += desc_lines[k].substr(0, MAX_LINE_LEN) + U"…";
+            } else {
+                joined += desc_lines[k];
+            }
+        }
+        if (desc_lines.size() > MAX_LINES) {
+            char more[32];
+            snprintf(more, sizeof(more), "(+%zu lines)", desc_lines.size() - MAX_LINES);
+            joined.push_back('\n');
+            joined += decode_utf8(more);
+        }
+        description = encode_utf8(strip(joined));
+    }
+
+    std::string& out = *out_json;
+    out.clear();
+    out += "{\"tool_name\":";
+    json_append_string(&out, tool_name);
+    out += ",\"tool_input\":";
+    const JsonValue* tool_input = d.get("tool_input");
+    if (tool_input) json_dump(*tool_input, &out);
+    else out += "{}";
+    out += ",\"message\":";
+    const JsonValue* message = d.get("message");
+    if (message) json_dump(*message, &out);
+    else out += "\"\"";
+    out += ",\"header\":";
+    json_append_string(&out, encode_utf8(header));
+    out += ",\"description\":";
+    json_append_string(&out, description);
+    out += ",\"prompt_question\":";
+    json_append_string(&out, encode_utf8(prompt_question));
+    out += ",\"choices\":[";
+    for (size_t k = 0; k < choices.size(); k++) {
+        char num[24];
+        snprintf(num, sizeof(num), "%s{\"number\":%ld,\"text\":", k ? "," : "", choices[k].number);
+        out += num;
+        json_append_string(&out, encode_utf8(choices[k].text));
+        out += "}";
+    }
+    out += "],\"has_tmux\":";
+    out += pane_data.empty() ? "false" : "true";
+    out += ",\"tmux_target\":";
+    if (tmux_target) json_append_string(&out, tmux_target);
+    else out += "null";
+    out += ",\"hostname\":";
+    if (hostname) json_append_string(&out, hostname);
+    else out += "null";
+    if (timeout > 0) {
+        char t[32];
+        snprintf(t, sizeof(t), ",\"timeout\":%d", timeout);
+        out += t;
+    }
+    out += "}";
+    return true;
+}
+
+// ── parse_response ──
+
+PromptResponse parse_response(const std::string& body) {
+    JsonValue v;
+    if (!json_parse(body, &v)) return PromptResponse();
+    return parse_response_value(v);
+}
+
+PromptResponse parse_response_value(const JsonValue& v) {
+    PromptResponse r;
+    if (v.type != JsonValue::OBJECT) return r;
+
+    std::string resp = v.get_string("response");
+    if (resp.empty()) return r;
+    if (resp == "cancelled" || resp == "expired") {
+        r.status = PromptResponse::STALE;
+        return r;
+    }
+    // send_key は null のこともある (Node 版は未設定を null で返す)
+    r.status = PromptResponse::OK;
+    r.response = resp;
+    r.send_key = v.get_string("send_key");
+    if (r.send_key.empty() && resp == "allow") r.send_key = "1";
+    return r;
+}
+
+std::string format_response(const PromptResponse& r) {
+    switch (r.status) {
+        case PromptResponse::OK:    return "ok|" + r.send_key + "|" + r.response;
+        case PromptResponse::STALE: return "stale||";
+        default:                    return "none||";
+    }
+}
+
+// ── 応答待ち中のペイン確認 ──
+
+bool pane_has_cursor_choice(const PaneLines& lines) {
+    for (const std::u32string& line : lines) {
+        for (size_t i = 0; i < line.size(); i++) {
+            if (!is_cursor(line[i])) continue;
+            size_t j = skip_space(line, i + 1);
+            size_t d = j;
+            while (d < line.size() && is_digit(line[d])) d++;
+            if (d > j && d < line.size() && line[d] == '.') return true;
+        }
+    }
+    return false;
+}
+
+int pane_last_choice_number(const PaneLines& lines) {
+    for (size_t k = lines.size(); k-- > 0;) {
+        const std::u32string& line = lines[k];
+        size_t j = skip_space(line, 0);
+        size_t d = j;
+        long num = 0;
+        while (d < line.size() && is_digit(line[d])) {
+            if (num < 100000000) num = num * 10 + (line[d] - '0');
+            d++;
+        }
+        if (d > j && d < line.size() && line[d] == '.') return (int)num;
+    }
+    return -1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// hook/prompt_parser.py のネイティブ版
+// 判定ロジックは Python 版と同じ。文字数 (区切り線の長さ・説明の切り詰め) は Python と同じく
+// コードポイント単位で数えるため、行は UTF-32 で持つ
+
+typedef std::vector<std::u32string> PaneLines;
+
+// tmux capture-pane の出力を行に分ける (空文字列は 0 行)
+PaneLines pane_split_lines(const std::string& text);
+
+// detect_prompt(): 番号付き選択肢 + ❯/> カーソル + "Esc to"/"Enter to" 行の組み合わせを探す
+bool detect_prompt(const PaneLines& lines);
+bool detect_prompt(const std::string& pane_text);
+
+// detect_prompt() の行ごとの判定結果
+// 行の判定と組み合わせの判定を分けておき、差分検出 (pane_screen) では変化した行だけ判定し直す
+struct PromptLine {
+    enum Kind { OTHER, CHOICE, ESC_ENTER };
+    Kind kind = OTHER;
+    bool cursor = false;    // CHOICE: ❯/> カーソル付き
+    long number = 0;        // CHOICE: 選択肢の番号
+};
+PromptLine classify_prompt_line(const std::u32string& line);
+PromptLine classify_prompt_line(const std::string& line);     // UTF-8 の 1 行
+bool detect_prompt(const std::vector<PromptLine>& lines);
+
+// parse_pane(): PreToolUse の stdin とペイン内容からサーバ送信用の JSON を組み立てる
+// tmux_target / hostname は nullptr で null、timeout は 0 以下で省略
+// 戻り値: false = stdin が JSON として不正 (Python 版では例外になるケース)
+bool parse_pane(const std::string& stdin_data, const std::string& pane_data,
+                const char* tmux_target, const char* hostname, int timeout,
+                std::string* out_json);
+
+// parse_response(): GET /permission-request/:id/response の応答
+struct PromptResponse {
+    enum Status { NONE, STALE, OK };
+    Status status = NONE;
+    std::string send_key;   // allow で未指定なら "1"
+    std::string response;
+};
+PromptResponse parse_response(const std::string& body);
+// 解析済みの応答 (CBOR で受け取った場合など)
+struct JsonValue;
+PromptResponse parse_response_value(const JsonValue& v);
+// Python 版 CLI と同じ "status|send_key|response" 形式
+std::string format_response(const PromptResponse& r);
+
+// 応答待ち中の手動回答検知用: カーソル付きの番号行 ([❯>]\s*[0-9]+\.) がどこかにあるか
+bool pane_has_cursor_choice(const PaneLines& lines);
+// send_key 不明時の入力キー: 行頭が番号 (^\s*[0-9]+\.) の最後の行の番号 (なければ -1)
+int pane_last_choice_number(const PaneLines& lines);
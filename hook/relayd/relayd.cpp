@@ -0,0 +1,633 @@
+#include "relayd.h"
+#include "cbor.h"
+#include "http_async.h"
+#include "ipc.h"
+#include "json.h"
+#include "pane_screen.h"
+#include "prompt_parser.h"
+#include "relayd_log.h"
+#include "tmux_control.h"
+
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#define POLL_INTERVAL_MS 1000       // 応答ポーリング間隔 (従来の POLL_INTERVAL=1)
+#define HTTP_IDLE_CLOSE_MS 4000     // Node 版の keepAliveTimeout (5 秒) より先に閉じる
+#define CLIENT_TIMEOUT_MS 5000      // 書き終わらないクライアントを切る
+#define OUTPUT_SETTLE_MS 10         // %output から画面を取り直すまで (1 回の再描画が複数の %output に分かれる)
+#define MAX_WAIT_MS 1000
+
+static const char* TAG = "relayd";
+
+struct Pane {
+    std::string key;                // s_panes のキー (HTTP の完了コールバックから引き直す)
+    RelaySubmission sub;
+    TmuxControl* tmux = nullptr;
+
+    // 検出 (旧 WATCHER_FILE: 後から来たフックが引き継ぐ)
+    // %output を購読できれば画面が変わったときだけ確認し、できなければ従来どおり一定間隔で確認する
+    bool detecting = false;
+    std::string pane_id;            // %output の宛先 (%12 の形式、空 = 購読していない)
+    PaneScreen screen;              // 可視領域の行キャッシュ (変化した行だけ判定し直す)
+    int attempts_left = 0;          // 一定間隔で確認する場合の残り回数
+    int64_t detect_until_ms = 0;    // %output で確認する場合の期限 (従来の試行回数 × 間隔)
+    int64_t next_detect_ms = 0;
+    int64_t deadline_ms = 0;        // 検出を続ける期限 (送信後はサーバの expires_at)
+    std::string last_sent_raw;      // 旧 SKIP_FILE / PREV_DETECTED_RAW: 送信済みの画面
+    bool sending = false;           // プライマリへの作成リクエストが終わるまで次の検出はしない
+
+    // 応答待ち (旧 POLLER_FILE: 同じペインで新しいリクエストを送ったら置き換える)
+    bool polling = false;
+    std::string request_id[2];
+    bool seen_prompt = false;
+    bool fetching = false;          // 応答の GET が終わるまで次のポーリングはしない
+    int64_t next_poll_ms = 0;
+    int64_t poll_deadline_ms = 0;
+};
+
+struct Client {
+    int fd;
+    int64_t since_ms;
+    std::string buf;
+};
+
+static std::map<std::string, Pane> s_panes;    // キー: tmux ソケット + " " + target
+static std::vector<Client> s_clients;
+static volatile sig_atomic_t s_stop = 0;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t epoch_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool is_digits(const std::string& s) {
+    if (s.empty()) return false;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+    }
+    return true;
+}
+
+// URL に埋め込むので、サーバが返した ID は英数字とハイフンのみ受け付ける
+static bool id_is_safe(const std::string& id) {
+    if (id.empty() || id.size() > 64) return false;
+    for (char c : id) {
+        if (!isalnum((unsigned char)c) && c != '-') return false;
+    }
+    return true;
+}
+
+static int detect_interval(const Pane& p) {
+    return p.sub.detect_interval_ms > 0 ? p.sub.detect_interval_ms : 100;
+}
+
+// ── サーバ ──
+
+static bool has_server(const Pane& p, int i) {
+    return !p.sub.server_url[i].empty();
+}
+
+// プライマリと CBOR でやりとりするか (セカンダリは Node.js 版のことがあるので JSON のまま)
+static bool use_cbor(const Pane& p, int i) {
+    return i == 0 && p.sub.cbor;
+}
+
+static std::vector<std::string> server_headers(const Pane& p, int i, bool body) {
+    std::vector<std::string> h = {
+        "Authorization: Bearer " + p.sub.api_key[i],
+        // ESP32 版はボディを読む前にホスト単位で流量制御する
+        "X-Prompt-Relay-Host: " + p.sub.display_host,
+    };
+    if (use_cbor(p, i)) {
+        h.push_back("Accept: application/cbor");
+        if (body) h.push_back("Content-Type: application/cbor");
+    } else if (body) {
+        h.push_back("Content-Type: application/json");
+    }
+    return h;
+}
+
+// 組み立てた JSON の本文をサーバ i に送る形式にする
+static std::string encode_body(const Pane& p, int i, const std::string& json) {
+    JsonValue v;
+    if (!use_cbor(p, i) || !json_parse(json, &v)) return json;
+    std::string out;
+    cbor_encode(v, &out);
+    return out;
+}
+
+// 応答本文を解釈する (CBOR で頼んでもエラーは JSON で返る)。失敗時は out を空にする
+static bool parse_body(const HttpResponse& r, JsonValue* out) {
+    bool ok = r.content_type.compare(0, 16, "application/cbor") == 0 ? cbor_decode(r.body, out)
+                                                                      : json_parse(r.body, out);
+    if (!ok) *out = JsonValue();
+    return ok;
+}
+
+static void notify_fallback(const Pane& p, const char* message) {
+    std::string body = "{\"title\":\"承認待ち\",\"message\":";
+    json_append_string(&body, message);
+    body += ",\"hostname\":";
+    json_append_string(&body, p.sub.display_host);
+    body += "}";
+    for (int i = 0; i < 2; i++) {
+        if (!has_server(p, i)) continue;
+        http_submit(p.sub.server_url[i], "POST", "/notify", server_headers(p, i, true),
+                    encode_body(p, i, body), nullptr);
+    }
+}
+
+static void cancel_one(const std::string& url, std::vector<std::string> headers, const std::string& id) {
+    http_submit(url, "POST", "/permission-request/" + id + "/cancel", std::move(headers), std::string(),
+                nullptr);
+}
+
+// 両サーバにキャンセル送信
+static void cancel_all(const Pane& p) {
+    for (int i = 0; i < 2; i++) {
+        if (!has_server(p, i) || p.request_id[i].empty()) continue;
+        cancel_one(p.sub.server_url[i], server_headers(p, i, false), p.request_id[i]);
+    }
+}
+
+// ── tmux ──
+
+static bool capture(const Pane& p, bool with_history, std::string* out) {
+    std::string cmd = "capture-pane -p -t " + tmux_quote(p.sub.target);
+    // -S -50: 可視領域 + 50 行 (プロンプトヘッダーが画面外にある場合に対応)
+    if (with_history) cmd += " -S -50";
+    return tmux_command(p.tmux, cmd, out);
+}
+
+static void send_keys(const Pane& p, const std::string& key) {
+    // 数字のみであることは呼び出し側で確認済み (インジェクション防止)
+    tmux_command(p.tmux, "send-keys -t " + tmux_quote(p.sub.target) + " " + key, nullptr);
+}
+
+// ── ペインの状態遷移 ──
+
+static std::string session_of(const std::string& target) {
+    size_t colon = target.rfind(':');
+    return colon == std::string::npos ? target : target.substr(0, colon);
+}
+
+static void start_detect(Pane& p, int64_t now) {
+    p.detecting = true;
+    p.attempts_left = p.sub.detect_attempts > 0 ? p.sub.detect_attempts : 1;
+    p.detect_until_ms = now + (int64_t)p.attempts_left * detect_interval(p);
+    // 購読できていれば今の画面をすぐ確認し、あとは %output を待つ
+    p.next_detect_ms = p.pane_id.empty() ? now + detect_interval(p) : now;
+}
+
+// ターゲットのペイン ID を引き直して %output を購読する (ペインが作り直されていれば ID が変わる)
+static void watch_pane(Pane& p) {
+    std::string id;
+    if (!tmux_command(p.tmux, "display-message -p -t " + tmux_quote(p.sub.target) + " " +
+                      tmux_quote("#{pane_id}"), &id) || id.size() < 2 || id[0] != '%') {
+        id.clear();
+    }
+    if (id == p.pane_id) return;
+
+    if (!p.pane_id.empty()) tmux_control_unwatch(p.tmux, p.pane_id);
+    pane_screen_clear(&p.screen);
+    p.pane_id = id;
+    if (!id.empty() && !tmux_control_watch(p.tmux, id)) {
+        LOGW(TAG, "%s: cannot subscribe to %%output, falling back to polling", p.sub.target.c_str());
+        p.pane_id.clear();
+    }
+}
+
+static void unwatch_pane(Pane& p) {
+    if (!p.pane_id.empty()) tmux_control_unwatch(p.tmux, p.pane_id);
+    p.pane_id.clear();
+}
+
+// 購読中のペインに出力があった: 少し待ってから画面を取り直す
+// 出力が続いても先送りはしない (ストリーミング中でも OUTPUT_SETTLE_MS ごとに確認する)
+static void on_pane_output(TmuxControl* tc, const std::string& pane_id) {
+    int64_t at = now_ms() + OUTPUT_SETTLE_MS;
+    for (auto& kv : s_panes) {
+        Pane& p = kv.second;
+        if (p.detecting && p.tmux == tc && p.pane_id == pane_id && at < p.next_detect_ms) {
+            p.next_detect_ms = at;
+        }
+    }
+}
+
+static void pane_submit(const RelaySubmission& sub) {
+    // tmux のコマンドにシングルクォートで埋め込むので ' を含むターゲットは扱わない
+    if (sub.target.empty() || sub.target.find('\'') != std::string::npos || sub.target[0] == '-') {
+        LOGW(TAG, "invalid target: %s", sub.target.c_str());
+        return;
+    }
+    if (!http_url_supported(sub.server_url[0])) {
+        LOGW(TAG, "unsupported server URL: %s", sub.server_url[0].c_str());
+        return;
+    }
+
+    std::string key = sub.tmux_socket + " " + sub.target;
+    Pane& p = s_panes[key];
+    int64_t now = now_ms();
+    p.key = key;
+    // 後から来たフックが検出を引き継ぐ。応答待ちは新しいリクエストを送るまで続ける
+    p.sub = sub;
+    p.tmux = tmux_control_get(sub.tmux_socket, session_of(sub.target));
+    watch_pane(p);
+    p.deadline_ms = now + (int64_t)(sub.timeout_sec > 0 ? sub.timeout_sec : 120) * 1000;
+    start_detect(p, now);
+    LOGD(TAG, "%s: watching", sub.target.c_str());
+}
+
+// 応答を tmux に送った / 手動回答を検知した → 連続プロンプトに備えて検出に戻る
+static void finish_answered(Pane& p, int64_t now) {
+    p.polling = false;
+    if (!p.detecting && now < p.deadline_ms) start_detect(p, now);
+}
+
+// セカンダリでの作成が終わった (プライマリの応答待ちはもう始まっている)
+static void on_created_secondary(const std::string& key, const std::string& id, const std::string& url,
+                                 const std::vector<std::string>& headers, bool ok, const HttpResponse& r) {
+    JsonValue v;
+    std::string id2;
+    if (ok && parse_body(r, &v)) id2 = v.get_string("id");
+    if (!id_is_safe(id2)) return;
+
+    auto it = s_panes.find(key);
+    if (it != s_panes.end() && it->second.polling && it->second.request_id[0] == id) {
+        it->second.request_id[1] = id2;
+        LOGI(TAG, "%s: request %s sent to secondary", it->second.sub.target.c_str(), id2.c_str());
+        return;
+    }
+    // 待っている間にプライマリ側が終わった (応答・タイムアウト・置き換え): セカンダリにも残さない
+    cancel_one(url, headers, id2);
+}
+
+// プライマリでの作成が終わった
+static void on_created(const std::string& key, const std::string& raw, const std::string& payload,
+                       bool ok, const HttpResponse& r) {
+    auto it = s_panes.find(key);
+    if (it == s_panes.end()) return;
+    Pane& p = it->second;
+    p.sending = false;
+
+    if (!ok) {
+        notify_fallback(p, "サーバ接続失敗");
+        return;
+    }
+    // 429 = 流量制御で拒否 (フォールバック通知も同じ制限に掛かるので送らない)
+    if (r.status == 503 || r.status == 401 || r.status == 429) {
+        LOGW(TAG, "%s: server rejected request (%d)", p.sub.target.c_str(), r.status);
+        return;
+    }
+
+    JsonValue v;
+    parse_body(r, &v);
+    std::string id = v.get_string("id");
+    if (!id_is_safe(id)) {
+        notify_fallback(p, "サーバ応答異常");
+        return;
+    }
+
+    int64_t now = now_ms();
+    // サーバが返した expires_at (エポックミリ秒) をポーリング期限に使用
+    // ESP32 版はブート相対時刻を返すため、妥当なエポック値 (2020 年以降) のみ採用
+    const JsonValue* exp = v.get("expires_at");
+    if (exp && exp->type == JsonValue::NUMBER) {
+        double expires_at = strtod(exp->str.c_str(), nullptr);
+        if (expires_at > 1577836800000.0) p.deadline_ms = now + (int64_t)expires_at - epoch_ms();
+    }
+
+    // セカンダリサーバにも送信 (失敗しても続行。ID は届いた時点で応答待ちに加える)
+    if (has_server(p, 1)) {
+        std::string url = p.sub.server_url[1];
+        std::vector<std::string> cancel_headers = server_headers(p, 1, false);
+        http_submit(url, "POST", "/permission-request", server_headers(p, 1, true), payload,
+                    [key, id, url, cancel_headers](bool ok2, const HttpResponse& r2) {
+                        on_created_secondary(key, id, url, cancel_headers, ok2, r2);
+                    });
+    }
+
+    // 前のリクエストの応答待ちは置き換える (サーバ側も同じ tmux_target の旧リクエストをキャンセルする)
+    p.last_sent_raw = raw;
+    p.polling = true;
+    p.request_id[0] = id;
+    p.request_id[1].clear();
+    p.seen_prompt = true;
+    p.fetching = false;
+    p.next_poll_ms = now;
+    p.poll_deadline_ms = p.deadline_ms;
+    LOGI(TAG, "%s: request %s sent", p.sub.target.c_str(), id.c_str());
+}
+
+static void send_request(Pane& p, const std::string& raw, const std::string& pane) {
+    std::string payload;
+    if (!parse_pane(p.sub.input, pane, p.sub.target_id.c_str(), p.sub.display_host.c_str(),
+                    p.sub.timeout_sec, &payload)) {
+        notify_fallback(p, "パース失敗: 手動で確認してください");
+        return;
+    }
+
+    p.sending = true;
+    std::string key = p.key;
+    http_submit(p.sub.server_url[0], "POST", "/permission-request", server_headers(p, 0, true),
+                encode_body(p, 0, payload), [key, raw, payload](bool ok, const HttpResponse& r) { on_created(key, raw, payload, ok, r); });
+}
+
+// フェーズ 1: プロンプト出現を待つ (可視領域のみ対象、スクロールバック内の古いプロンプトは見ない)
+static void detect_tick(Pane& p, int64_t now) {
+    std::string raw;
+    bool found = false;
+    if (capture(p, false, &raw)) {
+        // 変化した行だけ判定し直す。送信済みと同じ画面は再処理しない (偽プロンプトの無限ループ防止)。
+        // 真の連続プロンプトは画面が変わる
+        size_t changed = pane_screen_update(&p.screen, raw);
+        LOGD(TAG, "%s: %zu/%zu lines changed", p.sub.target.c_str(), changed, p.screen.lines.size());
+        found = p.screen.has_prompt && raw != p.last_sent_raw;
+    }
+    if (!found) {
+        if (!p.pane_id.empty()) {
+            // 次は %output が来たとき。来なければ期限に最後の確認をして終わる
+            if (now >= p.detect_until_ms) {
+                p.detecting = false;
+            } else {
+                p.next_detect_ms = p.detect_until_ms;
+            }
+        } else if (--p.attempts_left <= 0) {
+            p.detecting = false;
+        } else {
+            p.next_detect_ms = now + detect_interval(p);
+        }
+        return;
+    }
+
+    // フェーズ 2: パース + 送信 (成否にかかわらずこの検出は終わり)
+    p.detecting = false;
+    std::string pane;
+    if (capture(p, true, &pane)) send_request(p, raw, pane);
+}
+
+static void on_poll_response(const std::string& key, const std::string& id, int server,
+                             const PromptResponse& res);
+
+// 応答を取りに行く (結果は on_poll_response)
+static void fetch_response(Pane& p, int i) {
+    std::string key = p.key;
+    std::string id = p.request_id[0];
+    http_submit(p.sub.server_url[i], "GET", "/permission-request/" + p.request_id[i] + "/response",
+                server_headers(p, i, false), std::string(),
+                [key, id, i](bool, const HttpResponse& r) {
+                    JsonValue v;
+                    parse_body(r, &v);
+                    on_poll_response(key, id, i, parse_response_value(v));
+                });
+}
+
+// フェーズ 3: 応答ポーリング
+static void poll_tick(Pane& p, int64_t now) {
+    if (now >= p.poll_deadline_ms) {
+        // タイムアウト: 未応答リクエストをキャンセルして通知を消去
+        LOGI(TAG, "%s: request %s timed out", p.sub.target.c_str(), p.request_id[0].c_str());
+        cancel_all(p);
+        p.polling = false;
+        return;
+    }
+
+    // まずプライマリ、応答がなければセカンダリ
+    p.fetching = true;
+    fetch_response(p, 0);
+}
+
+static void on_poll_response(const std::string& key, const std::string& id, int server,
+                             const PromptResponse& res) {
+    auto it = s_panes.find(key);
+    if (it == s_panes.end()) return;
+    Pane& p = it->second;
+    // 待っている間に終わった・新しいリクエストに置き換わった
+    if (!p.polling || p.request_id[0] != id) return;
+
+    if (res.status == PromptResponse::NONE && server == 0 && has_server(p, 1) && !p.request_id[1].empty()) {
+        fetch_response(p, 1);
+        return;
+    }
+    p.fetching = false;
+    int64_t now = now_ms();
+
+    if (res.status == PromptResponse::STALE) {
+        cancel_all(p);
+        p.polling = false;
+        return;
+    }
+
+    if (res.status == PromptResponse::OK) {
+        std::string send_key = res.send_key;
+        if (send_key.empty()) {
+            // deny でキー不明 → ペインの最後の番号 (No) を使う
+            std::string now_raw;
+            if (capture(p, false, &now_raw)) {
+                int last = pane_last_choice_number(pane_split_lines(now_raw));
+                if (last >= 0) send_key = std::to_string(last);
+            }
+        }
+        if (is_digits(send_key)) send_keys(p, send_key);
+        LOGI(TAG, "%s: %s -> key %s", p.sub.target.c_str(), res.response.c_str(),
+             send_key.empty() ? "(none)" : send_key.c_str());
+        cancel_all(p);
+        finish_answered(p, now);
+        return;
+    }
+
+    // tmux ペインの手動回答を検知 (プロンプトが消えた)
+    std::string check;
+    capture(p, false, &check);
+    if (pane_has_cursor_choice(pane_split_lines(check))) {
+        p.seen_prompt = true;
+    } else if (p.seen_prompt) {
+        LOGI(TAG, "%s: answered in tmux", p.sub.target.c_str());
+        cancel_all(p);
+        finish_answered(p, now);
+        return;
+    }
+    p.next_poll_ms = now + POLL_INTERVAL_MS;
+}
+
+// ── ソケット ──
+
+static void accept_clients(int listen_fd) {
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        // ソケットは 0600 だが、念のため同じユーザー以外は受け付けない
+        uid_t uid = (uid_t)-1;
+#ifdef __linux__
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) uid = cred.uid;
+#else
+        gid_t gid;
+        getpeereid(fd, &uid, &gid);
+#endif
+        if (uid != getuid()) {
+            LOGW(TAG, "rejected client (uid %d)", (int)uid);
+            close(fd);
+            continue;
+        }
+        s_clients.push_back({ fd, now_ms(), std::string() });
+    }
+}
+
+// 戻り値: false = クライアントを閉じてよい
+static bool read_client(Client* c) {
+    char buf[8192];
+    while (true) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n > 0) {
+            c->buf.append(buf, n);
+            if (c->buf.size() > IPC_MAX_MESSAGE) {
+                LOGW(TAG, "submission too large");
+                return false;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+        break;
+    }
+    // EOF: 1 件分そろった
+    RelaySubmission sub;
+    if (ipc_decode(c->buf, &sub)) {
+        pane_submit(sub);
+    } else {
+        LOGW(TAG, "malformed submission (%zu bytes)", c->buf.size());
+    }
+    return false;
+}
+
+static void on_signal(int) {
+    s_stop = 1;
+}
+
+int relayd_run(const std::string& socket_path, int idle_exit_sec) {
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+
+    int lock_fd = -1;
+    int listen_fd = ipc_listen(socket_path, &lock_fd);
+    if (listen_fd == -2) return 0;      // 他のデーモンが動いている
+    if (listen_fd < 0) return 1;
+    if (!http_async_init()) {
+        unlink(socket_path.c_str());
+        close(listen_fd);
+        close(lock_fd);
+        return 1;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    LOGI(TAG, "listening on %s", socket_path.c_str());
+    tmux_control_set_output_handler(on_pane_output);
+
+    int64_t idle_since = now_ms();
+    std::vector<struct pollfd> fds;
+    std::vector<int> tmux_fds;
+
+    while (!s_stop) {
+        int64_t now = now_ms();
+        int64_t next = now + MAX_WAIT_MS;
+        for (auto& kv : s_panes) {
+            const Pane& p = kv.second;
+            // HTTP の完了待ちのペインはパイプで起こされる
+            if (p.detecting && !p.sending && p.next_detect_ms < next) next = p.next_detect_ms;
+            if (p.polling && !p.fetching && p.next_poll_ms < next) next = p.next_poll_ms;
+        }
+
+        fds.clear();
+        fds.push_back({ listen_fd, POLLIN, 0 });
+        fds.push_back({ http_async_fd(), POLLIN, 0 });
+        for (const Client& c : s_clients) fds.push_back({ c.fd, POLLIN, 0 });
+        tmux_fds.clear();
+        tmux_control_fds(&tmux_fds);
+        for (int fd : tmux_fds) fds.push_back({ fd, POLLIN, 0 });
+
+        int wait = next > now ? (int)(next - now) : 0;
+        if (poll(fds.data(), fds.size(), wait) < 0 && errno != EINTR) {
+            LOGE(TAG, "poll: %s", strerror(errno));
+            break;
+        }
+        if (s_stop) break;
+
+        now = now_ms();
+        if (fds[0].revents & POLLIN) accept_clients(listen_fd);
+        if (fds[1].revents & POLLIN) http_async_service();
+        size_t idx = 2;
+        for (size_t i = 0; i < s_clients.size(); idx++) {
+            Client& c = s_clients[i];
+            bool keep = true;
+            if (idx < fds.size() && fds[idx].fd == c.fd && fds[idx].revents) keep = read_client(&c);
+            if (keep && now - c.since_ms > CLIENT_TIMEOUT_MS) keep = false;
+            if (keep) {
+                i++;
+            } else {
+                close(c.fd);
+                s_clients.erase(s_clients.begin() + i);
+            }
+        }
+        for (size_t i = 0; i < tmux_fds.size(); i++) {
+            size_t k = fds.size() - tmux_fds.size() + i;
+            if (fds[k].revents) tmux_control_service(fds[k].fd);
+        }
+
+        for (auto it = s_panes.begin(); it != s_panes.end();) {
+            Pane& p = it->second;
+            if (p.detecting && !p.sending && now_ms() >= p.next_detect_ms) detect_tick(p, now_ms());
+            if (p.polling && !p.fetching && now_ms() >= p.next_poll_ms) poll_tick(p, now_ms());
+            if (!p.detecting && !p.polling && !p.sending) {
+                LOGD(TAG, "%s: idle", p.sub.target.c_str());
+                unwatch_pane(p);
+                it = s_panes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        http_close_idle(HTTP_IDLE_CLOSE_MS);
+
+        now = now_ms();
+        // 送りっぱなしのキャンセル・通知も届けてから終わる
+        if (!s_panes.empty() || !s_clients.empty() || http_async_pending() > 0) {
+            idle_since = now;
+        } else if (idle_exit_sec > 0 && now - idle_since >= (int64_t)idle_exit_sec * 1000) {
+            LOGI(TAG, "idle for %d s, exiting", idle_exit_sec);
+            break;
+        }
+    }
+
+    for (const Client& c : s_clients) close(c.fd);
+    s_clients.clear();
+    tmux_control_close_all();
+    http_async_stop();
+    http_close_all();
+    unlink(socket_path.c_str());
+    close(listen_fd);
+    close(lock_fd);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// 常駐デーモン本体
+//
+// permission-request.sh のバックグラウンドループ (検出 → 送信 → 応答ポーリング → send-keys)
+// を 1 プロセスにまとめ、全ペインの処理を 1 本のイベントループで回す。
+// ペインごとの状態 (旧 WATCHER / POLLER / SKIP ファイル) はメモリ上に持ち、
+// サーバとは keep-alive 接続、tmux とは制御モード接続を使い回す
+
+// idle_exit_sec: 処理中のペインがない状態がこの秒数続いたら終了する (0 = 終了しない)
+// 戻り値: プロセスの終了コード
+int relayd_run(const std::string& socket_path, int idle_exit_sec);
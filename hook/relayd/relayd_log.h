@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdio>
+#include <ctime>
+
+// デーモンのログ (stderr)。自動起動時は PROMPT_RELAY_DAEMON_LOG のファイルか /dev/null に向く
+// ESP32 版の ESP_LOGx と同じく "レベル (時刻) タグ: 本文" の 1 行で出す
+
+extern bool g_relayd_verbose;
+
+#define RELAYD_LOG(level, tag, fmt, ...) do { \
+    time_t _t = time(nullptr); \
+    struct tm _tm; \
+    localtime_r(&_t, &_tm); \
+    fprintf(stderr, "%c (%02d:%02d:%02d) %s: " fmt "\n", level, \
+            _tm.tm_hour, _tm.tm_min, _tm.tm_sec, tag, ##__VA_ARGS__); \
+} while (0)
+
+#define LOGE(tag, fmt, ...) RELAYD_LOG('E', tag, fmt, ##__VA_ARGS__)
+#define LOGW(tag, fmt, ...) RELAYD_LOG('W', tag, fmt, ##__VA_ARGS__)
+#define LOGI(tag, fmt, ...) RELAYD_LOG('I', tag, fmt, ##__VA_ARGS__)
+#define LOGD(tag, fmt, ...) do { if (g_relayd_verbose) RELAYD_LOG('D', tag, fmt, ##__VA_ARGS__); } while (0)
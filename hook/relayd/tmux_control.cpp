@@ -0,0 +1,325 @@
+#include "tmux_control.h"
+#include "relayd_log.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define COMMAND_TIMEOUT_MS 2000
+
+static const char* TAG = "tmux";
+
+struct TmuxControl {
+    std::string socket_path;
+    std::string session;
+    pid_t pid = -1;
+    int in_fd = -1;             // tmux の stdin (コマンドを書く)
+    int out_fd = -1;            // tmux の stdout (応答ブロックと通知を読む)
+    std::string rbuf;
+
+    bool legacy_attach = false; // attach-session -f 未対応 (tmux 3.2 未満、%output は常に流れる)
+    bool confirmed = false;     // この起動方法でコマンドが通ったか
+    bool attached = false;      // %session-changed を受け取った (refresh-client はこれ以降でないと通らない)
+
+    // %begin 〜 %end / %error の解析状態
+    bool in_block = false;
+    bool block_ours = false;    // flags & 1: このクライアントが送ったコマンドの応答
+    std::string block_id;       // "%begin" の後ろの "時刻 番号"
+    std::string block_out;
+    std::string attach_error;   // アタッチ自体の %error (flags 0) の内容
+
+    // 送ったコマンド数と完了した応答数 (応答は送った順に返る)
+    uint64_t issued = 0;
+    uint64_t completed = 0;
+    bool last_ok = false;
+    std::string last_out;
+
+    std::map<std::string, int> watched;     // %output を購読中のペイン ID と watch の回数
+};
+
+static std::map<std::string, TmuxControl*> s_controls;   // キー: ソケットパス + "\n" + セッション名
+static TmuxOutputHandler s_output_handler = nullptr;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+std::string tmux_quote(const std::string& s) {
+    return "'" + s + "'";
+}
+
+static bool is_alive(const TmuxControl* tc) {
+    return tc->pid > 0;
+}
+
+static void stop(TmuxControl* tc) {
+    if (tc->in_fd >= 0) close(tc->in_fd);
+    if (tc->out_fd >= 0) close(tc->out_fd);
+    tc->in_fd = tc->out_fd = -1;
+    if (tc->pid > 0) {
+        kill(tc->pid, SIGTERM);
+        waitpid(tc->pid, nullptr, 0);
+    }
+    tc->pid = -1;
+    tc->rbuf.clear();
+    tc->in_block = false;
+    tc->attached = false;
+    tc->issued = tc->completed = 0;
+}
+
+static bool start(TmuxControl* tc) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) < 0) return false;
+    if (pipe(from_child) < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+
+    // argv は fork 前に組み立てる
+    std::string target = "=" + tc->session;
+    std::vector<const char*> argv = { "tmux" };
+    if (!tc->socket_path.empty()) {
+        argv.push_back("-S");
+        argv.push_back(tc->socket_path.c_str());
+    }
+    argv.push_back("-C");
+    argv.push_back("attach-session");
+    argv.push_back("-t");
+    argv.push_back(target.c_str());
+    if (!tc->legacy_attach) {
+        // 制御クライアントのサイズでウィンドウを縮めない / 購読がなければ %output を流さない
+        argv.push_back("-f");
+        argv.push_back(tc->watched.empty() ? "ignore-size,no-output" : "ignore-size");
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(to_child[0]); close(to_child[1]);
+        close(from_child[0]); close(from_child[1]);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDERR_FILENO);
+        for (int fd = 3; fd < 1024; fd++) close(fd);
+        // 入れ子チェック (sessions should be nested with care) に掛からないように
+        unsetenv("TMUX");
+        execvp("tmux", (char* const*)argv.data());
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    fcntl(to_child[1], F_SETFD, FD_CLOEXEC);
+    fcntl(from_child[0], F_SETFD, FD_CLOEXEC);
+    tc->pid = pid;
+    tc->in_fd = to_child[1];
+    tc->out_fd = from_child[0];
+    tc->attach_error.clear();
+    LOGI(TAG, "control client started (pid %d, session %s%s)", (int)pid, tc->session.c_str(),
+         tc->legacy_attach ? ", legacy attach" : "");
+    return true;
+}
+
+// 1 行を解釈する。戻り値: false = 制御クライアントが終了した
+static bool handle_line(TmuxControl* tc, const std::string& line) {
+    if (tc->in_block) {
+        // 出力中に同じ形の行が紛れても誤認しないよう、%begin と同じ "時刻 番号" を確認する
+        bool is_end = line.compare(0, 5, "%end ") == 0;
+        bool is_error = line.compare(0, 7, "%error ") == 0;
+        if ((is_end || is_error) &&
+            line.compare(is_end ? 5 : 7, tc->block_id.size(), tc->block_id) == 0) {
+            tc->in_block = false;
+            if (tc->block_ours) {
+                tc->completed++;
+                tc->last_ok = is_end;
+                tc->last_out.swap(tc->block_out);
+            } else if (is_error) {
+                tc->attach_error = tc->block_out;
+            }
+            tc->block_out.clear();
+            return true;
+        }
+        if (!tc->block_out.empty()) tc->block_out.push_back('\n');
+        tc->block_out += line;
+        return true;
+    }
+
+    if (line.compare(0, 7, "%begin ") == 0) {
+        // %begin <時刻> <番号> <flags>
+        size_t sp = line.rfind(' ');
+        tc->in_block = true;
+        tc->block_id = line.substr(7, sp - 7);
+        tc->block_ours = (atoi(line.c_str() + sp + 1) & 1) != 0;
+        tc->block_out.clear();
+        return true;
+    }
+    if (line.compare(0, 8, "%output ") == 0) {
+        // %output %<ペイン ID> <出力 (8 進エスケープ)>
+        // 画面の再構成は tmux に任せ、どのペインが変化したかだけを使う
+        size_t sp = line.find(' ', 8);
+        std::string pane_id = line.substr(8, sp == std::string::npos ? std::string::npos : sp - 8);
+        if (s_output_handler && tc->watched.count(pane_id)) s_output_handler(tc, pane_id);
+        return true;
+    }
+    if (line.compare(0, 17, "%session-changed ") == 0) {
+        tc->attached = true;
+        return true;
+    }
+    if (line == "%exit" || line.compare(0, 6, "%exit ") == 0) {
+        return false;
+    }
+    // その他の通知 (%session-changed など) は使わない
+    return true;
+}
+
+// 読めるだけ読んで行ごとに処理する。timeout_ms 待っても何も来なければ戻る
+// 戻り値: false = 制御クライアントが終了した
+static bool pump(TmuxControl* tc, int timeout_ms) {
+    struct pollfd pfd = { tc->out_fd, POLLIN, 0 };
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) return errno == EINTR;
+    if (rc == 0) return true;
+
+    char buf[8192];
+    ssize_t n = read(tc->out_fd, buf, sizeof(buf));
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+    tc->rbuf.append(buf, n);
+
+    size_t start = 0;
+    size_t nl;
+    bool alive = true;
+    while ((nl = tc->rbuf.find('\n', start)) != std::string::npos) {
+        if (!handle_line(tc, tc->rbuf.substr(start, nl - start))) alive = false;
+        start = nl + 1;
+    }
+    tc->rbuf.erase(0, start);
+    return alive;
+}
+
+TmuxControl* tmux_control_get(const std::string& socket_path, const std::string& session) {
+    TmuxControl*& tc = s_controls[socket_path + "\n" + session];
+    if (!tc) {
+        tc = new TmuxControl();
+        tc->socket_path = socket_path;
+        tc->session = session;
+    }
+    return tc;
+}
+
+bool tmux_command(TmuxControl* tc, const std::string& command, std::string* out) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!is_alive(tc) && !start(tc)) return false;
+
+        uint64_t mine = tc->issued++;
+        std::string line = command + "\n";
+        bool alive = write(tc->in_fd, line.data(), line.size()) == (ssize_t)line.size();
+
+        int64_t deadline = now_ms() + COMMAND_TIMEOUT_MS;
+        while (alive && tc->completed <= mine) {
+            int64_t left = deadline - now_ms();
+            if (left <= 0) {
+                LOGW(TAG, "command timed out: %s", command.c_str());
+                stop(tc);
+                return false;
+            }
+            alive = pump(tc, (int)left);
+        }
+
+        if (tc->completed > mine) {
+            tc->confirmed = true;
+            if (out) {
+                out->swap(tc->last_out);
+                // bash の $(...) と同じく末尾の空行を落とす
+                while (!out->empty() && out->back() == '\n') out->pop_back();
+            }
+            return tc->last_ok;
+        }
+
+        // 応答の前に終了した。tmux 3.2 未満で attach-session -f が通らなかった場合は付けずにやり直す
+        std::string err = tc->attach_error;
+        stop(tc);
+        LOGW(TAG, "control client exited: %s", err.empty() ? "(no message)" : err.c_str());
+        bool flag_rejected = err.find("usage") != std::string::npos ||
+                             err.find("unknown flag") != std::string::npos ||
+                             err.find("unknown option") != std::string::npos;
+        if (tc->confirmed || tc->legacy_attach || !flag_rejected) return false;
+        tc->legacy_attach = true;
+    }
+    return false;
+}
+
+// refresh-client はアタッチが終わる前に送ると "no current client" になる
+static bool wait_attached(TmuxControl* tc) {
+    int64_t deadline = now_ms() + COMMAND_TIMEOUT_MS;
+    while (!tc->attached) {
+        int64_t left = deadline - now_ms();
+        if (left <= 0 || !pump(tc, (int)left)) return false;
+    }
+    return true;
+}
+
+bool tmux_control_watch(TmuxControl* tc, const std::string& pane_id) {
+    if (tc->watched[pane_id]++ > 0 || tc->watched.size() > 1) return true;
+    // 未起動なら起動時に no-output を付けない。tmux 3.2 未満はもともと流れている
+    if (!is_alive(tc) || tc->legacy_attach) return true;
+    if (wait_attached(tc) &&
+        tmux_command(tc, "refresh-client -f " + tmux_quote("!no-output"), nullptr)) {
+        return true;
+    }
+    tc->watched.erase(pane_id);
+    return false;
+}
+
+void tmux_control_unwatch(TmuxControl* tc, const std::string& pane_id) {
+    auto it = tc->watched.find(pane_id);
+    if (it == tc->watched.end() || --it->second > 0) return;
+    tc->watched.erase(it);
+    if (tc->watched.empty() && is_alive(tc) && !tc->legacy_attach && tc->attached) {
+        tmux_command(tc, "refresh-client -f no-output", nullptr);
+    }
+}
+
+void tmux_control_set_output_handler(TmuxOutputHandler handler) {
+    s_output_handler = handler;
+}
+
+void tmux_control_fds(std::vector<int>* fds) {
+    for (auto& kv : s_controls) {
+        if (is_alive(kv.second)) fds->push_back(kv.second->out_fd);
+    }
+}
+
+void tmux_control_service(int fd) {
+    for (auto& kv : s_controls) {
+        TmuxControl* tc = kv.second;
+        if (tc->out_fd != fd) continue;
+        if (!pump(tc, 0)) {
+            LOGI(TAG, "control client for session %s exited", tc->session.c_str());
+            stop(tc);
+        }
+        return;
+    }
+}
+
+void tmux_control_close_all(void) {
+    for (auto& kv : s_controls) {
+        stop(kv.second);
+        delete kv.second;
+    }
+    s_controls.clear();
+}
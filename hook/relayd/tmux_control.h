@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// tmux の制御モード (tmux -C) クライアント
+// tmux サーバ (ソケット) とセッションの組ごとに 1 本だけ張り、capture-pane / send-keys を
+// プロセスを起動せずに実行する。ignore-size を付けるのでウィンドウサイズには影響しない。
+// %output はアタッチしたセッションのペインの分しか届かないため、セッションごとに分けている
+
+struct TmuxControl;
+
+// socket_path: $TMUX の先頭 (空なら既定のソケット)
+// session: アタッチ先のセッション名
+TmuxControl* tmux_control_get(const std::string& socket_path, const std::string& session);
+
+// コマンドを 1 つ実行して出力を返す (行を '\n' で連結、末尾の空行は除く)
+// 戻り値: false = エラー応答 (%error) または接続断・タイムアウト
+bool tmux_command(TmuxControl* tc, const std::string& command, std::string* out);
+
+// tmux のコマンド引数用にシングルクォートで囲む (' を含む文字列は呼び出し側で弾く)
+std::string tmux_quote(const std::string& s);
+
+// %output の購読 (pane_id は "%12" の形式)
+// 購読中のペインがある間だけ no-output を外す (購読がなければ端末出力は流れてこない)
+// 同じペインを複数回 watch した場合は同じ回数 unwatch するまで購読を続ける
+// 戻り値: false = 制御クライアントを起動できない
+bool tmux_control_watch(TmuxControl* tc, const std::string& pane_id);
+void tmux_control_unwatch(TmuxControl* tc, const std::string& pane_id);
+
+// 購読中のペインに出力があったときに呼ばれる (同じ変化で何度も呼ばれうる)
+// tmux_command() の応答待ちの途中でも呼ばれるので、ハンドラ内で tmux_command() は使わない
+typedef void (*TmuxOutputHandler)(TmuxControl* tc, const std::string& pane_id);
+void tmux_control_set_output_handler(TmuxOutputHandler handler);
+
+// メインループ用: 読み取り待ちにする fd と、読めるようになったときの処理 (%output の振り分け)
+void tmux_control_fds(std::vector<int>* fds);
+void tmux_control_service(int fd);
+
+void tmux_control_close_all(void);
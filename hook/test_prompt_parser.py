@@ -1,8 +1,39 @@
-"""prompt_parser のテスト"""
+"""prompt_parser のテスト
+
+PROMPT_RELAYD_BIN にネイティブ版 (hook/relayd の prompt-relayd) を指定すると、
+同じテストケースを prompt-relayd の detect / parse / response サブコマンドに対して実行する。
+detect のケースは差分検出 (detect --incremental) でも同じ結果になることを確認する。
+"""
 
 import json
+import os
+import subprocess
 import pytest
-from prompt_parser import detect_prompt, parse_pane, parse_response
+
+RELAYD_BIN = os.environ.get('PROMPT_RELAYD_BIN')
+
+if RELAYD_BIN:
+    def _relayd(*args):
+        return subprocess.run([RELAYD_BIN, *args], capture_output=True, text=True, check=True).stdout.strip()
+
+    def detect_prompt(pane_text):
+        result = _relayd('detect', pane_text)
+        # 行キャッシュを通した判定も途中の画面を含めて一致すること (不一致なら終了コード 1)
+        assert _relayd('detect', '--incremental', pane_text) == result
+        return result == 'yes'
+
+    def parse_pane(stdin_data, pane_data, tmux_target=None, hostname=None, timeout=None):
+        args = ['parse', stdin_data, pane_data]
+        for opt in (tmux_target, hostname, timeout):
+            if opt is None:
+                break
+            args.append(str(opt))
+        return json.loads(_relayd(*args))
+
+    def parse_response(response_json):
+        return _relayd('response', response_json or '')
+else:
+    from prompt_parser import detect_prompt, parse_pane, parse_response
 
 
 # ============================================================
@@ -0,0 +1,184 @@
+// 詳細 (tool_input の全文) の圧縮と 1 ページの展開
+// 引数はフックが実際に送ってくる形のボディ (Bash の短いコマンド・ヒアドキュメントのスクリプト、
+// Edit の差し替え、Write の新規ファイル、MultiEdit)。Edit / Write の中身はファームウェアのソースから取る
+//
+// カウンタ: raw = 詳細の平文、stored = 圧縮後 (ページの頭を含む)、
+// pool = 実際に使うプール (ブロック単位の切り上げと連結リストを含む)、ratio = raw / pool
+
+#include "bench_fixtures.h"
+#include "request_detail.h"
+#include "request_parse.h"
+
+#include <benchmark/benchmark.h>
+#include <cJSON.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static const char* const PAYLOADS[] = { "bash", "script", "edit", "write", "multiedit" };
+
+static std::string read_source(const char* name, size_t offset, size_t len) {
+    std::ifstream in(std::string(BENCH_FIRMWARE_DIR) + "/" + name);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string s = ss.str();
+    if (offset >= s.size()) return s;
+    return s.substr(offset, len);
+}
+
+static const char* const SCRIPT =
+    "set -euo pipefail\n"
+    "cd /home/user/src/prompt-relay/server-esp32\n"
+    "for board in M5STACK_BASIC M5STACK_CORE2 M5STICKC_PLUS; do\n"
+    "  build=\"build-bench-${board,,}\"\n"
+    "  cmake -S bench -B \"$build\" -DCMAKE_BUILD_TYPE=Release -DBENCH_BOARD=\"$board\" \\\n"
+    "        -DBENCH_DISPLAY=ON > \"$build.configure.log\" 2>&1\n"
+    "  cmake --build \"$build\" -j\"$(nproc)\" 2>&1 | tee \"$build.log\" | grep -E '(error|warning):' || true\n"
+    "  \"./$build/prompt_relay_bench\" --benchmark_filter='BM_(Detail|Route|Parse)' \\\n"
+    "      --benchmark_out=\"$build/bench.json\" --benchmark_out_format=json\n"
+    "  python3 - \"$build/bench.json\" <<'EOF'\n"
+    "import json, sys\n"
+    "data = json.load(open(sys.argv[1]))\n"
+    "for b in data['benchmarks']:\n"
+    "    name = b['name']\n"
+    "    ratio = b.get('ratio')\n"
+    "    print(f\"{name:48s} {b['real_time']:10.1f} {b['time_unit']}\" + (f\"  x{ratio:.2f}\" if ratio else ''))\n"
+    "EOF\n"
+    "  for scenario in idle request notify switch; do\n"
+    "    \"./$build/prompt_relay_display\" --out \"$build/png\" \"$scenario\" | tail -n 3\n"
+    "  done\n"
+    "done\n"
+    "git status --short && git diff --stat -- main/ bench/ ../docs/\n";
+
+// フックの JSON ボディ (prompt_parser.py が組み立てる形)
+static std::string make_body(int kind) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* input = cJSON_CreateObject();
+    const char* tool = "Bash";
+    switch (kind) {
+        case 0:
+            cJSON_AddStringToObject(input, "command", BENCH_MESSAGE);
+            cJSON_AddStringToObject(input, "description", "Build firmware and count warnings");
+            break;
+        case 1:
+            cJSON_AddStringToObject(input, "command", SCRIPT);
+            cJSON_AddStringToObject(input, "description", "Run host benchmarks for every board");
+            cJSON_AddNumberToObject(input, "timeout", 600000);
+            break;
+        case 2: {
+            tool = "Edit";
+            std::string old_string = read_source("request_store.cpp", 4000, 1800);
+            std::string new_string = old_string;
+            size_t at = new_string.find("StoreLock lock;");
+            if (at != std::string::npos) new_string.insert(at, "// 詳細も同じロックで解放する\n    ");
+            cJSON_AddStringToObject(input, "file_path", "/home/user/src/prompt-relay/server-esp32/main/request_store.cpp");
+            cJSON_AddStringToObject(input, "old_string", old_string.c_str());
+            cJSON_AddStringToObject(input, "new_string", new_string.c_str());
+            cJSON_AddBoolToObject(input, "replace_all", false);
+            break;
+        }
+        case 3: {
+            tool = "Write";
+            std::string content = read_source("http_server.cpp", 0, 6000);
+            cJSON_AddStringToObject(input, "file_path", "/home/user/src/prompt-relay/server-esp32/main/http_server.cpp");
+            cJSON_AddStringToObject(input, "content", content.c_str());
+            break;
+        }
+        default: {
+            tool = "MultiEdit";
+            cJSON_AddStringToObject(input, "file_path", "/home/user/src/prompt-relay/server-esp32/main/display_manager.cpp");
+            cJSON* edits = cJSON_AddArrayToObject(input, "edits");
+            for (int i = 0; i < 3; i++) {
+                std::string old_string = read_source("display_manager.cpp", 6000 + i * 3000, 600);
+                cJSON* e = cJSON_CreateObject();
+                cJSON_AddStringToObject(e, "old_string", old_string.c_str());
+                cJSON_AddStringToObject(e, "new_string", (old_string + "\n    // TODO").c_str());
+                cJSON_AddItemToArray(edits, e);
+            }
+            break;
+        }
+    }
+    cJSON_AddStringToObject(root, "tool_name", tool);
+    cJSON_AddStringToObject(root, "message", "Claude needs your permission");
+    cJSON_AddStringToObject(root, "prompt_question", "Do you want to proceed?");
+    cJSON_AddItemToObject(root, "tool_input", input);
+    cJSON_AddStringToObject(root, "hostname", "bench-host");
+    char* s = cJSON_PrintUnformatted(root);
+    std::string body(s);
+    cJSON_free(s);
+    cJSON_Delete(root);
+    return body;
+}
+
+static DetailWriter s_writer;
+
+// 解析済みのツリーから詳細を書き出して確定する (作成ハンドラと同じ順)
+static void store_detail(const cJSON* root, const char* id) {
+    CreateFields f = {};
+    request_detail_begin(&s_writer);
+    parse_create_json(root, &f, &s_writer);
+    build_detail_context(&f, &s_writer);
+    request_detail_commit(&s_writer, id);
+}
+
+static void set_counters(benchmark::State& state, const char* id, size_t body_len) {
+    DetailInfo info = {};
+    request_detail_info(id, &info);
+    state.counters["body"] = (double)body_len;
+    state.counters["raw"] = info.raw_len;
+    state.counters["stored"] = info.stored_len;
+    state.counters["pool"] = info.pool_len;
+    state.counters["ratio"] = info.pool_len ? (double)info.raw_len / info.pool_len : 0;
+    state.counters["pages"] = info.pages;
+    if (info.truncated) state.SetLabel(std::string(PAYLOADS[state.range(0)]) + " (truncated)");
+    else state.SetLabel(PAYLOADS[state.range(0)]);
+}
+
+// ── 書き出し + ページごとの圧縮 + プールへの格納 (作成時に 1 回) ──
+static void BM_DetailStore(benchmark::State& state) {
+    request_detail_init();
+    std::string body = make_body(state.range(0));
+    cJSON* root = cJSON_Parse(body.c_str());
+    const char* id = "3f2b8c1e-7a4d-4e6f-9b0a-1c2d3e4f5a6b";
+    for (auto _ : state) {
+        store_detail(root, id);
+        state.PauseTiming();
+        request_detail_drop(id);
+        state.ResumeTiming();
+    }
+    store_detail(root, id);
+    set_counters(state, id, body.size());
+    DetailInfo info = {};
+    request_detail_info(id, &info);
+    state.SetBytesProcessed(state.iterations() * info.raw_len);
+    request_detail_drop(id);
+    cJSON_Delete(root);
+}
+BENCHMARK(BM_DetailStore)->DenseRange(0, 4);
+
+// ── 1 ページの展開 (画面で 1 ページ送るたび・GET .../detail の 1 ページごと) ──
+static void BM_DetailReadPage(benchmark::State& state) {
+    request_detail_init();
+    std::string body = make_body(state.range(0));
+    cJSON* root = cJSON_Parse(body.c_str());
+    const char* id = "3f2b8c1e-7a4d-4e6f-9b0a-1c2d3e4f5a6b";
+    store_detail(root, id);
+    DetailInfo info = {};
+    request_detail_info(id, &info);
+
+    static char out[DETAIL_READ_LEN];
+    int page = 0;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        int n = request_detail_read_page(id, page, out, sizeof(out));
+        benchmark::DoNotOptimize(n);
+        bytes += n;
+        if (++page >= info.pages) page = 0;
+    }
+    set_counters(state, id, body.size());
+    state.SetBytesProcessed(bytes);
+    request_detail_drop(id);
+    cJSON_Delete(root);
+}
+BENCHMARK(BM_DetailReadPage)->DenseRange(0, 4);
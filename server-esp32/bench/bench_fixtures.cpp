@@ -0,0 +1,56 @@
+#include "bench_fixtures.h"
+#include "host_shim.h"
+
+#include <cstdio>
+#include <cstring>
+
+const char* const BENCH_MESSAGE =
+    "cd /home/user/src/prompt-relay/server-esp32 && idf.py build 2>&1 | tee build.log | "
+    "grep -E '(error|warning):' | sort | uniq -c | sort -rn | head -n 40";
+
+const Choice BENCH_CHOICES[] = {
+    { 1, "Yes" },
+    { 2, "Yes, and don't ask again" },
+    { 3, "No, and tell Claude what to do" },
+};
+const int BENCH_CHOICE_COUNT = sizeof(BENCH_CHOICES) / sizeof(BENCH_CHOICES[0]);
+
+static char s_ids[MAX_REQUESTS][UUID_STR_LEN];
+static const char* s_id_ptrs[MAX_REQUESTS];
+static int64_t s_now_us = 0;
+
+void advance_clock_ms(int ms) {
+    s_now_us += (int64_t)ms * 1000;
+    host_set_time_us(s_now_us);
+}
+
+int fill_store(int n) {
+    if (n > MAX_REQUESTS) n = MAX_REQUESTS;
+    // 期限切れ・自動削除が起きないよう、起動直後の時刻から始める
+    s_now_us = 1000 * 1000;
+    host_set_time_us(s_now_us);
+    request_store_init();
+
+    for (int i = 0; i < n; i++) {
+        char target[32];
+        snprintf(target, sizeof(target), "bench:fill.%d", i);
+        advance_clock_ms(1);
+        PermissionRequest* r = request_store_create(
+            "Bash", BENCH_MESSAGE, "Bash", BENCH_CHOICES, BENCH_CHOICE_COUNT,
+            target, bench_host(i), 0);
+        strcpy(s_ids[i], r->id);
+        s_id_ptrs[i] = s_ids[i];
+    }
+    return n;
+}
+
+const char* bench_host(int index) {
+    // 1 ホストの未応答の上限 (MAX_PENDING_PER_HOST) ごとにホストを変える
+    static const char* const HOSTS[] = { "bench-host", "build-01", "build-02", "build-03" };
+    static_assert(MAX_REQUESTS <= MAX_PENDING_PER_HOST * 4, "not enough bench hosts to fill the store");
+    return HOSTS[index / MAX_PENDING_PER_HOST];
+}
+
+const char* const* bench_ids(void) {
+    return s_id_ptrs;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "request_store.h"
+
+// ベンチマーク共通の入力データ
+// フックが実際に送ってくる大きさに合わせてある (Bash の 3 択 + 数百バイトのコマンド)
+
+extern const char* const BENCH_MESSAGE;
+extern const Choice BENCH_CHOICES[];
+extern const int BENCH_CHOICE_COUNT;
+
+// ストアを初期化して n 件のリクエストを作る (tmux ペインはすべて別)
+// 戻り値: 作成数。ID は bench_ids() で取得
+int fill_store(int n);
+const char* const* bench_ids(void);
+
+// index 件目のリクエストのホスト名 (1 ホストの未応答の上限を超えないように分ける)
+const char* bench_host(int index);
+
+// 仮想時計を進める (created_at の順序を作るため)
+void advance_clock_ms(int ms);
@@ -0,0 +1,75 @@
+// 自動判断ポリシーの照合 (DFA の表引き) とコンパイル
+// 引数はルール数。照合の時間がルール数によらず入力長だけで決まることを確かめる
+// 照合は lookups (行き止まりまでに表を引いた回数) と bytes_per_second で比べる。
+// 入力が同じでも、どこまで読めるかはルールセットの形で変わる
+
+#include "bench_fixtures.h"
+#include "policy_rules.h"
+
+#include <benchmark/benchmark.h>
+
+static void rule_args(benchmark::internal::Benchmark* b) {
+    for (int n = 1; n <= POLICY_MAX_RULES; n *= 2) b->Arg(n);
+}
+
+static void BM_PolicyCompile(benchmark::State& state) {
+    RuleSet set;
+    make_rules(state.range(0), &set);
+    for (auto _ : state) {
+        PolicyAutomaton a;
+        char err[96];
+        bool ok = policy_automaton_compile(set.rules.data(), (int)set.rules.size(), &a, err, sizeof(err));
+        if (!ok) {
+            state.SkipWithError(err);
+            break;
+        }
+        state.counters["states"] = a.state_count;
+        state.counters["bytes"] = (double)policy_automaton_bytes(&a);
+        policy_automaton_free(&a);
+    }
+}
+BENCHMARK(BM_PolicyCompile)->Apply(rule_args);
+
+// どのルールにも一致しない Bash コマンド (コマンドの先頭で行き止まりになる)
+static void BM_PolicyMatchMiss(benchmark::State& state) {
+    RuleSet set;
+    make_rules(state.range(0), &set);
+    PolicyAutomaton a;
+    char err[96];
+    if (!policy_automaton_compile(set.rules.data(), (int)set.rules.size(), &a, err, sizeof(err))) {
+        state.SkipWithError(err);
+        return;
+    }
+    const char* fields[PF_COUNT] = { "bench-host", "Bash", BENCH_MESSAGE, nullptr };
+    int lookups = policy_lookups(&a, fields);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(policy_automaton_match(&a, fields));
+    }
+    state.counters["lookups"] = lookups;
+    state.SetBytesProcessed((int64_t)state.iterations() * lookups);
+    policy_automaton_free(&a);
+}
+BENCHMARK(BM_PolicyMatchMiss)->Apply(rule_args);
+
+// Edit のパスに一致するケース。ルール 1, 2 本ではパスのルールがないので 'E' で行き止まりになり
+// (12 回)、4 本以上ではパスの末尾まで読む (68 回)。所要時間の差は表を引く回数の差
+static void BM_PolicyMatchPath(benchmark::State& state) {
+    RuleSet set;
+    make_rules(state.range(0), &set);
+    PolicyAutomaton a;
+    char err[96];
+    if (!policy_automaton_compile(set.rules.data(), (int)set.rules.size(), &a, err, sizeof(err))) {
+        state.SkipWithError(err);
+        return;
+    }
+    const char* fields[PF_COUNT] = {
+        "bench-host", "Edit", nullptr, "/home/user/src/project1/server-esp32/main/policy.cpp" };
+    int lookups = policy_lookups(&a, fields);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(policy_automaton_match(&a, fields));
+    }
+    state.counters["lookups"] = lookups;
+    state.SetBytesProcessed((int64_t)state.iterations() * lookups);
+    policy_automaton_free(&a);
+}
+BENCHMARK(BM_PolicyMatchPath)->Apply(rule_args);
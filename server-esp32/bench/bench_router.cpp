@@ -0,0 +1,76 @@
+// URI ルーターの照合
+// 引数は本番のルートに足したルート数。照合の時間がルート数によらずパス長だけで決まることを確かめる
+
+#include "http_router.h"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+// http_server.cpp の ROUTES と同じパターン
+static const RoutePattern FIRMWARE_ROUTES[] = {
+    { ROUTE_GET,  "/health" },
+    { ROUTE_POST, "/permission-request" },
+    { ROUTE_GET,  "/permission-requests" },
+    { ROUTE_GET,  "/permission-request/:id/response" },
+    { ROUTE_POST, "/permission-request/:id/respond" },
+    { ROUTE_POST, "/permission-request/:id/cancel" },
+    { ROUTE_POST, "/notify" },
+    { ROUTE_GET,  "/stats" },
+    { ROUTE_GET,  "/logs" },
+    { ROUTE_GET,  "/history" },
+    { ROUTE_GET,  "/policy" },
+    { ROUTE_PUT,  "/policy" },
+    { ROUTE_GET,  "/*" },
+};
+
+static void route_args(benchmark::internal::Benchmark* b) {
+    for (int n : { 0, 4, 8, 16 }) b->Arg(n);
+}
+
+// 本番のルートに /extra-N と /permission-request/:id/extra-N を足して組み立てる
+static void build_routes(int extra, std::vector<std::string>* paths) {
+    std::vector<RoutePattern> routes(std::begin(FIRMWARE_ROUTES), std::end(FIRMWARE_ROUTES));
+    paths->clear();
+    paths->reserve(extra);
+    for (int i = 0; i < extra; i++) {
+        paths->push_back(i % 2 ? "/extra-" + std::to_string(i)
+                               : "/permission-request/:id/extra-" + std::to_string(i));
+        routes.push_back({ ROUTE_GET, paths->back().c_str() });
+    }
+    http_router_build(routes.data(), (int)routes.size());
+}
+
+static void match_uri(benchmark::State& state, RouteMethod method, const char* uri) {
+    std::vector<std::string> paths;
+    build_routes(state.range(0), &paths);
+    int route = -1;
+    RouteParams params;
+    for (auto _ : state) {
+        RouteResult r = http_router_match(method, uri, &route, &params);
+        benchmark::DoNotOptimize(r);
+        benchmark::DoNotOptimize(route);
+    }
+}
+
+// フックのポーリング (最も頻繁に来る)
+static void BM_RouteResponse(benchmark::State& state) {
+    match_uri(state, ROUTE_GET, "/permission-request/3f2b8c1e-7a4d-4e6f-9b0a-1c2d3e4f5a6b/response");
+}
+BENCHMARK(BM_RouteResponse)->Apply(route_args);
+
+static void BM_RouteRespond(benchmark::State& state) {
+    match_uri(state, ROUTE_POST, "/permission-request/3f2b8c1e-7a4d-4e6f-9b0a-1c2d3e4f5a6b/respond");
+}
+BENCHMARK(BM_RouteRespond)->Apply(route_args);
+
+static void BM_RouteStats(benchmark::State& state) {
+    match_uri(state, ROUTE_GET, "/stats");
+}
+BENCHMARK(BM_RouteStats)->Apply(route_args);
+
+// どのルートにも一致せず静的ファイルのキャッチオールに落ちる
+static void BM_RouteStatic(benchmark::State& state) {
+    match_uri(state, ROUTE_GET, "/assets/app.js?v=0123abcd");
+}
+BENCHMARK(BM_RouteStatic)->Apply(route_args);
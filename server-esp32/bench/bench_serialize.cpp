@@ -0,0 +1,300 @@
+// POST /permission-request のボディ解析・detailText 構築と、一覧・ポーリング応答のシリアライズ
+// 一覧系の引数はストアに入っているリクエスト数、解析系の引数は message のバイト数、ポーリングは 0 = 未応答 / 1 = 応答済み
+// JSON と CBOR は同じ内容で、wire_bytes が 1 回あたりの本文の大きさ
+
+#include "bench_fixtures.h"
+#include "request_store.h"
+#include "request_json.h"
+#include "request_parse.h"
+#include "cbor.h"
+
+#include <benchmark/benchmark.h>
+#include <cJSON.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define MAX_BODY_LEN Board::MAX_BODY_LEN    // http_server.cpp と同じ
+
+static void store_args(benchmark::internal::Benchmark* b) {
+    for (int n = 1; n <= MAX_REQUESTS; n *= 2) b->Arg(n);
+}
+
+static void body_args(benchmark::internal::Benchmark* b) {
+    b->Arg(64)->Arg(512)->Arg(1536);
+}
+
+// フックが送るものと同じ構成の JSON ボディ
+static std::string make_json_body(size_t message_len) {
+    std::string message(message_len, 'x');
+    return std::string("{\"tool_name\":\"Bash\",\"message\":\"") + message + "\","
+        "\"header\":\"Bash command\",\"prompt_question\":\"Do you want to proceed?\","
+        "\"tool_input\":{\"command\":\"" + message + "\",\"description\":\"Build firmware\"},"
+        "\"choices\":[{\"number\":1,\"text\":\"Yes\"},"
+        "{\"number\":2,\"text\":\"Yes, and don't ask again\"},"
+        "{\"number\":3,\"text\":\"No, and tell Claude what to do\"}],"
+        "\"tmux_target\":\"dev:1.0\",\"has_tmux\":true,\"hostname\":\"bench-host\",\"timeout\":120}";
+}
+
+static std::vector<uint8_t> make_cbor_body(size_t message_len) {
+    std::string message(message_len, 'x');
+    std::vector<uint8_t> buf(MAX_BODY_LEN * 2);
+    CborWriter w;
+    cbor_writer_init(&w, buf.data(), buf.size());
+    cbor_put_map(&w, 10);
+    cbor_put_uint(&w, CK_TOOL_NAME);
+    cbor_put_text(&w, "Bash");
+    cbor_put_uint(&w, CK_MESSAGE);
+    cbor_put_text(&w, message.c_str());
+    cbor_put_uint(&w, CK_HEADER);
+    cbor_put_text(&w, "Bash command");
+    cbor_put_uint(&w, CK_PROMPT_QUESTION);
+    cbor_put_text(&w, "Do you want to proceed?");
+    cbor_put_uint(&w, CK_TOOL_INPUT);
+    cbor_put_map(&w, 2);
+    cbor_put_uint(&w, CK_COMMAND);
+    cbor_put_text(&w, message.c_str());
+    cbor_put_uint(&w, CK_DESCRIPTION);
+    cbor_put_text(&w, "Build firmware");
+    cbor_put_uint(&w, CK_CHOICES);
+    cbor_put_array(&w, BENCH_CHOICE_COUNT);
+    for (int i = 0; i < BENCH_CHOICE_COUNT; i++) {
+        cbor_put_map(&w, 2);
+        cbor_put_uint(&w, CK_NUMBER);
+        cbor_put_uint(&w, BENCH_CHOICES[i].number);
+        cbor_put_uint(&w, CK_TEXT);
+        cbor_put_text(&w, BENCH_CHOICES[i].text);
+    }
+    cbor_put_uint(&w, CK_TMUX_TARGET);
+    cbor_put_text(&w, "dev:1.0");
+    cbor_put_uint(&w, CK_HAS_TMUX);
+    cbor_put_bool(&w, true);
+    cbor_put_uint(&w, CK_HOSTNAME);
+    cbor_put_text(&w, "bench-host");
+    cbor_put_uint(&w, CK_TIMEOUT);
+    cbor_put_uint(&w, 120);
+    buf.resize(w.len);
+    return buf;
+}
+
+// ── ボディ解析 (受信バッファへのコピーを含む。ハンドラの read_body 相当) ──
+
+static void BM_ParseCreateJson(benchmark::State& state) {
+    std::string body = make_json_body(state.range(0));
+    std::vector<char> buf(body.size() + 1);
+    for (auto _ : state) {
+        memcpy(buf.data(), body.c_str(), body.size() + 1);
+        cJSON* root = cJSON_Parse(buf.data());
+        CreateFields f = {};
+        parse_create_json(root, &f);
+        benchmark::DoNotOptimize(f);
+        cJSON_Delete(root);
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+    state.counters["wire_bytes"] = (double)body.size();
+}
+BENCHMARK(BM_ParseCreateJson)->Apply(body_args);
+
+static void BM_ParseCreateCbor(benchmark::State& state) {
+    std::vector<uint8_t> body = make_cbor_body(state.range(0));
+    std::vector<uint8_t> buf(body.size());
+    for (auto _ : state) {
+        // 解析は文字列をバッファ内で NUL 終端するので毎回コピーし直す
+        memcpy(buf.data(), body.data(), body.size());
+        CborReader r;
+        cbor_reader_init(&r, buf.data(), buf.size());
+        CreateFields f = {};
+        bool ok = parse_create_cbor(&r, &f);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(f);
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+    state.counters["wire_bytes"] = (double)body.size();
+}
+BENCHMARK(BM_ParseCreateCbor)->Apply(body_args);
+
+// ── detailText ──
+
+// 0 = description, 1 = command, 2 = file_path, 3 = message + prompt_question + 非 tmux 注記
+static void BM_DetailText(benchmark::State& state) {
+    static const char* const LABELS[] = { "description", "command", "file_path", "message" };
+    CreateFields f = {};
+    f.tool_name = "Bash";
+    switch (state.range(0)) {
+        case 0:
+            f.description = "Build the firmware and show the first forty warnings";
+            break;
+        case 1:
+            f.has_tool_input = true;
+            f.command = BENCH_MESSAGE;
+            break;
+        case 2:
+            f.has_tool_input = true;
+            f.file_path = "/home/user/src/prompt-relay/server-esp32/main/http_server.cpp";
+            break;
+        default:
+            f.message = BENCH_MESSAGE;
+            f.prompt_question = "Do you want to proceed?";
+            f.no_tmux = true;
+            break;
+    }
+    char out[512];
+    for (auto _ : state) {
+        build_detail_text(&f, "Bash", out, sizeof(out));
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetLabel(LABELS[state.range(0)]);
+}
+BENCHMARK(BM_DetailText)->DenseRange(0, 3);
+
+// ── 一覧のシリアライズ (GET /permission-requests と /ws の update) ──
+
+static void BM_ListToJson(benchmark::State& state) {
+    fill_store(state.range(0));
+    PermissionRequest* reqs[MAX_REQUESTS];
+    int count = request_store_get_all(reqs, MAX_REQUESTS);
+    size_t bytes = 0;
+    for (auto _ : state) {
+        cJSON* arr = request_list_to_json(reqs, count);
+        char* json = cJSON_PrintBuffered(arr, 256 + count * 1024, false);
+        bytes = strlen(json);
+        benchmark::DoNotOptimize(json);
+        cJSON_free(json);
+        cJSON_Delete(arr);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["wire_bytes"] = (double)bytes;
+}
+BENCHMARK(BM_ListToJson)->Apply(store_args);
+
+static void BM_ListToCbor(benchmark::State& state) {
+    fill_store(state.range(0));
+    PermissionRequest* reqs[MAX_REQUESTS];
+    int count = request_store_get_all(reqs, MAX_REQUESTS);
+    static uint8_t buf[16384];
+    size_t bytes = 0;
+    for (auto _ : state) {
+        CborWriter w;
+        cbor_writer_init(&w, buf, sizeof(buf));
+        request_list_to_cbor(&w, reqs, count);
+        bytes = w.len;
+        benchmark::DoNotOptimize(buf);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["wire_bytes"] = (double)bytes;
+}
+BENCHMARK(BM_ListToCbor)->Apply(store_args);
+
+// ── ポーリング応答 (GET /permission-request/:id/response。フックごとに毎秒) ──
+// Build* は毎回組み立てる以前のハンドラ (ロック中にスナップショットを取り、ロック外で組み立てる)、
+// Memo* は状態遷移時に request_store が作った本文をロック中にコピーするだけの今のハンドラ
+
+static void poll_args(benchmark::internal::Benchmark* b) {
+    b->Arg(0)->Arg(1);
+}
+
+// 1 件だけ入ったストアの ID (responded なら応答済みにする)
+static const char* poll_fixture(bool responded) {
+    fill_store(1);
+    const char* id = bench_ids()[0];
+    if (responded) request_store_respond(id, "allow", "1", DECISION_API);
+    return id;
+}
+
+static void BM_PollBuildJson(benchmark::State& state) {
+    const char* id = poll_fixture(state.range(0));
+    static PermissionRequest snapshot;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        request_store_lock();
+        PermissionRequest* found = request_store_get(id);
+        if (found) snapshot = *found;
+        request_store_unlock();
+        const PermissionRequest* pr = &snapshot;
+
+        cJSON* resp = cJSON_CreateObject();
+        cJSON_AddStringToObject(resp, "id", pr->id);
+        if (pr->response[0] != '\0') {
+            cJSON_AddStringToObject(resp, "response", pr->response);
+            cJSON_AddNumberToObject(resp, "responded_at", (double)pr->responded_at);
+            if (pr->send_key[0] != '\0') {
+                cJSON_AddStringToObject(resp, "send_key", pr->send_key);
+            } else {
+                cJSON_AddNullToObject(resp, "send_key");
+            }
+        } else {
+            cJSON_AddNullToObject(resp, "response");
+            cJSON_AddNullToObject(resp, "responded_at");
+            cJSON_AddNullToObject(resp, "send_key");
+        }
+        char* json = cJSON_PrintUnformatted(resp);
+        bytes = strlen(json);
+        benchmark::DoNotOptimize(json);
+        cJSON_free(json);
+        cJSON_Delete(resp);
+    }
+    state.counters["wire_bytes"] = (double)bytes;
+}
+BENCHMARK(BM_PollBuildJson)->Apply(poll_args);
+
+static void BM_PollBuildCbor(benchmark::State& state) {
+    const char* id = poll_fixture(state.range(0));
+    static PermissionRequest snapshot;
+    uint8_t buf[96];
+    size_t bytes = 0;
+    for (auto _ : state) {
+        request_store_lock();
+        PermissionRequest* found = request_store_get(id);
+        if (found) snapshot = *found;
+        request_store_unlock();
+        const PermissionRequest* pr = &snapshot;
+
+        CborWriter w;
+        cbor_writer_init(&w, buf, sizeof(buf));
+        cbor_put_map(&w, 4);
+        cbor_put_uint(&w, CK_ID);
+        cbor_put_text(&w, pr->id);
+        cbor_put_uint(&w, CK_RESPONSE);
+        cbor_put_text_or_null(&w, pr->response);
+        cbor_put_uint(&w, CK_RESPONDED_AT);
+        if (pr->response[0] != '\0') {
+            cbor_put_int(&w, pr->responded_at);
+        } else {
+            cbor_put_null(&w);
+        }
+        cbor_put_uint(&w, CK_SEND_KEY);
+        cbor_put_text_or_null(&w, pr->response[0] != '\0' ? pr->send_key : nullptr);
+        bytes = w.len;
+        benchmark::DoNotOptimize(buf);
+    }
+    state.counters["wire_bytes"] = (double)bytes;
+}
+BENCHMARK(BM_PollBuildCbor)->Apply(poll_args);
+
+// http_server.cpp の handle_permission_request_response と同じコピー
+static void poll_memo(benchmark::State& state, bool cbor) {
+    const char* id = poll_fixture(state.range(0));
+    char body[POLL_JSON_MAX > POLL_CBOR_MAX ? POLL_JSON_MAX : POLL_CBOR_MAX];
+    size_t len = 0;
+    for (auto _ : state) {
+        request_store_lock();
+        PermissionRequest* pr = request_store_get(id);
+        if (pr) {
+            len = cbor ? pr->poll_cbor_len : pr->poll_json_len;
+            memcpy(body, cbor ? (const void*)pr->poll_cbor : (const void*)pr->poll_json, len);
+        }
+        request_store_unlock();
+        benchmark::DoNotOptimize(body);
+    }
+    state.counters["wire_bytes"] = (double)len;
+}
+
+static void BM_PollMemoJson(benchmark::State& state) {
+    poll_memo(state, false);
+}
+BENCHMARK(BM_PollMemoJson)->Apply(poll_args);
+
+static void BM_PollMemoCbor(benchmark::State& state) {
+    poll_memo(state, true);
+}
+BENCHMARK(BM_PollMemoCbor)->Apply(poll_args);
@@ -0,0 +1,99 @@
+// request_store のホットパス (作成・検索・一覧・send_key 決定)
+// 引数はストアに入っているリクエスト数 (1〜MAX_REQUESTS)
+
+#include "bench_fixtures.h"
+#include "request_store.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstring>
+
+static void store_args(benchmark::internal::Benchmark* b) {
+    for (int n = 1; n <= MAX_REQUESTS; n *= 2) b->Arg(n);
+}
+
+// 満杯のストアへの作成 (未応答が上限に達したホストから送るので、毎回そのホストの最古のスロットを置き換える)
+static void BM_StoreCreateEvict(benchmark::State& state) {
+    fill_store(MAX_REQUESTS);
+    int i = 0;
+    for (auto _ : state) {
+        char target[32];
+        snprintf(target, sizeof(target), "bench:evict.%d", i++ % 64);
+        advance_clock_ms(1);
+        PermissionRequest* r = request_store_create(
+            "Bash", BENCH_MESSAGE, "Bash", BENCH_CHOICES, BENCH_CHOICE_COUNT,
+            target, "bench-host", 0);
+        benchmark::DoNotOptimize(r);
+    }
+}
+BENCHMARK(BM_StoreCreateEvict);
+
+// 同じ tmux ペインからの再作成 (自動キャンセル + 作成)
+static void BM_StoreCreateSameTarget(benchmark::State& state) {
+    fill_store(state.range(0));
+    for (auto _ : state) {
+        advance_clock_ms(1);
+        PermissionRequest* r = request_store_create(
+            "Bash", BENCH_MESSAGE, "Bash", BENCH_CHOICES, BENCH_CHOICE_COUNT,
+            "bench:pane.0", "bench-host", 0);
+        benchmark::DoNotOptimize(r);
+    }
+}
+BENCHMARK(BM_StoreCreateSameTarget)->Apply(store_args);
+
+static void BM_StoreGetHit(benchmark::State& state) {
+    int n = fill_store(state.range(0));
+    int i = 0;
+    for (auto _ : state) {
+        PermissionRequest* r = request_store_get(bench_ids()[i++ % n]);
+        benchmark::DoNotOptimize(r);
+    }
+}
+BENCHMARK(BM_StoreGetHit)->Apply(store_args);
+
+static void BM_StoreGetMiss(benchmark::State& state) {
+    fill_store(state.range(0));
+    const char* missing = "00000000-0000-4000-8000-000000000000";
+    for (auto _ : state) {
+        PermissionRequest* r = request_store_get(missing);
+        benchmark::DoNotOptimize(r);
+    }
+}
+BENCHMARK(BM_StoreGetMiss)->Apply(store_args);
+
+static void BM_StoreGetAll(benchmark::State& state) {
+    fill_store(state.range(0));
+    PermissionRequest* out[MAX_REQUESTS];
+    for (auto _ : state) {
+        int count = request_store_get_all(out, MAX_REQUESTS);
+        benchmark::DoNotOptimize(count);
+        benchmark::DoNotOptimize(out);
+    }
+}
+BENCHMARK(BM_StoreGetAll)->Apply(store_args);
+
+static void BM_StoreSnapshot(benchmark::State& state) {
+    fill_store(state.range(0));
+    static PermissionRequest out[MAX_REQUESTS];
+    for (auto _ : state) {
+        int count = request_store_snapshot(out, MAX_REQUESTS);
+        benchmark::DoNotOptimize(count);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_StoreSnapshot)->Apply(store_args);
+
+// 0 = allow, 1 = allow_all (選択肢の文字列検索), 2 = deny
+static void BM_ResolveSendKey(benchmark::State& state) {
+    static const char* const RESPONSES[] = { "allow", "allow_all", "deny" };
+    const char* response = RESPONSES[state.range(0)];
+    fill_store(1);
+    PermissionRequest* r = request_store_get(bench_ids()[0]);
+    char key[8];
+    for (auto _ : state) {
+        request_store_resolve_send_key(r, response, key, sizeof(key));
+        benchmark::DoNotOptimize(key);
+    }
+    state.SetLabel(response);
+}
+BENCHMARK(BM_ResolveSendKey)->DenseRange(0, 2);
@@ -0,0 +1,313 @@
+// 画面描画のシナリオ実行 (ヘッドレス)
+// display_manager.cpp をメモリ上の画面に描かせ、メインループ 1 周 (display_update 1 回) ごとに
+// パネルへの転送回数・画素数・SPI バイト数を出す。時刻は仮想時計なので何度実行しても同じ数字になる
+//
+//   prompt_relay_display [--out DIR] [--golden DIR] [シナリオ名...]
+//
+// --out    描画のあったフレームを DIR/<シナリオ>-<フレーム>.png に書き出す (ゴールデンの作成)
+// --golden DIR の同名 PNG と比べ、違う画素があれば終了コード 1
+// シナリオは 1 つずつ子プロセスで実行する (display_manager の状態を持ち越さない)
+
+#include "bench_fixtures.h"
+#include "display_manager.h"
+#include "headless_display.h"
+#include "host_shim.h"
+#include "notify_queue.h"
+#include "request_store.h"
+
+#include <cJSON.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DISPLAY_W Board::DISPLAY_W   // 選んだ機種の寸法 (CMake の BENCH_BOARD)
+#define DISPLAY_H Board::DISPLAY_H
+#define LOOP_MS 50              // main.cpp のメインループの周期
+#define CLICK_MS 80             // クリックの押下から解放まで
+
+static const char* s_out_dir = nullptr;
+static const char* s_golden_dir = nullptr;
+
+struct Run {
+    const char* scenario;
+    int frame;
+    int64_t now_ms;
+    int pending_index;          // button_handler の s_current_index 相当
+    HeadlessCost total;
+    int drawn_frames;
+    int mismatches;
+};
+
+static void set_clock(Run* run, int64_t ms) {
+    run->now_ms = ms;
+    host_set_time_us(ms * 1000);
+}
+
+// メインループ 1 周: request_store_tick + display_update
+static void loop_once(Run* run) {
+    set_clock(run, run->now_ms + LOOP_MS);
+    request_store_tick();
+    auto start = std::chrono::steady_clock::now();
+    display_update();
+    auto host_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    HeadlessCost cost = headless_display_take_cost();
+    int frame = run->frame++;
+    if (cost.draw_calls == 0) return;
+
+    run->drawn_frames++;
+    run->total.draw_calls += cost.draw_calls;
+    run->total.pixels += cost.pixels;
+    run->total.spi_bytes += cost.spi_bytes;
+    double spi_ms = (double)cost.spi_bytes * 8 * 1000 / HEADLESS_SPI_HZ;
+    printf("%-14s %5d %7lld %7u %8llu %10llu %8.2f %8lld\n", run->scenario, frame,
+           (long long)run->now_ms, cost.draw_calls, (unsigned long long)cost.pixels,
+           (unsigned long long)cost.spi_bytes, spi_ms, (long long)host_us);
+
+    char name[256];
+    if (s_out_dir) {
+        snprintf(name, sizeof(name), "%s/%s-%03d.png", s_out_dir, run->scenario, frame);
+        if (!headless_display_write_png(name)) fprintf(stderr, "cannot write %s\n", name);
+    }
+    if (s_golden_dir) {
+        snprintf(name, sizeof(name), "%s/%s-%03d.png", s_golden_dir, run->scenario, frame);
+        long diff = headless_display_compare_png(name);
+        if (diff != 0) {
+            run->mismatches++;
+            if (diff < 0) fprintf(stderr, "%s: missing or wrong size\n", name);
+            else fprintf(stderr, "%s: %ld pixels differ\n", name, diff);
+        }
+    }
+}
+
+static void run_for(Run* run, int ms) {
+    for (int t = 0; t < ms; t += LOOP_MS) loop_once(run);
+}
+
+// ── 入力 ──
+
+static PermissionRequest* create(const char* tool, const char* message, const char* subtitle,
+                                 int index, int64_t timeout_ms = 0, int choice_count = BENCH_CHOICE_COUNT) {
+    char target[32];
+    snprintf(target, sizeof(target), "scenario:pane.%d", index);
+    PermissionRequest* r = request_store_create(tool, message, subtitle, BENCH_CHOICES,
+                                                choice_count, target, bench_host(index), timeout_ms);
+    display_notify_new_request();
+    notify_queue_beep();
+    return r;
+}
+
+// message の上限近くまで日本語を詰める (折り返しと 3 バイト文字の幅計測が最も多くなる)
+static std::string long_japanese(void) {
+    static const char* const SENTENCE =
+        "ビルドの警告を集計してから、失敗したテストだけを再実行します。"
+        "設定ファイルを書き換えるので、実行前に差分を確認してください。";
+    std::string s;
+    while (s.size() + strlen(SENTENCE) < sizeof(PermissionRequest::message) - 1) s += SENTENCE;
+    return s;
+}
+
+static int collect_pending(PermissionRequest** pending) {
+    PermissionRequest* all[MAX_REQUESTS];
+    int count = request_store_get_all(all, MAX_REQUESTS);
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (all[i]->response[0] == '\0') pending[n++] = all[i];
+    }
+    return n;
+}
+
+// ボタン C (次の未応答リクエスト)。押下の時刻から、離すまでと (3 択以上なら) ダブルクリックの待ちの間も
+// メインループを回してから表示を要求する (button_handler と input_events の流れ)
+static void press_next(Run* run) {
+    PermissionRequest* pending[MAX_REQUESTS];
+    int n = collect_pending(pending);
+    if (n == 0) return;
+    int64_t press_us = run->now_ms * 1000;
+    bool wait_double = pending[run->pending_index % n]->choice_count > 2;
+    run_for(run, CLICK_MS + (wait_double ? CONFIG_INPUT_DOUBLE_PRESS_MS : 0));
+
+    n = collect_pending(pending);
+    if (n == 0) return;
+    run->pending_index = (run->pending_index + 1) % n;
+    display_show_request(pending[run->pending_index], run->pending_index, n, press_us);
+}
+
+// ボタン A (表示中のリクエストに最初の選択肢で応答)
+static void press_allow(Run* run) {
+    PermissionRequest* all[MAX_REQUESTS];
+    int count = request_store_get_all(all, MAX_REQUESTS);
+    for (int i = 0; i < count; i++) {
+        if (all[i]->response[0] == '\0') {
+            request_store_respond(all[i]->id, "allow", "1", DECISION_BUTTON);
+            break;
+        }
+    }
+    run->pending_index = 0;
+    display_notify_new_request();
+}
+
+// ── シナリオ ──
+
+static void scenario_idle(Run* run) {
+    run_for(run, 3000);
+}
+
+static void scenario_long_ja(Run* run) {
+    std::string message = long_japanese();
+    create("Bash", message.c_str(), "長い日本語の説明", 0, 120 * 1000);
+    run_for(run, 3000);
+}
+
+// 満杯の待ち行列を C で一巡する (choice_count が 3 以上なら C はダブルクリックを待ってから出る)
+static void page_through_queue(Run* run, int choice_count) {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        char subtitle[32];
+        snprintf(subtitle, sizeof(subtitle), "Bash #%d", i + 1);
+        create("Bash", BENCH_MESSAGE, subtitle, i, 120 * 1000, choice_count);
+        set_clock(run, run->now_ms + 10);
+    }
+    run_for(run, 500);
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        press_next(run);
+        run_for(run, 500);
+    }
+}
+
+static void scenario_queue8(Run* run) {
+    page_through_queue(run, BENCH_CHOICE_COUNT);
+}
+
+static void scenario_queue8_yes_no(Run* run) {
+    page_through_queue(run, 2);
+}
+
+// 3 つのホストから同じタイトルの通知が 2 件ずつ届く (ホストごとに 1 件にまとまり、"+N" が減っていく)
+static void scenario_notify_burst(Run* run) {
+    create("Bash", BENCH_MESSAGE, "Bash", 0);
+    run_for(run, 500);
+    static const char* const HOSTS[] = { "bench-host", "build-01", "build-02" };
+    for (int i = 0; i < 6; i++) {
+        char message[64];
+        snprintf(message, sizeof(message), "ビルドが完了しました (%d/6)", i + 1);
+        notify_queue_push("make", message, HOSTS[i % 3]);
+        run_for(run, 100);
+    }
+    // 待ちの 2 件 (2 秒ずつ) と最後の 1 件 (5 秒) が消えてリクエスト表示に戻るまで
+    run_for(run, 10000);
+}
+
+static void scenario_respond(Run* run) {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        create("Bash", BENCH_MESSAGE, "Bash", i);
+        set_clock(run, run->now_ms + 10);
+    }
+    run_for(run, 500);
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        press_allow(run);
+        run_for(run, 300);
+    }
+}
+
+struct Scenario {
+    const char* name;
+    void (*fn)(Run*);
+};
+
+static const Scenario SCENARIOS[] = {
+    { "idle",         scenario_idle },
+    { "long_ja",      scenario_long_ja },
+    { "queue8",       scenario_queue8 },
+    { "queue8_yes_no", scenario_queue8_yes_no },
+    { "notify_burst", scenario_notify_burst },
+    { "respond",      scenario_respond },
+};
+static const int SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+// 子プロセスで 1 つ実行する。戻り値は終了コード (0 = ゴールデンと一致)
+static int run_scenario(const Scenario* sc) {
+    Run run = {};
+    run.scenario = sc->name;
+    set_clock(&run, 1000);
+    request_store_init();
+    notify_queue_init();
+    if (!headless_display_begin(DISPLAY_W, DISPLAY_H)) {
+        fprintf(stderr, "cannot allocate %dx%d frame buffer\n", DISPLAY_W, DISPLAY_H);
+        return 2;
+    }
+    display_init();
+    display_show_idle("192.168.1.39");
+    headless_display_take_cost();       // 起動画面の分は数えない
+
+    sc->fn(&run);
+
+    double spi_ms = (double)run.total.spi_bytes * 8 * 1000 / HEADLESS_SPI_HZ;
+    printf("%-14s total %d frames drawn / %d, %u calls, %llu pixels, %llu bytes, %.2f ms SPI, %u beeps\n",
+           sc->name, run.drawn_frames, run.frame, run.total.draw_calls,
+           (unsigned long long)run.total.pixels, (unsigned long long)run.total.spi_bytes, spi_ms,
+           M5.Speaker.tones);
+    // 押下から本文の転送完了まで (仮想時計なので、ジェスチャーの待ちとメインループの周期の分だけ)
+    cJSON* stats = display_stats_to_json();
+    static const char* const SWITCHES[] = { "switch_hit", "switch_miss" };
+    for (const char* name : SWITCHES) {
+        cJSON* st = cJSON_GetObjectItem(stats, name);
+        int count = cJSON_GetObjectItem(st, "count")->valueint;
+        if (count == 0) continue;
+        printf("%-14s %s %d, press to pixels avg %.0f ms, max %.0f ms\n", sc->name, name, count,
+               cJSON_GetObjectItem(st, "avg_us")->valuedouble / 1000,
+               cJSON_GetObjectItem(st, "max_us")->valuedouble / 1000);
+    }
+    cJSON_Delete(stats);
+    printf("\n");
+    return run.mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    const Scenario* selected[SCENARIO_COUNT];
+    int n = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            s_out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            s_golden_dir = argv[++i];
+        } else {
+            int k = 0;
+            while (k < SCENARIO_COUNT && strcmp(argv[i], SCENARIOS[k].name) != 0) k++;
+            if (k == SCENARIO_COUNT || n == SCENARIO_COUNT) {
+                fprintf(stderr, "usage: %s [--out DIR] [--golden DIR] [scenario...]\nscenarios:",
+                        argv[0]);
+                for (int j = 0; j < SCENARIO_COUNT; j++) fprintf(stderr, " %s", SCENARIOS[j].name);
+                fprintf(stderr, "\n");
+                return 2;
+            }
+            selected[n++] = &SCENARIOS[k];
+        }
+    }
+    if (n == 0) {
+        for (int k = 0; k < SCENARIO_COUNT; k++) selected[n++] = &SCENARIOS[k];
+    }
+
+    printf("%-14s %5s %7s %7s %8s %10s %8s %8s\n",
+           "scenario", "frame", "t_ms", "calls", "pixels", "spi_bytes", "spi_ms", "host_us");
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            int code = run_scenario(selected[i]);
+            fflush(stdout);
+            _exit(code);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    if (s_golden_dir && failed) fprintf(stderr, "%d scenario(s) differ from %s\n", failed, s_golden_dir);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// bench_policy.cpp と policy_limits.cpp で共通のルールセット
+
+#include "policy_automaton.h"
+
+#include <string>
+#include <vector>
+
+struct RuleSet {
+    std::vector<std::string> strings;
+    std::vector<PolicyRule> rules;
+};
+
+enum RuleShape {
+    SHAPE_MIXED,        // ありがちな構成: コマンドの前方一致とパスのグロブを交互に、最後に deny を 1 つ
+    SHAPE_PATHS,        // すべてパスのグロブ (** を含むので状態が最も増える)
+    SHAPE_COMMANDS,     // すべてコマンドの前方一致
+};
+
+// n = 1, 2 の SHAPE_MIXED にはパスのルールがない (i == n - 1 が deny になるため)。
+// パスのルールは 4 本目から入る
+inline void make_rules(int n, RuleSet* set, RuleShape shape = SHAPE_MIXED) {
+    set->strings.clear();
+    set->strings.reserve(n);
+    set->rules.assign(n, PolicyRule{});
+    for (int i = 0; i < n; i++) {
+        PolicyRule* r = &set->rules[i];
+        bool path = shape == SHAPE_PATHS || (shape == SHAPE_MIXED && i % 2 == 1);
+        if (shape == SHAPE_MIXED && i == n - 1) {
+            set->strings.push_back("rm -rf *");
+            r->action = POLICY_DENY;
+            r->pattern[PF_TOOL] = "Bash";
+            r->pattern[PF_COMMAND] = set->strings.back().c_str();
+        } else if (path) {
+            set->strings.push_back("/home/user/src/project" + std::to_string(i) + "/**/*.cpp");
+            r->action = POLICY_ALLOW;
+            r->pattern[PF_TOOL] = "Edit";
+            r->pattern[PF_PATH] = set->strings.back().c_str();
+        } else {
+            set->strings.push_back("git subcmd" + std::to_string(i) + " *");
+            r->action = POLICY_ALLOW;
+            r->pattern[PF_TOOL] = "Bash";
+            r->pattern[PF_COMMAND] = set->strings.back().c_str();
+        }
+    }
+}
+
+// policy_automaton_match と同じ順に表を引き、行き止まりまでに引いた回数を数える
+// (照合の所要時間はルール数ではなくこの回数で決まる)
+inline int policy_lookups(const PolicyAutomaton* a, const char* const fields[PF_COUNT]) {
+    if (a->state_count == 0) return 0;
+    int lookups = 0;
+    uint32_t row = a->class_count;
+    for (int f = 0; f < PF_COUNT; f++) {
+        if (f > 0) {
+            row = a->next[row + a->byte_class[0x1f]];
+            lookups++;
+        }
+        for (const char* p = fields[f]; p && *p; p++) {
+            uint8_t b = (uint8_t)*p;
+            row = a->next[row + (b == 0x1f ? 0 : a->byte_class[b])];
+            lookups++;
+            if (row == 0) return lookups;
+        }
+    }
+    return lookups;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// display_manager.cpp のホストビルド用 M5Unified
+// 描画は本物の LovyanGFX (M5GFX の元になったライブラリ) で行い、画面だけを
+// メモリ上のフレームバッファ (HeadlessPanel) に置き換える。パネルへの転送を横取りして、
+// 実機の SPI 接続 LCD (ILI9342C / ST7789) に送るはずだった量を数える
+
+#include <LovyanGFX.hpp>
+
+#include <cstdint>
+
+using namespace lgfx;
+
+// パネル転送のコスト (headless_display_take_cost で 1 フレームごとに取り出す)
+struct HeadlessCost {
+    uint32_t draw_calls;    // 転送の回数 (アドレス窓の設定 + 画素の書き込み 1 組で 1 回)
+    uint64_t pixels;        // 書き込んだ画素数
+    uint64_t spi_bytes;     // コマンド・引数・画素 (RGB565) を合わせたバイト数
+};
+
+// スプライト用のパネル (フレームバッファへの書き込み) に、転送量の計数を足したもの
+class HeadlessPanel : public lgfx::Panel_Sprite {
+public:
+    HeadlessCost cost = {};
+
+    void setWindow(uint_fast16_t xs, uint_fast16_t ys, uint_fast16_t xe, uint_fast16_t ye) override;
+    void writeBlock(uint32_t rawcolor, uint32_t length) override;
+    void writePixels(lgfx::pixelcopy_t* param, uint32_t len, bool use_dma) override;
+    void drawPixelPreclipped(uint_fast16_t x, uint_fast16_t y, uint32_t rawcolor) override;
+    void writeFillRectPreclipped(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+                                 uint32_t rawcolor) override;
+    void writeImage(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+                    lgfx::pixelcopy_t* param, bool use_dma) override;
+    void writeImageARGB(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+                        lgfx::pixelcopy_t* param) override;
+    void copyRect(uint_fast16_t dst_x, uint_fast16_t dst_y, uint_fast16_t w, uint_fast16_t h,
+                  uint_fast16_t src_x, uint_fast16_t src_y) override;
+
+private:
+    // 基底の実装が中で別の仮想関数を呼んでも、外側の呼び出しの 1 回だけ数える
+    int _nest = 0;
+    bool enter(void) { return _nest++ == 0; }
+    void leave(void) { _nest--; }
+    void charge(bool outer, bool window, uint64_t pixels);
+};
+
+// M5.Display の代わり。headless_display_begin を呼ぶまでは幅 0 (= ディスプレイなし)
+class M5GFX : public lgfx::LovyanGFX {
+public:
+    M5GFX() { setPanel(&_headless); }
+
+    bool beginHeadless(int width, int height);
+    HeadlessPanel* headlessPanel(void) { return &_headless; }
+
+    // 実機の setRotation(1) 後と同じ横長で確保するので回転はしない
+    void setRotation(uint_fast8_t) {}
+    void setBrightness(uint8_t) {}
+
+private:
+    HeadlessPanel _headless;
+};
+
+// 本文カードなどの画面外スプライト。親 (M5GFX) への pushSprite は HeadlessPanel で数えられる
+class M5Canvas : public lgfx::LGFX_Sprite {
+public:
+    M5Canvas() = default;
+    explicit M5Canvas(lgfx::LovyanGFX* parent) : lgfx::LGFX_Sprite(parent) {}
+};
+
+// ビープは回数だけ数える
+struct HeadlessSpeaker {
+    uint32_t tones = 0;
+    bool tone(float frequency, uint32_t duration = UINT32_MAX) {
+        (void)frequency;
+        (void)duration;
+        tones++;
+        return true;
+    }
+};
+
+struct HeadlessM5 {
+    M5GFX Display;
+    HeadlessSpeaker Speaker;
+};
+
+extern HeadlessM5 M5;
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+
+// 計測を乱さないようログは捨てる (書式のチェックだけ残す)
+#define ESP_LOG_DISCARD(tag, fmt, ...) \
+    do { if (0) std::printf(fmt, ##__VA_ARGS__); (void)(tag); } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...);
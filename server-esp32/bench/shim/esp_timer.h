@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// 時刻はベンチマークが進める仮想時計 (host_shim.h の host_set_time_us)
+// 実時間に依存させないことで、期限切れ・自動削除の分岐を計測ごとに固定する
+int64_t esp_timer_get_time(void);
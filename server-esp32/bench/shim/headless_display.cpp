@@ -0,0 +1,152 @@
+#include "headless_display.h"
+
+#include <png.h>
+#include <vector>
+
+HeadlessM5 M5;
+
+// SPI 接続の LCD に 1 回転送するときのバイト数
+// アドレス窓 = CASET (コマンド 1 + 引数 4) + RASET (1 + 4) + RAMWR (1)、画素は RGB565
+static constexpr uint32_t WINDOW_BYTES = 11;
+static constexpr uint32_t PIXEL_BYTES = 2;
+
+void HeadlessPanel::charge(bool outer, bool window, uint64_t pixels) {
+    if (!outer) return;
+    if (window) {
+        cost.draw_calls++;
+        cost.spi_bytes += WINDOW_BYTES;
+    }
+    cost.pixels += pixels;
+    cost.spi_bytes += pixels * PIXEL_BYTES;
+}
+
+// setWindow の後に writeBlock / writePixels で画素を流す経路 (窓の設定で 1 回と数える)
+void HeadlessPanel::setWindow(uint_fast16_t xs, uint_fast16_t ys, uint_fast16_t xe, uint_fast16_t ye) {
+    bool outer = enter();
+    Panel_Sprite::setWindow(xs, ys, xe, ye);
+    charge(outer, true, 0);
+    leave();
+}
+
+void HeadlessPanel::writeBlock(uint32_t rawcolor, uint32_t length) {
+    bool outer = enter();
+    Panel_Sprite::writeBlock(rawcolor, length);
+    charge(outer, false, length);
+    leave();
+}
+
+void HeadlessPanel::writePixels(lgfx::pixelcopy_t* param, uint32_t len, bool use_dma) {
+    bool outer = enter();
+    Panel_Sprite::writePixels(param, len, use_dma);
+    charge(outer, false, len);
+    leave();
+}
+
+// 窓の設定と画素の書き込みを 1 回で行う経路
+void HeadlessPanel::drawPixelPreclipped(uint_fast16_t x, uint_fast16_t y, uint32_t rawcolor) {
+    bool outer = enter();
+    Panel_Sprite::drawPixelPreclipped(x, y, rawcolor);
+    charge(outer, true, 1);
+    leave();
+}
+
+void HeadlessPanel::writeFillRectPreclipped(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w,
+                                            uint_fast16_t h, uint32_t rawcolor) {
+    bool outer = enter();
+    Panel_Sprite::writeFillRectPreclipped(x, y, w, h, rawcolor);
+    charge(outer, true, (uint64_t)w * h);
+    leave();
+}
+
+void HeadlessPanel::writeImage(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+                               lgfx::pixelcopy_t* param, bool use_dma) {
+    bool outer = enter();
+    Panel_Sprite::writeImage(x, y, w, h, param, use_dma);
+    charge(outer, true, (uint64_t)w * h);
+    leave();
+}
+
+void HeadlessPanel::writeImageARGB(uint_fast16_t x, uint_fast16_t y, uint_fast16_t w, uint_fast16_t h,
+                                   lgfx::pixelcopy_t* param) {
+    bool outer = enter();
+    Panel_Sprite::writeImageARGB(x, y, w, h, param);
+    charge(outer, true, (uint64_t)w * h);
+    leave();
+}
+
+// 実機では読み出してから書き戻す。読み出し分は数えず、書き込みだけ数える
+void HeadlessPanel::copyRect(uint_fast16_t dst_x, uint_fast16_t dst_y, uint_fast16_t w, uint_fast16_t h,
+                             uint_fast16_t src_x, uint_fast16_t src_y) {
+    bool outer = enter();
+    Panel_Sprite::copyRect(dst_x, dst_y, w, h, src_x, src_y);
+    charge(outer, true, (uint64_t)w * h);
+    leave();
+}
+
+bool M5GFX::beginHeadless(int width, int height) {
+    setColorDepth(lgfx::rgb565_2Byte);
+    if (!_headless.createSprite(width, height, &_write_conv, false)) return false;
+    clearClipRect();
+    clearScrollRect();
+    return true;
+}
+
+bool headless_display_begin(int width, int height) {
+    return M5.Display.beginHeadless(width, height);
+}
+
+HeadlessCost headless_display_take_cost(void) {
+    HeadlessPanel* panel = M5.Display.headlessPanel();
+    HeadlessCost cost = panel->cost;
+    panel->cost = {};
+    return cost;
+}
+
+// 画面を RGB888 で読み出す (パネルの読み出しは転送コストに数えない)
+static void read_screen(std::vector<uint8_t>* rgb) {
+    int w = M5.Display.width();
+    int h = M5.Display.height();
+    rgb->resize((size_t)w * h * 3);
+    std::vector<lgfx::bgr888_t> row(w);
+    for (int y = 0; y < h; y++) {
+        M5.Display.readRectRGB(0, y, w, 1, row.data());
+        uint8_t* out = rgb->data() + (size_t)y * w * 3;
+        for (int x = 0; x < w; x++) {
+            out[x * 3 + 0] = row[x].R8();
+            out[x * 3 + 1] = row[x].G8();
+            out[x * 3 + 2] = row[x].B8();
+        }
+    }
+}
+
+bool headless_display_write_png(const char* path) {
+    std::vector<uint8_t> rgb;
+    read_screen(&rgb);
+    png_image image = {};
+    image.version = PNG_IMAGE_VERSION;
+    image.width = M5.Display.width();
+    image.height = M5.Display.height();
+    image.format = PNG_FORMAT_RGB;
+    return png_image_write_to_file(&image, path, 0, rgb.data(), 0, nullptr) != 0;
+}
+
+long headless_display_compare_png(const char* path) {
+    png_image image = {};
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path)) return -1;
+    if ((int)image.width != M5.Display.width() || (int)image.height != M5.Display.height()) {
+        png_image_free(&image);
+        return -1;
+    }
+    image.format = PNG_FORMAT_RGB;
+    std::vector<uint8_t> golden(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, nullptr, golden.data(), 0, nullptr)) return -1;
+
+    std::vector<uint8_t> rgb;
+    read_screen(&rgb);
+    long diff = 0;
+    for (size_t i = 0; i < rgb.size(); i += 3) {
+        if (rgb[i] != golden[i] || rgb[i + 1] != golden[i + 1] || rgb[i + 2] != golden[i + 2]) diff++;
+    }
+    return diff;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "M5Unified.h"
+
+// 実機の SPI クロック (M5Stack の LCD は 40MHz で書き込む)。spi_bytes から転送時間を見積もる
+#define HEADLESS_SPI_HZ 40000000
+
+// M5.Display のフレームバッファを確保する (display_init の前に呼ぶ)
+bool headless_display_begin(int width, int height);
+
+// 前回の呼び出しから積算した転送コストを返し、0 に戻す
+HeadlessCost headless_display_take_cost(void);
+
+// 画面を PNG に書き出す
+bool headless_display_write_png(const char* path);
+
+// 画面と PNG を比べ、違う画素の数を返す (-1 = 読めない・大きさが違う)
+long headless_display_compare_png(const char* path);
@@ -0,0 +1,92 @@
+#include "host_shim.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <cstdarg>
+#include <mutex>
+#include <random>
+
+static int64_t s_now_us = 0;
+
+void host_set_time_us(int64_t us) {
+    s_now_us = us;
+}
+
+int64_t esp_timer_get_time(void) {
+    return s_now_us;
+}
+
+// 乱数は固定シード (UUID の生成コストだけを計測する)
+static std::mt19937 s_rng(3939);
+
+uint32_t esp_random(void) {
+    return s_rng();
+}
+
+void esp_fill_random(void* buf, size_t len) {
+    uint8_t* p = (uint8_t*)buf;
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t v = s_rng();
+        for (size_t j = 0; j < 4 && i + j < len; j++) p[i + j] = (v >> (8 * j)) & 0xff;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    (void)level;
+    (void)tag;
+    (void)format;
+}
+
+struct HostSemaphore {
+    std::recursive_mutex mutex;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return new HostSemaphore();
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return new HostSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    (void)wait;
+    sem->mutex.lock();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    sem->mutex.unlock();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait) {
+    return xSemaphoreTake(sem, wait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    return xSemaphoreGive(sem);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                       UBaseType_t prio, TaskHandle_t* handle) {
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)prio;
+    (void)handle;
+    return pdFAIL;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    static thread_local int self;
+    return &self;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    (void)ticks;
+}
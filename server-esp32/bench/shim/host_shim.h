@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// 仮想時計を設定 (esp_timer_get_time の戻り値)
+void host_set_time_us(int64_t us);
@@ -0,0 +1,7 @@
+#pragma once
+
+// ホストビルドでは Kconfig の bool オプションはすべて無効 (CONFIG_DEFERRED_LOG_UART なし)
+// 数値オプションは Kconfig.projbuild の既定値
+#define CONFIG_DECISION_HISTORY_SIZE 512
+#define CONFIG_NOTIFY_BEEP_INTERVAL_MS 3000
+#define CONFIG_INPUT_DOUBLE_PRESS_MS 300
@@ -0,0 +1,84 @@
+// 1 ホストの殺到で他のホストのリクエストが追い出されないことの検査 (ctest で実行)
+// 流量制御 (admission.cpp) を通った分をストアに作り、別ホストの未応答が残ることを確かめる
+
+#include "admission.h"
+#include "bench_fixtures.h"
+#include "host_shim.h"
+#include "request_store.h"
+
+#include <cstdio>
+#include <cstring>
+
+static int s_failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) s_failures++;
+}
+
+static bool is_pending(const char* id) {
+    PermissionRequest* r = request_store_get(id);
+    return r && r->response[0] == '\0';
+}
+
+static int pending_of(const char* host) {
+    PermissionRequest* all[MAX_REQUESTS];
+    int n = request_store_get_all(all, MAX_REQUESTS);
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (all[i]->response[0] == '\0' && strcmp(all[i]->hostname, host) == 0) count++;
+    }
+    return count;
+}
+
+static PermissionRequest* create(const char* host, int pane) {
+    char target[32];
+    snprintf(target, sizeof(target), "%s:pane.%d", host, pane);
+    advance_clock_ms(1);
+    return request_store_create("Bash", BENCH_MESSAGE, "Bash", BENCH_CHOICES, BENCH_CHOICE_COUNT,
+                                target, host, 120 * 1000);
+}
+
+int main() {
+    host_set_time_us(1000 * 1000);
+    request_store_init();
+    admission_init();
+
+    // 連続許容数はスロットの半分以下 (1 回の殺到で他のホストの分を埋めない)
+    int admitted = 0;
+    for (int i = 0; i < MAX_REQUESTS * 2; i++) {
+        int retry = 0;
+        if (admission_begin("flood:dev", "192.0.2.1", &retry) != ADMIT_OK) break;
+        admission_end();
+        admitted++;
+    }
+    printf("     burst: %d of %d slots\n", admitted, MAX_REQUESTS);
+    check(admitted <= MAX_PENDING_PER_HOST, "host burst fits in the per-host pending cap");
+
+    // 静かなホストの未応答が 1 件ある状態で、別のホストがペインを変えながら殺到する
+    // (流量制御を抜けた分がすべてストアに届いたとしても)
+    PermissionRequest* quiet = create("quiet", 0);
+    char quiet_id[UUID_STR_LEN];
+    strcpy(quiet_id, quiet->id);
+    for (int i = 0; i < MAX_REQUESTS * 4; i++) {
+        if (!create("flood", i)) {
+            check(false, "flooding host always gets a slot (its own oldest is replaced)");
+            break;
+        }
+    }
+    check(is_pending(quiet_id), "quiet host's pending request survives the flood");
+    check(pending_of("flood") == MAX_PENDING_PER_HOST, "flooding host holds at most its cap");
+
+    // 他のホストの未応答でストアが埋まっていれば、新しいホストは断られる (誰も追い出さない)
+    for (int h = 0; request_store_pending_count() < MAX_REQUESTS; h++) {
+        char host[24];
+        snprintf(host, sizeof(host), "other-%d", h);
+        for (int i = 0; i < MAX_PENDING_PER_HOST && request_store_pending_count() < MAX_REQUESTS; i++) {
+            create(host, i);
+        }
+    }
+    check(create("late", 0) == nullptr, "full store rejects a new host instead of evicting");
+    check(is_pending(quiet_id), "quiet host's pending request survives a full store");
+
+    return s_failures == 0 ? 0 : 1;
+}
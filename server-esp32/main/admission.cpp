@@ -0,0 +1,175 @@
+#include "admission.h"
+#include "request_store.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const char* TAG = "admission";
+
+#define MAX_BUCKETS 16
+#define MAX_INFLIGHT 4
+
+// トークンはミリトークン単位 (1000 = 1 リクエスト)
+// 連続許容数はストアのスロットの半分 (1 ホストの未応答の上限と同じ)。1 回の殺到で他のホストの
+// リクエストが入る余地を埋めないようにする。ヘッダーを変えて送る暴走にも効くよう IP も同じ数にする
+// ホスト: 以後 2 秒に 1 件 / IP: 同一マシンの複数 tmux セッションを考慮して 1 秒に 1 件
+// (上限を超えた分はストアが同じホストの最古の未応答を置き換えるので、他のホストは追い出されない)
+static constexpr int HOST_BURST = MAX_PENDING_PER_HOST;
+#define HOST_REFILL_MS 2000
+static constexpr int IP_BURST = MAX_PENDING_PER_HOST;
+#define IP_REFILL_MS 1000
+
+enum BucketKind {
+    BUCKET_HOST,
+    BUCKET_IP,
+};
+
+struct Bucket {
+    bool used;
+    BucketKind kind;
+    char key[64];
+    int32_t tokens;         // ミリトークン
+    int64_t updated_at;     // 最終補充時刻 (ms)
+    uint32_t accepted;
+    uint32_t shed;
+};
+
+static SemaphoreHandle_t s_lock = nullptr;
+static Bucket s_buckets[MAX_BUCKETS];
+static int s_inflight = 0;
+static uint32_t s_shed_busy = 0;
+
+static int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+static int burst_of(BucketKind kind) {
+    return kind == BUCKET_HOST ? HOST_BURST : IP_BURST;
+}
+
+static int refill_ms_of(BucketKind kind) {
+    return kind == BUCKET_HOST ? HOST_REFILL_MS : IP_REFILL_MS;
+}
+
+// キーに対応するバケットを取得 (なければ最も古いものを再利用)
+static Bucket* find_bucket(BucketKind kind, const char* key, int64_t now) {
+    Bucket* victim = nullptr;
+    for (int i = 0; i < MAX_BUCKETS; i++) {
+        Bucket* b = &s_buckets[i];
+        if (b->used && b->kind == kind && strcmp(b->key, key) == 0) return b;
+        if (!victim || !b->used || (victim->used && b->updated_at < victim->updated_at)) {
+            victim = b;
+        }
+    }
+    memset(victim, 0, sizeof(Bucket));
+    victim->used = true;
+    victim->kind = kind;
+    strncpy(victim->key, key, sizeof(victim->key) - 1);
+    victim->tokens = burst_of(kind) * 1000;
+    victim->updated_at = now;
+    return victim;
+}
+
+static void refill(Bucket* b, int64_t now) {
+    int32_t cap = burst_of(b->kind) * 1000;
+    int64_t gained = (now - b->updated_at) * 1000 / refill_ms_of(b->kind);
+    b->tokens = (int32_t)(b->tokens + gained > cap ? cap : b->tokens + gained);
+    b->updated_at = now;
+}
+
+// 次の 1 トークンまでの秒数 (切り上げ)
+static int wait_seconds(const Bucket* b) {
+    int32_t missing = 1000 - b->tokens;
+    int64_t ms = (int64_t)missing * refill_ms_of(b->kind) / 1000;
+    return (int)((ms + 999) / 1000);
+}
+
+void admission_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+    memset(s_buckets, 0, sizeof(s_buckets));
+}
+
+AdmitResult admission_begin(const char* host, const char* ip, int* retry_after_s) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    int64_t now = now_ms();
+    Bucket* buckets[2];
+    int count = 0;
+    if (host && host[0] != '\0') buckets[count++] = find_bucket(BUCKET_HOST, host, now);
+    if (ip && ip[0] != '\0') buckets[count++] = find_bucket(BUCKET_IP, ip, now);
+
+    // どちらか一方でも切れていれば拒否 (トークンは消費しない)
+    Bucket* limited = nullptr;
+    for (int i = 0; i < count; i++) {
+        refill(buckets[i], now);
+        if (buckets[i]->tokens < 1000 &&
+            (!limited || wait_seconds(buckets[i]) > wait_seconds(limited))) {
+            limited = buckets[i];
+        }
+    }
+
+    AdmitResult result = ADMIT_OK;
+    if (limited) {
+        *retry_after_s = wait_seconds(limited);
+        result = ADMIT_RATE_LIMITED;
+    } else if (s_inflight >= MAX_INFLIGHT) {
+        *retry_after_s = 1;
+        s_shed_busy++;
+        result = ADMIT_BUSY;
+    } else {
+        s_inflight++;
+        for (int i = 0; i < count; i++) buckets[i]->tokens -= 1000;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (result == ADMIT_OK) {
+            buckets[i]->accepted++;
+        } else {
+            buckets[i]->shed++;
+        }
+    }
+    uint32_t shed = limited ? limited->shed : s_shed_busy;
+    xSemaphoreGive(s_lock);
+
+    // 連続拒否でログが溢れないよう 2 のべき乗回目だけ出す
+    if (result != ADMIT_OK && (shed & (shed - 1)) == 0) {
+        ESP_LOGW(TAG, "Shed request from %s / %s (%s, total %u)",
+            host ? host : "-", ip ? ip : "-",
+            result == ADMIT_BUSY ? "busy" : "rate limited", (unsigned)shed);
+    }
+    return result;
+}
+
+void admission_end(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_inflight > 0) s_inflight--;
+    xSemaphoreGive(s_lock);
+}
+
+cJSON* admission_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    cJSON_AddNumberToObject(root, "inflight", s_inflight);
+    cJSON_AddNumberToObject(root, "max_inflight", MAX_INFLIGHT);
+    cJSON_AddNumberToObject(root, "shed_busy", s_shed_busy);
+
+    cJSON* clients = cJSON_CreateArray();
+    for (int i = 0; i < MAX_BUCKETS; i++) {
+        const Bucket* b = &s_buckets[i];
+        if (!b->used) continue;
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "kind", b->kind == BUCKET_HOST ? "host" : "ip");
+        cJSON_AddStringToObject(item, "key", b->key);
+        cJSON_AddNumberToObject(item, "accepted", b->accepted);
+        cJSON_AddNumberToObject(item, "shed", b->shed);
+        cJSON_AddItemToArray(clients, item);
+    }
+    cJSON_AddItemToObject(root, "clients", clients);
+
+    xSemaphoreGive(s_lock);
+    return root;
+}
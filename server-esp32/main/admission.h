@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cJSON.h>
+
+// 流量制御 (POST /permission-request と /notify の入口で使う)
+// ホスト名 (X-Prompt-Relay-Host ヘッダー) とクライアント IP ごとのトークンバケット +
+// 全体の同時処理数の上限。判定はボディを読む前に行う
+
+// 初期化 (http_server_start から呼ぶ)
+void admission_init(void);
+
+enum AdmitResult {
+    ADMIT_OK,               // 受理 (処理後に admission_end を呼ぶこと)
+    ADMIT_RATE_LIMITED,     // 429: トークン切れ
+    ADMIT_BUSY,             // 503: 同時処理数の上限
+};
+
+// 受理判定。host は nullptr 可 (ヘッダーなしの古いフック)
+// 拒否時は *retry_after_s に再送までの秒数を入れる
+AdmitResult admission_begin(const char* host, const char* ip, int* retry_after_s);
+
+// 受理したリクエストの処理完了
+void admission_end(void);
+
+// ホスト/IP ごとの受理数・拒否数 (GET /stats 用)
+cJSON* admission_stats_to_json(void);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "board_profile.h"
+#include "request_store.h"
+#include "request_detail.h"
+#include "notify_queue.h"
+#include "http_workers.h"
+
+// 機種ごとの内部 RAM の予算 (コンパイル時に検査する。main.cpp だけが include する)
+//
+// 起動時に確保したまま使い続けるもの: ストアのスロット・通知の待ち行列・ワーカーのアリーナ・
+// 本文カード・詳細のプール (PSRAM に置く機種は除く)。スロット数や本文の長さを変えて予算を超えたらビルドが止まる
+
+// cJSON のノードとキー・作成のレスポンスの分 (典型的なボディで 1.5KB 前後。文字列の値はボディ以下)
+#define BUDGET_CJSON_NODES 2048
+
+template <class B>
+struct BoardBudget {
+    static constexpr size_t STORE = sizeof(PermissionRequestFor<B>) * B::MAX_REQUESTS;
+    static constexpr size_t NOTIFY = sizeof(NotifyItem) * (B::NOTIFY_QUEUE_LEN + 1);   // 待ち + 表示中
+    static constexpr size_t ARENAS = (size_t)B::DECISION_ARENA_SIZE +
+        (B::ARENAS_IN_PSRAM ? 0 : (size_t)B::GENERAL_ARENA_SIZE * (HTTP_WORKER_COUNT - 1));
+    static constexpr size_t CARDS = B::CARDS_IN_PSRAM ? 0 : BoardLayout<B>::CARD_BYTES * B::CARD_SLOTS;
+    // 詳細のエントリは常に内部 RAM。プール (ブロック + 連結リスト) は PSRAM に置く機種なら除く
+    static constexpr size_t DETAIL = sizeof(DetailEntry) * B::MAX_REQUESTS +
+        (B::DETAIL_IN_PSRAM ? 0 : (size_t)B::DETAIL_POOL_SIZE / DETAIL_BLOCK_LEN * (DETAIL_BLOCK_LEN + sizeof(uint16_t)));
+    static constexpr size_t TOTAL = STORE + NOTIFY + ARENAS + CARDS + DETAIL;
+
+    // 一覧 (GET /permission-requests) は全スロットの本文を 1 つのアリーナで組み立てる
+    static_assert((size_t)B::GENERAL_ARENA_SIZE >= (size_t)B::MAX_REQUESTS * (B::MESSAGE_LEN + 512),
+                  "general arena cannot hold a full request list");
+    // 作成 (POST /permission-request) は 1 つのアリーナにボディ・解析したツリー (文字列はボディの写し)・
+    // 詳細の書き込み領域を置く。溢れるとヒープに回り、アリーナで避けたい断片化が起きる
+    static constexpr size_t CREATE = (size_t)B::MAX_BODY_LEN * 2 + sizeof(DetailWriter) + BUDGET_CJSON_NODES;
+    static_assert((size_t)B::GENERAL_ARENA_SIZE >= CREATE,
+                  "general arena cannot hold a maximum-size create body and its parse tree");
+    // 作成のボディは本文 + 選択肢 + tool_input を含む。Edit や複数行のコマンドは 1KB を普通に超えるので、
+    // どの機種でも 2KB までは 413 にしない
+    static_assert(B::MAX_BODY_LEN >= B::MESSAGE_LEN * 2, "body limit is smaller than two messages");
+    static_assert(B::MAX_BODY_LEN >= 2048, "body limit rejects ordinary tool_input");
+    // 応答専用のアリーナは respond のボディ・解析ツリー・レスポンスを置く
+    static_assert(B::DECISION_ARENA_SIZE >= B::RESPOND_BODY_LEN * 8, "decision arena too small for a respond");
+    // 1 ページを圧縮したものが最悪でもプールに収まる
+    static_assert((size_t)B::DETAIL_POOL_SIZE >= 2 + LZ_BOUND(DETAIL_PAGE_LEN), "detail pool cannot hold a page");
+    static_assert(TOTAL <= B::RAM_BUDGET, "board profile exceeds its RAM budget");
+};
+
+// 選んでいない機種も含めて全機種を検査する (どの機種向けのビルドでも崩れに気づく)
+template struct BoardBudget<BoardM5StackBasic>;
+template struct BoardBudget<BoardM5StackCore2>;
+template struct BoardBudget<BoardM5StickCPlus>;
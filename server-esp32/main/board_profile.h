@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include "sdkconfig.h"
+
+// 機種ごとの寸法 (Kconfig の "Board profile" で 1 つ選ぶ)
+//
+// ストアのスロット数・本文の長さ・ボディの上限・詳細のプール・画面の寸法・ボタン数をコンパイル時に決める。
+// 配列の長さも画面の配置 (BoardLayout) もすべて定数になるので、小さい機種は RAM を使わず、
+// 描画側の座標計算は定数に畳み込まれる。予算の検査は board_budget.h
+
+// 全機種で共通の値 (API で受け取る形に合わせたもの)。機種ごとの型で同名のメンバーを定義すれば上書きできる
+struct BoardCommon {
+    static constexpr int FONT_H = 16;               // efontJA_14 の fontHeight()
+    static constexpr int RESPOND_BODY_LEN = 256;    // POST /permission-request/:id/respond のボディ
+    static constexpr int NOTIFY_BODY_LEN = 512;     // POST /notify のボディ (title + message + hostname)
+    static constexpr int DECISION_ARENA_SIZE = 6144;    // 応答専用ワーカーの cJSON アリーナ
+    static constexpr bool CARDS_IN_PSRAM = false;   // 本文カードを PSRAM に置く (内部 RAM の予算に入れない)
+    static constexpr bool DETAIL_IN_PSRAM = false;  // 詳細 (tool_input の全文) のプールを PSRAM に置く
+    static constexpr bool ARENAS_IN_PSRAM = false;  // 汎用ワーカーのアリーナを PSRAM に置く (応答専用は常に内部 RAM)
+};
+
+// M5Stack Basic / Gray / Fire: 320x240、物理ボタン 3 つ (GPIO 39/38/37)、PSRAM なし (Basic)
+struct BoardM5StackBasic : BoardCommon {
+    static constexpr const char* NAME = "m5stack";
+    static constexpr int DISPLAY_W = 320;           // setRotation(1) 後の横長
+    static constexpr int DISPLAY_H = 240;
+    static constexpr int BUTTONS = 3;
+    static constexpr int MAX_REQUESTS = 8;
+    static constexpr int MESSAGE_LEN = 512;
+    static constexpr int MAX_BODY_LEN = 4096;       // POST /permission-request のボディ (tool_input の全文を含む)
+    static constexpr int NOTIFY_QUEUE_LEN = 8;
+    static constexpr int CARD_SLOTS = 2;            // 表示中 + 次
+    static constexpr int DETAIL_POOL_SIZE = 8192;   // 詳細の圧縮済みページ (全リクエストで共有)
+    static constexpr int GENERAL_ARENA_SIZE = 16384;
+    static constexpr size_t RAM_BUDGET = 88 * 1024; // ストア・通知・アリーナ・カード・詳細の合計の上限
+};
+
+// M5Stack Core2 / CoreS3: 320x240、タッチボタン 3 つ、PSRAM 8MB (カードを増やして PSRAM に置く)
+struct BoardM5StackCore2 : BoardCommon {
+    static constexpr const char* NAME = "m5stack-core2";
+    static constexpr int DISPLAY_W = 320;
+    static constexpr int DISPLAY_H = 240;
+    static constexpr int BUTTONS = 3;
+    static constexpr int MAX_REQUESTS = 8;
+    static constexpr int MESSAGE_LEN = 512;
+    static constexpr int MAX_BODY_LEN = 16384;
+    static constexpr int NOTIFY_QUEUE_LEN = 8;
+    static constexpr int CARD_SLOTS = 4;
+    static constexpr bool CARDS_IN_PSRAM = true;
+    static constexpr int DETAIL_POOL_SIZE = 128 * 1024;
+    static constexpr bool DETAIL_IN_PSRAM = true;
+    static constexpr int GENERAL_ARENA_SIZE = 40 * 1024;   // 最大のボディ + 解析ツリー + 詳細の書き込み領域
+    static constexpr bool ARENAS_IN_PSRAM = true;
+    static constexpr size_t RAM_BUDGET = 64 * 1024;
+};
+
+// M5StickC Plus: 240x135、前面 (A) と側面 (B) の 2 ボタン。C (次へ) は電源ボタンのクリック
+// 画面が小さいので同時に持つリクエストと本文を減らす。ボディは他の機種と同じ下限 (2KB) まで受け、
+// 汎用アリーナを広げた分は応答専用のアリーナを縮めて予算に収める
+struct BoardM5StickCPlus : BoardCommon {
+    static constexpr const char* NAME = "m5stickc-plus";
+    static constexpr int DISPLAY_W = 240;
+    static constexpr int DISPLAY_H = 135;
+    static constexpr int BUTTONS = 2;
+    static constexpr int MAX_REQUESTS = 4;
+    static constexpr int MESSAGE_LEN = 256;
+    static constexpr int MAX_BODY_LEN = 2048;
+    static constexpr int NOTIFY_QUEUE_LEN = 4;
+    static constexpr int CARD_SLOTS = 2;
+    static constexpr int DETAIL_POOL_SIZE = 2048;
+    static constexpr int GENERAL_ARENA_SIZE = 10368;
+    static constexpr int DECISION_ARENA_SIZE = 3072;    // respond / cancel の使用量は 1.5KB 前後 (GET /stats の high_water)
+    static constexpr size_t RAM_BUDGET = 40 * 1024;
+};
+
+#if defined(CONFIG_BOARD_M5STICKC_PLUS)
+using Board = BoardM5StickCPlus;
+#elif defined(CONFIG_BOARD_M5STACK_CORE2)
+using Board = BoardM5StackCore2;
+#else
+using Board = BoardM5StackBasic;
+#endif
+
+// 画面の配置 (ヘッダー・本文・状態行・ボタンバー)。display_manager とカードの大きさが使う
+template <class B>
+struct BoardLayout {
+    static constexpr int HEADER_H = B::FONT_H + 6;
+    static constexpr int BTN_BAR_H = B::FONT_H + 6;
+    static constexpr int BODY_TOP = HEADER_H + 1;
+    static constexpr int BODY_BOTTOM = B::DISPLAY_H - BTN_BAR_H;
+    static constexpr int STATUS_Y = BODY_BOTTOM - B::FONT_H - 4;
+    static constexpr int MESSAGE_H = STATUS_Y - BODY_TOP;
+    static constexpr int BTN_W = B::DISPLAY_W / B::BUTTONS;
+    static constexpr size_t CARD_BYTES = (size_t)B::DISPLAY_W * MESSAGE_H / 4;     // 2bit パレット
+
+    static_assert(MESSAGE_H >= B::FONT_H * 3, "message area must hold a subtitle and two lines");
+    static_assert(B::BUTTONS == 2 || B::BUTTONS == 3, "button bar supports 2 or 3 buttons");
+};
+
+using Layout = BoardLayout<Board>;
@@ -1,17 +1,57 @@
 #include "button_handler.h"
 #include "request_store.h"
 #include "display_manager.h"
+#include "input_events.h"
 #include "wifi_setup.h"
+#include "relay_mirror.h"
+#include "deferred_log.h"
 
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
 #include <M5Unified.h>
 #include <esp_log.h>
+#include "sdkconfig.h"
 
 static const char* TAG = "button";
 
 static int s_current_index = 0;
 
+// A で送る選択肢 (C のダブルクリックで巡回)。選んだときに表示していたリクエストにだけ効く
+static char s_choice_id[UUID_STR_LEN] = {0};
+static int s_choice_index = 0;
+
+// 巡回が要るのは 3 択以上だけ (2 択なら A が先頭、B が最後を送るので全部押し分けられる)
+static bool cycles_choices(const PermissionRequest* req) {
+    return req->choice_count > 2;
+}
+
+static int selected_choice(const PermissionRequest* req) {
+    if (strcmp(s_choice_id, req->id) != 0 || s_choice_index >= req->choice_count) return 0;
+    return s_choice_index;
+}
+
+static void reset_choice(void) {
+    s_choice_id[0] = '\0';
+    s_choice_index = 0;
+    display_select_choice(nullptr, 0);
+}
+
+// 応答を記録し、ミラー中なら上流へ転送する
+// response / send_key を決めてから呼ぶ (forward_response は上流に渡す response、nullptr = choice で転送)
+static bool respond(PermissionRequest* req, const char* response, const char* send_key,
+                    int choice_number, const char* forward_response) {
+    bool ok = request_store_respond(req->id, response, send_key, DECISION_BUTTON);
+    if (ok) {
+        dlog(DL_BUTTON_RESPONDED, req->id, choice_number, send_key, response);
+        // ミラー中のリクエストは上流サーバが正本なので応答を転送
+        if (req->mirrored) {
+            relay_mirror_forward_respond(req->id, forward_response ? 0 : choice_number, forward_response);
+        }
+    }
+    return ok;
+}
+
 // choice 番号で応答する
 static void respond_with_choice(PermissionRequest* req, int choice_number) {
     char send_key[8];
@@ -26,38 +66,55 @@ static void respond_with_choice(PermissionRequest* req, int choice_number) {
                        choice_number == req->choices[req->choice_count - 1].number;
         actual_response = is_last ? "deny" : "allow";
     }
+    respond(req, actual_response, send_key, choice_number, nullptr);
+}
 
-    bool ok = request_store_respond(req->id, actual_response);
-    if (ok) {
-        strncpy(req->send_key, send_key, sizeof(req->send_key) - 1);
-        ESP_LOGI(TAG, "Responded %s: choice=%d send_key=%s (%s)",
-            req->id, choice_number, send_key, actual_response);
-    }
-
-    // 画面更新
-    display_notify_new_request();
+// 長押し A: 「今後は確認しない」系の選択肢で応答 (HTTP の allow_all と同じ選び方)
+static void respond_allow_all(PermissionRequest* req) {
+    char send_key[8];
+    request_store_resolve_send_key(req, "allow_all", send_key, sizeof(send_key));
+    respond(req, "allow", send_key, atoi(send_key), "allow_all");
 }
 
-void button_handler_update(void) {
-    if (!display_available()) return;
+// 長押し B: 表示中のリクエストと同じホストの未応答をすべて拒否
+static void deny_host(PermissionRequest* const* pending, int pending_count,
+                      const PermissionRequest* current) {
+    char host[sizeof(PermissionRequest::hostname)];
+    strcpy(host, current->hostname);
+    int denied = 0;
+    for (int i = 0; i < pending_count; i++) {
+        PermissionRequest* req = pending[i];
+        if (strcmp(req->hostname, host) != 0) continue;
+        char send_key[8];
+        request_store_resolve_send_key(req, "deny", send_key, sizeof(send_key));
+        if (respond(req, "deny", send_key, atoi(send_key), "deny")) denied++;
+    }
+    dlog(DL_BUTTON_DENIED_HOST, denied, host[0] ? host : "local");
+}
 
-    // 未応答リクエストを収集
+// 未応答リクエストを収集 (ロック内で呼ぶ)
+static int collect_pending(PermissionRequest** pending) {
     PermissionRequest* all[MAX_REQUESTS];
     int all_count = request_store_get_all(all, MAX_REQUESTS);
-
-    PermissionRequest* pending[MAX_REQUESTS];
     int pending_count = 0;
     for (int i = 0; i < all_count; i++) {
         if (all[i]->response[0] == '\0') {
             pending[pending_count++] = all[i];
         }
     }
+    return pending_count;
+}
+
+static void handle_gesture(const InputEvent* ev) {
+    PermissionRequest* pending[MAX_REQUESTS];
+    int pending_count = collect_pending(pending);
 
     // ボタン C: 次のリクエスト / 通知 OK
-    if (M5.BtnC.wasPressed()) {
+    if (ev->button == INPUT_BUTTON_C && ev->gesture == GESTURE_CLICK) {
+        reset_choice();
         if (pending_count > 0) {
             s_current_index = (s_current_index + 1) % pending_count;
-            display_show_request(pending[s_current_index], s_current_index, pending_count);
+            display_show_request(pending[s_current_index], s_current_index, pending_count, ev->time_us);
         } else {
             // 通知表示中なら idle に戻る
             display_show_idle(wifi_get_ip_str());
@@ -74,15 +131,90 @@ void button_handler_update(void) {
 
     PermissionRequest* current = pending[s_current_index];
 
-    // ボタン A: 最初の選択肢で応答
-    if (M5.BtnA.wasPressed() && current->choice_count > 0) {
-        respond_with_choice(current, current->choices[0].number);
-        s_current_index = 0;
+    switch (ev->button) {
+        case INPUT_BUTTON_A:
+            if (current->choice_count == 0) return;
+            if (ev->gesture == GESTURE_LONG_PRESS) {
+                respond_allow_all(current);
+            } else {
+                respond_with_choice(current, current->choices[selected_choice(current)].number);
+            }
+            break;
+        case INPUT_BUTTON_B:
+            if (ev->gesture == GESTURE_LONG_PRESS) {
+                deny_host(pending, pending_count, current);
+            } else if (current->choice_count > 1) {
+                respond_with_choice(current, current->choices[current->choice_count - 1].number);
+            } else {
+                return;
+            }
+            break;
+        case INPUT_BUTTON_C:
+            // ダブルクリック: A で送る選択肢を 1 → 2 → … → N → 1 と巡回 (応答はしない)
+            if (ev->gesture == GESTURE_DOUBLE_CLICK && cycles_choices(current)) {
+                int next = (selected_choice(current) + 1) % current->choice_count;
+                strcpy(s_choice_id, current->id);
+                s_choice_index = next;
+                display_select_choice(current->id, next);
+            } else if (ev->gesture == GESTURE_LONG_PRESS) {
+                // 長押し: 詳細 (tool_input の全文) を 1 画面ずつ送る (応答はしない)
+                display_page_detail();
+            }
+            return;
+        default:
+            return;
     }
 
-    // ボタン B: 最後の選択肢で応答
-    if (M5.BtnB.wasPressed() && current->choice_count > 1) {
-        respond_with_choice(current, current->choices[current->choice_count - 1].number);
-        s_current_index = 0;
+    // 応答したら先頭の未応答に戻る
+    s_current_index = 0;
+    reset_choice();
+    display_notify_new_request();
+}
+
+// 認識タスクから呼ばれる
+static void on_gesture(const InputEvent* ev) {
+    if (!display_available()) return;
+
+    // HTTP ワーカーが同じリクエストに応答するのと競合しないようロックして判定
+    request_store_lock();
+    handle_gesture(ev);
+    request_store_unlock();
+}
+
+// 認識タスクから C を離すたびに呼ばれる。表示中のリクエストが 3 択以上のときだけ
+// ダブルクリック (選択肢の巡回) を待つ。それ以外の C (次へ) は離した時点で出す
+static bool wants_double_click(InputButton button) {
+    if (button != INPUT_BUTTON_C || !display_available()) return false;
+
+    request_store_lock();
+    PermissionRequest* pending[MAX_REQUESTS];
+    int pending_count = collect_pending(pending);
+    bool wants = pending_count > 0 &&
+                 cycles_choices(pending[s_current_index < pending_count ? s_current_index : 0]);
+    request_store_unlock();
+    return wants;
+}
+
+void button_handler_start(void) {
+    esp_err_t err = input_start(on_gesture, wants_double_click);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Button input not started: %s", esp_err_to_name(err));
+    }
+}
+
+void button_handler_update(void) {
+#ifndef CONFIG_INPUT_GPIO_BUTTONS
+    // GPIO 割り込みを使わない機種 (タッチボタン) は M5.update() の結果を端として渡す
+    m5::Button_Class* btns[INPUT_BUTTON_COUNT] = { &M5.BtnA, &M5.BtnB, &M5.BtnC };
+    for (int i = 0; i < Board::BUTTONS; i++) {
+        if (btns[i]->wasPressed()) input_feed((InputButton)i, true);
+        if (btns[i]->wasReleased()) input_feed((InputButton)i, false);
+    }
+#endif
+    if constexpr (Board::BUTTONS == 2) {
+        // 2 ボタンの機種の C は電源ボタン。PMIC が短押しを通知した 1 周期だけ押下になる
+        // (周期 50ms > チャタリング除去の 20ms なので、解放も捨てられない)
+        if (M5.BtnPWR.wasPressed()) input_feed(INPUT_BUTTON_C, true);
+        if (M5.BtnPWR.wasReleased()) input_feed(INPUT_BUTTON_C, false);
     }
 }
@@ -1,4 +1,11 @@
 #pragma once
 
-// ボタン入力を処理 (メインループから呼ぶ)
+// ボタン入力の開始 (ジェスチャーごとに応答・切り替えを行う。request_store_init の後に呼ぶ)
+//   A: 選択中の選択肢 (既定は最初) で応答、長押しで「今後は確認しない」系の選択肢で応答
+//   B: 最後の選択肢 (拒否) で応答、長押しで表示中のホストの未応答をすべて拒否
+//   C: 次のリクエスト、ダブルクリックで A の選択肢を巡回 (2 ボタンの機種では電源ボタン)
+void button_handler_start(void);
+
+// タッチボタンの機種用: M5.update() の結果を入力に渡す (メインループから呼ぶ)
+// GPIO 割り込みを使う場合は、2 ボタンの機種の電源ボタン (C) だけを渡す
 void button_handler_update(void);
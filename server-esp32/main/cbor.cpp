@@ -0,0 +1,367 @@
+#include "cbor.h"
+
+#include <cstring>
+
+// メジャータイプ (先頭 3 bit)
+#define MT_UINT   0
+#define MT_NEGINT 1
+#define MT_BYTES  2
+#define MT_TEXT   3
+#define MT_ARRAY  4
+#define MT_MAP    5
+#define MT_TAG    6
+#define MT_SIMPLE 7
+
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE  21
+#define SIMPLE_NULL  22
+
+#define MAX_SKIP_DEPTH 8
+
+static const char* const KEY_NAMES[CK_COUNT] = {
+    "id", "tool_name", "message", "choices", "created_at", "expires_at",
+    "response", "responded_at", "send_key", "hostname", "number", "text",
+    "tmux_target", "header", "description", "prompt_question", "has_tmux",
+    "tool_input", "timeout", "title", "choice", "ok", "error", "command",
+    "file_path", "source",
+};
+
+const char* cbor_key_name(int key) {
+    return (key >= 0 && key < CK_COUNT) ? KEY_NAMES[key] : nullptr;
+}
+
+// ── エンコーダ ──
+
+void cbor_writer_init(CborWriter* w, uint8_t* buf, size_t cap, cbor_flush_fn flush, void* ctx) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->flushed = 0;
+    w->flush = flush;
+    w->ctx = ctx;
+    w->error = false;
+}
+
+bool cbor_writer_flush(CborWriter* w) {
+    if (w->error) return false;
+    if (!w->flush || w->len == 0) return true;
+    if (!w->flush(w->ctx, w->buf, w->len)) {
+        w->error = true;
+        return false;
+    }
+    w->flushed += w->len;
+    w->len = 0;
+    return true;
+}
+
+static void put_bytes(CborWriter* w, const void* data, size_t len) {
+    const uint8_t* src = (const uint8_t*)data;
+    while (len > 0 && !w->error) {
+        if (w->len == w->cap) {
+            if (!w->flush) {
+                w->error = true;
+                return;
+            }
+            cbor_writer_flush(w);
+            continue;
+        }
+        size_t n = w->cap - w->len;
+        if (n > len) n = len;
+        memcpy(w->buf + w->len, src, n);
+        w->len += n;
+        src += n;
+        len -= n;
+    }
+}
+
+static void put_head(CborWriter* w, uint8_t major, uint64_t v) {
+    uint8_t head[9];
+    size_t n;
+    if (v < 24) {
+        head[0] = (uint8_t)((major << 5) | v);
+        n = 1;
+    } else if (v <= 0xff) {
+        head[0] = (uint8_t)((major << 5) | 24);
+        head[1] = (uint8_t)v;
+        n = 2;
+    } else if (v <= 0xffff) {
+        head[0] = (uint8_t)((major << 5) | 25);
+        head[1] = (uint8_t)(v >> 8);
+        head[2] = (uint8_t)v;
+        n = 3;
+    } else if (v <= 0xffffffffu) {
+        head[0] = (uint8_t)((major << 5) | 26);
+        for (int i = 0; i < 4; i++) head[1 + i] = (uint8_t)(v >> (24 - 8 * i));
+        n = 5;
+    } else {
+        head[0] = (uint8_t)((major << 5) | 27);
+        for (int i = 0; i < 8; i++) head[1 + i] = (uint8_t)(v >> (56 - 8 * i));
+        n = 9;
+    }
+    put_bytes(w, head, n);
+}
+
+void cbor_put_uint(CborWriter* w, uint64_t v) {
+    put_head(w, MT_UINT, v);
+}
+
+void cbor_put_int(CborWriter* w, int64_t v) {
+    if (v >= 0) {
+        put_head(w, MT_UINT, (uint64_t)v);
+    } else {
+        put_head(w, MT_NEGINT, (uint64_t)(-1 - v));
+    }
+}
+
+void cbor_put_text_n(CborWriter* w, const char* s, size_t len) {
+    put_head(w, MT_TEXT, len);
+    put_bytes(w, s, len);
+}
+
+void cbor_put_text(CborWriter* w, const char* s) {
+    cbor_put_text_n(w, s, strlen(s));
+}
+
+void cbor_put_bool(CborWriter* w, bool v) {
+    uint8_t b = (MT_SIMPLE << 5) | (v ? SIMPLE_TRUE : SIMPLE_FALSE);
+    put_bytes(w, &b, 1);
+}
+
+void cbor_put_null(CborWriter* w) {
+    uint8_t b = (MT_SIMPLE << 5) | SIMPLE_NULL;
+    put_bytes(w, &b, 1);
+}
+
+void cbor_put_array(CborWriter* w, size_t count) {
+    put_head(w, MT_ARRAY, count);
+}
+
+void cbor_put_map(CborWriter* w, size_t count) {
+    put_head(w, MT_MAP, count);
+}
+
+void cbor_put_text_or_null(CborWriter* w, const char* s) {
+    if (s && s[0]) {
+        cbor_put_text(w, s);
+    } else {
+        cbor_put_null(w);
+    }
+}
+
+// ── デコーダ ──
+
+void cbor_reader_init(CborReader* r, uint8_t* buf, size_t len) {
+    r->p = buf;
+    r->end = buf + len;
+    r->error = false;
+}
+
+CborType cbor_peek_type(const CborReader* r) {
+    if (r->error || r->p >= r->end) return CBOR_TYPE_END;
+    return (CborType)(*r->p >> 5);
+}
+
+// ヘッダを読み、メジャータイプと引数を返す
+static bool get_head(CborReader* r, uint8_t* major, uint64_t* arg, uint8_t* info = nullptr) {
+    if (r->error || r->p >= r->end) {
+        r->error = true;
+        return false;
+    }
+    uint8_t ib = *r->p++;
+    *major = ib >> 5;
+    uint8_t ai = ib & 0x1f;
+    if (info) *info = ai;
+
+    if (ai < 24) {
+        *arg = ai;
+        return true;
+    }
+    int n = ai == 24 ? 1 : ai == 25 ? 2 : ai == 26 ? 4 : ai == 27 ? 8 : 0;
+    if (n == 0 || r->end - r->p < n) {
+        // 不定長 (31) と予約値は非対応
+        r->error = true;
+        return false;
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v = (v << 8) | *r->p++;
+    *arg = v;
+    return true;
+}
+
+bool cbor_get_int(CborReader* r, int64_t* out) {
+    uint8_t major;
+    uint64_t arg;
+    if (!get_head(r, &major, &arg)) return false;
+    if (major == MT_UINT && arg <= INT64_MAX) {
+        *out = (int64_t)arg;
+        return true;
+    }
+    if (major == MT_NEGINT && arg <= INT64_MAX) {
+        *out = -1 - (int64_t)arg;
+        return true;
+    }
+    r->error = true;
+    return false;
+}
+
+static double half_to_double(uint16_t h) {
+    int exp = (h >> 10) & 0x1f;
+    int mant = h & 0x3ff;
+    double v;
+    if (exp == 0) {
+        v = mant / 16777216.0;  // 2^-24
+    } else if (exp != 31) {
+        v = (mant + 1024) / 1024.0;
+        for (int e = exp - 15; e > 0; e--) v *= 2;
+        for (int e = exp - 15; e < 0; e++) v /= 2;
+    } else {
+        v = mant == 0 ? __builtin_inf() : __builtin_nan("");
+    }
+    return (h & 0x8000) ? -v : v;
+}
+
+bool cbor_get_number(CborReader* r, double* out) {
+    CborType t = cbor_peek_type(r);
+    if (t == CBOR_TYPE_UINT || t == CBOR_TYPE_NEGINT) {
+        int64_t v;
+        if (!cbor_get_int(r, &v)) return false;
+        *out = (double)v;
+        return true;
+    }
+    uint8_t major, info;
+    uint64_t arg;
+    if (!get_head(r, &major, &arg, &info) || major != MT_SIMPLE) {
+        r->error = true;
+        return false;
+    }
+    if (info == 25) {
+        *out = half_to_double((uint16_t)arg);
+    } else if (info == 26) {
+        uint32_t bits = (uint32_t)arg;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        *out = f;
+    } else if (info == 27) {
+        memcpy(out, &arg, sizeof(*out));
+    } else {
+        r->error = true;
+        return false;
+    }
+    return true;
+}
+
+bool cbor_get_text(CborReader* r, const char** out) {
+    if (r->p < r->end && *r->p == ((MT_SIMPLE << 5) | SIMPLE_NULL)) {
+        r->p++;
+        *out = nullptr;
+        return true;
+    }
+    uint8_t major;
+    uint64_t len;
+    if (!get_head(r, &major, &len)) return false;
+    if (major != MT_TEXT || len > (uint64_t)(r->end - r->p)) {
+        r->error = true;
+        return false;
+    }
+    // ヘッダは最低 1 バイトあるので、1 バイト前に詰めて末尾に NUL を置く
+    char* dst = (char*)r->p - 1;
+    memmove(dst, r->p, len);
+    dst[len] = '\0';
+    r->p += len;
+    *out = dst;
+    return true;
+}
+
+bool cbor_get_bool(CborReader* r, bool* out) {
+    uint8_t major, info;
+    uint64_t arg;
+    if (!get_head(r, &major, &arg, &info)) return false;
+    if (major != MT_SIMPLE || (info != SIMPLE_TRUE && info != SIMPLE_FALSE)) {
+        r->error = true;
+        return false;
+    }
+    *out = info == SIMPLE_TRUE;
+    return true;
+}
+
+static bool get_container(CborReader* r, uint8_t want, size_t* count) {
+    uint8_t major;
+    uint64_t arg;
+    if (!get_head(r, &major, &arg)) return false;
+    if (major != want || arg > (uint64_t)(r->end - r->p)) {
+        r->error = true;
+        return false;
+    }
+    *count = (size_t)arg;
+    return true;
+}
+
+bool cbor_get_array(CborReader* r, size_t* count) {
+    return get_container(r, MT_ARRAY, count);
+}
+
+bool cbor_get_map(CborReader* r, size_t* count) {
+    return get_container(r, MT_MAP, count);
+}
+
+bool cbor_get_key(CborReader* r, int* key) {
+    CborType t = cbor_peek_type(r);
+    if (t == CBOR_TYPE_UINT) {
+        int64_t v;
+        if (!cbor_get_int(r, &v)) return false;
+        *key = (v < CK_COUNT) ? (int)v : CK_UNKNOWN;
+        return true;
+    }
+    if (t == CBOR_TYPE_TEXT) {
+        const char* name;
+        if (!cbor_get_text(r, &name)) return false;
+        *key = CK_UNKNOWN;
+        for (int i = 0; i < CK_COUNT; i++) {
+            if (strcmp(name, KEY_NAMES[i]) == 0) {
+                *key = i;
+                break;
+            }
+        }
+        return true;
+    }
+    r->error = true;
+    return false;
+}
+
+static bool skip_depth(CborReader* r, int depth) {
+    if (depth > MAX_SKIP_DEPTH) {
+        r->error = true;
+        return false;
+    }
+    uint8_t major;
+    uint64_t arg;
+    if (!get_head(r, &major, &arg)) return false;
+    switch (major) {
+        case MT_BYTES:
+        case MT_TEXT:
+            if (arg > (uint64_t)(r->end - r->p)) {
+                r->error = true;
+                return false;
+            }
+            r->p += arg;
+            return true;
+        case MT_ARRAY:
+            for (uint64_t i = 0; i < arg; i++) {
+                if (!skip_depth(r, depth + 1)) return false;
+            }
+            return true;
+        case MT_MAP:
+            for (uint64_t i = 0; i < arg * 2; i++) {
+                if (!skip_depth(r, depth + 1)) return false;
+            }
+            return true;
+        case MT_TAG:
+            return skip_depth(r, depth + 1);
+        default:
+            return true;
+    }
+}
+
+bool cbor_skip(CborReader* r) {
+    return skip_depth(r, 0);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// CBOR (RFC 8949) の最小実装
+// 対応: 符号なし/負整数、テキスト文字列、配列、マップ、bool、null、浮動小数点 (読み取りのみ)
+// 非対応: 不定長 (indefinite length)、タグ、バイト文字列の読み取り
+//
+// ワイヤ上のキーは下記 CborKey の整数を使う (テキストキーも読み取り時は受け付ける)
+// 対応表は docs/api.md の「CBOR ワイヤフォーマット」を参照
+
+enum CborKey : int {
+    CK_ID = 0,
+    CK_TOOL_NAME = 1,
+    CK_MESSAGE = 2,
+    CK_CHOICES = 3,
+    CK_CREATED_AT = 4,
+    CK_EXPIRES_AT = 5,
+    CK_RESPONSE = 6,
+    CK_RESPONDED_AT = 7,
+    CK_SEND_KEY = 8,
+    CK_HOSTNAME = 9,
+    CK_NUMBER = 10,
+    CK_TEXT = 11,
+    CK_TMUX_TARGET = 12,
+    CK_HEADER = 13,
+    CK_DESCRIPTION = 14,
+    CK_PROMPT_QUESTION = 15,
+    CK_HAS_TMUX = 16,
+    CK_TOOL_INPUT = 17,
+    CK_TIMEOUT = 18,
+    CK_TITLE = 19,
+    CK_CHOICE = 20,
+    CK_OK = 21,
+    CK_ERROR = 22,
+    CK_COMMAND = 23,
+    CK_FILE_PATH = 24,
+    CK_SOURCE = 25,
+    CK_COUNT,
+    CK_UNKNOWN = -1,
+};
+
+// キー番号 → JSON フィールド名
+const char* cbor_key_name(int key);
+
+// ── エンコーダ ──
+// バッファが溢れると flush コールバックで逐次吐き出す (nullptr ならエラー扱い)
+typedef bool (*cbor_flush_fn)(void* ctx, const uint8_t* data, size_t len);
+
+struct CborWriter {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    size_t flushed;         // flush 済みバイト数
+    cbor_flush_fn flush;
+    void* ctx;
+    bool error;
+};
+
+void cbor_writer_init(CborWriter* w, uint8_t* buf, size_t cap, cbor_flush_fn flush = nullptr, void* ctx = nullptr);
+void cbor_put_uint(CborWriter* w, uint64_t v);
+void cbor_put_int(CborWriter* w, int64_t v);
+void cbor_put_text(CborWriter* w, const char* s);
+void cbor_put_text_n(CborWriter* w, const char* s, size_t len);
+void cbor_put_bool(CborWriter* w, bool v);
+void cbor_put_null(CborWriter* w);
+void cbor_put_array(CborWriter* w, size_t count);
+void cbor_put_map(CborWriter* w, size_t count);
+// 文字列が空なら null を書く
+void cbor_put_text_or_null(CborWriter* w, const char* s);
+// バッファ残りを flush (flush 未指定なら何もしない)
+bool cbor_writer_flush(CborWriter* w);
+
+// ── デコーダ ──
+// テキスト文字列はバッファ内でその場で NUL 終端する (バッファを書き換える)
+enum CborType {
+    CBOR_TYPE_UINT,
+    CBOR_TYPE_NEGINT,
+    CBOR_TYPE_BYTES,
+    CBOR_TYPE_TEXT,
+    CBOR_TYPE_ARRAY,
+    CBOR_TYPE_MAP,
+    CBOR_TYPE_TAG,
+    CBOR_TYPE_SIMPLE,
+    CBOR_TYPE_END,
+};
+
+struct CborReader {
+    uint8_t* p;
+    uint8_t* end;
+    bool error;
+};
+
+void cbor_reader_init(CborReader* r, uint8_t* buf, size_t len);
+CborType cbor_peek_type(const CborReader* r);
+bool cbor_get_int(CborReader* r, int64_t* out);
+bool cbor_get_number(CborReader* r, double* out);     // 整数 or 浮動小数点
+bool cbor_get_text(CborReader* r, const char** out);  // null なら *out = nullptr
+bool cbor_get_bool(CborReader* r, bool* out);
+bool cbor_get_array(CborReader* r, size_t* count);
+bool cbor_get_map(CborReader* r, size_t* count);
+// マップのキーを読む (整数キー or テキストキー → CborKey、未知なら CK_UNKNOWN)
+bool cbor_get_key(CborReader* r, int* key);
+// 任意の 1 要素を読み飛ばす
+bool cbor_skip(CborReader* r);
@@ -0,0 +1,217 @@
+#include "decision_history.h"
+#include "decision_stats.h"
+
+#include <cstdarg>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static const char* TAG = "history";
+
+#define HISTORY_SIZE CONFIG_DECISION_HISTORY_SIZE
+
+static HistoryRecord s_ring[HISTORY_SIZE];
+static uint32_t s_next_seq = 1;         // 次に書くレコードの seq (書いた数 + 1)
+
+// intern 表: ID は添字 + 1 (0 = HISTORY_ID_NONE)。一度入れた文字列は変えないので、
+// レコードから得た ID の文字列はロックなしで読める
+static char s_hosts[HISTORY_MAX_HOSTS][sizeof(PermissionRequest::hostname)];
+static char s_tools[HISTORY_MAX_TOOLS][HISTORY_TOOL_LEN];
+static int s_host_count = 0;
+static int s_tool_count = 0;
+
+static SemaphoreHandle_t s_lock = nullptr;
+
+void decision_history_init(void) {
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+    decision_stats_init();
+    ESP_LOGI(TAG, "Decision history: %d records (%u bytes)",
+             HISTORY_SIZE, (unsigned)sizeof(s_ring));
+}
+
+// 線形探索で十分 (確定は人の操作の頻度でしか起きない)
+static uint16_t intern(char* table, size_t width, int* count, int max, const char* s) {
+    if (!s || s[0] == '\0') return HISTORY_ID_NONE;
+    for (int i = 0; i < *count; i++) {
+        if (strncmp(table + i * width, s, width - 1) == 0) return (uint16_t)(i + 1);
+    }
+    if (*count >= max) return HISTORY_ID_NONE;
+    char* slot = table + *count * width;
+    strncpy(slot, s, width - 1);
+    slot[width - 1] = '\0';
+    return (uint16_t)(++*count);
+}
+
+static uint32_t fnv1a(const char* s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static HistoryOutcome outcome_of(const char* response) {
+    if (response[0] == '\0') return OUTCOME_EVICTED;
+    if (strcmp(response, "allow") == 0) return OUTCOME_ALLOW;
+    if (strcmp(response, "deny") == 0) return OUTCOME_DENY;
+    if (strcmp(response, "cancelled") == 0) return OUTCOME_CANCELLED;
+    if (strcmp(response, "expired") == 0) return OUTCOME_EXPIRED;
+    return OUTCOME_OTHER;
+}
+
+void decision_history_record(const PermissionRequest* req, DecisionSource source) {
+    HistoryRecord rec = {};
+    rec.command_hash = fnv1a(req->message);
+    rec.created_at = req->created_at;
+    rec.responded_at = req->responded_at;
+    rec.outcome = outcome_of(req->response);
+    rec.source = source;
+    int key = atoi(req->send_key);
+    rec.send_key = (key > 0 && key <= 255) ? (uint8_t)key : 0;
+    rec.mirrored = req->mirrored ? 1 : 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    rec.host_id = intern(&s_hosts[0][0], sizeof(s_hosts[0]), &s_host_count, HISTORY_MAX_HOSTS,
+                         req->hostname);
+    rec.tool_id = intern(&s_tools[0][0], sizeof(s_tools[0]), &s_tool_count, HISTORY_MAX_TOOLS,
+                         req->tool_name);
+    rec.seq = s_next_seq++;
+    s_ring[rec.seq % HISTORY_SIZE] = rec;
+    xSemaphoreGive(s_lock);
+
+    decision_stats_add(&rec);
+}
+
+int decision_history_read(uint32_t before, HistoryRecord* out, int max, bool* more) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // リングに残っている範囲は [oldest, s_next_seq)
+    uint32_t oldest = s_next_seq > HISTORY_SIZE ? s_next_seq - HISTORY_SIZE : 1;
+    uint32_t seq = before < s_next_seq ? before : s_next_seq;
+    int count = 0;
+    while (count < max && seq > oldest) {
+        seq--;
+        out[count++] = s_ring[seq % HISTORY_SIZE];
+    }
+    *more = seq > oldest;
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+static const char* outcome_name(HistoryOutcome o) {
+    switch (o) {
+        case OUTCOME_ALLOW:     return "allow";
+        case OUTCOME_DENY:      return "deny";
+        case OUTCOME_CANCELLED: return "cancelled";
+        case OUTCOME_EXPIRED:   return "expired";
+        case OUTCOME_EVICTED:   return "evicted";
+        default:                return "other";
+    }
+}
+
+static const char* source_name(DecisionSource s) {
+    switch (s) {
+        case DECISION_API:      return "api";
+        case DECISION_BUTTON:   return "button";
+        case DECISION_UPSTREAM: return "upstream";
+        case DECISION_HOOK:     return "hook";
+        case DECISION_POLICY:   return "policy";
+        default:                return "auto";
+    }
+}
+
+// 固定長バッファへの追記 (溢れたら overflow を立てて以降は書かない)
+struct JsonOut {
+    char* buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+};
+
+static void out_printf(JsonOut* o, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out_printf(JsonOut* o, const char* fmt, ...) {
+    if (o->overflow) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= o->cap - o->len) {
+        o->overflow = true;
+        return;
+    }
+    o->len += n;
+}
+
+// JSON 文字列 (引用符込み)。nullptr なら null
+static void out_string(JsonOut* o, const char* s) {
+    if (!s) {
+        out_printf(o, "null");
+        return;
+    }
+    out_printf(o, "\"");
+    for (; *s && !o->overflow; s++) {
+        uint8_t c = (uint8_t)*s;
+        if (c == '"' || c == '\\') {
+            out_printf(o, "\\%c", c);
+        } else if (c < 0x20) {
+            out_printf(o, "\\u%04x", c);
+        } else if (o->len + 1 < o->cap) {
+            o->buf[o->len++] = c;
+            o->buf[o->len] = '\0';
+        } else {
+            o->overflow = true;
+        }
+    }
+    out_printf(o, "\"");
+}
+
+static bool format_record(const HistoryRecord* rec, const char* host, const char* tool,
+                          char* buf, size_t cap, size_t* len) {
+    JsonOut o = { buf, cap, 0, false };
+    out_printf(&o, "{\"seq\":%u,\"host\":", (unsigned)rec->seq);
+    out_string(&o, host);
+    out_printf(&o, ",\"tool\":");
+    out_string(&o, tool);
+    out_printf(&o,
+        ",\"command_hash\":\"%08x\",\"outcome\":\"%s\",\"source\":\"%s\","
+        "\"send_key\":%u,\"mirrored\":%s,\"created_at\":%lld,\"responded_at\":%lld}",
+        (unsigned)rec->command_hash, outcome_name(rec->outcome), source_name(rec->source),
+        (unsigned)rec->send_key, rec->mirrored ? "true" : "false",
+        (long long)rec->created_at, (long long)rec->responded_at);
+    *len = o.len;
+    return !o.overflow;
+}
+
+const char* decision_history_host_name(uint16_t id) {
+    return id != HISTORY_ID_NONE && id <= HISTORY_MAX_HOSTS ? s_hosts[id - 1] : nullptr;
+}
+
+const char* decision_history_tool_name(uint16_t id) {
+    return id != HISTORY_ID_NONE && id <= HISTORY_MAX_TOOLS ? s_tools[id - 1] : nullptr;
+}
+
+size_t decision_history_record_json(const HistoryRecord* rec, char* buf, size_t cap) {
+    const char* host = decision_history_host_name(rec->host_id);
+    const char* tool = decision_history_tool_name(rec->tool_id);
+    size_t len = 0;
+    if (format_record(rec, host, tool, buf, cap, &len)) return len;
+    // エスケープで膨らんで収まらない場合は名前を省く
+    if (format_record(rec, nullptr, nullptr, buf, cap, &len)) return len;
+    return 0;
+}
+
+cJSON* decision_history_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON_AddNumberToObject(root, "recorded", s_next_seq - 1);
+    cJSON_AddNumberToObject(root, "capacity", HISTORY_SIZE);
+    cJSON_AddNumberToObject(root, "hosts", s_host_count);
+    cJSON_AddNumberToObject(root, "tools", s_tool_count);
+    xSemaphoreGive(s_lock);
+    return root;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "request_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cJSON.h>
+
+// 判断履歴: リクエストが確定 (応答・キャンセル・期限切れ・追い出し) した時点の要約を
+// 固定長レコードのリングに残す。request_store の 5 分 cleanup やスロットの追い出しで
+// リクエスト本体が消えても「誰が何をどう判断し、何秒かかったか」を後から引ける
+//
+// ホスト名とツール名は ID に置き換え (intern)、コマンドは message のハッシュだけを持つ
+
+#define HISTORY_MAX_HOSTS 32
+#define HISTORY_MAX_TOOLS 32
+#define HISTORY_TOOL_LEN 32
+#define HISTORY_ID_NONE 0           // 空文字列、または intern 表が満杯
+// decision_history_record_json の 1 レコードに確保する長さ
+// (名前のエスケープで溢れる場合は host / tool を null にして収める)
+#define HISTORY_JSON_MAX 320
+
+enum HistoryOutcome : uint8_t {
+    OUTCOME_ALLOW,
+    OUTCOME_DENY,
+    OUTCOME_CANCELLED,
+    OUTCOME_EXPIRED,
+    OUTCOME_EVICTED,        // 未応答のままストアから消えた (スロット不足・cleanup・上流で削除)
+    OUTCOME_OTHER,
+};
+
+struct HistoryRecord {
+    uint32_t seq;               // 通し番号 (1 始まり、GET /history の cursor)
+    uint32_t command_hash;      // message の FNV-1a
+    int64_t created_at;         // ミリ秒 (boot 相対)
+    int64_t responded_at;       // ミリ秒 (boot 相対)
+    uint16_t host_id;
+    uint16_t tool_id;
+    HistoryOutcome outcome;
+    DecisionSource source;
+    uint8_t send_key;           // 送ったキーの番号 (0 = なし)
+    uint8_t mirrored;
+};
+static_assert(sizeof(HistoryRecord) == 32, "HistoryRecord must stay 32 bytes");
+
+// 初期化 (request_store_init から呼ばれる)
+void decision_history_init(void);
+
+// 確定したリクエストを記録する。outcome は req->response から決める (空なら EVICTED)
+void decision_history_record(const PermissionRequest* req, DecisionSource source);
+
+// seq が before 未満のレコードを新しい順に最大 max 件コピーする (最新から読むなら UINT32_MAX)
+// 戻り値: コピーした件数。*more = さらに古いレコードが残っている
+int decision_history_read(uint32_t before, HistoryRecord* out, int max, bool* more);
+
+// intern ID の文字列 (HISTORY_ID_NONE なら nullptr)。一度入れた文字列は変わらないのでロック不要
+const char* decision_history_host_name(uint16_t id);
+const char* decision_history_tool_name(uint16_t id);
+
+// 1 レコードを JSON オブジェクトとして buf に書く (NUL 終端)
+// 戻り値: 書いた長さ (0 = 収まらない)
+size_t decision_history_record_json(const HistoryRecord* rec, char* buf, size_t cap);
+
+// 記録数・容量・intern 表の使用数 (GET /stats 用)
+cJSON* decision_history_stats_to_json(void);
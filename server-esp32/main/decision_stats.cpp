@@ -0,0 +1,217 @@
+#include "decision_stats.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const char* TAG = "dstats";
+
+// GET /stats に出すホスト・ツールの数 (人に回した数の多い順)。/stats のアリーナを食い潰さないための上限
+#define STATS_JSON_KEYS 8
+
+// 1 つのキーの通算。バケットは 16bit で、どれかが溢れそうになったら全バケットを半分にする
+// (分布の形は保ったまま古い分の重みを下げる。件数は 32bit で別に数えるので正確なまま)
+struct Sketch {
+    uint16_t hist[DECISION_BUCKETS];
+    uint32_t decided;       // 人が応答 (API・ボタン・上流)。判断までの時間をバケットに入れる
+    uint32_t policy;        // 自動判断ポリシー (人に回していないので時間は入れない)
+    uint32_t expired;
+    uint32_t cancelled;     // フック側で確定 (tmux での手動回答・フックのタイムアウト)・上流でキャンセル
+    uint32_t superseded;    // 同じペインの新しいリクエストで自動キャンセル
+    uint32_t evicted;       // 未応答のままストアから消えた
+    uint32_t max_ms;
+};
+
+// 添字は intern ID (0 = 名前なし・表が満杯)
+static_assert(HISTORY_MAX_HOSTS < 64 && HISTORY_MAX_TOOLS < 64, "keys_to_json marks keys in a 64-bit mask");
+static Sketch s_total;
+static Sketch s_hosts[HISTORY_MAX_HOSTS + 1];
+static Sketch s_tools[HISTORY_MAX_TOOLS + 1];
+
+static SemaphoreHandle_t s_lock = nullptr;
+
+void decision_stats_init(void) {
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+    ESP_LOGI(TAG, "Decision stats: %d buckets x %d keys (%u bytes)", DECISION_BUCKETS,
+             1 + HISTORY_MAX_HOSTS + 1 + HISTORY_MAX_TOOLS + 1,
+             (unsigned)(sizeof(s_total) + sizeof(s_hosts) + sizeof(s_tools)));
+}
+
+// [0, 250ms) が 0、[250ms << (i-1), 250ms << i) が i、最後のバケットは上限なし
+static int bucket_of(uint32_t ms) {
+    int i = 0;
+    for (uint32_t bound = DECISION_BUCKET_BASE_MS; i < DECISION_BUCKETS - 1 && ms >= bound; bound <<= 1) i++;
+    return i;
+}
+
+static uint32_t bucket_lower(int i) {
+    return i == 0 ? 0 : (uint32_t)DECISION_BUCKET_BASE_MS << (i - 1);
+}
+
+static void add_latency(Sketch* s, uint32_t ms) {
+    int b = bucket_of(ms);
+    if (s->hist[b] == UINT16_MAX) {
+        for (int i = 0; i < DECISION_BUCKETS; i++) s->hist[i] /= 2;
+    }
+    s->hist[b]++;
+    if (ms > s->max_ms) s->max_ms = ms;
+}
+
+static void add_to(Sketch* s, const HistoryRecord* rec, uint32_t ms) {
+    switch (rec->outcome) {
+        case OUTCOME_ALLOW:
+        case OUTCOME_DENY:
+        case OUTCOME_OTHER:
+            if (rec->source == DECISION_POLICY) {
+                s->policy++;
+            } else {
+                s->decided++;
+                add_latency(s, ms);
+            }
+            break;
+        case OUTCOME_EXPIRED:
+            s->expired++;
+            break;
+        case OUTCOME_CANCELLED:
+            if (rec->source == DECISION_AUTO) s->superseded++;
+            else s->cancelled++;
+            break;
+        case OUTCOME_EVICTED:
+            s->evicted++;
+            break;
+    }
+}
+
+void decision_stats_add(const HistoryRecord* rec) {
+    int64_t d = rec->responded_at - rec->created_at;
+    uint32_t ms = d <= 0 ? 0 : d > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    int host = rec->host_id <= HISTORY_MAX_HOSTS ? rec->host_id : HISTORY_ID_NONE;
+    int tool = rec->tool_id <= HISTORY_MAX_TOOLS ? rec->tool_id : HISTORY_ID_NONE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    add_to(&s_total, rec, ms);
+    add_to(&s_hosts[host], rec, ms);
+    add_to(&s_tools[tool], rec, ms);
+    xSemaphoreGive(s_lock);
+}
+
+static uint32_t asked_of(const Sketch* s) {
+    return s->decided + s->expired + s->cancelled + s->superseded + s->evicted;
+}
+
+// バケット内は一様とみなして線形補間する。最後のバケットの上限は max_ms
+static uint32_t percentile(const Sketch* s, int q) {
+    uint32_t n = 0;
+    for (int i = 0; i < DECISION_BUCKETS; i++) n += s->hist[i];
+    if (n == 0) return 0;
+    uint32_t rank = (n * q + 99) / 100;
+    if (rank == 0) rank = 1;
+    uint32_t before = 0;
+    for (int i = 0; i < DECISION_BUCKETS; i++) {
+        uint32_t c = s->hist[i];
+        if (before + c >= rank) {
+            uint32_t lo = bucket_lower(i);
+            uint32_t hi = i == DECISION_BUCKETS - 1 ? s->max_ms : bucket_lower(i + 1);
+            if (hi > s->max_ms) hi = s->max_ms;
+            if (hi < lo) return lo;
+            return lo + (uint32_t)((uint64_t)(hi - lo) * (rank - before) / c);
+        }
+        before += c;
+    }
+    return s->max_ms;
+}
+
+static uint16_t permille(uint32_t part, uint32_t whole) {
+    return whole ? (uint16_t)((uint64_t)part * 1000 / whole) : 0;
+}
+
+bool decision_stats_summary(DecisionSummary* out) {
+    memset(out, 0, sizeof(*out));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    out->decided = s_total.decided;
+    out->asked = asked_of(&s_total);
+    out->p50_ms = percentile(&s_total, 50);
+    out->p90_ms = percentile(&s_total, 90);
+    out->expired_permille = permille(s_total.expired, out->asked);
+    out->superseded_permille = permille(s_total.superseded, out->asked);
+    int slowest = -1;
+    for (int i = 1; i <= HISTORY_MAX_HOSTS; i++) {
+        if (s_hosts[i].decided < DECISION_MIN_SAMPLES) continue;
+        uint32_t p90 = percentile(&s_hosts[i], 90);
+        if (slowest < 0 || p90 > out->slowest_p90_ms) {
+            slowest = i;
+            out->slowest_p90_ms = p90;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (slowest > 0) {
+        const char* name = decision_history_host_name((uint16_t)slowest);
+        if (name) {
+            strncpy(out->slowest_host, name, sizeof(out->slowest_host) - 1);
+            out->slowest_host[sizeof(out->slowest_host) - 1] = '\0';
+        }
+    }
+    return out->asked > 0;
+}
+
+static void sketch_to_json(cJSON* o, const Sketch* s) {
+    uint32_t asked = asked_of(s);
+    cJSON_AddNumberToObject(o, "asked", asked);
+    cJSON_AddNumberToObject(o, "decided", s->decided);
+    cJSON_AddNumberToObject(o, "policy", s->policy);
+    cJSON_AddNumberToObject(o, "expired", s->expired);
+    cJSON_AddNumberToObject(o, "cancelled", s->cancelled);
+    cJSON_AddNumberToObject(o, "superseded", s->superseded);
+    cJSON_AddNumberToObject(o, "evicted", s->evicted);
+    cJSON_AddNumberToObject(o, "expired_permille", permille(s->expired, asked));
+    cJSON_AddNumberToObject(o, "superseded_permille", permille(s->superseded, asked));
+    cJSON_AddNumberToObject(o, "p50_ms", percentile(s, 50));
+    cJSON_AddNumberToObject(o, "p90_ms", percentile(s, 90));
+    cJSON_AddNumberToObject(o, "p99_ms", percentile(s, 99));
+    cJSON_AddNumberToObject(o, "max_ms", s->max_ms);
+    cJSON* hist = cJSON_AddArrayToObject(o, "hist");
+    for (int i = 0; i < DECISION_BUCKETS; i++) cJSON_AddItemToArray(hist, cJSON_CreateNumber(s->hist[i]));
+}
+
+// 人に回した数 + ポリシーの多い順に最大 STATS_JSON_KEYS 件。名前なし (ID 0) は name: null
+static cJSON* keys_to_json(const Sketch* table, int max_id, const char* (*name_of)(uint16_t)) {
+    cJSON* arr = cJSON_CreateArray();
+    uint64_t used = 0;
+    for (int n = 0; n < STATS_JSON_KEYS; n++) {
+        int best = -1;
+        uint32_t best_count = 0;
+        for (int i = 0; i <= max_id; i++) {
+            uint32_t count = asked_of(&table[i]) + table[i].policy;
+            if ((used >> i & 1) || count == 0) continue;
+            if (best < 0 || count > best_count) {
+                best = i;
+                best_count = count;
+            }
+        }
+        if (best < 0) break;
+        used |= 1ull << best;
+        cJSON* o = cJSON_CreateObject();
+        const char* name = name_of((uint16_t)best);
+        if (name) cJSON_AddStringToObject(o, "name", name);
+        else cJSON_AddNullToObject(o, "name");
+        sketch_to_json(o, &table[best]);
+        cJSON_AddItemToArray(arr, o);
+    }
+    return arr;
+}
+
+cJSON* decision_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* bounds = cJSON_AddArrayToObject(root, "bucket_ms");
+    for (int i = 1; i < DECISION_BUCKETS; i++) cJSON_AddItemToArray(bounds, cJSON_CreateNumber(bucket_lower(i)));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    sketch_to_json(cJSON_AddObjectToObject(root, "all"), &s_total);
+    cJSON_AddItemToObject(root, "hosts", keys_to_json(s_hosts, HISTORY_MAX_HOSTS, decision_history_host_name));
+    cJSON_AddItemToObject(root, "tools", keys_to_json(s_tools, HISTORY_MAX_TOOLS, decision_history_tool_name));
+    xSemaphoreGive(s_lock);
+    return root;
+}
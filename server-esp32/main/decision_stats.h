@@ -0,0 +1,42 @@
+#pragma once
+
+#include "decision_history.h"
+
+#include <cstdint>
+#include <cJSON.h>
+
+// 判断までの時間の集計: 判断履歴に記録したレコードを、ホスト別・ツール別の固定長スケッチに足し込む
+//
+// リングは CONFIG_DECISION_HISTORY_SIZE 件で古いものから消えるが、こちらは起動後の通算を持つ。
+// スケッチは判断までの時間の対数バケット (250ms から 2 倍ずつ 16 段) と、確定の種類ごとの件数。
+// キーは判断履歴の intern ID をそのまま使う (ホスト・ツールとも最大 32 + 表に入らなかった分の 1)
+
+#define DECISION_BUCKETS 16
+#define DECISION_BUCKET_BASE_MS 250     // バケット i の上限は 250ms << i (最後のバケットは上限なし)
+
+// 待機画面に出す要約
+struct DecisionSummary {
+    uint32_t decided;           // 人が応答した数 (ポリシーの自動判断を除く)
+    uint32_t asked;             // 人に回した数 (decided + 期限切れ + キャンセル + 追い出し)
+    uint32_t p50_ms;
+    uint32_t p90_ms;
+    uint16_t expired_permille;  // asked に対する期限切れの割合 (‰)
+    uint16_t superseded_permille;   // asked に対する自動キャンセル (同じペインの新しいリクエスト) の割合
+    char slowest_host[32];      // p90 が最も長いホスト (DECISION_MIN_SAMPLES 件以上。なければ空)
+    uint32_t slowest_p90_ms;
+};
+
+// 要約で「遅いホスト」とみなすのに必要な応答数
+#define DECISION_MIN_SAMPLES 5
+
+// 初期化 (decision_history_init から呼ばれる)
+void decision_stats_init(void);
+
+// 判断履歴に書いたレコードを足し込む (decision_history_record から呼ばれる)
+void decision_stats_add(const HistoryRecord* rec);
+
+// 全体の要約と最も遅いホスト。まだ 1 件も人に回していなければ false
+bool decision_stats_summary(DecisionSummary* out);
+
+// 全体・ホスト別・ツール別の件数と分位点、バケット (GET /stats 用)
+cJSON* decision_stats_to_json(void);
@@ -0,0 +1,285 @@
+#include "deferred_log.h"
+
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+
+static const char* TAG = "dlog";
+
+#define RING_SLOTS 64               // 2 のべき乗
+#define DRAIN_INTERVAL_MS 100
+#define DRAIN_TASK_PRIORITY 1       // 通信・表示より低い (アイドル時に吐き出す)
+
+struct EventInfo {
+    const char* tag;
+    const char* fmt;
+};
+
+#define DLOG_INFO_ENTRY(id, tag, fmt) { tag, fmt },
+static const EventInfo EVENTS[DL_EVENT_COUNT] = {
+    DLOG_EVENTS(DLOG_INFO_ENTRY)
+};
+#undef DLOG_INFO_ENTRY
+
+// 有界 MPSC リング (Vyukov 方式)
+// seq == pos: 空き / seq == pos + 1: 書き込み済み。書き手同士は enqueue_pos の CAS で競合を解決する
+struct Cell {
+    std::atomic<uint32_t> seq;
+    uint8_t data[DLOG_SLOT_SIZE];
+};
+
+static Cell s_ring[RING_SLOTS];
+static std::atomic<uint32_t> s_enqueue_pos{0};
+static uint32_t s_dequeue_pos = 0;  // drain タスクのみが触る
+static std::atomic<uint32_t> s_dropped{0};
+static std::atomic<uint32_t> s_written{0};
+static std::atomic<bool> s_ring_ready{false};
+
+// 直近レコードの履歴 (drain タスクが追記、HTTP ハンドラが読む)
+static uint8_t s_history[DLOG_HISTORY_SIZE];
+static size_t s_history_len = 0;
+static SemaphoreHandle_t s_history_lock = nullptr;
+
+static void ring_init(void) {
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        s_ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+    s_ring_ready.store(true, std::memory_order_release);
+}
+
+uint8_t* dlog_reserve(DlogEvent event) {
+    // dlog_start 前のログは捨てる (起動ログは ESP_LOG を使う)
+    if (!s_ring_ready.load(std::memory_order_acquire)) return nullptr;
+
+    uint32_t pos = s_enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &s_ring[pos & (RING_SLOTS - 1)];
+        uint32_t seq = cell->seq.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (s_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            s_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = s_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t ts = (uint32_t)(esp_timer_get_time() / 1000);
+    uint8_t* p = cell->data;
+    p[1] = ts & 0xff;
+    p[2] = (ts >> 8) & 0xff;
+    p[3] = (ts >> 16) & 0xff;
+    p[4] = (ts >> 24) & 0xff;
+    p[5] = event & 0xff;
+    p[6] = event >> 8;
+    return p;
+}
+
+void dlog_commit(uint8_t* slot, size_t len) {
+    slot[0] = (uint8_t)len;
+    Cell* cell = (Cell*)(slot - offsetof(Cell, data));
+    uint32_t seq = cell->seq.load(std::memory_order_relaxed);
+    cell->seq.store(seq + 1, std::memory_order_release);
+    s_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void dlog_put_u32(DlogWriter* w, char type, uint32_t v) {
+    if (w->len + 5 > DLOG_SLOT_SIZE) return;
+    uint8_t* p = w->buf + w->len;
+    p[0] = type;
+    for (int i = 0; i < 4; i++) p[1 + i] = (v >> (8 * i)) & 0xff;
+    w->len += 5;
+}
+
+void dlog_put_u64(DlogWriter* w, char type, uint64_t v) {
+    if (w->len + 9 > DLOG_SLOT_SIZE) return;
+    uint8_t* p = w->buf + w->len;
+    p[0] = type;
+    for (int i = 0; i < 8; i++) p[1 + i] = (v >> (8 * i)) & 0xff;
+    w->len += 9;
+}
+
+void dlog_put_str(DlogWriter* w, const char* s) {
+    if (w->len + 2 > DLOG_SLOT_SIZE) return;
+    if (!s) s = "(null)";
+    size_t n = strnlen(s, DLOG_SLOT_SIZE - w->len - 2);
+    uint8_t* p = w->buf + w->len;
+    p[0] = 's';
+    p[1] = (uint8_t)n;
+    memcpy(p + 2, s, n);
+    w->len += 2 + n;
+}
+
+// ── 文字列化 (UART 出力用。tools/decode_log.py と同じ規則) ──
+
+#ifdef CONFIG_DEFERRED_LOG_UART
+static uint64_t read_le(const uint8_t* p, int n) {
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// 書式の変換指定ごとに次の引数を 1 つ取り出して snprintf する
+static void format_record(const EventInfo* info, const uint8_t* args, size_t args_len,
+                          char* out, size_t out_len) {
+    size_t o = 0;
+    size_t a = 0;
+    const char* f = info->fmt;
+    while (*f && o + 1 < out_len) {
+        if (*f != '%') {
+            out[o++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            out[o++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // 変換指定を取り出す (長さ修飾子 l は引数の型から付け直す)
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *f++;
+        while (*f && !strchr("sdiuxX", *f)) {
+            if (*f != 'l' && s < sizeof(spec) - 4) spec[s++] = *f;
+            f++;
+        }
+        char conv = *f ? *f++ : 's';
+
+        int n = 0;
+        if (a >= args_len) {
+            n = snprintf(out + o, out_len - o, "?");
+        } else if (args[a] == 's') {
+            char str[DLOG_SLOT_SIZE];
+            uint8_t len = args[a + 1];
+            memcpy(str, args + a + 2, len);
+            str[len] = '\0';
+            spec[s++] = 's';
+            spec[s] = '\0';
+            n = snprintf(out + o, out_len - o, spec, str);
+            a += 2 + len;
+        } else if (args[a] == 'q' || args[a] == 'Q') {
+            uint64_t v = read_le(args + a + 1, 8);
+            spec[s++] = 'l';
+            spec[s++] = 'l';
+            spec[s++] = conv == 's' ? 'd' : conv;
+            spec[s] = '\0';
+            n = snprintf(out + o, out_len - o, spec, (long long)v);
+            a += 9;
+        } else {
+            uint32_t v = (uint32_t)read_le(args + a + 1, 4);
+            spec[s++] = conv == 's' ? 'd' : conv;
+            spec[s] = '\0';
+            n = snprintf(out + o, out_len - o, spec, (int)v);
+            a += 5;
+        }
+        if (n < 0) break;
+        o += (size_t)n < out_len - o ? (size_t)n : out_len - o - 1;
+    }
+    out[o] = '\0';
+}
+
+static void echo_record(const uint8_t* rec) {
+    uint32_t ts = (uint32_t)read_le(rec + 1, 4);
+    uint16_t event = (uint16_t)read_le(rec + 5, 2);
+    if (event >= DL_EVENT_COUNT) return;
+    const EventInfo* info = &EVENTS[event];
+
+    char line[256];
+    format_record(info, rec + DLOG_HEADER_SIZE, rec[0] - DLOG_HEADER_SIZE, line, sizeof(line));
+    // タイムスタンプは記録時刻 (出力時刻ではない)
+    esp_log_write(ESP_LOG_INFO, info->tag, "I (%u) %s: %s\n", (unsigned)ts, info->tag, line);
+}
+#endif
+
+// ── drain タスク ──
+
+static void history_append(const uint8_t* rec) {
+    size_t len = rec[0];
+    xSemaphoreTake(s_history_lock, portMAX_DELAY);
+    // 入りきらなければ古いレコードから丸ごと捨てる
+    size_t drop = 0;
+    while (s_history_len - drop + len > DLOG_HISTORY_SIZE && drop < s_history_len) {
+        drop += s_history[drop];
+    }
+    if (drop > 0) {
+        memmove(s_history, s_history + drop, s_history_len - drop);
+        s_history_len -= drop;
+    }
+    memcpy(s_history + s_history_len, rec, len);
+    s_history_len += len;
+    xSemaphoreGive(s_history_lock);
+}
+
+static void drain_task(void*) {
+    uint32_t reported_drops = 0;
+    while (true) {
+        while (true) {
+            Cell* cell = &s_ring[s_dequeue_pos & (RING_SLOTS - 1)];
+            if (cell->seq.load(std::memory_order_acquire) != s_dequeue_pos + 1) break;
+
+            uint8_t rec[DLOG_SLOT_SIZE];
+            memcpy(rec, cell->data, cell->data[0]);
+            cell->seq.store(s_dequeue_pos + RING_SLOTS, std::memory_order_release);
+            s_dequeue_pos++;
+
+            history_append(rec);
+#ifdef CONFIG_DEFERRED_LOG_UART
+            echo_record(rec);
+#endif
+        }
+
+        uint32_t dropped = s_dropped.load(std::memory_order_relaxed);
+        if (dropped != reported_drops) {
+            ESP_LOGW(TAG, "Ring full, dropped %u records (total %u)",
+                (unsigned)(dropped - reported_drops), (unsigned)dropped);
+            reported_drops = dropped;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DRAIN_INTERVAL_MS));
+    }
+}
+
+esp_err_t dlog_start(void) {
+    s_history_lock = xSemaphoreCreateMutex();
+    if (!s_history_lock) return ESP_ERR_NO_MEM;
+    ring_init();
+    if (xTaskCreate(drain_task, "dlog", 3072, nullptr, DRAIN_TASK_PRIORITY, nullptr) != pdPASS) {
+        s_ring_ready.store(false, std::memory_order_release);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Deferred log started (%d slots x %d bytes)", RING_SLOTS, DLOG_SLOT_SIZE);
+    return ESP_OK;
+}
+
+size_t dlog_read_history(uint8_t* out, size_t out_len) {
+    if (out_len < 4) return 0;
+    memcpy(out, "DLG1", 4);
+    if (!s_history_lock) return 4;
+
+    xSemaphoreTake(s_history_lock, portMAX_DELAY);
+    // 入りきらない場合は新しい側を優先 (レコード境界で切る)
+    size_t skip = 0;
+    while (s_history_len - skip > out_len - 4) skip += s_history[skip];
+    size_t n = s_history_len - skip;
+    memcpy(out + 4, s_history + skip, n);
+    xSemaphoreGive(s_history_lock);
+    return 4 + n;
+}
+
+uint32_t dlog_dropped(void) {
+    return s_dropped.load(std::memory_order_relaxed);
+}
+
+uint32_t dlog_written(void) {
+    return s_written.load(std::memory_order_relaxed);
+}
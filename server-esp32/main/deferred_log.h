@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <esp_err.h>
+
+// 遅延ログ: 呼び出し側は書式 ID + 生の引数をリングバッファに書くだけ
+// 文字列化と UART 出力は低優先度の drain タスクが行う
+//
+// イベント表 (ID, タグ, 書式)。ID は並び順で決まるので末尾に追加すること
+// tools/decode_log.py はこの表をパースしてバイナリを復号する
+// 書式で使える変換: %s %d %u %x %lld %llu (幅指定可)
+#define DLOG_EVENTS(X) \
+    X(DL_STORE_CREATED,       "store",  "Created request %s: %s") \
+    X(DL_STORE_AUTO_CANCELLED, "store", "Auto-cancelled %s (same tmux target)") \
+    X(DL_STORE_RESPONDED,     "store",  "Responded to %s: %s") \
+    X(DL_STORE_CANCELLED,     "store",  "Cancelled %s") \
+    X(DL_STORE_CLEANED_UP,    "store",  "Cleaned up %s") \
+    X(DL_STORE_MIRRORED,      "store",  "Mirrored request %s: %s") \
+    X(DL_HTTP_NEW,            "httpd",  "[permission] New: %s - %s: %s") \
+    X(DL_HTTP_RESPOND,        "httpd",  "[respond] %s: send_key=%s (%s)") \
+    X(DL_HTTP_CANCEL,         "httpd",  "[cancel] %s") \
+    X(DL_HTTP_NOTIFY,         "httpd",  "[notify] %s [%s]: %s") \
+    X(DL_BUTTON_RESPONDED,    "button", "Responded %s: choice=%d send_key=%s (%s)") \
+    X(DL_HTTP_POLICY,         "httpd",  "[policy] %s: %s by rule %d") \
+    X(DL_BUTTON_DENIED_HOST,  "button", "Denied %d pending from %s") \
+    X(DL_STORE_HOST_CAPPED,   "store",  "Replaced %s (%s has %d pending)")
+
+#define DLOG_ENUM_ENTRY(id, tag, fmt) id,
+enum DlogEvent : uint16_t {
+    DLOG_EVENTS(DLOG_ENUM_ENTRY)
+    DL_EVENT_COUNT,
+};
+#undef DLOG_ENUM_ENTRY
+
+// レコード: [長さ u8][時刻 ms u32][イベント u16][引数...] (リトルエンディアン)
+// 引数: 'i' + i32 / 'u' + u32 / 'q' + i64 / 'Q' + u64 / 's' + 長さ u8 + バイト列
+// スロットに入らない文字列は切り詰める (詳細テキスト等)
+#define DLOG_SLOT_SIZE 96
+#define DLOG_HEADER_SIZE 7
+// GET /logs で返す直近レコードのバイト数
+#define DLOG_HISTORY_SIZE 4096
+
+struct DlogWriter {
+    uint8_t* buf;
+    size_t len;
+};
+
+// スロットを確保してヘッダーを書く (満杯なら nullptr、破棄数を加算)
+uint8_t* dlog_reserve(DlogEvent event);
+// 書き込み完了 (drain タスクから見えるようになる)
+void dlog_commit(uint8_t* slot, size_t len);
+
+void dlog_put_u32(DlogWriter* w, char type, uint32_t v);
+void dlog_put_u64(DlogWriter* w, char type, uint64_t v);
+void dlog_put_str(DlogWriter* w, const char* s);
+
+inline void dlog_put(DlogWriter* w, const char* s) { dlog_put_str(w, s); }
+inline void dlog_put(DlogWriter* w, char* s) { dlog_put_str(w, s); }
+
+template <typename T>
+inline void dlog_put(DlogWriter* w, T v) {
+    static_assert(std::is_integral<T>::value, "dlog arguments must be integers or strings");
+    if (sizeof(T) <= 4) {
+        dlog_put_u32(w, std::is_signed<T>::value ? 'i' : 'u', (uint32_t)v);
+    } else {
+        dlog_put_u64(w, std::is_signed<T>::value ? 'q' : 'Q', (uint64_t)v);
+    }
+}
+
+// ホットパス用のログ (数マイクロ秒、ブロックしない)
+template <typename... Args>
+inline void dlog(DlogEvent event, Args... args) {
+    uint8_t* slot = dlog_reserve(event);
+    if (!slot) return;
+    DlogWriter w = { slot, DLOG_HEADER_SIZE };
+    (dlog_put(&w, args), ...);
+    dlog_commit(slot, w.len);
+}
+
+// drain タスクを起動
+esp_err_t dlog_start(void);
+
+// 直近のレコード (GET /logs 用)。先頭にマジック "DLG1" を付けたバイト列を out にコピー
+// 戻り値: コピーしたバイト数
+size_t dlog_read_history(uint8_t* out, size_t out_len);
+
+// 統計
+uint32_t dlog_dropped(void);
+uint32_t dlog_written(void);
@@ -1,10 +1,18 @@
 #include "display_manager.h"
+#include "notify_queue.h"
+#include "board_profile.h"
+#include "decision_stats.h"
+#include "request_detail.h"
 
 #include <cstdio>
 #include <cstring>
 #include <M5Unified.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
 #include <esp_timer.h>
 
+static const char* TAG = "display";
+
 static bool s_available = false;
 static bool s_dirty = true;
 
@@ -12,14 +20,26 @@ enum DisplayState {
     IDLE,
     SHOWING_REQUEST,
     SHOWING_NOTIFICATION,
+    SCREEN_NONE,            // s_screen の初期値 (まだ何の画面も描いていない)
 };
 
 static DisplayState s_state = IDLE;
+static DisplayState s_screen = SCREEN_NONE;     // 背景と部品の配置が描かれている画面
 static char s_ip_str[32] = {0};
 static const PermissionRequest* s_current_req = nullptr;
 static int s_current_idx = 0;
 static int s_current_total = 0;
 static int64_t s_notification_time = 0;
+static char s_choice_id[UUID_STR_LEN] = {0};    // A の選択肢を選び直したリクエスト
+static int s_choice_index = 0;
+static NotifyItem s_notification;               // 表示中の通知 (notify_queue から写したもの)
+static uint32_t s_notification_seq = 0;         // 0 = 通知を表示していない
+static int s_notification_waiting = 0;          // 後ろで待っている件数 ("+N")
+static uint32_t s_notify_generation = 0;
+
+// 通知の表示時間 (後ろに待ちがあれば短くして次へ進む)
+#define NOTIFY_SHOW_MS 5000
+#define NOTIFY_SHOW_QUEUED_MS 2000
 
 // ディスプレイ参照 (短縮用)
 static M5GFX* s_lcd = nullptr;
@@ -33,12 +53,14 @@ static constexpr uint32_t COL_ACCENT    = 0xe94560u;
 static constexpr uint32_t COL_GREEN     = 0x4caf50u;
 static constexpr uint32_t COL_BTN_BG    = 0x333333u;
 
-// レイアウト定数
-static int s_font_h = 16;
-static int s_header_h = 22;
-static int s_btn_bar_h = 22;
-static int s_disp_w = 320;
-static int s_disp_h = 240;
+// レイアウト定数 (機種ごとにコンパイル時に決まる。board_profile.h)
+static constexpr int DISP_W = Board::DISPLAY_W;
+static constexpr int DISP_H = Board::DISPLAY_H;
+static constexpr int FONT_H = Board::FONT_H;
+static constexpr int HEADER_H = Layout::HEADER_H;
+static constexpr int BTN_BAR_H = Layout::BTN_BAR_H;
+
+static void cards_init(void);
 
 void display_init(void) {
     if (M5.Display.width() == 0 || M5.Display.height() == 0) {
@@ -49,53 +71,194 @@ void display_init(void) {
     s_lcd = &M5.Display;
 
     s_lcd->setRotation(1);
-    s_disp_w = s_lcd->width();
-    s_disp_h = s_lcd->height();
 
     // 日本語フォント設定
     s_lcd->setFont(&fonts::efontJA_14);
     s_lcd->setTextSize(1);
-    s_font_h = s_lcd->fontHeight();
-    s_header_h = s_font_h + 6;
-    s_btn_bar_h = s_font_h + 6;
+
+    // 配置は選んだ機種の寸法で決めてあるので、実際の画面と違えば Kconfig の選択を疑う
+    if (s_lcd->width() != DISP_W || s_lcd->height() != DISP_H || s_lcd->fontHeight() != FONT_H) {
+        ESP_LOGW(TAG, "Display is %dx%d (font %d) but board profile %s expects %dx%d (font %d)",
+                 (int)s_lcd->width(), (int)s_lcd->height(), (int)s_lcd->fontHeight(),
+                 Board::NAME, DISP_W, DISP_H, FONT_H);
+    }
 
     // 起動画面
     s_lcd->startWrite();
     s_lcd->fillScreen(COL_BG);
     s_lcd->setTextColor(COL_TEXT, COL_BG);
     s_lcd->setTextDatum(middle_center);
-    s_lcd->drawString("Prompt Relay", s_disp_w / 2, s_disp_h / 2 - 12);
-    s_lcd->drawString("Starting...", s_disp_w / 2, s_disp_h / 2 + 12);
+    s_lcd->drawString("Prompt Relay", DISP_W / 2, DISP_H / 2 - 12);
+    s_lcd->drawString("Starting...", DISP_W / 2, DISP_H / 2 + 12);
     s_lcd->endWrite();
+
+    cards_init();
 }
 
 bool display_available(void) {
     return s_available;
 }
 
-void display_beep(void) {
-    M5.Speaker.tone(1800, 200);
+// ── 部品 (retained widget) ──
+// 画面を矩形の部品に分け、部品ごとに最後に描いた内容のハッシュを持つ。
+// 毎回すべての部品の内容を組み立てるが、描き直すのはハッシュが変わった部品の矩形だけ
+// (経過時間が進んだ・[1/3] が [1/2] になった、などはその部品だけが描き直される)
+//
+// 画面 (待機 / リクエスト / 通知) が切り替わったときだけ、部品の配置を決め直して全部品を未描画に戻す
+
+enum WidgetId {
+    W_HEAD_LEFT,            // ホスト名 / "Prompt Relay" / "通知"
+    W_HEAD_CENTER,          // [1/3]
+    W_HEAD_RIGHT,           // 経過時間 / "WiFi" / 通知元ホスト
+    W_LINE1,                // 待機: アドレス、通知: タイトル
+    W_LINE2,                // 待機: 判断までの時間、通知: 本文
+    W_CENTER,               // 待機: 承認待ち件数
+    W_MESSAGE,              // リクエスト: subtitle + message (カードを転送)
+    W_STATUS,               // 待機: 最も遅いホスト、リクエスト: 残り時間 / 応答結果
+    W_BTN_A,
+    W_BTN_B,
+    W_BTN_C,
+    W_COUNT,
+};
+
+struct Widget {
+    int16_t x, y, w, h;
+    bool visible;           // この画面で使う部品か
+    uint32_t hash;          // 最後に描いた内容 (0 = 未描画)
+};
+
+static Widget s_widgets[W_COUNT];
+static uint32_t s_widget_draws = 0;
+static uint64_t s_widget_pixels = 0;
+
+static uint32_t hash_str(uint32_t h, const char* s) {
+    for (; *s; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_u32(uint32_t h, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= 16777619u;
+    }
+    return h;
 }
 
-// 背景色つきで矩形領域をテキストで埋める (残り部分も bg で塗りつぶし)
-static void fill_text_line(int x, int y, int w, const char* text, uint32_t fg, uint32_t bg, uint8_t datum = top_left) {
-    s_lcd->setTextDatum(datum);
-    s_lcd->setTextColor(fg, bg);
-    s_lcd->fillRect(x, y, w, s_font_h, bg);
-    s_lcd->drawString(text, x + (datum == top_left ? 0 : datum == top_right ? w : w / 2), y);
+// 内容が前回と同じなら false。変わっていれば記録して true (呼び出し側が矩形を描き直す)
+static bool widget_changed(WidgetId id, uint32_t hash) {
+    Widget* w = &s_widgets[id];
+    if (!w->visible) return false;
+    if (hash == 0) hash = 1;
+    if (w->hash == hash) return false;
+    w->hash = hash;
+    s_widget_draws++;
+    s_widget_pixels += (uint32_t)w->w * w->h;
+    return true;
+}
+
+// 1 行のテキスト部品。矩形を bg で塗り、datum に合わせて描く (矩形からはみ出す分は切る)
+static void widget_label(WidgetId id, const char* text, uint32_t fg, uint32_t bg, uint8_t datum) {
+    uint32_t h = hash_u32(hash_u32(hash_str(2166136261u, text), fg), bg);
+    if (!widget_changed(id, h)) return;
+
+    const Widget* w = &s_widgets[id];
+    s_lcd->setClipRect(w->x, w->y, w->w, w->h);
+    s_lcd->fillRect(w->x, w->y, w->w, w->h, bg);
+    if (text[0]) {
+        int tx = datum == middle_left || datum == top_left ? w->x + 4
+               : datum == middle_right ? w->x + w->w - 4
+               : w->x + w->w / 2;
+        int ty = datum == top_left ? w->y + 2 : w->y + w->h / 2;
+        s_lcd->setTextDatum(datum);
+        s_lcd->setTextColor(fg, bg);
+        s_lcd->drawString(text, tx, ty);
+    }
+    s_lcd->clearClipRect();
+}
+
+static void widget_place(WidgetId id, int x, int y, int w, int h) {
+    s_widgets[id] = { (int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h, true, 0 };
+}
+
+static constexpr int BODY_TOP = Layout::BODY_TOP;
+static constexpr int BODY_BOTTOM = Layout::BODY_BOTTOM;
+static constexpr int STATUS_Y = Layout::STATUS_Y;
+static constexpr int MESSAGE_H = Layout::MESSAGE_H;
+// 待機画面で承認待ち件数と状態行の間に判断時間の行を置けるか (小さい画面では状態行に 1 行でまとめる)
+static constexpr int IDLE_STATS_Y = STATUS_Y - FONT_H - 4;
+static constexpr bool IDLE_STATS_LINE = IDLE_STATS_Y >= DISP_H / 2 + FONT_H / 2 + 2;
+
+// ヘッダー 3 分割とボタンバー (ボタンの数で分割) は全画面で共通
+// 2 ボタンの機種では C の部品を置かない (電源ボタンで操作する)
+static void place_bars(void) {
+    int center_w = s_lcd->textWidth("[88/88]") + 8;
+    int center_x = (DISP_W - center_w) / 2;
+    widget_place(W_HEAD_LEFT, 0, 0, center_x, HEADER_H);
+    widget_place(W_HEAD_CENTER, center_x, 0, center_w, HEADER_H);
+    widget_place(W_HEAD_RIGHT, center_x + center_w, 0, DISP_W - center_x - center_w, HEADER_H);
+
+    constexpr int btn_w = Layout::BTN_W;
+    widget_place(W_BTN_A, 0, BODY_BOTTOM, btn_w, BTN_BAR_H);
+    if constexpr (Board::BUTTONS == 3) {
+        widget_place(W_BTN_B, btn_w, BODY_BOTTOM, btn_w, BTN_BAR_H);
+        widget_place(W_BTN_C, btn_w * 2, BODY_BOTTOM, DISP_W - btn_w * 2, BTN_BAR_H);
+    } else {
+        widget_place(W_BTN_B, btn_w, BODY_BOTTOM, DISP_W - btn_w, BTN_BAR_H);
+    }
+}
+
+// 画面の切り替え: 部品を配置し直し、部品で覆わない部分 (区切り線・本文の余白) だけ塗る
+static void enter_screen(DisplayState screen) {
+    for (int i = 0; i < W_COUNT; i++) s_widgets[i].visible = false;
+    place_bars();
+
+    switch (screen) {
+        case IDLE:
+            s_lcd->fillRect(0, HEADER_H, DISP_W, BODY_BOTTOM - HEADER_H, COL_BG);
+            widget_place(W_LINE1, 0, HEADER_H + 2, DISP_W, FONT_H + 4);
+            widget_place(W_CENTER, 0, DISP_H / 2 - FONT_H / 2 - 2, DISP_W, FONT_H + 4);
+            if constexpr (IDLE_STATS_LINE) widget_place(W_LINE2, 0, IDLE_STATS_Y, DISP_W, FONT_H + 4);
+            widget_place(W_STATUS, 0, STATUS_Y, DISP_W, BODY_BOTTOM - STATUS_Y);
+            break;
+        case SHOWING_REQUEST:
+            s_lcd->drawFastHLine(0, HEADER_H, DISP_W, COL_DIM);
+            widget_place(W_MESSAGE, 0, BODY_TOP, DISP_W, MESSAGE_H);
+            widget_place(W_STATUS, 0, STATUS_Y, DISP_W, BODY_BOTTOM - STATUS_Y);
+            break;
+        case SHOWING_NOTIFICATION:
+            s_lcd->fillRect(0, HEADER_H, DISP_W, BODY_BOTTOM - HEADER_H, COL_BG);
+            widget_place(W_LINE1, 0, HEADER_H + 4, DISP_W, FONT_H + 4);
+            widget_place(W_LINE2, 0, HEADER_H + 8 + FONT_H, DISP_W, FONT_H + 4);
+            break;
+        default:
+            break;
+    }
+    s_screen = screen;
+}
+
+static void update_button(WidgetId id, char key, const char* label) {
+    char buf[24] = "";
+    if (label && label[0]) snprintf(buf, sizeof(buf), "[%c:%s]", key, label);
+    widget_label(id, buf, COL_TEXT, COL_BTN_BG, middle_center);
 }
 
 // テキスト折り返し描画 (UTF-8 対応、背景色塗りつぶし付き)
-static void draw_wrapped_text(const char* text, int x, int* y, int max_x, int max_y, uint32_t fg, uint32_t bg) {
-    s_lcd->setTextDatum(top_left);
-    s_lcd->setTextColor(fg, bg);
+// g は画面またはカードのスプライト (スプライトでは fg / bg はパレット番号)
+// 戻り値: 描ききれなかった残りの先頭 (全部描いたら末尾の NUL)
+static const char* draw_wrapped_text(LovyanGFX* g, const char* text, int x, int* y, int max_x, int max_y,
+                              uint32_t fg, uint32_t bg) {
+    g->setTextDatum(top_left);
+    g->setTextColor(fg, bg);
 
     int cursor_x = x;
     const char* p = text;
 
     // 行開始時にその行の背景を塗る
     auto fill_line_bg = [&]() {
-        s_lcd->fillRect(x, *y, max_x - x, s_font_h, bg);
+        g->fillRect(x, *y, max_x - x, FONT_H, bg);
     };
 
     fill_line_bg();
@@ -103,7 +266,7 @@ static void draw_wrapped_text(const char* text, int x, int* y, int max_x, int ma
     while (*p && *y < max_y) {
         if (*p == '\n') {
             cursor_x = x;
-            *y += s_font_h;
+            *y += FONT_H;
             if (*y < max_y) fill_line_bg();
             p++;
             continue;
@@ -119,240 +282,509 @@ static void draw_wrapped_text(const char* text, int x, int* y, int max_x, int ma
         char ch_buf[5] = {0};
         for (int i = 0; i < char_len && p[i]; i++) ch_buf[i] = p[i];
 
-        int cw = s_lcd->textWidth(ch_buf);
+        int cw = g->textWidth(ch_buf);
 
         if (cursor_x + cw > max_x) {
             cursor_x = x;
-            *y += s_font_h;
+            *y += FONT_H;
             if (*y >= max_y) break;
             fill_line_bg();
         }
 
-        s_lcd->drawString(ch_buf, cursor_x, *y);
+        g->drawString(ch_buf, cursor_x, *y);
         cursor_x += cw;
         p += char_len;
     }
 
-    *y += s_font_h;
-}
-
-static void draw_button_bar(const char* btn_a, const char* btn_b, const char* btn_c) {
-    int y = s_disp_h - s_btn_bar_h;
-    int btn_w = s_disp_w / 3;
-
-    s_lcd->fillRect(0, y, s_disp_w, s_btn_bar_h, COL_BTN_BG);
-    s_lcd->setTextDatum(middle_center);
-    s_lcd->setTextColor(COL_TEXT, COL_BTN_BG);
-
-    if (btn_a && btn_a[0]) {
-        char buf[24];
-        snprintf(buf, sizeof(buf), "[A:%s]", btn_a);
-        s_lcd->drawString(buf, btn_w * 0 + btn_w / 2, y + s_btn_bar_h / 2);
-    }
-    if (btn_b && btn_b[0]) {
-        char buf[24];
-        snprintf(buf, sizeof(buf), "[B:%s]", btn_b);
-        s_lcd->drawString(buf, btn_w * 1 + btn_w / 2, y + s_btn_bar_h / 2);
-    }
-    if (btn_c && btn_c[0]) {
-        char buf[24];
-        snprintf(buf, sizeof(buf), "[C:%s]", btn_c);
-        s_lcd->drawString(buf, btn_w * 2 + btn_w / 2, y + s_btn_bar_h / 2);
-    }
-}
-
-static void draw_header_bar(const char* left, const char* center, const char* right,
-                            uint32_t left_col, uint32_t right_col) {
-    s_lcd->fillRect(0, 0, s_disp_w, s_header_h, COL_HEADER_BG);
-    s_lcd->setTextColor(left_col, COL_HEADER_BG);
-    s_lcd->setTextDatum(middle_left);
-    s_lcd->drawString(left, 4, s_header_h / 2);
-
-    if (center && center[0]) {
-        s_lcd->setTextDatum(middle_center);
-        s_lcd->setTextColor(COL_TEXT, COL_HEADER_BG);
-        s_lcd->drawString(center, s_disp_w / 2, s_header_h / 2);
-    }
-
-    if (right && right[0]) {
-        s_lcd->setTextDatum(middle_right);
-        s_lcd->setTextColor(right_col, COL_HEADER_BG);
-        s_lcd->drawString(right, s_disp_w - 4, s_header_h / 2);
-    }
+    *y += FONT_H;
+    return p;
 }
 
 void display_show_idle(const char* ip_str) {
     if (!s_available) return;
     s_state = IDLE;
-    strncpy(s_ip_str, ip_str, sizeof(s_ip_str) - 1);
+    // 再描画 (display_show_idle(s_ip_str)) では同じバッファなのでコピーしない
+    if (ip_str != s_ip_str) snprintf(s_ip_str, sizeof(s_ip_str), "%s", ip_str);
     s_dirty = true;
 }
 
-static void draw_idle(void) {
-    s_lcd->startWrite();
+static void format_mmss(char* buf, size_t len, int64_t sec) {
+    if (sec < 0) sec = 0;
+    snprintf(buf, len, "%02d:%02d", (int)(sec / 60), (int)(sec % 60));
+}
 
-    // ヘッダ
-    draw_header_bar("Prompt Relay", nullptr, "WiFi", COL_ACCENT, COL_GREEN);
+// 判断までの時間の要約 (decision_stats)。まだ人に回したことがなければ何も出さない
+// 大きい画面: 「応答 p50 / p90  期限切れ %」と「遅い: ホスト (p90)」の 2 行。小さい画面は 1 行目だけ
+static void update_idle_stats(void) {
+    DecisionSummary sum;
+    char line[64] = "";
+    char slow[64] = "";
+    if (decision_stats_summary(&sum)) {
+        char p50[12], p90[12];
+        format_mmss(p50, sizeof(p50), sum.p50_ms / 1000);
+        format_mmss(p90, sizeof(p90), sum.p90_ms / 1000);
+        snprintf(line, sizeof(line), "応答 %s/%s 期限切れ %u%%", p50, p90,
+                 (unsigned)((sum.expired_permille + 5) / 10));
+        if (sum.slowest_host[0]) {
+            char p[12];
+            format_mmss(p, sizeof(p), sum.slowest_p90_ms / 1000);
+            snprintf(slow, sizeof(slow), "遅い: %.16s %s", sum.slowest_host, p);
+        }
+    }
+    if constexpr (IDLE_STATS_LINE) {
+        widget_label(W_LINE2, line, COL_DIM, COL_BG, top_left);
+        widget_label(W_STATUS, slow, COL_DIM, COL_BG, top_left);
+    } else {
+        widget_label(W_STATUS, line, COL_DIM, COL_BG, top_left);
+    }
+}
 
-    // 本文エリアを背景色で塗りつぶし
-    int body_y = s_header_h;
-    int body_h = s_disp_h - s_header_h - s_btn_bar_h;
-    s_lcd->fillRect(0, body_y, s_disp_w, body_h, COL_BG);
+static void update_idle(void) {
+    widget_label(W_HEAD_LEFT, "Prompt Relay", COL_ACCENT, COL_HEADER_BG, middle_left);
+    widget_label(W_HEAD_CENTER, "", COL_TEXT, COL_HEADER_BG, middle_center);
+    widget_label(W_HEAD_RIGHT, "WiFi", COL_GREEN, COL_HEADER_BG, middle_right);
 
     // IP アドレス
-    s_lcd->setTextDatum(top_left);
-    s_lcd->setTextColor(COL_TEXT, COL_BG);
     char addr[48];
     snprintf(addr, sizeof(addr), "%s:3939", s_ip_str);
-    s_lcd->drawString(addr, 4, s_header_h + 4);
+    widget_label(W_LINE1, addr, COL_TEXT, COL_BG, top_left);
 
     // 承認待ち数
-    s_lcd->setTextDatum(middle_center);
     int pending = request_store_pending_count();
     if (pending == 0) {
-        s_lcd->setTextColor(COL_DIM, COL_BG);
-        s_lcd->drawString("承認待ちなし", s_disp_w / 2, s_disp_h / 2);
+        widget_label(W_CENTER, "承認待ちなし", COL_DIM, COL_BG, middle_center);
     } else {
-        s_lcd->setTextColor(COL_ACCENT, COL_BG);
         char buf[32];
         snprintf(buf, sizeof(buf), "承認待ち %d 件", pending);
-        s_lcd->drawString(buf, s_disp_w / 2, s_disp_h / 2);
+        widget_label(W_CENTER, buf, COL_ACCENT, COL_BG, middle_center);
     }
 
-    draw_button_bar("---", "---", "---");
-    s_lcd->endWrite();
+    update_idle_stats();
+
+    update_button(W_BTN_A, 'A', "---");
+    update_button(W_BTN_B, 'B', "---");
+    update_button(W_BTN_C, 'C', "---");
+}
+
+// ── 本文カードのキャッシュ ──
+// 本文 (subtitle + 折り返した message) を画面外のスプライトに描いておき、
+// 表示時は pushSprite で転送するだけにする。1 文字ずつの幅計測と描画が押下後に走らないので、
+// C (Next) での切り替えは転送時間だけで済む。空き時間に「次に表示するリクエスト」を先に描く
+//
+// 本文は 3 色しか使わないので 2bit パレット (Layout::CARD_BYTES、320x240 の機種で約 14KB)。PSRAM があればそちらに置く
+
+#define CARD_SLOTS Board::CARD_SLOTS    // 表示中 + 次 (PSRAM のある機種は先読みを増やす)
+
+enum CardColor : uint8_t {
+    CARD_BG,
+    CARD_TEXT,
+    CARD_ACCENT,
+};
+
+struct CardPalette {
+    uint32_t bg, text, accent;
+};
+static constexpr CardPalette SCREEN_COLORS = { COL_BG, COL_TEXT, COL_ACCENT };
+static constexpr CardPalette CARD_COLORS = { CARD_BG, CARD_TEXT, CARD_ACCENT };
+
+struct CardSlot {
+    M5Canvas* canvas;           // nullptr = 確保できなかった
+    char id[UUID_STR_LEN];      // 空 = 未使用
+    uint32_t last_used;
+};
+
+static CardSlot s_cards[CARD_SLOTS];
+static uint32_t s_card_clock = 0;
+
+// ボタンの押下 (入力の端) から本文の転送完了までの時間。ジェスチャーの判定の待ちも含む
+struct SwitchStats {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+};
+static SwitchStats s_switch_hit = {};
+static SwitchStats s_switch_miss = {};
+static uint32_t s_prerendered = 0;
+static int64_t s_show_us = 0;
+
+// 本文を g の (0, oy) から描く。screen / card で色の指定方法が違うので pal で渡す
+// 戻り値: message のうち描ききれなかった残りの先頭
+static const char* draw_card(LovyanGFX* g, int oy, const char* subtitle, const char* message,
+                             const CardPalette& pal) {
+    constexpr int h = MESSAGE_H;
+    g->fillRect(0, oy, DISP_W, h, pal.bg);
+
+    // ── subtitle ──
+    int y = oy + 2;
+    g->setTextDatum(top_left);
+    g->setTextColor(pal.accent, pal.bg);
+    g->drawString(subtitle, 4, y);
+    y += FONT_H + 2;
+
+    // ── message (折り返し) ──
+    return draw_wrapped_text(g, message, 4, &y, DISP_W - 4, oy + h, pal.text, pal.bg);
+}
+
+static void cards_init(void) {
+    constexpr int h = MESSAGE_H;
+    bool psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > 0;
+    for (int i = 0; i < CARD_SLOTS; i++) {
+        M5Canvas* c = new M5Canvas(s_lcd);
+        c->setPsram(psram);
+        c->setColorDepth(lgfx::palette_2bit);
+        if (!c->createSprite(DISP_W, h)) {
+            delete c;
+            ESP_LOGW(TAG, "Card cache %d not allocated (drawing directly)", i);
+            continue;
+        }
+        c->createPalette();
+        c->setPaletteColor(CARD_BG, COL_BG);
+        c->setPaletteColor(CARD_TEXT, COL_TEXT);
+        c->setPaletteColor(CARD_ACCENT, COL_ACCENT);
+        c->setFont(&fonts::efontJA_14);
+        c->setTextSize(1);
+        s_cards[i].canvas = c;
+    }
+    ESP_LOGI(TAG, "Card cache: %d x %dx%d (2bpp, %s)", CARD_SLOTS, DISP_W, h,
+             psram ? "PSRAM" : "internal");
 }
 
-void display_show_request(const PermissionRequest* req, int idx, int total) {
+static CardSlot* card_find(const char* id) {
+    for (int i = 0; i < CARD_SLOTS; i++) {
+        CardSlot* slot = &s_cards[i];
+        if (slot->canvas && slot->id[0] && strcmp(slot->id, id) == 0) return slot;
+    }
+    return nullptr;
+}
+
+// keep_id のカードは残し、最も古いスロットを描き直す (id が空なら使い捨て。card_find では見つからない)
+// end には message の描ききれなかった残りの先頭を返す
+static CardSlot* card_render(const char* id, const char* subtitle, const char* message,
+                             const char* keep_id, const char** end = nullptr) {
+    CardSlot* victim = nullptr;
+    for (int i = 0; i < CARD_SLOTS; i++) {
+        CardSlot* slot = &s_cards[i];
+        if (!slot->canvas) continue;
+        if (keep_id && slot->id[0] && strcmp(slot->id, keep_id) == 0) continue;
+        if (!victim || slot->last_used < victim->last_used) victim = slot;
+    }
+    if (!victim) return nullptr;
+
+    victim->id[0] = '\0';
+    const char* rest = draw_card(victim->canvas, 0, subtitle, message, CARD_COLORS);
+    if (end) *end = rest;
+    strncpy(victim->id, id, sizeof(victim->id) - 1);
+    victim->id[sizeof(victim->id) - 1] = '\0';
+    victim->last_used = ++s_card_clock;
+    return victim;
+}
+
+static void record_switch(SwitchStats* st, int64_t start_us) {
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start_us);
+    st->count++;
+    st->total_us += us;
+    if (us > st->max_us) st->max_us = us;
+}
+
+// ── 詳細 (tool_input の全文) ──
+// C の長押しで要約 → 詳細の 1 画面目 → 次の画面 … と進め、最後の画面の次は要約に戻る。
+// 圧縮済みのページ (DETAIL_PAGE_LEN) は表示する 1 ページだけを展開して持つ。
+// 次の画面の先頭は、描いたときに折り返しで収まらなかった位置 (s_detail_next)
+
+static char s_detail_id[UUID_STR_LEN] = {0};    // 詳細を表示しているリクエスト (空 = 要約)
+static bool s_detail_advance = false;           // 長押しで次の画面が要求された
+static DetailInfo s_detail_info;
+static char s_detail_buf[DETAIL_READ_LEN];      // 展開したページ
+static int s_detail_page = -1;
+static int s_detail_len = 0;
+static int s_detail_off = 0;                    // 表示中の画面の先頭 (ページ内)
+static int s_detail_next = 0;                   // 次の画面の先頭 (ページ内)
+static uint32_t s_detail_base = 0;              // 展開したページより前のバイト数
+
+static bool load_detail_page(const char* id, int page) {
+    int n = request_detail_read_page(id, page, s_detail_buf, sizeof(s_detail_buf));
+    if (n < 0) return false;
+    s_detail_page = page;
+    s_detail_len = n;
+    s_detail_off = 0;
+    s_detail_next = n;
+    return true;
+}
+
+// 長押しの要求を表示中のリクエストに当てる (メインループから)
+static void advance_detail(const char* id) {
+    if (strcmp(s_detail_id, id) != 0) {
+        if (!request_detail_info(id, &s_detail_info) || !load_detail_page(id, 0)) return;
+        strcpy(s_detail_id, id);
+        s_detail_base = 0;
+        return;
+    }
+    if (s_detail_next < s_detail_len) {
+        s_detail_off = s_detail_next;
+        return;
+    }
+    uint32_t base = s_detail_base + s_detail_len;
+    if (s_detail_page + 1 < s_detail_info.pages && load_detail_page(id, s_detail_page + 1)) {
+        s_detail_base = base;
+        return;
+    }
+    s_detail_id[0] = '\0';
+}
+
+// 詳細の 1 画面を描く (カードのスロットを 1 つ借りる。表示中のリクエストの要約のカードは残す)
+static void draw_detail(const char* id, const char* subtitle) {
+    const char* text = s_detail_buf + s_detail_off;
+    const char* end = nullptr;
+    CardSlot* card = card_render("", subtitle, text, id, &end);
+    if (card) {
+        card->canvas->pushSprite(0, BODY_TOP);
+    } else {
+        end = draw_card(s_lcd, BODY_TOP, subtitle, text, SCREEN_COLORS);
+    }
+    s_detail_next = (int)(end - s_detail_buf);
+}
+
+void display_page_detail(void) {
+    if (!s_available) return;
+    s_detail_advance = true;
+    s_dirty = true;
+}
+
+void display_show_request(const PermissionRequest* req, int idx, int total, int64_t input_us) {
     if (!s_available) return;
     s_current_req = req;
     s_current_idx = idx;
     s_current_total = total;
     s_state = SHOWING_REQUEST;
     s_dirty = true;
+    s_show_us = input_us ? input_us : esp_timer_get_time();
 }
 
-static void draw_request(void) {
-    if (!s_current_req) return;
+void display_select_choice(const char* id, int choice_index) {
+    if (!s_available) return;
+    strncpy(s_choice_id, id ? id : "", sizeof(s_choice_id) - 1);
+    s_choice_index = choice_index;
+    s_dirty = true;
+}
+
+// update_request が表示に使うリクエストの内容 (ロック中にコピーし、部品の組み立てと描画はロックの外)
+struct ShownRequest {
+    char id[UUID_STR_LEN];
+    char hostname[sizeof(PermissionRequest::hostname)];
+    char subtitle[sizeof(PermissionRequest::subtitle)];
+    char message[sizeof(PermissionRequest::message)];
+    char response[sizeof(PermissionRequest::response)];
+    char btn_a[sizeof(Choice::text)];
+    char btn_b[sizeof(Choice::text)];
+    int64_t created_at;
+    int64_t expires_at;
+};
+
+// HTTP ワーカーやボタンの応答と同時に読まないよう、ストアのロック中に写す
+static bool copy_shown_request(ShownRequest* out) {
+    request_store_lock();
     const PermissionRequest* req = s_current_req;
+    if (!req) {
+        request_store_unlock();
+        return false;
+    }
+    strcpy(out->id, req->id);
+    strcpy(out->hostname, req->hostname);
+    strcpy(out->subtitle, req->subtitle);
+    strcpy(out->message, req->message);
+    strcpy(out->response, req->response);
+    out->created_at = req->created_at;
+    out->expires_at = req->expires_at;
+    out->btn_a[0] = '\0';
+    out->btn_b[0] = '\0';
+    if (req->response[0] == '\0' && req->choice_count > 0) {
+        int choice = strcmp(s_choice_id, req->id) == 0 && s_choice_index < req->choice_count
+                   ? s_choice_index : 0;
+        strcpy(out->btn_a, req->choices[choice].text);
+    }
+    if (req->response[0] == '\0' && req->choice_count > 1) {
+        strcpy(out->btn_b, req->choices[req->choice_count - 1].text);
+    }
+    request_store_unlock();
+    return true;
+}
 
-    s_lcd->startWrite();
+static void update_request(void) {
+    static ShownRequest shown;
+    if (!copy_shown_request(&shown)) return;
+    const ShownRequest* req = &shown;
+    bool responded = req->response[0] != '\0';
+    int64_t now_ms = esp_timer_get_time() / 1000;
 
-    // ── ヘッダバー ──
+    // ── ヘッダー ──
     char host_buf[32];
     if (req->hostname[0]) {
         snprintf(host_buf, sizeof(host_buf), "%.16s", req->hostname);
     } else {
         strcpy(host_buf, "local");
     }
+    widget_label(W_HEAD_LEFT, host_buf, COL_TEXT, COL_HEADER_BG, middle_left);
 
     char idx_buf[16];
     snprintf(idx_buf, sizeof(idx_buf), "[%d/%d]", s_current_idx + 1, s_current_total);
+    widget_label(W_HEAD_CENTER, idx_buf, COL_TEXT, COL_HEADER_BG, middle_center);
 
-    int64_t elapsed_sec = (esp_timer_get_time() / 1000000) - (req->created_at / 1000);
-    if (elapsed_sec < 0) elapsed_sec = 0;
     char time_buf[16];
-    snprintf(time_buf, sizeof(time_buf), "%02d:%02d", (int)(elapsed_sec / 60), (int)(elapsed_sec % 60));
-
-    draw_header_bar(host_buf, idx_buf, time_buf,
-                    COL_TEXT, req->response[0] != '\0' ? COL_DIM : COL_ACCENT);
-
-    // 区切り線
-    s_lcd->drawFastHLine(0, s_header_h, s_disp_w, COL_DIM);
-
-    // ── 本文エリアを背景で塗りつぶし ──
-    int body_top = s_header_h + 1;
-    int body_bottom = s_disp_h - s_btn_bar_h;
-    s_lcd->fillRect(0, body_top, s_disp_w, body_bottom - body_top, COL_BG);
-
-    // ── subtitle ──
-    int y = body_top + 2;
-    s_lcd->setTextDatum(top_left);
-    s_lcd->setTextColor(COL_ACCENT, COL_BG);
-    s_lcd->drawString(req->subtitle, 4, y);
-    y += s_font_h + 2;
+    format_mmss(time_buf, sizeof(time_buf), (now_ms - req->created_at) / 1000);
+    widget_label(W_HEAD_RIGHT, time_buf, responded ? COL_DIM : COL_ACCENT, COL_HEADER_BG, middle_right);
+
+    // ── 詳細の表示位置 (別のリクエストに切り替わったら要約に戻す) ──
+    if (s_detail_id[0] && strcmp(s_detail_id, req->id) != 0) s_detail_id[0] = '\0';
+    if (s_detail_advance) {
+        s_detail_advance = false;
+        advance_detail(req->id);
+    }
+    bool detail = s_detail_id[0] != '\0';
+
+    // ── 本文 (描画済みのカードがあれば転送だけ) ──
+    // 本文はリクエストの作成後に変わらないので ID だけで内容が決まる (詳細は ID + 位置)
+    uint32_t message_hash = hash_str(2166136261u, req->id);
+    if (detail) message_hash = hash_u32(hash_u32(message_hash, s_detail_page + 1), s_detail_off);
+    if (widget_changed(W_MESSAGE, message_hash)) {
+        if (detail) {
+            draw_detail(req->id, req->subtitle);
+        } else {
+            CardSlot* card = card_find(req->id);
+            bool hit = card != nullptr;
+            if (!card) card = card_render(req->id, req->subtitle, req->message, nullptr);
+            if (card) {
+                card->last_used = ++s_card_clock;
+                card->canvas->pushSprite(0, BODY_TOP);
+            } else {
+                draw_card(s_lcd, BODY_TOP, req->subtitle, req->message, SCREEN_COLORS);
+            }
+            if (s_show_us != 0) {
+                record_switch(hit ? &s_switch_hit : &s_switch_miss, s_show_us);
+            }
+        }
+    }
+    s_show_us = 0;
 
-    // ── message (折り返し) ──
-    int max_y = body_bottom - 2;
-    if (req->response[0] != '\0') {
-        max_y -= (s_font_h + 2);
-    }
-    draw_wrapped_text(req->message, 4, &y, s_disp_w - 4, max_y, COL_TEXT, COL_BG);
-
-    // ── 応答済みステータス ──
-    if (req->response[0] != '\0') {
-        int status_y = body_bottom - s_font_h - 2;
-        s_lcd->setTextDatum(top_left);
-        s_lcd->setTextColor(strcmp(req->response, "allow") == 0 ? COL_GREEN : COL_ACCENT, COL_BG);
-        char status_buf[32];
+    // ── ステータス行: 未応答なら期限までの残り、応答済みなら結果。詳細の表示中は読んだ割合 ──
+    char status_buf[48] = "";
+    uint32_t status_color = COL_DIM;
+    if (responded) {
         snprintf(status_buf, sizeof(status_buf), "> %s", req->response);
-        s_lcd->drawString(status_buf, 4, status_y);
-        draw_button_bar("---", "---", "Next");
-    } else {
-        const char* btn_a = "---";
-        const char* btn_b = "---";
-        if (req->choice_count > 0) {
-            btn_a = req->choices[0].text;
-        }
-        if (req->choice_count > 1) {
-            btn_b = req->choices[req->choice_count - 1].text;
-        }
-        draw_button_bar(btn_a, btn_b, "Next");
+        status_color = strcmp(req->response, "allow") == 0 ? COL_GREEN : COL_ACCENT;
+    } else if (req->expires_at > 0) {
+        char left[16];
+        format_mmss(left, sizeof(left), (req->expires_at - now_ms + 999) / 1000);
+        snprintf(status_buf, sizeof(status_buf), "残り %s", left);
+    }
+    if (detail && s_detail_info.raw_len > 0) {
+        size_t n = strlen(status_buf);
+        uint32_t shown = s_detail_base + (uint32_t)s_detail_next;
+        snprintf(status_buf + n, sizeof(status_buf) - n, "%s詳細 %u%%%s", n ? "  " : "",
+                 (unsigned)((uint64_t)shown * 100 / s_detail_info.raw_len),
+                 s_detail_info.truncated && shown >= s_detail_info.raw_len ? " (以下略)" : "");
     }
+    widget_label(W_STATUS, status_buf, status_color, COL_BG, top_left);
 
-    s_lcd->endWrite();
+    // ── ボタン ──
+    update_button(W_BTN_A, 'A', req->btn_a[0] ? req->btn_a : "---");
+    update_button(W_BTN_B, 'B', req->btn_b[0] ? req->btn_b : "---");
+    update_button(W_BTN_C, 'C', "Next");
 }
 
-// ヘッダ右側の経過時間だけ部分更新
-static void update_request_timer(void) {
+// 次に C で表示される未応答リクエストのカードを先に描いておく (メインループの空き時間)
+// リクエストの内容はロック中にコピーし、描画はロックの外で行う
+static void prerender_next_card(void) {
     if (!s_current_req) return;
-    const PermissionRequest* req = s_current_req;
 
-    int64_t elapsed_sec = (esp_timer_get_time() / 1000000) - (req->created_at / 1000);
-    if (elapsed_sec < 0) elapsed_sec = 0;
-    char time_buf[16];
-    snprintf(time_buf, sizeof(time_buf), "%02d:%02d", (int)(elapsed_sec / 60), (int)(elapsed_sec % 60));
+    static char id[UUID_STR_LEN];
+    static char subtitle[sizeof(PermissionRequest::subtitle)];
+    static char message[sizeof(PermissionRequest::message)];
+    char current_id[UUID_STR_LEN];
 
-    // タイマー表示領域だけ上書き (ヘッダ右端)
-    int time_w = s_lcd->textWidth("00:00") + 8;
-    int time_x = s_disp_w - time_w;
+    request_store_lock();
+    PermissionRequest* all[MAX_REQUESTS];
+    int count = request_store_get_all(all, MAX_REQUESTS);
+    PermissionRequest* pending[MAX_REQUESTS];
+    int pending_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (all[i]->response[0] == '\0') pending[pending_count++] = all[i];
+    }
+    PermissionRequest* next = nullptr;
+    if (pending_count > 1) {
+        next = pending[(s_current_idx + 1) % pending_count];
+    }
+    if (!next || card_find(next->id)) {
+        request_store_unlock();
+        return;
+    }
+    strcpy(id, next->id);
+    strcpy(subtitle, next->subtitle);
+    strcpy(message, next->message);
+    strcpy(current_id, s_current_req->id);
+    request_store_unlock();
 
-    s_lcd->startWrite();
-    s_lcd->fillRect(time_x, 0, time_w, s_header_h, COL_HEADER_BG);
-    s_lcd->setTextDatum(middle_right);
-    s_lcd->setTextColor(req->response[0] != '\0' ? COL_DIM : COL_ACCENT, COL_HEADER_BG);
-    s_lcd->drawString(time_buf, s_disp_w - 4, s_header_h / 2);
-    s_lcd->endWrite();
+    if (card_render(id, subtitle, message, current_id)) s_prerendered++;
 }
 
-void display_show_notification(const char* title, const char* message, const char* hostname) {
-    if (!s_available) return;
+cJSON* display_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    int slots = 0;
+    for (int i = 0; i < CARD_SLOTS; i++) {
+        if (s_cards[i].canvas) slots++;
+    }
+    cJSON_AddNumberToObject(root, "card_slots", slots);
+    cJSON_AddNumberToObject(root, "prerendered", s_prerendered);
+    const SwitchStats* st[2] = { &s_switch_hit, &s_switch_miss };
+    const char* names[2] = { "switch_hit", "switch_miss" };
+    for (int i = 0; i < 2; i++) {
+        cJSON* o = cJSON_AddObjectToObject(root, names[i]);
+        cJSON_AddNumberToObject(o, "count", st[i]->count);
+        cJSON_AddNumberToObject(o, "avg_us", st[i]->count ? (double)(st[i]->total_us / st[i]->count) : 0);
+        cJSON_AddNumberToObject(o, "max_us", st[i]->max_us);
+    }
+    cJSON_AddNumberToObject(root, "widget_draws", s_widget_draws);
+    cJSON_AddNumberToObject(root, "widget_pixels", (double)s_widget_pixels);
+    return root;
+}
 
-    s_state = SHOWING_NOTIFICATION;
-    s_notification_time = esp_timer_get_time() / 1000;
+// notify_queue の変化を画面に反映する (表示側のみ)
+static void sync_notification(int64_t now) {
+    NotifyItem item;
+    int waiting = 0;
+    if (!notify_queue_current(&item, &waiting)) return;
+
+    if (item.seq != s_notification_seq || item.repeat != s_notification.repeat) {
+        // 新しい通知、または表示中の通知に同じものがまとめられた: 表示し直して時間を数え直す
+        if (item.seq != s_notification_seq) s_screen = SCREEN_NONE;    // 配置からやり直す
+        s_notification = item;
+        s_notification_seq = item.seq;
+        s_notification_time = now;
+        s_state = SHOWING_NOTIFICATION;
+    }
+    s_notification_waiting = waiting;
     s_dirty = true;
+}
 
-    s_lcd->startWrite();
-
-    // ヘッダ
-    draw_header_bar("通知", nullptr, hostname, COL_ACCENT, COL_DIM);
-
-    // 本文エリア
-    int body_top = s_header_h;
-    int body_bottom = s_disp_h - s_btn_bar_h;
-    s_lcd->fillRect(0, body_top, s_disp_w, body_bottom - body_top, COL_BG);
-
-    s_lcd->setTextDatum(top_left);
-    s_lcd->setTextColor(COL_TEXT, COL_BG);
-    s_lcd->drawString(title, 4, s_header_h + 6);
-
-    if (message && message[0]) {
-        s_lcd->setTextColor(COL_DIM, COL_BG);
-        s_lcd->drawString(message, 4, s_header_h + 6 + s_font_h + 4);
+static void update_notification(void) {
+    widget_label(W_HEAD_LEFT, "通知", COL_ACCENT, COL_HEADER_BG, middle_left);
+    char more[16] = "";
+    if (s_notification_waiting > 0) snprintf(more, sizeof(more), "+%d", s_notification_waiting);
+    widget_label(W_HEAD_CENTER, more, COL_ACCENT, COL_HEADER_BG, middle_center);
+    widget_label(W_HEAD_RIGHT, s_notification.hostname, COL_DIM, COL_HEADER_BG, middle_right);
+
+    // まとめた通知は回数を付ける (本文は最後に届いたもの)
+    char title[sizeof(s_notification.title) + 16];
+    if (s_notification.repeat > 1) {
+        snprintf(title, sizeof(title), "%s ×%u", s_notification.title, (unsigned)s_notification.repeat);
+    } else {
+        snprintf(title, sizeof(title), "%s", s_notification.title);
     }
+    widget_label(W_LINE1, title, COL_TEXT, COL_BG, top_left);
+    widget_label(W_LINE2, s_notification.message, COL_DIM, COL_BG, top_left);
 
-    draw_button_bar("---", "---", "OK");
-    s_lcd->endWrite();
+    update_button(W_BTN_A, 'A', "---");
+    update_button(W_BTN_B, 'B', "---");
+    update_button(W_BTN_C, 'C', "OK");
 }
 
 void display_notify_new_request(void) {
@@ -376,36 +808,57 @@ void display_notify_new_request(void) {
 }
 
 void display_update(void) {
+    int64_t now = esp_timer_get_time() / 1000;
+
+    // ビープは要求をまとめてここで鳴らす (HTTP ハンドラからは鳴らさない)
+    if (notify_queue_take_beep(now)) M5.Speaker.tone(1800, 200);
+
     if (!s_available) return;
 
-    if (s_state == SHOWING_NOTIFICATION) {
-        int64_t now = esp_timer_get_time() / 1000;
-        if (now - s_notification_time > 5000) {
-            display_notify_new_request();
+    // 表示中の通知が時間切れ、または別の画面に切り替わった (ボタン C・新着リクエスト) なら次へ
+    if (s_notification_seq) {
+        int show_ms = s_notification_waiting > 0 ? NOTIFY_SHOW_QUEUED_MS : NOTIFY_SHOW_MS;
+        if (s_state != SHOWING_NOTIFICATION || now - s_notification_time > show_ms) {
+            bool was_showing = s_state == SHOWING_NOTIFICATION;
+            s_notification_seq = 0;
+            notify_queue_advance();
+            if (was_showing) display_notify_new_request();
         }
     }
+    uint32_t generation = notify_queue_generation();
+    if (generation != s_notify_generation) {
+        s_notify_generation = generation;
+        sync_notification(now);
+    }
 
-    // リクエスト表示中は経過時間のみ部分更新 (全画面再描画しない)
-    if (s_state == SHOWING_REQUEST) {
-        static int64_t last_timer = 0;
-        int64_t now = esp_timer_get_time() / 1000;
-        if (now - last_timer > 1000) {
-            update_request_timer();
-            last_timer = now;
-        }
+    // 時刻の表示は 1 秒ごとに内容を組み立て直す (変わった部品だけ描かれる)
+    static int64_t last_tick = 0;
+    if (now - last_tick >= 1000) {
+        last_tick = now;
+        s_dirty = true;
     }
 
-    if (!s_dirty) return;
+    if (!s_dirty) {
+        // 描くものがないループで次のカードを用意する
+        if (s_state == SHOWING_REQUEST) prerender_next_card();
+        return;
+    }
     s_dirty = false;
 
+    s_lcd->startWrite();
+    if (s_screen != s_state) enter_screen(s_state);
     switch (s_state) {
         case IDLE:
-            draw_idle();
+            update_idle();
             break;
         case SHOWING_REQUEST:
-            draw_request();
+            update_request();
             break;
         case SHOWING_NOTIFICATION:
+            update_notification();
+            break;
+        default:
             break;
     }
+    s_lcd->endWrite();
 }
@@ -2,6 +2,8 @@
 
 #include "request_store.h"
 
+#include <cJSON.h>
+
 // 画面を初期化
 void display_init(void);
 
@@ -9,19 +11,26 @@ void display_init(void);
 void display_show_idle(const char* ip_str);
 
 // リクエスト表示 (idx: 0-based, total: 全数)
-void display_show_request(const PermissionRequest* req, int idx, int total);
+// input_us: 表示を求めたボタンの押下の時刻 (InputEvent::time_us。切り替え時間の起点。0 = 今)
+void display_show_request(const PermissionRequest* req, int idx, int total, int64_t input_us = 0);
+
+// A ボタンで送る選択肢を表示する (id のリクエストを表示している間だけ。nullptr = 最初の選択肢)
+void display_select_choice(const char* id, int choice_index);
+
+// 表示中のリクエストの詳細 (tool_input の全文) を 1 画面進める (C の長押し)
+// 要約 → 詳細の先頭 → … → 最後の画面の次は要約に戻る。詳細がなければ何もしない
+void display_page_detail(void);
 
 // 画面更新 (メインループから呼ぶ)
+// notify_queue に積まれた通知の表示とビープもここで行う
 void display_update(void);
 
 // 新着リクエスト通知 (自動で最新リクエストを表示)
 void display_notify_new_request(void);
 
-// 通知表示
-void display_show_notification(const char* title, const char* message, const char* hostname);
-
-// 通知ビープ音
-void display_beep(void);
-
 // ディスプレイが利用可能か
 bool display_available(void);
+
+// カードキャッシュの使用状況と、切り替え (ボタンの押下から本文の転送完了まで) の時間 (GET /stats 用)
+// switch_hit = 描画済みカードの転送のみ、switch_miss = その場で描画
+cJSON* display_stats_to_json(void);
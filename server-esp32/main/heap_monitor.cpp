@@ -0,0 +1,92 @@
+#include "heap_monitor.h"
+#include "json_arena.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const char* TAG = "heap";
+
+#define SAMPLE_INTERVAL_S 3600      // 1 時間ごと
+#define MAX_SAMPLES 168             // 7 日分 (古いものから上書き)
+#define HEAP_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+struct HeapSample {
+    uint32_t uptime_h;
+    uint32_t free_bytes;
+    uint32_t largest_block;
+};
+
+static SemaphoreHandle_t s_lock = nullptr;
+static esp_timer_handle_t s_timer = nullptr;
+static HeapSample s_samples[MAX_SAMPLES];
+static int s_sample_count = 0;
+static int s_sample_next = 0;
+static uint32_t s_min_largest = UINT32_MAX;   // サンプル時点の最大ブロックの最小値
+
+static void take_sample(void* arg) {
+    HeapSample s;
+    s.uptime_h = (uint32_t)(esp_timer_get_time() / 1000000 / 3600);
+    s.free_bytes = heap_caps_get_free_size(HEAP_CAPS);
+    s.largest_block = heap_caps_get_largest_free_block(HEAP_CAPS);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_samples[s_sample_next] = s;
+    s_sample_next = (s_sample_next + 1) % MAX_SAMPLES;
+    if (s_sample_count < MAX_SAMPLES) s_sample_count++;
+    if (s.largest_block < s_min_largest) s_min_largest = s.largest_block;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "free=%u largest=%u (uptime %uh)",
+        (unsigned)s.free_bytes, (unsigned)s.largest_block, (unsigned)s.uptime_h);
+}
+
+esp_err_t heap_monitor_start(void) {
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    // 起動直後の値を基準として記録しておく
+    take_sample(nullptr);
+
+    esp_timer_create_args_t args = {};
+    args.callback = take_sample;
+    args.name = "heap_mon";
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) return err;
+    return esp_timer_start_periodic(s_timer, (uint64_t)SAMPLE_INTERVAL_S * 1000000);
+}
+
+cJSON* heap_monitor_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "free", heap_caps_get_free_size(HEAP_CAPS));
+    cJSON_AddNumberToObject(root, "largest_block", heap_caps_get_largest_free_block(HEAP_CAPS));
+    cJSON_AddNumberToObject(root, "min_free", heap_caps_get_minimum_free_size(HEAP_CAPS));
+    if (!s_lock) return root;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON_AddNumberToObject(root, "min_largest_block", s_min_largest);
+
+    // [経過時間 (h), 空き, 最大ブロック] を古い順に
+    // 168 件を cJSON ノードにすると数十 KB になるので、文字列で組み立てて raw で埋め込む
+    size_t cap = 2 + s_sample_count * 36;
+    char* history = (char*)json_arena_alloc(cap);
+    if (history) {
+        size_t len = 0;
+        history[len++] = '[';
+        int start = (s_sample_next - s_sample_count + MAX_SAMPLES) % MAX_SAMPLES;
+        for (int i = 0; i < s_sample_count; i++) {
+            const HeapSample* s = &s_samples[(start + i) % MAX_SAMPLES];
+            len += snprintf(history + len, cap - len, "%s[%u,%u,%u]", i ? "," : "",
+                (unsigned)s->uptime_h, (unsigned)s->free_bytes, (unsigned)s->largest_block);
+        }
+        snprintf(history + len, cap - len, "]");
+        cJSON_AddRawToObject(root, "history", history);
+        json_arena_free(history);
+    }
+    xSemaphoreGive(s_lock);
+    return root;
+}
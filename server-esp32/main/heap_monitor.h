@@ -0,0 +1,14 @@
+#pragma once
+
+#include <esp_err.h>
+#include <cJSON.h>
+
+// ヒープ断片化モニタ
+// 内部 RAM の空き容量と最大連続空きブロックを 1 時間ごとに記録する (直近 7 日分)
+// 空き容量が一定でも最大ブロックが縮み続けていれば断片化が進んでいる
+
+// 定期サンプリングを開始
+esp_err_t heap_monitor_start(void);
+
+// 現在値・起動後の最小値・履歴 (GET /stats 用)
+cJSON* heap_monitor_stats_to_json(void);
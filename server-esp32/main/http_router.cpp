@@ -0,0 +1,259 @@
+#include "http_router.h"
+
+#include <cstring>
+#include <esp_log.h>
+
+static const char* TAG = "router";
+
+// ノード 0 が "/"。ルート番号とキャッチオールはメソッドごと (-1 = なし)
+struct RouteNode {
+    int8_t routes[ROUTE_METHOD_COUNT];
+    int8_t catch_all[ROUTE_METHOD_COUNT];   // このノードより下の残り全部 ("*")
+    int8_t param_child;
+    RouteParamType param_type;
+};
+
+// リテラルの辺: (親ノード, セグメント) → 子ノード。開番地法 (線形探索) で引く
+struct RouteEdge {
+    uint32_t hash;
+    const char* seg;        // パターン文字列の中 (静的な表なので持ち続けてよい)
+    uint8_t len;
+    int8_t parent;
+    int8_t child;           // -1 = 空き
+};
+
+static RouteNode s_nodes[ROUTER_MAX_NODES];
+static RouteEdge s_edges[ROUTER_EDGE_SLOTS];
+static int s_node_count = 0;
+static int s_edge_count = 0;
+static int s_route_count = 0;
+static int s_max_probe = 0;
+
+// 照合の結果の件数 (照合は httpd タスクだけが呼ぶのでロックなし)
+static uint32_t s_found = 0;
+static uint32_t s_not_found = 0;
+static uint32_t s_method_not_allowed = 0;
+
+// セグメントのハッシュは親ノードを種にした FNV-1a (照合側はパスを 1 回なめる間に計算する)
+static inline uint32_t hash_seed(int node) {
+    return 2166136261u ^ ((uint32_t)node * 0x9e3779b1u);
+}
+
+static inline uint32_t hash_byte(uint32_t h, char c) {
+    return (h ^ (uint8_t)c) * 16777619u;
+}
+
+static int find_edge(int parent, uint32_t hash, const char* seg, size_t len) {
+    for (int i = 0; i < ROUTER_EDGE_SLOTS; i++) {
+        const RouteEdge* e = &s_edges[(hash + i) & (ROUTER_EDGE_SLOTS - 1)];
+        if (e->child < 0) return -1;
+        if (e->hash == hash && e->parent == parent && e->len == len && memcmp(e->seg, seg, len) == 0) {
+            return e->child;
+        }
+    }
+    return -1;
+}
+
+static int new_node(void) {
+    if (s_node_count >= ROUTER_MAX_NODES) return -1;
+    RouteNode* n = &s_nodes[s_node_count];
+    memset(n->routes, -1, sizeof(n->routes));
+    memset(n->catch_all, -1, sizeof(n->catch_all));
+    n->param_child = -1;
+    n->param_type = PARAM_ID;
+    return s_node_count++;
+}
+
+static int add_edge(int parent, uint32_t hash, const char* seg, size_t len) {
+    // 使用率 50% までに抑え、探索の長さを短く保つ
+    if (s_edge_count >= ROUTER_EDGE_SLOTS / 2 || len > UINT8_MAX) return -1;
+    int child = new_node();
+    if (child < 0) return -1;
+    for (int i = 0; i < ROUTER_EDGE_SLOTS; i++) {
+        RouteEdge* e = &s_edges[(hash + i) & (ROUTER_EDGE_SLOTS - 1)];
+        if (e->child >= 0) continue;
+        *e = { hash, seg, (uint8_t)len, (int8_t)parent, (int8_t)child };
+        s_edge_count++;
+        if (i + 1 > s_max_probe) s_max_probe = i + 1;
+        return child;
+    }
+    return -1;
+}
+
+static bool param_type_of(const char* name, size_t len, RouteParamType* type) {
+    if (len == 2 && memcmp(name, "id", 2) == 0) {
+        *type = PARAM_ID;
+        return true;
+    }
+    return false;
+}
+
+static bool param_valid(RouteParamType type, const char* s, size_t len) {
+    switch (type) {
+        case PARAM_ID:
+            if (len == 0 || len > ROUTE_ID_MAX_LEN) return false;
+            for (size_t i = 0; i < len; i++) {
+                char c = s[i];
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-')) {
+                    return false;
+                }
+            }
+            return true;
+    }
+    return false;
+}
+
+// 1 つのパターンをトライに入れる
+static esp_err_t insert(int index, const RoutePattern* r) {
+    const char* p = r->path;
+    if (p[0] != '/') return ESP_ERR_INVALID_ARG;
+    p++;
+    int node = 0;
+    while (*p) {
+        const char* seg = p;
+        while (*p && *p != '/') p++;
+        size_t len = p - seg;
+        if (len == 0) return ESP_ERR_INVALID_ARG;
+        if (*p == '/' && *++p == '\0') return ESP_ERR_INVALID_ARG;   // 末尾の '/'
+
+        if (len == 1 && seg[0] == '*') {
+            if (*p) return ESP_ERR_INVALID_ARG;     // "*" は末尾だけ
+            if (s_nodes[node].catch_all[r->method] >= 0) return ESP_ERR_INVALID_STATE;
+            s_nodes[node].catch_all[r->method] = (int8_t)index;
+            return ESP_OK;
+        }
+        if (seg[0] == ':') {
+            RouteParamType type;
+            if (!param_type_of(seg + 1, len - 1, &type)) return ESP_ERR_INVALID_ARG;
+            RouteNode* n = &s_nodes[node];
+            if (n->param_child < 0) {
+                int child = new_node();
+                if (child < 0) return ESP_ERR_NO_MEM;
+                n = &s_nodes[node];
+                n->param_child = (int8_t)child;
+                n->param_type = type;
+            } else if (n->param_type != type) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            node = n->param_child;
+            continue;
+        }
+
+        uint32_t hash = hash_seed(node);
+        for (size_t i = 0; i < len; i++) hash = hash_byte(hash, seg[i]);
+        int child = find_edge(node, hash, seg, len);
+        if (child < 0) child = add_edge(node, hash, seg, len);
+        if (child < 0) return ESP_ERR_NO_MEM;
+        node = child;
+    }
+    if (s_nodes[node].routes[r->method] >= 0) return ESP_ERR_INVALID_STATE;
+    s_nodes[node].routes[r->method] = (int8_t)index;
+    return ESP_OK;
+}
+
+esp_err_t http_router_build(const RoutePattern* routes, int count) {
+    if (count > INT8_MAX) return ESP_ERR_INVALID_ARG;
+    s_node_count = 0;
+    s_edge_count = 0;
+    s_max_probe = 0;
+    for (int i = 0; i < ROUTER_EDGE_SLOTS; i++) s_edges[i].child = -1;
+    new_node();     // "/"
+
+    for (int i = 0; i < count; i++) {
+        esp_err_t err = insert(i, &routes[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot add route %s: %s", routes[i].path, esp_err_to_name(err));
+            return err;
+        }
+    }
+    s_route_count = count;
+    ESP_LOGI(TAG, "%d routes: %d nodes, %d edges (max probe %d)",
+             count, s_node_count, s_edge_count, s_max_probe);
+    return ESP_OK;
+}
+
+RouteResult http_router_match(RouteMethod method, const char* uri, int* route, RouteParams* params) {
+    params->count = 0;
+    if (uri[0] != '/' || s_node_count == 0) {
+        s_not_found++;
+        return ROUTE_NOT_FOUND;
+    }
+
+    // 通ったノードのうち最も深いキャッチオール (と、その時点のパラメータ数)
+    int fallback = s_nodes[0].catch_all[method];
+    uint8_t fallback_params = 0;
+
+    const char* p = uri + 1;
+    int node = 0;
+    while (*p && *p != '?') {
+        const char* seg = p;
+        uint32_t hash = hash_seed(node);
+        while (*p && *p != '/' && *p != '?') hash = hash_byte(hash, *p++);
+        size_t len = p - seg;
+
+        int next = len ? find_edge(node, hash, seg, len) : -1;
+        const RouteNode* n = &s_nodes[node];
+        if (next < 0 && len && n->param_child >= 0 && params->count < ROUTE_MAX_PARAMS &&
+            param_valid(n->param_type, seg, len)) {
+            params->off[params->count] = (uint16_t)(seg - uri);
+            params->len[params->count] = (uint8_t)len;
+            params->count++;
+            next = n->param_child;
+        }
+        if (next < 0) {
+            node = -1;
+            break;
+        }
+        node = next;
+        if (s_nodes[node].catch_all[method] >= 0) {
+            fallback = s_nodes[node].catch_all[method];
+            fallback_params = params->count;
+        }
+        // 末尾の '/' は空のセグメントとみなして外す ("/stats/" は "/stats" と別)
+        if (*p == '/' && (*++p == '\0' || *p == '?')) {
+            node = -1;
+            break;
+        }
+    }
+
+    if (node >= 0 && s_nodes[node].routes[method] >= 0) {
+        *route = s_nodes[node].routes[method];
+        s_found++;
+        return ROUTE_FOUND;
+    }
+    if (fallback >= 0) {
+        *route = fallback;
+        params->count = fallback_params;
+        s_found++;
+        return ROUTE_FOUND;
+    }
+    if (node >= 0) {
+        for (int m = 0; m < ROUTE_METHOD_COUNT; m++) {
+            if (s_nodes[node].routes[m] >= 0) {
+                s_method_not_allowed++;
+                return ROUTE_METHOD_NOT_ALLOWED;
+            }
+        }
+    }
+    s_not_found++;
+    return ROUTE_NOT_FOUND;
+}
+
+bool route_param_copy(const char* uri, const RouteParams* params, int index, char* out, size_t cap) {
+    if (index >= params->count || params->len[index] >= cap) return false;
+    memcpy(out, uri + params->off[index], params->len[index]);
+    out[params->len[index]] = '\0';
+    return true;
+}
+
+cJSON* http_router_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "routes", s_route_count);
+    cJSON_AddNumberToObject(root, "nodes", s_node_count);
+    cJSON_AddNumberToObject(root, "edges", s_edge_count);
+    cJSON_AddNumberToObject(root, "max_probe", s_max_probe);
+    cJSON_AddNumberToObject(root, "found", s_found);
+    cJSON_AddNumberToObject(root, "not_found", s_not_found);
+    cJSON_AddNumberToObject(root, "method_not_allowed", s_method_not_allowed);
+    return root;
+}
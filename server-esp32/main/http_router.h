@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_err.h>
+#include <cJSON.h>
+
+// URI ルーター: パスのセグメント単位のトライを起動時に 1 回だけ組み立てる
+//
+// パターンは "/permission-request/:id/respond" のようにセグメントを '/' で区切って書く。
+//   - リテラル: そのまま一致
+//   - ':' 始まり: 型付きパラメータ。型は名前で決まり、合わない値のセグメントには一致しない (今は ":id" だけ)
+//   - 末尾の "*": 残りのパス全部 (静的ファイル用。そのノードより深いルートが外れたときだけ使う)
+// 照合は 1 セグメントごとにハッシュ表を 1 回引くだけなので、パス長に比例し、ルート数によらない。
+// 同じ位置ではリテラルがパラメータより優先される (後戻りはしない)
+//
+// ルーターはパターンとメソッドからルート番号を引くだけで、ハンドラや認証などの情報は
+// 呼び出し側の表 (http_server.cpp の ROUTES) が同じ番号で持つ
+
+#define ROUTE_MAX_PARAMS 2
+#define ROUTER_MAX_NODES 32
+#define ROUTER_EDGE_SLOTS 64        // リテラルの辺のハッシュ表 (2 の冪。使用率 50% 以下で使う)
+#define ROUTE_ID_MAX_LEN 36         // ":id" の最大長 (UUID_STR_LEN - 1)
+
+enum RouteMethod : uint8_t {
+    ROUTE_GET,
+    ROUTE_POST,
+    ROUTE_PUT,
+    ROUTE_DELETE,
+    ROUTE_METHOD_COUNT,
+};
+
+enum RouteParamType : uint8_t {
+    PARAM_ID,               // ":id" リクエスト ID (英数字と '-'、UUID_STR_LEN - 1 文字以下)
+};
+
+struct RoutePattern {
+    RouteMethod method;
+    const char* path;
+};
+
+// 一致したパラメータ (req->uri 内の位置。ワーカーに渡すコピーでも uri は複製されるので有効)
+struct RouteParams {
+    uint8_t count;
+    uint8_t len[ROUTE_MAX_PARAMS];
+    uint16_t off[ROUTE_MAX_PARAMS];
+};
+
+enum RouteResult : uint8_t {
+    ROUTE_FOUND,
+    ROUTE_NOT_FOUND,
+    ROUTE_METHOD_NOT_ALLOWED,   // パスは一致したがメソッドのルートがない
+};
+
+// パターンからトライを作る (起動時に 1 回。ルートの数と順序は呼び出し側の表と同じ)
+// ノード・辺が足りない、同じメソッドとパスの重複、同じ位置で型の違うパラメータは失敗
+esp_err_t http_router_build(const RoutePattern* routes, int count);
+
+// uri ('?' 以降は見ない) を照合する。ROUTE_FOUND なら *route にルート番号、*params にパラメータ
+RouteResult http_router_match(RouteMethod method, const char* uri, int* route, RouteParams* params);
+
+// パラメータ index を NUL 終端でコピーする。なければ・収まらなければ false
+bool route_param_copy(const char* uri, const RouteParams* params, int index, char* out, size_t cap);
+
+// ノード・辺の数と照合の結果の件数 (GET /stats 用)
+cJSON* http_router_stats_to_json(void);
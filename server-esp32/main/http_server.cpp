@@ -1,17 +1,43 @@
 #include "http_server.h"
 #include "request_store.h"
+#include "request_json.h"
 #include "display_manager.h"
+#include "relay_mirror.h"
+#include "cbor.h"
+#include "web_assets.h"
+#include "ws_server.h"
+#include "admission.h"
+#include "http_workers.h"
+#include "http_router.h"
+#include "deferred_log.h"
+#include "json_arena.h"
+#include "request_parse.h"
+#include "request_detail.h"
+#include "heap_monitor.h"
+#include "decision_history.h"
+#include "decision_stats.h"
+#include "policy.h"
+#include "input_events.h"
+#include "notify_queue.h"
+#include "mdns_service.h"
+#include "https_server.h"
 
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_http_server.h>
 #include <cJSON.h>
+#include "sdkconfig.h"
 
 static const char* TAG = "httpd";
 
 #define HTTP_PORT 3939
-#define MAX_BODY_LEN 2048
+#define MAX_BODY_LEN Board::MAX_BODY_LEN
 #define MIN_KEY_LENGTH 8
 #define MAX_KEY_LENGTH 128
 
@@ -30,7 +56,11 @@ static bool check_auth(httpd_req_t* req) {
 static void send_json_error(httpd_req_t* req, int status, const char* error) {
     httpd_resp_set_status(req, status == 400 ? "400 Bad Request" :
                                 status == 401 ? "401 Unauthorized" :
+                                status == 403 ? "403 Forbidden" :
                                 status == 404 ? "404 Not Found" :
+                                status == 405 ? "405 Method Not Allowed" :
+                                status == 413 ? "413 Payload Too Large" :
+                                status == 429 ? "429 Too Many Requests" :
                                 status == 503 ? "503 Service Unavailable" :
                                                 "500 Internal Server Error");
     httpd_resp_set_type(req, "application/json");
@@ -44,23 +74,53 @@ static void send_json_ok(httpd_req_t* req) {
     httpd_resp_sendstr(req, "{\"ok\":true}");
 }
 
-// URI からリクエスト ID を抽出
-// /permission-request/{uuid}/response → uuid 部分
-static bool extract_request_id(const char* uri, char* out_id, int out_len) {
-    // "/permission-request/" の後ろから UUID を取得
-    const char* prefix = "/permission-request/";
-    const char* start = strstr(uri, prefix);
-    if (!start) return false;
-    start += strlen(prefix);
+// ── CBOR コンテンツネゴシエーション ──
+// JSON がデフォルト。Accept / Content-Type に application/cbor があれば CBOR を使う
 
-    // 次の "/" か末尾までコピー
-    const char* end = strchr(start, '/');
-    int len = end ? (int)(end - start) : (int)strlen(start);
-    if (len <= 0 || len >= out_len) return false;
+#define CBOR_MIME "application/cbor"
 
-    memcpy(out_id, start, len);
-    out_id[len] = '\0';
-    return true;
+static bool header_has_cbor(httpd_req_t* req, const char* field) {
+    char buf[96];
+    if (httpd_req_get_hdr_value_str(req, field, buf, sizeof(buf)) != ESP_OK) return false;
+    return strstr(buf, CBOR_MIME) != nullptr;
+}
+
+static bool accepts_cbor(httpd_req_t* req) {
+    return header_has_cbor(req, "Accept");
+}
+
+static bool body_is_cbor(httpd_req_t* req) {
+    return header_has_cbor(req, "Content-Type");
+}
+
+static bool cbor_chunk_flush(void* ctx, const uint8_t* data, size_t len) {
+    return httpd_resp_send_chunk((httpd_req_t*)ctx, (const char*)data, len) == ESP_OK;
+}
+
+// CBOR レスポンス開始: バッファが溢れたら chunked で逐次送信する
+static void cbor_resp_begin(httpd_req_t* req, CborWriter* w, uint8_t* buf, size_t cap) {
+    httpd_resp_set_type(req, CBOR_MIME);
+    cbor_writer_init(w, buf, cap, cbor_chunk_flush, req);
+}
+
+static void cbor_resp_end(httpd_req_t* req, CborWriter* w) {
+    if (w->flushed == 0) {
+        // 一度も溢れていなければ Content-Length 付きで一括送信
+        httpd_resp_send(req, (const char*)w->buf, w->len);
+    } else {
+        cbor_writer_flush(w);
+        httpd_resp_send_chunk(req, nullptr, 0);
+    }
+}
+
+static void send_ok(httpd_req_t* req) {
+    if (!accepts_cbor(req)) {
+        send_json_ok(req);
+        return;
+    }
+    static const uint8_t ok_map[] = { 0xa1, CK_OK, 0xf5 };  // {21: true}
+    httpd_resp_set_type(req, CBOR_MIME);
+    httpd_resp_send(req, (const char*)ok_map, sizeof(ok_map));
 }
 
 // POST body を読み込む
@@ -82,26 +142,59 @@ static int read_body(httpd_req_t* req, char* buf, int buf_len) {
     return received;
 }
 
-// 前方宣言
-static esp_err_t handle_permission_request_response(httpd_req_t* req);
-static esp_err_t handle_permission_request_respond(httpd_req_t* req);
-static esp_err_t handle_permission_request_cancel(httpd_req_t* req);
+// 接続元 IP アドレス (文字列)
+static void get_client_ip(httpd_req_t* req, char* out, size_t out_len) {
+    out[0] = '\0';
+    struct sockaddr_in6 addr = {};
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr*)&addr, &addr_len) != 0) return;
+
+    if (addr.sin6_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in*)&addr)->sin_addr, out, out_len);
+        return;
+    }
+    // IPv6 ソケットで受けた IPv4 は ::ffff:a.b.c.d (IPv4 射影アドレス) になる
+    const uint8_t* a = (const uint8_t*)&addr.sin6_addr;
+    static const uint8_t v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (memcmp(a, v4_mapped, sizeof(v4_mapped)) == 0) {
+        snprintf(out, out_len, "%u.%u.%u.%u", a[12], a[13], a[14], a[15]);
+    } else {
+        inet_ntop(AF_INET6, &addr.sin6_addr, out, out_len);
+    }
+}
+
+// 流量制御: ボディを読む前にホスト名ヘッダーと IP で判定し、超過なら即 429/503
+static bool admit(httpd_req_t* req) {
+    char host[64];
+    bool has_host = httpd_req_get_hdr_value_str(req, "X-Prompt-Relay-Host", host, sizeof(host)) == ESP_OK;
+    char ip[48];
+    get_client_ip(req, ip, sizeof(ip));
+
+    int retry_after = 1;
+    AdmitResult result = admission_begin(has_host ? host : nullptr, ip, &retry_after);
+    if (result == ADMIT_OK) return true;
+
+    char retry_str[12];
+    snprintf(retry_str, sizeof(retry_str), "%d", retry_after);
+    httpd_resp_set_hdr(req, "Retry-After", retry_str);
+    if (result == ADMIT_RATE_LIMITED) {
+        send_json_error(req, 429, "rate limited");
+    } else {
+        send_json_error(req, 503, "server busy");
+    }
+    return false;
+}
 
 // ── GET /health ──
-static esp_err_t handle_health(httpd_req_t* req) {
+static esp_err_t handle_health(httpd_req_t* req, const RouteParams*) {
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
     return ESP_OK;
 }
 
 // ── POST /permission-request ──
-static esp_err_t handle_permission_request_create(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
-        return ESP_OK;
-    }
-
-    char* body = (char*)malloc(MAX_BODY_LEN);
+static esp_err_t handle_permission_request_create(httpd_req_t* req, const RouteParams*) {
+    char* body = (char*)json_arena_alloc(MAX_BODY_LEN);
     if (!body) {
         send_json_error(req, 500, "out of memory");
         return ESP_OK;
@@ -109,225 +202,243 @@ static esp_err_t handle_permission_request_create(httpd_req_t* req) {
 
     int len = read_body(req, body, MAX_BODY_LEN);
     if (len <= 0) {
-        free(body);
+        json_arena_free(body);
         send_json_error(req, 400, "empty body");
         return ESP_OK;
     }
 
-    cJSON* root = cJSON_Parse(body);
-    free(body);
-    if (!root) {
-        send_json_error(req, 400, "invalid json");
-        return ESP_OK;
-    }
-
-    // フィールド取得
-    const char* tool_name = cJSON_GetStringValue(cJSON_GetObjectItem(root, "tool_name"));
-    const char* message = cJSON_GetStringValue(cJSON_GetObjectItem(root, "message"));
-    const char* header = cJSON_GetStringValue(cJSON_GetObjectItem(root, "header"));
-    const char* description = cJSON_GetStringValue(cJSON_GetObjectItem(root, "description"));
-    const char* prompt_question = cJSON_GetStringValue(cJSON_GetObjectItem(root, "prompt_question"));
-    const char* tmux_target = cJSON_GetStringValue(cJSON_GetObjectItem(root, "tmux_target"));
-    const char* hostname = cJSON_GetStringValue(cJSON_GetObjectItem(root, "hostname"));
-    cJSON* has_tmux_json = cJSON_GetObjectItem(root, "has_tmux");
-    cJSON* tool_input_json = cJSON_GetObjectItem(root, "tool_input");
-    cJSON* choices_json = cJSON_GetObjectItem(root, "choices");
-    cJSON* timeout_json = cJSON_GetObjectItem(root, "timeout");
-
-    const char* tool_display = (tool_name && tool_name[0]) ? tool_name : "Unknown";
-    const char* subtitle_text = (header && header[0]) ? header : tool_display;
-
-    // detailText 構築 (index.ts ロジック移植)
-    char detail_text[512] = {0};
-    if (description && description[0]) {
-        strncpy(detail_text, description, sizeof(detail_text) - 1);
-    } else if (tool_input_json) {
-        const char* command = cJSON_GetStringValue(cJSON_GetObjectItem(tool_input_json, "command"));
-        const char* file_path = cJSON_GetStringValue(cJSON_GetObjectItem(tool_input_json, "file_path"));
-        if (command && command[0]) {
-            snprintf(detail_text, sizeof(detail_text), "$ %s", command);
-        } else if (file_path && file_path[0]) {
-            strncpy(detail_text, file_path, sizeof(detail_text) - 1);
-        } else if (message && message[0]) {
-            strncpy(detail_text, message, sizeof(detail_text) - 1);
-        } else {
-            snprintf(detail_text, sizeof(detail_text), "%s の実行を許可しますか？", tool_display);
+    // 詳細 (tool_input の全文) は解析しながらページごとに圧縮してプールへ書き出す
+    // (確保できなければ要約の本文だけになる)
+    DetailWriter* detail = (DetailWriter*)json_arena_alloc(sizeof(DetailWriter));
+    if (detail) request_detail_begin(detail);
+
+    // フィールド取得 (CBOR は body 内を直接参照するので body は最後に解放)
+    CreateFields f = {};
+    cJSON* root = nullptr;
+    if (body_is_cbor(req)) {
+        CborReader r;
+        cbor_reader_init(&r, (uint8_t*)body, len);
+        if (!parse_create_cbor(&r, &f, detail)) {
+            request_detail_abort(detail);
+            json_arena_free(detail);
+            json_arena_free(body);
+            send_json_error(req, 400, "invalid cbor");
+            return ESP_OK;
         }
-    } else if (message && message[0]) {
-        strncpy(detail_text, message, sizeof(detail_text) - 1);
     } else {
-        snprintf(detail_text, sizeof(detail_text), "%s の実行を許可しますか？", tool_display);
-    }
-
-    // prompt_question 追加
-    if (prompt_question && prompt_question[0]) {
-        int cur = strlen(detail_text);
-        snprintf(detail_text + cur, sizeof(detail_text) - cur, "\n%s", prompt_question);
-    }
-
-    // 非 tmux の注記
-    if (has_tmux_json && cJSON_IsFalse(has_tmux_json)) {
-        int cur = strlen(detail_text);
-        snprintf(detail_text + cur, sizeof(detail_text) - cur, "\n⚠ tmux未経由");
-    }
-
-    // choices パース
-    Choice choices[MAX_CHOICES] = {};
-    uint8_t choice_count = 0;
-    if (cJSON_IsArray(choices_json)) {
-        int arr_size = cJSON_GetArraySize(choices_json);
-        for (int i = 0; i < arr_size && i < MAX_CHOICES; i++) {
-            cJSON* item = cJSON_GetArrayItem(choices_json, i);
-            cJSON* num = cJSON_GetObjectItem(item, "number");
-            cJSON* txt = cJSON_GetObjectItem(item, "text");
-            if (cJSON_IsNumber(num) && txt) {
-                choices[choice_count].number = (uint8_t)num->valueint;
-                const char* txt_str = cJSON_GetStringValue(txt);
-                if (txt_str) {
-                    strncpy(choices[choice_count].text, txt_str, sizeof(choices[choice_count].text) - 1);
-                }
-                choice_count++;
-            }
+        root = cJSON_Parse(body);
+        if (!root) {
+            request_detail_abort(detail);
+            json_arena_free(detail);
+            json_arena_free(body);
+            send_json_error(req, 400, "invalid json");
+            return ESP_OK;
         }
+        parse_create_json(root, &f, detail);
     }
 
+    const char* tool_display = (f.tool_name && f.tool_name[0]) ? f.tool_name : "Unknown";
+    const char* subtitle_text = (f.header && f.header[0]) ? f.header : tool_display;
+
+    char detail_text[sizeof(PermissionRequest::message)] = {0};
+    build_detail_text(&f, tool_display, detail_text, sizeof(detail_text));
+
     // フックから送信された timeout（秒）を ms に変換
     int64_t timeout_ms = 0;
-    if (cJSON_IsNumber(timeout_json) && timeout_json->valuedouble > 0) {
-        timeout_ms = (int64_t)(timeout_json->valuedouble * 1000);
+    if (f.timeout_sec > 0) {
+        timeout_ms = (int64_t)(f.timeout_sec * 1000);
+    }
+
+    // Question は選択肢の中身を選ぶものなので、常に人に聞く
+    int rule = -1;
+    PolicyAction action = POLICY_ASK;
+    if (strcmp(tool_display, "Question") != 0) {
+        action = policy_evaluate(f.hostname, f.tool_name, f.command, f.file_path, &rule);
     }
 
-    // リクエスト作成
-    PermissionRequest* pr = request_store_create(
+    // リクエスト作成 (スロットは他のワーカーに再利用されうるので、ロック中にコピーする)
+    request_store_lock();
+    PermissionRequest* slot = request_store_create(
         tool_display, detail_text, subtitle_text,
-        choices, choice_count,
-        tmux_target, hostname,
+        f.choices, f.choice_count,
+        f.tmux_target, f.hostname,
         timeout_ms
     );
-
-    if (!pr) {
+    // 自動判断ポリシーに一致したら作成と同じロック内で確定する
+    // (フックの最初のポーリングで結果が返り、画面には出ない)
+    if (slot && action != POLICY_ASK) {
+        const char* response = action == POLICY_ALLOW ? "allow" : "deny";
+        char send_key[8] = {0};
+        request_store_resolve_send_key(slot, response, send_key, sizeof(send_key));
+        request_store_respond(slot->id, response, send_key, DECISION_POLICY);
+    }
+    PermissionRequest created;
+    if (slot) created = *slot;
+    request_store_unlock();
+
+    if (!slot) {
+        // 他のホストの未応答でスロットが埋まっている (1 ホストの上限は request_store.h)
+        request_detail_abort(detail);
+        json_arena_free(detail);
         cJSON_Delete(root);
-        send_json_error(req, 500, "store full");
+        json_arena_free(body);
+        httpd_resp_set_hdr(req, "Retry-After", "2");
+        send_json_error(req, 503, "store full");
         return ESP_OK;
     }
+    const PermissionRequest* pr = &created;
 
-    ESP_LOGI(TAG, "[permission] New: %s - %s: %s", pr->id, subtitle_text, detail_text);
+    // ポリシーで確定したものは画面に出ず、フックも結果を受け取るだけなので詳細は持たない
+    if (action == POLICY_ASK) {
+        build_detail_context(&f, detail);
+        request_detail_commit(detail, pr->id);
+    } else {
+        request_detail_abort(detail);
+    }
+    json_arena_free(detail);
 
-    // レスポンス
-    cJSON* resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "id", pr->id);
-    cJSON_AddStringToObject(resp, "tool_name", tool_display);
-    cJSON_AddStringToObject(resp, "message", detail_text);
-    cJSON_AddNumberToObject(resp, "expires_at", (double)pr->expires_at);
+    dlog(DL_HTTP_NEW, pr->id, subtitle_text, detail_text);
+    if (action != POLICY_ASK) {
+        dlog(DL_HTTP_POLICY, pr->id, policy_action_name(action), rule);
+    }
 
-    char* resp_str = cJSON_PrintUnformatted(resp);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, resp_str);
-    free(resp_str);
-    cJSON_Delete(resp);
+    // レスポンス (コピーの値を使うので入力バッファは先に解放できる)
     cJSON_Delete(root);
-
-    // 画面に新着通知 + ビープ音
-    display_notify_new_request();
-    display_beep();
-
-    return ESP_OK;
-}
-
-// ── GET /permission-request/* (キャッチオール: /response をディスパッチ) ──
-static esp_err_t handle_permission_request_get_wildcard(httpd_req_t* req) {
-    // URI 末尾で振り分け
-    const char* uri = req->uri;
-    if (strstr(uri, "/response")) {
-        return handle_permission_request_response(req);
+    json_arena_free(body);
+
+    if (accepts_cbor(req)) {
+        uint8_t buf[640];
+        CborWriter w;
+        cbor_resp_begin(req, &w, buf, sizeof(buf));
+        cbor_put_map(&w, 4);
+        cbor_put_uint(&w, CK_ID);
+        cbor_put_text(&w, pr->id);
+        cbor_put_uint(&w, CK_TOOL_NAME);
+        cbor_put_text(&w, pr->tool_name);
+        cbor_put_uint(&w, CK_MESSAGE);
+        cbor_put_text(&w, pr->message);
+        cbor_put_uint(&w, CK_EXPIRES_AT);
+        cbor_put_int(&w, pr->expires_at);
+        cbor_resp_end(req, &w);
+    } else {
+        cJSON* resp = cJSON_CreateObject();
+        cJSON_AddStringToObject(resp, "id", pr->id);
+        cJSON_AddStringToObject(resp, "tool_name", pr->tool_name);
+        cJSON_AddStringToObject(resp, "message", pr->message);
+        cJSON_AddNumberToObject(resp, "expires_at", (double)pr->expires_at);
+
+        char* resp_str = cJSON_PrintUnformatted(resp);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, resp_str);
+        cJSON_free(resp_str);
+        cJSON_Delete(resp);
     }
-    send_json_error(req, 404, "not found");
-    return ESP_OK;
-}
 
-// ── POST /permission-request/* (キャッチオール: /respond, /cancel をディスパッチ) ──
-static esp_err_t handle_permission_request_post_wildcard(httpd_req_t* req) {
-    const char* uri = req->uri;
-    if (strstr(uri, "/respond")) {
-        return handle_permission_request_respond(req);
-    }
-    if (strstr(uri, "/cancel")) {
-        return handle_permission_request_cancel(req);
+    // 画面に新着通知 + ビープ音 (ポリシーで確定したものは人の判断が要らないので出さない)
+    if (action == POLICY_ASK) {
+        display_notify_new_request();
+        notify_queue_beep();
     }
-    send_json_error(req, 404, "not found");
+
     return ESP_OK;
 }
 
-static esp_err_t handle_permission_request_response(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
-        return ESP_OK;
-    }
-
+// ── GET /permission-request/:id/response ──
+static esp_err_t handle_permission_request_response(httpd_req_t* req, const RouteParams* params) {
     char id[UUID_STR_LEN] = {0};
-    if (!extract_request_id(req->uri, id, sizeof(id))) {
+    if (!route_param_copy(req->uri, params, 0, id, sizeof(id))) {
         send_json_error(req, 400, "invalid uri");
         return ESP_OK;
     }
 
+    // 本文は状態遷移時に request_store が作り直しているので、コピーして送るだけ
+    bool cbor = accepts_cbor(req);
+    char body[POLL_JSON_MAX > POLL_CBOR_MAX ? POLL_JSON_MAX : POLL_CBOR_MAX];
+    size_t len = 0;
+    request_store_lock();
     PermissionRequest* pr = request_store_get(id);
+    if (pr) {
+        len = cbor ? pr->poll_cbor_len : pr->poll_json_len;
+        memcpy(body, cbor ? (const void*)pr->poll_cbor : (const void*)pr->poll_json, len);
+    }
+    request_store_unlock();
+
     if (!pr) {
         send_json_error(req, 404, "not found");
         return ESP_OK;
     }
 
-    cJSON* resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "id", pr->id);
-    if (pr->response[0] != '\0') {
-        cJSON_AddStringToObject(resp, "response", pr->response);
-        cJSON_AddNumberToObject(resp, "responded_at", (double)pr->responded_at);
-        if (pr->send_key[0] != '\0') {
-            cJSON_AddStringToObject(resp, "send_key", pr->send_key);
-        } else {
-            cJSON_AddNullToObject(resp, "send_key");
-        }
-    } else {
-        cJSON_AddNullToObject(resp, "response");
-        cJSON_AddNullToObject(resp, "responded_at");
-        cJSON_AddNullToObject(resp, "send_key");
-    }
-
-    char* resp_str = cJSON_PrintUnformatted(resp);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, resp_str);
-    free(resp_str);
-    cJSON_Delete(resp);
+    httpd_resp_set_type(req, cbor ? CBOR_MIME : "application/json");
+    httpd_resp_send(req, body, len);
     return ESP_OK;
 }
 
-// ── POST /permission-request/*/respond ──
-static esp_err_t handle_permission_request_respond(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
-        return ESP_OK;
-    }
-
+// ── POST /permission-request/:id/respond ──
+static esp_err_t handle_permission_request_respond(httpd_req_t* req, const RouteParams* params) {
     char id[UUID_STR_LEN] = {0};
-    if (!extract_request_id(req->uri, id, sizeof(id))) {
+    if (!route_param_copy(req->uri, params, 0, id, sizeof(id))) {
         send_json_error(req, 400, "invalid uri");
         return ESP_OK;
     }
 
-    char body[256] = {0};
+    char body[Board::RESPOND_BODY_LEN] = {0};
     int len = read_body(req, body, sizeof(body));
     if (len <= 0) {
         send_json_error(req, 400, "empty body");
         return ESP_OK;
     }
 
-    cJSON* root = cJSON_Parse(body);
-    if (!root) {
-        send_json_error(req, 400, "invalid json");
-        return ESP_OK;
+    // choice (番号) または response ("allow" / "deny" / "allow_all") を取り出す
+    bool has_choice = false;
+    int choice = 0;
+    const char* resp_str = nullptr;
+    cJSON* root = nullptr;
+
+    if (body_is_cbor(req)) {
+        CborReader r;
+        cbor_reader_init(&r, (uint8_t*)body, len);
+        size_t n = 0;
+        bool ok = cbor_get_map(&r, &n);
+        for (size_t i = 0; ok && i < n; i++) {
+            int key;
+            ok = cbor_get_key(&r, &key);
+            if (!ok) break;
+            if (key == CK_CHOICE && cbor_peek_type(&r) == CBOR_TYPE_UINT) {
+                int64_t v;
+                ok = cbor_get_int(&r, &v);
+                choice = (int)v;
+                has_choice = ok;
+            } else if (key == CK_RESPONSE && cbor_peek_type(&r) == CBOR_TYPE_TEXT) {
+                ok = cbor_get_text(&r, &resp_str);
+            } else {
+                ok = cbor_skip(&r);
+            }
+        }
+        if (!ok) {
+            send_json_error(req, 400, "invalid cbor");
+            return ESP_OK;
+        }
+    } else {
+        root = cJSON_Parse(body);
+        if (!root) {
+            send_json_error(req, 400, "invalid json");
+            return ESP_OK;
+        }
+        cJSON* choice_json = cJSON_GetObjectItem(root, "choice");
+        cJSON* response_json = cJSON_GetObjectItem(root, "response");
+        if (cJSON_IsNumber(choice_json)) {
+            has_choice = true;
+            choice = choice_json->valueint;
+        } else if (cJSON_IsString(response_json)) {
+            resp_str = cJSON_GetStringValue(response_json);
+        }
     }
 
+    // 選択肢の参照から応答の記録までを他のワーカーと競合させない
+    request_store_lock();
     PermissionRequest* pr = request_store_get(id);
     if (!pr) {
+        request_store_unlock();
         cJSON_Delete(root);
         send_json_error(req, 404, "not found");
         return ESP_OK;
@@ -336,11 +447,7 @@ static esp_err_t handle_permission_request_respond(httpd_req_t* req) {
     char send_key[8] = {0};
     char actual_response[16] = {0};
 
-    cJSON* choice_json = cJSON_GetObjectItem(root, "choice");
-    cJSON* response_json = cJSON_GetObjectItem(root, "response");
-
-    if (cJSON_IsNumber(choice_json)) {
-        int choice = choice_json->valueint;
+    if (has_choice) {
         snprintf(send_key, sizeof(send_key), "%d", choice);
 
         // Question は全選択肢が等価 → allow
@@ -352,8 +459,7 @@ static esp_err_t handle_permission_request_respond(httpd_req_t* req) {
                            choice == pr->choices[pr->choice_count - 1].number;
             strcpy(actual_response, is_last ? "deny" : "allow");
         }
-    } else if (response_json && cJSON_IsString(response_json)) {
-        const char* resp_str = cJSON_GetStringValue(response_json);
+    } else if (resp_str) {
         if (strcmp(resp_str, "allow") == 0 || strcmp(resp_str, "deny") == 0 || strcmp(resp_str, "allow_all") == 0) {
             request_store_resolve_send_key(pr, resp_str, send_key, sizeof(send_key));
             if (strcmp(resp_str, "allow_all") == 0) {
@@ -362,30 +468,36 @@ static esp_err_t handle_permission_request_respond(httpd_req_t* req) {
                 strncpy(actual_response, resp_str, sizeof(actual_response) - 1);
             }
         } else {
+            request_store_unlock();
             cJSON_Delete(root);
             send_json_error(req, 400, "invalid response value");
             return ESP_OK;
         }
     } else {
+        request_store_unlock();
         cJSON_Delete(root);
         send_json_error(req, 400, "response or choice is required");
         return ESP_OK;
     }
 
-    bool ok = request_store_respond(id, actual_response);
+    bool ok = request_store_respond(id, actual_response, send_key);
+    bool mirrored = pr->mirrored;
+    request_store_unlock();
     if (!ok) {
         cJSON_Delete(root);
         send_json_error(req, 404, "already responded");
         return ESP_OK;
     }
 
-    // send_key を保存
-    strncpy(pr->send_key, send_key, sizeof(pr->send_key) - 1);
+    // ミラー中のリクエストは上流サーバへ転送
+    if (mirrored) {
+        relay_mirror_forward_respond(id, has_choice ? choice : 0, resp_str);
+    }
 
-    ESP_LOGI(TAG, "[respond] %s: send_key=%s (%s)", id, send_key, actual_response);
+    dlog(DL_HTTP_RESPOND, id, send_key, actual_response);
 
     cJSON_Delete(root);
-    send_json_ok(req);
+    send_ok(req);
 
     // 画面更新
     display_notify_new_request();
@@ -393,15 +505,10 @@ static esp_err_t handle_permission_request_respond(httpd_req_t* req) {
     return ESP_OK;
 }
 
-// ── POST /permission-request/*/cancel ──
-static esp_err_t handle_permission_request_cancel(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
-        return ESP_OK;
-    }
-
+// ── POST /permission-request/:id/cancel ──
+static esp_err_t handle_permission_request_cancel(httpd_req_t* req, const RouteParams* params) {
     char id[UUID_STR_LEN] = {0};
-    if (!extract_request_id(req->uri, id, sizeof(id))) {
+    if (!route_param_copy(req->uri, params, 0, id, sizeof(id))) {
         send_json_error(req, 400, "invalid uri");
         return ESP_OK;
     }
@@ -412,197 +519,582 @@ static esp_err_t handle_permission_request_cancel(httpd_req_t* req) {
         return ESP_OK;
     }
 
-    ESP_LOGI(TAG, "[cancel] %s", id);
-    send_json_ok(req);
+    dlog(DL_HTTP_CANCEL, id);
+    send_ok(req);
 
     display_notify_new_request();
     return ESP_OK;
 }
 
-// ── GET /permission-requests ──
-static esp_err_t handle_permission_requests_list(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
+// ── GET /permission-request/:id/detail?page= ──
+// 作成時のボディの全文 (tool_input の全フィールドとプロンプトの文脈) をテキストで返す
+// 1 ページ (DETAIL_PAGE_LEN) ずつ展開して chunked で流す。page を付けるとそのページだけ
+static esp_err_t handle_permission_request_detail(httpd_req_t* req, const RouteParams* params) {
+    char id[UUID_STR_LEN] = {0};
+    if (!route_param_copy(req->uri, params, 0, id, sizeof(id))) {
+        send_json_error(req, 400, "invalid uri");
+        return ESP_OK;
+    }
+    DetailInfo info;
+    if (!request_detail_info(id, &info)) {
+        send_json_error(req, 404, "no detail");
         return ESP_OK;
     }
 
-    PermissionRequest* reqs[MAX_REQUESTS];
-    int count = request_store_get_all(reqs, MAX_REQUESTS);
-
-    cJSON* arr = cJSON_CreateArray();
-    for (int i = 0; i < count; i++) {
-        PermissionRequest* r = reqs[i];
-        cJSON* item = cJSON_CreateObject();
-        cJSON_AddStringToObject(item, "id", r->id);
-        cJSON_AddStringToObject(item, "tool_name", r->tool_name);
-        cJSON_AddStringToObject(item, "message", r->message);
-
-        if (r->choice_count > 0) {
-            cJSON* choices = cJSON_CreateArray();
-            for (int j = 0; j < r->choice_count; j++) {
-                cJSON* c = cJSON_CreateObject();
-                cJSON_AddNumberToObject(c, "number", r->choices[j].number);
-                cJSON_AddStringToObject(c, "text", r->choices[j].text);
-                cJSON_AddItemToArray(choices, c);
+    int first = 0;
+    int last = info.pages - 1;
+    char query[32];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[8];
+        char* end;
+        if (httpd_query_key_value(query, "page", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, &end, 10);
+            if (value[0] == '\0' || *end != '\0' || v < 0 || v >= info.pages) {
+                send_json_error(req, 400, "invalid page");
+                return ESP_OK;
             }
-            cJSON_AddItemToObject(item, "choices", choices);
-        } else {
-            cJSON_AddNullToObject(item, "choices");
+            first = last = (int)v;
         }
+    }
 
-        cJSON_AddNumberToObject(item, "created_at", (double)r->created_at);
-        cJSON_AddNumberToObject(item, "expires_at", (double)r->expires_at);
-
-        if (r->response[0] != '\0') {
-            cJSON_AddStringToObject(item, "response", r->response);
-            cJSON_AddNumberToObject(item, "responded_at", (double)r->responded_at);
-        } else {
-            cJSON_AddNullToObject(item, "response");
-            cJSON_AddNullToObject(item, "responded_at");
+    char* buf = (char*)json_arena_alloc(DETAIL_READ_LEN);
+    if (!buf) {
+        send_json_error(req, 500, "out of memory");
+        return ESP_OK;
+    }
+    char pages[8];
+    char length[12];
+    snprintf(pages, sizeof(pages), "%u", (unsigned)info.pages);
+    snprintf(length, sizeof(length), "%u", (unsigned)info.raw_len);
+
+    // 送信中に追い出されたらそこで打ち切る (最初のページからなければ 404)
+    bool sent = false;
+    for (int page = first; page <= last; page++) {
+        int n = request_detail_read_page(id, page, buf, DETAIL_READ_LEN);
+        if (n < 0) break;
+        if (!sent) {
+            httpd_resp_set_type(req, "text/plain; charset=utf-8");
+            httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+            httpd_resp_set_hdr(req, "X-Detail-Pages", pages);
+            httpd_resp_set_hdr(req, "X-Detail-Length", length);
+            if (info.truncated) httpd_resp_set_hdr(req, "X-Detail-Truncated", "1");
+            sent = true;
         }
-
-        if (r->send_key[0] != '\0') {
-            cJSON_AddStringToObject(item, "send_key", r->send_key);
-        } else {
-            cJSON_AddNullToObject(item, "send_key");
+        if (httpd_resp_send_chunk(req, buf, n) != ESP_OK) {
+            json_arena_free(buf);
+            return ESP_OK;
         }
+    }
+    json_arena_free(buf);
+    if (!sent) {
+        send_json_error(req, 404, "no detail");
+        return ESP_OK;
+    }
+    httpd_resp_send_chunk(req, nullptr, 0);
+    return ESP_OK;
+}
 
-        if (r->hostname[0] != '\0') {
-            cJSON_AddStringToObject(item, "hostname", r->hostname);
-        } else {
-            cJSON_AddNullToObject(item, "hostname");
+// 出力を捨てる flush (CBOR の長さを flushed で数えるだけのとき)
+static bool cbor_discard_flush(void*, const uint8_t*, size_t) {
+    return true;
+}
+
+// ── GET /permission-requests ──
+// ストアのロック中はツリー / CBOR をアリーナに組み立てるだけにして、送信はロックの外で行う
+// (/ws の build_payload と同じ。リクエストのコピーを取らない)
+static esp_err_t handle_permission_requests_list(httpd_req_t* req, const RouteParams*) {
+    PermissionRequest* reqs[MAX_REQUESTS];
+
+    if (accepts_cbor(req)) {
+        // 1 回目で長さを数え、ちょうどの大きさをアリーナから取って 2 回目で書く
+        request_store_lock();
+        int count = request_store_get_all(reqs, MAX_REQUESTS);
+        uint8_t scratch[64];
+        CborWriter w;
+        cbor_writer_init(&w, scratch, sizeof(scratch), cbor_discard_flush);
+        request_list_to_cbor(&w, reqs, count);
+        size_t len = w.flushed + w.len;
+        uint8_t* buf = (uint8_t*)json_arena_alloc(len);
+        if (buf) {
+            cbor_writer_init(&w, buf, len);
+            request_list_to_cbor(&w, reqs, count);
         }
+        request_store_unlock();
 
-        cJSON_AddItemToArray(arr, item);
+        if (!buf || w.error) {
+            json_arena_free(buf);
+            send_json_error(req, 500, "out of memory");
+            return ESP_OK;
+        }
+        httpd_resp_set_type(req, CBOR_MIME);
+        httpd_resp_send(req, (const char*)buf, w.len);
+        json_arena_free(buf);
+        return ESP_OK;
     }
 
-    char* json_str = cJSON_PrintUnformatted(arr);
+    request_store_lock();
+    int count = request_store_get_all(reqs, MAX_REQUESTS);
+    cJSON* arr = request_list_to_json(reqs, count);
+    request_store_unlock();
+
+    // 出力サイズを見積もって 1 回で確保する (倍々の再確保でアリーナを使い切らない)
+    char* json_str = cJSON_PrintBuffered(arr, 256 + count * 1024, false);
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, json_str);
-    free(json_str);
+    cJSON_free(json_str);
     cJSON_Delete(arr);
     return ESP_OK;
 }
 
 // ── POST /notify ──
-static esp_err_t handle_notify(httpd_req_t* req) {
-    if (!check_auth(req)) {
-        send_json_error(req, 401, "unauthorized");
-        return ESP_OK;
-    }
-
-    char body[512] = {0};
+static esp_err_t handle_notify(httpd_req_t* req, const RouteParams*) {
+    char body[Board::NOTIFY_BODY_LEN] = {0};
     int len = read_body(req, body, sizeof(body));
     if (len <= 0) {
         send_json_error(req, 400, "empty body");
         return ESP_OK;
     }
 
-    cJSON* root = cJSON_Parse(body);
-    if (!root) {
-        send_json_error(req, 400, "invalid json");
-        return ESP_OK;
+    const char* title = nullptr;
+    const char* message = nullptr;
+    const char* hostname = nullptr;
+    cJSON* root = nullptr;
+
+    if (body_is_cbor(req)) {
+        CborReader r;
+        cbor_reader_init(&r, (uint8_t*)body, len);
+        size_t n = 0;
+        bool ok = cbor_get_map(&r, &n);
+        for (size_t i = 0; ok && i < n; i++) {
+            int key;
+            ok = cbor_get_key(&r, &key);
+            if (!ok) break;
+            if (key == CK_TITLE) ok = cbor_get_text(&r, &title);
+            else if (key == CK_MESSAGE) ok = cbor_get_text(&r, &message);
+            else if (key == CK_HOSTNAME) ok = cbor_get_text(&r, &hostname);
+            else ok = cbor_skip(&r);
+        }
+        if (!ok) {
+            send_json_error(req, 400, "invalid cbor");
+            return ESP_OK;
+        }
+    } else {
+        root = cJSON_Parse(body);
+        if (!root) {
+            send_json_error(req, 400, "invalid json");
+            return ESP_OK;
+        }
+        title = cJSON_GetStringValue(cJSON_GetObjectItem(root, "title"));
+        message = cJSON_GetStringValue(cJSON_GetObjectItem(root, "message"));
+        hostname = cJSON_GetStringValue(cJSON_GetObjectItem(root, "hostname"));
     }
 
-    const char* title = cJSON_GetStringValue(cJSON_GetObjectItem(root, "title"));
-    const char* message = cJSON_GetStringValue(cJSON_GetObjectItem(root, "message"));
-    const char* hostname = cJSON_GetStringValue(cJSON_GetObjectItem(root, "hostname"));
-
-    ESP_LOGI(TAG, "[notify] %s%s%s%s: %s",
+    dlog(DL_HTTP_NOTIFY,
         title ? title : "Claude Code",
-        hostname ? " [" : "", hostname ? hostname : "", hostname ? "]" : "",
+        hostname ? hostname : "-",
         message ? message : "(no message)");
 
-    // 画面に通知表示
-    display_show_notification(
+    // 通知キューに積むだけ (表示・まとめ・ビープの間引きはメインループの display_update)
+    notify_queue_push(
         title ? title : "Claude Code",
         message ? message : "",
         hostname
     );
 
     cJSON_Delete(root);
-    send_json_ok(req);
+    send_ok(req);
+    return ESP_OK;
+}
+
+// ── GET /stats ──
+static esp_err_t handle_stats(httpd_req_t* req, const RouteParams*) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "admission", admission_stats_to_json());
+    cJSON_AddItemToObject(root, "router", http_router_stats_to_json());
+    cJSON* log = cJSON_AddObjectToObject(root, "log");
+    cJSON_AddNumberToObject(log, "written", dlog_written());
+    cJSON_AddNumberToObject(log, "dropped", dlog_dropped());
+    cJSON_AddItemToObject(root, "arena", json_arena_stats_to_json());
+    cJSON_AddItemToObject(root, "heap", heap_monitor_stats_to_json());
+    cJSON_AddItemToObject(root, "history", decision_history_stats_to_json());
+    cJSON_AddItemToObject(root, "decisions", decision_stats_to_json());
+    cJSON_AddItemToObject(root, "detail", request_detail_stats_to_json());
+    cJSON_AddItemToObject(root, "policy", policy_stats_to_json());
+    cJSON_AddItemToObject(root, "display", display_stats_to_json());
+    cJSON_AddItemToObject(root, "input", input_stats_to_json());
+    cJSON_AddItemToObject(root, "notify", notify_queue_stats_to_json());
+    cJSON_AddItemToObject(root, "mdns", mdns_service_stats_to_json());
+    cJSON* tls = https_stats_to_json();
+    if (tls) cJSON_AddItemToObject(root, "tls", tls);
+
+    char* json_str = cJSON_PrintUnformatted(root);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
+// ── GET /logs ──
+// 遅延ログの直近レコードをバイナリのまま返す (tools/decode_log.py で復号)
+static esp_err_t handle_logs(httpd_req_t* req, const RouteParams*) {
+    size_t cap = DLOG_HISTORY_SIZE + 4;
+    uint8_t* buf = (uint8_t*)json_arena_alloc(cap);
+    if (!buf) {
+        send_json_error(req, 500, "out of memory");
+        return ESP_OK;
+    }
+    size_t len = dlog_read_history(buf, cap);
+
+    char dropped[12];
+    snprintf(dropped, sizeof(dropped), "%u", (unsigned)dlog_dropped());
+    httpd_resp_set_hdr(req, "X-Dlog-Dropped", dropped);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_send(req, (const char*)buf, len);
+    json_arena_free(buf);
+    return ESP_OK;
+}
+
+// ── GET /history?cursor=&limit= ──
+// 判断履歴を新しい順に返す。次のページは next_cursor を cursor に渡す (null = 終わり)
+// 全件を組み立てずにレコードを少しずつコピーして chunked で流す
+
+#define HISTORY_DEFAULT_LIMIT 50
+#define HISTORY_MAX_LIMIT 500
+#define HISTORY_BATCH 16
+
+static esp_err_t handle_history(httpd_req_t* req, const RouteParams*) {
+    uint32_t cursor = UINT32_MAX;
+    int limit = HISTORY_DEFAULT_LIMIT;
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[16];
+        char* end;
+        if (httpd_query_key_value(query, "cursor", value, sizeof(value)) == ESP_OK) {
+            unsigned long long v = strtoull(value, &end, 10);
+            if (value[0] == '\0' || *end != '\0' || v == 0 || v > UINT32_MAX) {
+                send_json_error(req, 400, "invalid cursor");
+                return ESP_OK;
+            }
+            cursor = (uint32_t)v;
+        }
+        if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK) {
+            long v = strtol(value, &end, 10);
+            if (value[0] == '\0' || *end != '\0' || v <= 0) {
+                send_json_error(req, 400, "invalid limit");
+                return ESP_OK;
+            }
+            limit = v > HISTORY_MAX_LIMIT ? HISTORY_MAX_LIMIT : (int)v;
+        }
+    }
+
+    // レコードのコピーと送信バッファ (送信中は履歴のロックを持たない)
+    HistoryRecord batch[HISTORY_BATCH];
+    char buf[1024];
+    size_t len = snprintf(buf, sizeof(buf), "{\"now\":%lld,\"records\":[",
+                          (long long)(esp_timer_get_time() / 1000));
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    bool more = true;
+    bool first = true;
+    uint32_t last_seq = 0;
+    while (limit > 0 && more) {
+        int n = decision_history_read(cursor, batch, limit < HISTORY_BATCH ? limit : HISTORY_BATCH, &more);
+        for (int i = 0; i < n; i++) {
+            if (len + HISTORY_JSON_MAX + 1 > sizeof(buf)) {
+                if (httpd_resp_send_chunk(req, buf, len) != ESP_OK) return ESP_OK;
+                len = 0;
+            }
+            if (!first) buf[len++] = ',';
+            first = false;
+            len += decision_history_record_json(&batch[i], buf + len, sizeof(buf) - len);
+            last_seq = batch[i].seq;
+        }
+        if (n == 0) break;
+        cursor = last_seq;
+        limit -= n;
+    }
+
+    if (len + 40 > sizeof(buf)) {
+        if (httpd_resp_send_chunk(req, buf, len) != ESP_OK) return ESP_OK;
+        len = 0;
+    }
+    if (more && last_seq != 0) {
+        len += snprintf(buf + len, sizeof(buf) - len, "],\"next_cursor\":%u}", (unsigned)last_seq);
+    } else {
+        len += snprintf(buf + len, sizeof(buf) - len, "],\"next_cursor\":null}");
+    }
+    httpd_resp_send_chunk(req, buf, len);
+    httpd_resp_send_chunk(req, nullptr, 0);
+    return ESP_OK;
+}
+
+// ── GET /policy, PUT /policy ──
+// 自動判断ルールの参照と置き換え。置き換えはルームキーではなく管理キー
+// (CONFIG_POLICY_ADMIN_KEY) が必要で、未設定なら受け付けない
+
+#define POLICY_MAX_BODY 4096
+
+// 定数時間で比較する (一致した文字数を応答時間から推測させない)
+static bool check_admin_auth(httpd_req_t* req) {
+    const char* expected = CONFIG_POLICY_ADMIN_KEY;
+    char buf[256] = {0};
+    if (httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) != ESP_OK) {
+        return false;
+    }
+    if (strncmp(buf, "Bearer ", 7) != 0) return false;
+    const char* key = buf + 7;
+    size_t len = strlen(expected);
+    if (strlen(key) != len) return false;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) diff |= (uint8_t)(key[i] ^ expected[i]);
+    return diff == 0;
+}
+
+static void send_policy(httpd_req_t* req) {
+    cJSON* root = policy_to_json();
+    char* json_str = cJSON_PrintUnformatted(root);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_sendstr(req, json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+}
+
+static esp_err_t handle_policy_get(httpd_req_t* req, const RouteParams*) {
+    send_policy(req);
+    return ESP_OK;
+}
+
+static esp_err_t handle_policy_put(httpd_req_t* req, const RouteParams*) {
+    if (CONFIG_POLICY_ADMIN_KEY[0] == '\0') {
+        send_json_error(req, 403, "policy upload disabled");
+        return ESP_OK;
+    }
+    if (!check_admin_auth(req)) {
+        send_json_error(req, 401, "unauthorized");
+        return ESP_OK;
+    }
+    char* body = (char*)json_arena_alloc(POLICY_MAX_BODY);
+    if (!body) {
+        send_json_error(req, 500, "out of memory");
+        return ESP_OK;
+    }
+    int len = read_body(req, body, POLICY_MAX_BODY);
+    if (len <= 0) {
+        json_arena_free(body);
+        send_json_error(req, 400, "empty body");
+        return ESP_OK;
+    }
+
+    char err[96];
+    bool ok = policy_replace(body, err, sizeof(err));
+    json_arena_free(body);
+    if (!ok) {
+        send_json_error(req, 400, err);
+        return ESP_OK;
+    }
+    send_policy(req);
+    return ESP_OK;
+}
+
+// ── GET /* (PWA 静的ファイル、認証不要) ──
+// フラッシュ上の圧縮済みデータをそのまま送信する (デバイス側で展開しない)
+
+static const WebAsset* find_web_asset(const char* path, size_t path_len) {
+    for (int i = 0; i < WEB_ASSET_COUNT; i++) {
+        const char* p = WEB_ASSETS[i].path;
+        if (strlen(p) == path_len && memcmp(p, path, path_len) == 0) {
+            return &WEB_ASSETS[i];
+        }
+    }
+    return nullptr;
+}
+
+static esp_err_t handle_static(httpd_req_t* req, const RouteParams*) {
+    const char* uri = req->uri;
+    const char* query = strchr(uri, '?');
+    size_t path_len = query ? (size_t)(query - uri) : strlen(uri);
+
+    const WebAsset* asset = (path_len == 1 && uri[0] == '/')
+        ? find_web_asset("/index.html", 11)
+        : find_web_asset(uri, path_len);
+    if (!asset) {
+        send_json_error(req, 404, "not found");
+        return ESP_OK;
+    }
+
+    // index.html が付与した ?v=<hash> 付き URL は内容が変わらないので immutable
+    char version[16] = {0};
+    bool fingerprinted = query &&
+        httpd_query_key_value(query + 1, "v", version, sizeof(version)) == ESP_OK &&
+        strcmp(version, asset->version) == 0;
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control",
+        fingerprinted ? "public, max-age=31536000, immutable" : "no-cache");
+
+    // 再訪問: ETag 一致なら本文なしの 304
+    char inm[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strstr(inm, asset->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, nullptr, 0);
+        return ESP_OK;
+    }
+
+    if (asset->gzipped) {
+        // 非圧縮版は持たない (展開コストとフラッシュ容量を避ける)
+        char ae[64];
+        if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", ae, sizeof(ae)) != ESP_OK ||
+            !strstr(ae, "gzip")) {
+            httpd_resp_set_status(req, "406 Not Acceptable");
+            httpd_resp_sendstr(req, "gzip required");
+            return ESP_OK;
+        }
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+
+    httpd_resp_set_type(req, asset->mime);
+    httpd_resp_send(req, (const char*)asset->data, asset->len);
     return ESP_OK;
 }
 
-// ── ワイルドカード URI マッチング ──
-// ESP-IDF の httpd_uri_match_wildcard を使うため、
-// /permission-request/*/response 等をワイルドカード登録する
+// ── ルート表 ──
+// ルーター (http_router) のルート番号はこの表の添字。認証・ボディの上限・流量制御は
+// httpd タスクでディスパッチ前に確かめ、本処理は優先度ごとのワーカーに渡す
+
+#define ROUTE_AUTH 0x01         // Bearer 認証が必要
+#define ROUTE_ADMISSION 0x02    // 流量制御の対象 (POST /permission-request, /notify)
+#define ROUTE_INLINE 0x04       // httpd タスクでそのまま実行 (ワーカーに渡さない)
+
+struct Route {
+    RouteMethod method;
+    const char* path;
+    http_work_fn_t handler;
+    WorkPriority prio;
+    uint8_t flags;
+    uint16_t max_body;          // content_len がこれ以上なら読まずに 413 (0 = 検査しない)
+};
+
+static_assert(ROUTE_ID_MAX_LEN == UUID_STR_LEN - 1, ":id must fit a request ID");
+
+static const Route ROUTES[] = {
+    { ROUTE_GET,  "/health", handle_health, PRIO_HOOK, ROUTE_INLINE, 0 },
+    { ROUTE_POST, "/permission-request", handle_permission_request_create, PRIO_HOOK,
+      ROUTE_AUTH | ROUTE_ADMISSION, MAX_BODY_LEN },
+    { ROUTE_GET,  "/permission-requests", handle_permission_requests_list, PRIO_BULK, ROUTE_AUTH, 0 },
+    { ROUTE_GET,  "/permission-request/:id/response", handle_permission_request_response, PRIO_HOOK,
+      ROUTE_AUTH, 0 },
+    { ROUTE_POST, "/permission-request/:id/respond", handle_permission_request_respond, PRIO_DECISION,
+      ROUTE_AUTH, Board::RESPOND_BODY_LEN },
+    { ROUTE_POST, "/permission-request/:id/cancel", handle_permission_request_cancel, PRIO_DECISION,
+      ROUTE_AUTH, 0 },
+    { ROUTE_GET,  "/permission-request/:id/detail", handle_permission_request_detail, PRIO_BULK,
+      ROUTE_AUTH, 0 },
+    { ROUTE_POST, "/notify", handle_notify, PRIO_BULK, ROUTE_AUTH | ROUTE_ADMISSION, Board::NOTIFY_BODY_LEN },
+    { ROUTE_GET,  "/stats", handle_stats, PRIO_BULK, ROUTE_AUTH, 0 },
+    { ROUTE_GET,  "/logs", handle_logs, PRIO_BULK, ROUTE_AUTH, 0 },
+    { ROUTE_GET,  "/history", handle_history, PRIO_BULK, ROUTE_AUTH, 0 },
+    { ROUTE_GET,  "/policy", handle_policy_get, PRIO_BULK, ROUTE_AUTH, 0 },
+    // 管理用キーはハンドラで確かめる。切り詰めて読むと一部のルールだけが効くので上限は読む前に断る
+    { ROUTE_PUT,  "/policy", handle_policy_put, PRIO_BULK, 0, POLICY_MAX_BODY },
+    // PWA 静的ファイル (認証不要)。ほかの GET に一致しなかったときだけ
+    { ROUTE_GET,  "/*", handle_static, PRIO_BULK, 0, 0 },
+};
+static const int ROUTE_COUNT = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+static bool route_method(int method, RouteMethod* out) {
+    switch (method) {
+        case HTTP_GET: *out = ROUTE_GET; return true;
+        case HTTP_POST: *out = ROUTE_POST; return true;
+        case HTTP_PUT: *out = ROUTE_PUT; return true;
+        case HTTP_DELETE: *out = ROUTE_DELETE; return true;
+        default: return false;
+    }
+}
+
+// 全メソッド共通の入口 ("/*" に登録)。ルートを引き、表の情報に従って振り分ける
+static esp_err_t handle_route(httpd_req_t* req) {
+    RouteMethod method;
+    RouteParams params;
+    int index = 0;
+    RouteResult result = route_method(req->method, &method)
+        ? http_router_match(method, req->uri, &index, &params)
+        : ROUTE_METHOD_NOT_ALLOWED;
+    if (result != ROUTE_FOUND) {
+        send_json_error(req, result == ROUTE_NOT_FOUND ? 404 : 405,
+                        result == ROUTE_NOT_FOUND ? "not found" : "method not allowed");
+        return ESP_OK;
+    }
+
+    const Route* route = &ROUTES[index];
+    if ((route->flags & ROUTE_AUTH) && !check_auth(req)) {
+        send_json_error(req, 401, "unauthorized");
+        return ESP_OK;
+    }
+    if (route->max_body && req->content_len >= route->max_body) {
+        send_json_error(req, 413, "body too large");
+        return ESP_OK;
+    }
+    if (route->flags & ROUTE_INLINE) {
+        return route->handler(req, &params);
+    }
+    if (!(route->flags & ROUTE_ADMISSION)) {
+        return http_workers_dispatch(req, route->prio, route->handler, &params);
+    }
+    if (!admit(req)) return ESP_OK;
+    return http_workers_dispatch(req, route->prio, route->handler, &params, admission_end);
+}
 
 esp_err_t http_server_start(void) {
+    admission_init();
+    esp_err_t err = http_workers_start();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "http_workers_start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    RoutePattern patterns[ROUTE_COUNT];
+    for (int i = 0; i < ROUTE_COUNT; i++) patterns[i] = { ROUTES[i].method, ROUTES[i].path };
+    err = http_router_build(patterns, ROUTE_COUNT);
+    if (err != ESP_OK) return err;
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = HTTP_PORT;
     config.uri_match_fn = httpd_uri_match_wildcard;
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = 8;
     config.stack_size = 8192;
     config.recv_wait_timeout = 10;
     config.send_wait_timeout = 10;
+    // /ws の常時接続分 + 通常の HTTP リクエスト分
+    config.max_open_sockets = MAX_WS_CLIENTS + 4;
 
+    // CONFIG_HTTPS_SERVER なら同じポートを TLS で開く (同時接続数は TLS 側で絞る)
     httpd_handle_t server = nullptr;
-    esp_err_t err = httpd_start(&server, &config);
+    err = https_server_start(&config, &server);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "httpd_start failed: %s", esp_err_to_name(err));
         return err;
     }
 
-    // ルート登録 (順序重要: 具体的なパスを先に)
-
-    // GET /health
-    httpd_uri_t uri_health = {
-        .uri = "/health",
-        .method = HTTP_GET,
-        .handler = handle_health,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_health);
-
-    // POST /permission-request (完全一致 — ワイルドカードより先に)
-    httpd_uri_t uri_pr_create = {
-        .uri = "/permission-request",
-        .method = HTTP_POST,
-        .handler = handle_permission_request_create,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_pr_create);
-
-    // GET /permission-requests (一覧)
-    httpd_uri_t uri_pr_list = {
-        .uri = "/permission-requests",
-        .method = HTTP_GET,
-        .handler = handle_permission_requests_list,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_pr_list);
-
-    // GET /permission-request/* (catch-all for /response)
-    httpd_uri_t uri_pr_get_wild = {
-        .uri = "/permission-request/*",
-        .method = HTTP_GET,
-        .handler = handle_permission_request_get_wildcard,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_pr_get_wild);
-
-    // POST /permission-request/* (catch-all for /respond, /cancel)
-    httpd_uri_t uri_pr_post_wild = {
-        .uri = "/permission-request/*",
-        .method = HTTP_POST,
-        .handler = handle_permission_request_post_wildcard,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_pr_post_wild);
-
-    // POST /notify
-    httpd_uri_t uri_notify = {
-        .uri = "/notify",
-        .method = HTTP_POST,
-        .handler = handle_notify,
-        .user_ctx = nullptr,
-    };
-    httpd_register_uri_handler(server, &uri_notify);
-
-    ESP_LOGI(TAG, "HTTP server started on port %d", HTTP_PORT);
+    // GET /ws (WebSocket) は httpd のハンドラとして先に登録する (登録順に照合されるため)
+    ws_server_register(server);
+
+    // それ以外はメソッドごとに "/*" を 1 つだけ登録し、ルーターで振り分ける
+    static const httpd_method_t METHODS[] = { HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE };
+    for (httpd_method_t m : METHODS) {
+        httpd_uri_t uri = {};
+        uri.uri = "/*";
+        uri.method = m;
+        uri.handler = handle_route;
+        httpd_register_uri_handler(server, &uri);
+    }
+
+    ESP_LOGI(TAG, "%s server started on port %d", https_server_enabled() ? "HTTPS" : "HTTP", HTTP_PORT);
 
     return ESP_OK;
 }
@@ -0,0 +1,123 @@
+#include "http_workers.h"
+#include "json_arena.h"
+#include "board_profile.h"
+
+#include <cstdio>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static const char* TAG = "workers";
+
+// ワーカー 0 は PRIO_DECISION 専用 (一覧の送信中でも応答操作を待たせない)
+// 残りは優先度の高いキューから順に取り出す
+#define WORKER_COUNT HTTP_WORKER_COUNT
+#define WORKER_STACK 8192        // httpd タスクと同じ (ハンドラをそのまま動かすため)
+#define WORKER_TASK_PRIO 5
+// ワーカーごとの cJSON / ボディ用アリーナ (respond / cancel は小さい。一覧の大きさは機種のスロット数で決まる)
+#define DECISION_ARENA_SIZE Board::DECISION_ARENA_SIZE
+#define GENERAL_ARENA_SIZE Board::GENERAL_ARENA_SIZE
+
+static const int QUEUE_LEN[PRIO_COUNT] = { 8, 8, 4 };
+
+struct WorkItem {
+    httpd_req_t* req;
+    http_work_fn_t fn;
+    void (*done)(void);
+    RouteParams params;
+};
+
+static QueueHandle_t s_queues[PRIO_COUNT];
+static SemaphoreHandle_t s_decision_ready = nullptr;  // PRIO_DECISION 投入ごとに +1
+static SemaphoreHandle_t s_any_ready = nullptr;       // 全投入ごとに +1
+
+static void run_item(const WorkItem* item, JsonArena* arena) {
+    // ハンドラ内の cJSON 確保はアリーナから。送信まで終わってから一括で戻す
+    json_arena_begin(arena);
+    item->fn(item->req, &item->params);
+    json_arena_end(arena);
+    httpd_req_async_handler_complete(item->req);
+    if (item->done) item->done();
+}
+
+// 他のワーカーが先に取り出した場合は空振りするので、呼び出し側で待ち直す
+static void decision_worker(void* arg) {
+    JsonArena* arena = (JsonArena*)arg;
+    WorkItem item;
+    while (true) {
+        xSemaphoreTake(s_decision_ready, portMAX_DELAY);
+        if (xQueueReceive(s_queues[PRIO_DECISION], &item, 0) == pdTRUE) {
+            run_item(&item, arena);
+        }
+    }
+}
+
+static void general_worker(void* arg) {
+    JsonArena* arena = (JsonArena*)arg;
+    WorkItem item;
+    while (true) {
+        xSemaphoreTake(s_any_ready, portMAX_DELAY);
+        for (int p = 0; p < PRIO_COUNT; p++) {
+            if (xQueueReceive(s_queues[p], &item, 0) == pdTRUE) {
+                run_item(&item, arena);
+                break;
+            }
+        }
+    }
+}
+
+esp_err_t http_workers_start(void) {
+    for (int p = 0; p < PRIO_COUNT; p++) {
+        s_queues[p] = xQueueCreate(QUEUE_LEN[p], sizeof(WorkItem));
+        if (!s_queues[p]) return ESP_ERR_NO_MEM;
+    }
+    s_decision_ready = xSemaphoreCreateCounting(QUEUE_LEN[PRIO_DECISION], 0);
+    s_any_ready = xSemaphoreCreateCounting(QUEUE_LEN[PRIO_DECISION] + QUEUE_LEN[PRIO_HOOK] + QUEUE_LEN[PRIO_BULK], 0);
+    if (!s_decision_ready || !s_any_ready) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < WORKER_COUNT; i++) {
+        // 確保できなければアリーナなし (全てヒープ) で動かす
+        JsonArena* arena = i == 0 ? json_arena_create(DECISION_ARENA_SIZE)
+                                  : json_arena_create(GENERAL_ARENA_SIZE, Board::ARENAS_IN_PSRAM);
+        char name[16];
+        snprintf(name, sizeof(name), "http_w%d", i);
+        BaseType_t ok = xTaskCreatePinnedToCore(
+            i == 0 ? decision_worker : general_worker,
+            name, WORKER_STACK, arena, WORKER_TASK_PRIO, nullptr, i % 2);
+        if (ok != pdPASS) return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d HTTP workers started", WORKER_COUNT);
+    return ESP_OK;
+}
+
+static void send_busy(httpd_req_t* req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"error\":\"server busy\"}");
+}
+
+esp_err_t http_workers_dispatch(httpd_req_t* req, WorkPriority prio, http_work_fn_t fn,
+                                const RouteParams* params, void (*done)(void)) {
+    httpd_req_t* async_req = nullptr;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        send_busy(req);
+        if (done) done();
+        return ESP_OK;
+    }
+
+    WorkItem item = { async_req, fn, done, *params };
+    if (xQueueSend(s_queues[prio], &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Queue %d full, shedding %s", prio, req->uri);
+        send_busy(async_req);
+        httpd_req_async_handler_complete(async_req);
+        if (done) done();
+        return ESP_OK;
+    }
+
+    if (prio == PRIO_DECISION) xSemaphoreGive(s_decision_ready);
+    xSemaphoreGive(s_any_ready);
+    return ESP_OK;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "http_router.h"
+
+// ワーカー 0 は PRIO_DECISION 専用、残りは汎用 (アリーナの大きさは board_profile.h)
+#define HTTP_WORKER_COUNT 3
+
+// 非同期ハンドラの優先度クラス (小さいほど優先)
+enum WorkPriority {
+    PRIO_DECISION,  // respond / cancel: ユーザーの操作結果。最優先
+    PRIO_HOOK,      // create / response: フックの待ち時間に直結
+    PRIO_BULK,      // 一覧 / notify / stats / 静的ファイル
+    PRIO_COUNT,
+};
+
+// params はルーターが取り出したパラメータ (位置は req->uri 内)
+typedef esp_err_t (*http_work_fn_t)(httpd_req_t* req, const RouteParams* params);
+
+// ワーカープールを起動 (両コアに分散)
+esp_err_t http_workers_start(void);
+
+// req を httpd タスクから切り離してワーカーで fn を実行する (params はコピーして渡す)
+// キューが満杯なら 503 を返す。どちらの場合も呼び出し元は ESP_OK を返せばよい
+// done は fn 実行後 (または 503 で打ち切った後) に呼ばれる (nullptr 可)
+esp_err_t http_workers_dispatch(httpd_req_t* req, WorkPriority prio, http_work_fn_t fn,
+                                const RouteParams* params, void (*done)(void) = nullptr);
@@ -0,0 +1,114 @@
+#include "https_server.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "sdkconfig.h"
+
+#ifdef CONFIG_HTTPS_SERVER
+#include <esp_https_server.h>
+
+// session_tickets はこれがないと何も言わずに無視される (sdkconfig.defaults で有効にしている)
+#ifndef CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+#error "CONFIG_HTTPS_SERVER needs CONFIG_ESP_TLS_SERVER_SESSION_TICKETS for session resumption"
+#endif
+
+static const char* TAG = "https";
+
+// main/CMakeLists.txt の target_add_binary_data で埋め込む (TEXT なので末尾に NUL が付く)
+extern const uint8_t server_pem_start[] asm("_binary_server_pem_start");
+extern const uint8_t server_pem_end[] asm("_binary_server_pem_end");
+extern const uint8_t server_key_pem_start[] asm("_binary_server_key_pem_start");
+extern const uint8_t server_key_pem_end[] asm("_binary_server_key_pem_end");
+
+#define HTTPS_STACK_SIZE 10240      // ハンドシェイク (ECDSA 署名・ECDHE) は httpd タスクで行う
+
+static volatile int s_open = 0;
+static int s_peak = 0;
+static uint32_t s_created = 0;
+static uint32_t s_closed = 0;
+static size_t s_free_idle = 0;          // 起動直後 (セッション 0 件) の内部 RAM の空き
+static size_t s_free_min = SIZE_MAX;
+// (起動直後の空き - 今の空き) / 同時数 の直近値。他の確保も含む目安
+// (正確な値は tools/tls_handshake_test.py が接続を増やしながら測る)
+static size_t s_per_session = 0;
+
+static size_t internal_free(void) {
+    return heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+// セッション確立 (ハンドシェイク完了後) と終了で呼ばれる (httpd タスク)
+static void on_session(esp_https_server_user_cb_arg_t* arg) {
+    size_t free_now = internal_free();
+    if (arg->user_cb_state == HTTPD_SSL_USER_CB_SESS_CREATE) {
+        s_created++;
+        s_open = s_open + 1;
+        if (s_open > s_peak) s_peak = s_open;
+        if (free_now < s_free_min) s_free_min = free_now;
+        if (s_free_idle > free_now) s_per_session = (s_free_idle - free_now) / s_open;
+    } else if (arg->user_cb_state == HTTPD_SSL_USER_CB_SESS_CLOSE) {
+        s_closed++;
+        if (s_open > 0) s_open = s_open - 1;
+    }
+}
+
+esp_err_t https_server_start(httpd_config_t* config, httpd_handle_t* out) {
+    httpd_ssl_config_t ssl = HTTPD_SSL_CONFIG_DEFAULT();
+    ssl.httpd = *config;
+    ssl.httpd.stack_size = HTTPS_STACK_SIZE;
+    // /ws も 1 セッション。上限に達したら最も使われていない接続を閉じて受け入れる
+    ssl.httpd.max_open_sockets = CONFIG_HTTPS_MAX_SESSIONS;
+    ssl.httpd.lru_purge_enable = true;
+    ssl.port_secure = config->server_port;
+    ssl.transport_mode = HTTPD_SSL_TRANSPORT_SECURE;
+
+    ssl.servercert = server_pem_start;
+    ssl.servercert_len = server_pem_end - server_pem_start;
+    ssl.prvtkey_pem = server_key_pem_start;
+    ssl.prvtkey_len = server_key_pem_end - server_key_pem_start;
+    // 再接続はチケットで鍵交換と証明書の送信を省く (サーバ側にセッションキャッシュを持たない)
+    ssl.session_tickets = true;
+    ssl.user_cb = on_session;
+
+    s_free_idle = internal_free();
+    esp_err_t err = httpd_ssl_start(out, &ssl);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "httpd_ssl_start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "TLS on port %d (max %d sessions, tickets on)", config->server_port,
+             CONFIG_HTTPS_MAX_SESSIONS);
+    return ESP_OK;
+}
+
+bool https_server_enabled(void) {
+    return true;
+}
+
+cJSON* https_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "sessions", s_open);
+    cJSON_AddNumberToObject(root, "peak", s_peak);
+    cJSON_AddNumberToObject(root, "max", CONFIG_HTTPS_MAX_SESSIONS);
+    cJSON_AddNumberToObject(root, "created", s_created);
+    cJSON_AddNumberToObject(root, "closed", s_closed);
+    cJSON_AddNumberToObject(root, "heap_per_session", s_per_session);
+    cJSON_AddNumberToObject(root, "internal_free", internal_free());
+    cJSON_AddNumberToObject(root, "internal_free_min", s_free_min == SIZE_MAX ? 0 : s_free_min);
+    return root;
+}
+
+#else
+
+esp_err_t https_server_start(httpd_config_t* config, httpd_handle_t* out) {
+    return httpd_start(out, config);
+}
+
+bool https_server_enabled(void) {
+    return false;
+}
+
+cJSON* https_stats_to_json(void) {
+    return nullptr;
+}
+
+#endif
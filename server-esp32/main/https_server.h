@@ -0,0 +1,22 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <cJSON.h>
+
+// HTTP サーバの起動 (CONFIG_HTTPS_SERVER なら TLS)
+//
+// TLS のときは esp_https_server で同じポートを TLS のみにする。証明書は ECDSA P-256
+// (tools/make_cert.py で作り main/certs/ に置いたものをビルド時に埋め込む)。
+// セッションチケットで再接続時の鍵交換を省き、keep-alive でフックの 1 秒ポーリングは
+// 同じセッションを使い続ける。同時セッション数は CONFIG_HTTPS_MAX_SESSIONS
+// (1 セッションで数十 KB の内部 RAM を使うので、/ws を含めた総数をここで抑える)
+
+// config は平文 HTTP 用の設定 (TLS のときはスタックと同時接続数をここで調整する)
+esp_err_t https_server_start(httpd_config_t* config, httpd_handle_t* out);
+
+// TLS で動いているか
+bool https_server_enabled(void);
+
+// セッションの作成・終了数、同時数、内部 RAM の空き (GET /stats 用。平文なら nullptr)
+cJSON* https_stats_to_json(void);
@@ -0,0 +1,260 @@
+#include "input_events.h"
+#include "board_profile.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+
+static const char* TAG = "input";
+
+#define EDGE_QUEUE_LEN 16
+#define DEBOUNCE_US (20 * 1000)     // 前の端からこれより短い端はチャタリングとして捨てる
+#define INPUT_TASK_PRIORITY 4       // メインループ (1) より上、HTTP ワーカーと同程度
+
+// 割り込みから認識タスクへ渡す端
+struct Edge {
+    uint8_t button;
+    bool pressed;
+    int64_t time_us;
+};
+
+// 割り込み側の状態 (割り込みハンドラだけが書く)
+struct IsrState {
+    bool pressed;
+    int64_t last_us;
+};
+
+// 認識タスク側の状態
+struct ButtonState {
+    bool down;
+    bool long_fired;        // この押下で長押しを出した (離してもクリックにしない)
+    bool click_pending;     // ダブルクリック待ちのクリックが 1 つある
+    int64_t deadline_us;    // 0 = 期限なし。押下中は長押しの判定、解放後はダブルクリック待ちの終わり
+    int64_t pressed_us;     // ジェスチャーの最初の押下の時刻 (ダブルクリックなら 1 回目)
+};
+
+static QueueHandle_t s_edges = nullptr;
+static InputHandler s_handler = nullptr;
+static InputDoubleClickQuery s_wants_double = nullptr;
+static IsrState s_isr[INPUT_BUTTON_COUNT];
+static portMUX_TYPE s_isr_mux = portMUX_INITIALIZER_UNLOCKED;
+static ButtonState s_buttons[INPUT_BUTTON_COUNT];
+
+static volatile uint32_t s_edge_count = 0;
+static volatile uint32_t s_bounces = 0;
+static volatile uint32_t s_queue_drops = 0;
+static uint32_t s_gestures[3];
+
+#ifdef CONFIG_INPUT_GPIO_BUTTONS
+// GPIO に繋がっているのは前から Board::BUTTONS 個。2 ボタンの機種の C は電源ボタンで、input_feed で渡される
+#define GPIO_BUTTONS Board::BUTTONS
+static const gpio_num_t PINS[INPUT_BUTTON_COUNT] = {
+    (gpio_num_t)CONFIG_INPUT_GPIO_A,
+    (gpio_num_t)CONFIG_INPUT_GPIO_B,
+#ifdef CONFIG_INPUT_GPIO_C
+    (gpio_num_t)CONFIG_INPUT_GPIO_C,
+#else
+    GPIO_NUM_NC,
+#endif
+};
+#endif
+
+const char* input_gesture_name(InputGesture gesture) {
+    switch (gesture) {
+        case GESTURE_CLICK:        return "click";
+        case GESTURE_DOUBLE_CLICK: return "double";
+        case GESTURE_LONG_PRESS:   return "long";
+        default:                   return "?";
+    }
+}
+
+// 状態が変わらない端 (チャタリングの往復) と、直前の端から短すぎる端を捨てる
+static bool IRAM_ATTR accept_edge(int button, bool pressed, int64_t now) {
+    IsrState* st = &s_isr[button];
+    bool accepted = false;
+    portENTER_CRITICAL_SAFE(&s_isr_mux);
+    if (pressed != st->pressed) {
+        if (now - st->last_us < DEBOUNCE_US) {
+            s_bounces = s_bounces + 1;
+        } else {
+            st->pressed = pressed;
+            st->last_us = now;
+            accepted = true;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&s_isr_mux);
+    return accepted;
+}
+
+#ifdef CONFIG_INPUT_GPIO_BUTTONS
+static void IRAM_ATTR on_gpio_edge(void* arg) {
+    int button = (int)(intptr_t)arg;
+    int64_t now = esp_timer_get_time();
+    bool pressed = gpio_get_level(PINS[button]) == 0;     // M5Stack のボタンは押すと LOW
+    if (!accept_edge(button, pressed, now)) return;
+
+    s_edge_count = s_edge_count + 1;
+    Edge e = { (uint8_t)button, pressed, now };
+    BaseType_t woken = pdFALSE;
+    if (xQueueSendFromISR(s_edges, &e, &woken) != pdTRUE) s_queue_drops = s_queue_drops + 1;
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static bool button_level(int button) {
+    if (button >= GPIO_BUTTONS) return s_isr[button].pressed;
+    return gpio_get_level(PINS[button]) == 0;
+}
+#else
+static bool button_level(int button) {
+    return s_isr[button].pressed;
+}
+#endif
+
+// タッチボタンの機種と、GPIO に繋がっていないボタン (2 ボタンの機種の C) 用 (M5.update() のポーリング結果)
+void input_feed(InputButton button, bool pressed) {
+    if (!s_edges || button >= INPUT_BUTTON_COUNT) return;
+    int64_t now = esp_timer_get_time();
+    if (!accept_edge(button, pressed, now)) return;
+
+    s_edge_count = s_edge_count + 1;
+    Edge e = { (uint8_t)button, pressed, now };
+    if (xQueueSend(s_edges, &e, 0) != pdTRUE) s_queue_drops = s_queue_drops + 1;
+}
+
+// ── ジェスチャー認識 (認識タスク内のみ) ──
+
+static void emit(int button, InputGesture gesture) {
+    s_gestures[gesture]++;
+    InputEvent ev = { (InputButton)button, gesture, s_buttons[button].pressed_us };
+    s_handler(&ev);
+}
+
+static void on_edge(const Edge* e) {
+    ButtonState* b = &s_buttons[e->button];
+
+    if (e->pressed) {
+        if (!b->click_pending) b->pressed_us = e->time_us;
+        b->down = true;
+        b->long_fired = false;
+        b->deadline_us = e->time_us + (int64_t)CONFIG_INPUT_LONG_PRESS_MS * 1000;
+        return;
+    }
+
+    b->down = false;
+    b->deadline_us = 0;
+    if (b->long_fired) {
+        // 長押しの後の解放。待っていたクリックも長押しに吸収する
+        b->click_pending = false;
+    } else if (b->click_pending) {
+        b->click_pending = false;
+        emit(e->button, GESTURE_DOUBLE_CLICK);
+    } else if (!s_wants_double || !s_wants_double((InputButton)e->button)) {
+        // ダブルクリックに意味がない間は待たずに出す (待つと 1 回押しが毎回遅れる)
+        emit(e->button, GESTURE_CLICK);
+    } else {
+        b->click_pending = true;
+        b->deadline_us = e->time_us + (int64_t)CONFIG_INPUT_DOUBLE_PRESS_MS * 1000;
+    }
+}
+
+static void on_deadline(int button) {
+    ButtonState* b = &s_buttons[button];
+    b->deadline_us = 0;
+    if (b->down) {
+        // 押下直後の解放がチャタリングとして捨てられていたら、押しっぱなしと誤認しない
+        // (割り込み側の状態も解放に戻し、次の押下を受け付ける)
+        if (!button_level(button)) {
+            portENTER_CRITICAL(&s_isr_mux);
+            s_isr[button].pressed = false;
+            portEXIT_CRITICAL(&s_isr_mux);
+            b->down = false;
+            b->click_pending = false;
+            return;
+        }
+        b->long_fired = true;
+        emit(button, GESTURE_LONG_PRESS);
+    } else if (b->click_pending) {
+        b->click_pending = false;
+        emit(button, GESTURE_CLICK);
+    }
+}
+
+static void input_task(void* arg) {
+    while (true) {
+        // 最も近い期限まで待つ。期限がなければ端が来るまで眠ったまま
+        int64_t next = 0;
+        for (int i = 0; i < INPUT_BUTTON_COUNT; i++) {
+            int64_t d = s_buttons[i].deadline_us;
+            if (d && (!next || d < next)) next = d;
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (next) {
+            int64_t left_us = next - esp_timer_get_time();
+            wait = left_us > 0 ? pdMS_TO_TICKS((left_us + 999) / 1000) : 0;
+        }
+
+        Edge e;
+        if (xQueueReceive(s_edges, &e, wait) == pdTRUE) {
+            on_edge(&e);
+        }
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < INPUT_BUTTON_COUNT; i++) {
+            if (s_buttons[i].deadline_us && s_buttons[i].deadline_us <= now) on_deadline(i);
+        }
+    }
+}
+
+esp_err_t input_start(InputHandler handler, InputDoubleClickQuery wants_double) {
+    s_handler = handler;
+    s_wants_double = wants_double;
+    s_edges = xQueueCreate(EDGE_QUEUE_LEN, sizeof(Edge));
+    if (!s_edges) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(input_task, "input", 4096, nullptr, INPUT_TASK_PRIORITY, nullptr) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+#ifdef CONFIG_INPUT_GPIO_BUTTONS
+    // M5Stack Basic / Gray の A/B/C、M5StickC Plus の A/B は外付けプルアップの入力専用ピン
+    gpio_config_t cfg = {};
+    for (int i = 0; i < GPIO_BUTTONS; i++) cfg.pin_bit_mask |= 1ULL << PINS[i];
+    cfg.mode = GPIO_MODE_INPUT;
+    cfg.pull_up_en = GPIO_PULLUP_DISABLE;
+    cfg.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    cfg.intr_type = GPIO_INTR_ANYEDGE;
+    esp_err_t err = gpio_config(&cfg);
+    if (err != ESP_OK) return err;
+
+    // 他のコンポーネントが先に入れていれば ESP_ERR_INVALID_STATE (そのまま使う)
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;
+    for (int i = 0; i < GPIO_BUTTONS; i++) {
+        s_isr[i].pressed = gpio_get_level(PINS[i]) == 0;
+        err = gpio_isr_handler_add(PINS[i], on_gpio_edge, (void*)(intptr_t)i);
+        if (err != ESP_OK) return err;
+    }
+    if (GPIO_BUTTONS == 3) {
+        ESP_LOGI(TAG, "Buttons on GPIO %d/%d/%d (interrupt)", PINS[0], PINS[1], PINS[2]);
+    } else {
+        ESP_LOGI(TAG, "Buttons on GPIO %d/%d (interrupt), C by polling", PINS[0], PINS[1]);
+    }
+#else
+    ESP_LOGI(TAG, "Buttons fed by polling");
+#endif
+    return ESP_OK;
+}
+
+cJSON* input_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "edges", s_edge_count);
+    cJSON_AddNumberToObject(root, "bounces", s_bounces);
+    cJSON_AddNumberToObject(root, "queue_drops", s_queue_drops);
+    for (int g = 0; g < 3; g++) {
+        cJSON_AddNumberToObject(root, input_gesture_name((InputGesture)g), s_gestures[g]);
+    }
+    return root;
+}
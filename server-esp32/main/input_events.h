@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <esp_err.h>
+#include <cJSON.h>
+
+// ボタン入力: GPIO 割り込みで押下・解放の端を拾い、ジェスチャーにして通知する
+//
+// 割り込みハンドラはチャタリングを除いた端だけをキューに積み、認識タスクがキューを待つ。
+// 押されていない間はタスクもタイマーも動かない (メインループの周期でボタンを読まない)
+// 期限 (長押しの判定・ダブルクリックの待ち) があるときだけ、キューの待ち時間を期限までにする
+
+enum InputButton : uint8_t {
+    INPUT_BUTTON_A,
+    INPUT_BUTTON_B,
+    INPUT_BUTTON_C,
+    INPUT_BUTTON_COUNT,
+};
+
+enum InputGesture : uint8_t {
+    GESTURE_CLICK,
+    GESTURE_DOUBLE_CLICK,   // ダブルクリックを待つと答えたときだけ (1 回目のクリックは待ってから出す)
+    GESTURE_LONG_PRESS,     // 押している間に CONFIG_INPUT_LONG_PRESS_MS を超えた時点で出す
+};
+
+struct InputEvent {
+    InputButton button;
+    InputGesture gesture;
+    int64_t time_us;        // ジェスチャーを始めた押下の端の時刻 (esp_timer_get_time。判定の待ちを含めた遅延の起点)
+};
+
+// 認識タスクのコンテキストで呼ばれる
+typedef void (*InputHandler)(const InputEvent* event);
+
+// クリックを離した時点で認識タスクから呼ばれる。true ならダブルクリックを待つ
+// (CONFIG_INPUT_DOUBLE_PRESS_MS 後にクリックを出す)。false ならその場でクリックを出す
+typedef bool (*InputDoubleClickQuery)(InputButton button);
+
+// wants_double: nullptr ならどのボタンもダブルクリックを待たない
+// CONFIG_INPUT_GPIO_BUTTONS なら GPIO の割り込みも設定する
+esp_err_t input_start(InputHandler handler, InputDoubleClickQuery wants_double);
+
+// 押下・解放を外から渡す (GPIO を持たないタッチボタンの機種で、ポーリング結果を渡す)
+void input_feed(InputButton button, bool pressed);
+
+// 端・チャタリング・ジェスチャーの数 (GET /stats 用)
+cJSON* input_stats_to_json(void);
+
+const char* input_gesture_name(InputGesture gesture);
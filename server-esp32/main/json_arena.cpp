@@ -0,0 +1,129 @@
+#include "json_arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char* TAG = "arena";
+
+#define MAX_ARENAS 4
+#define ARENA_ALIGN 8               // cJSON は double を持つので 8 バイト境界
+
+struct JsonArena {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    TaskHandle_t owner;             // スコープ中のタスク (nullptr = スコープ外)
+
+    // 統計 (owner タスクだけが更新する)
+    uint32_t scopes;
+    uint32_t allocs;
+    uint32_t overflows;             // 溢れてヒープに回した確保
+    size_t high_water;
+};
+
+static JsonArena s_arenas[MAX_ARENAS];
+static int s_arena_count = 0;
+static volatile uint32_t s_unscoped = 0;  // スコープ外 (ws_tx, ミラー等) のヒープ確保
+
+static JsonArena* current_arena(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < s_arena_count; i++) {
+        if (s_arenas[i].owner == self) return &s_arenas[i];
+    }
+    return nullptr;
+}
+
+static bool in_arena(const void* ptr) {
+    const uint8_t* p = (const uint8_t*)ptr;
+    for (int i = 0; i < s_arena_count; i++) {
+        const JsonArena* a = &s_arenas[i];
+        if (p >= a->base && p < a->base + a->size) return true;
+    }
+    return false;
+}
+
+void* json_arena_alloc(size_t size) {
+    JsonArena* a = current_arena();
+    if (!a) {
+        s_unscoped++;
+        return malloc(size);
+    }
+
+    size_t offset = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (offset + size > a->size) {
+        a->overflows++;
+        return malloc(size);
+    }
+    a->used = offset + size;
+    a->allocs++;
+    if (a->used > a->high_water) a->high_water = a->used;
+    return a->base + offset;
+}
+
+void json_arena_free(void* ptr) {
+    // アリーナ内はスコープ終了時にまとめて戻すので何もしない
+    if (!ptr || in_arena(ptr)) return;
+    free(ptr);
+}
+
+void json_arena_init(void) {
+    // malloc_fn / free_fn を差し替えると cJSON は realloc を使わなくなる
+    cJSON_Hooks hooks = {};
+    hooks.malloc_fn = json_arena_alloc;
+    hooks.free_fn = json_arena_free;
+    cJSON_InitHooks(&hooks);
+}
+
+JsonArena* json_arena_create(size_t size, bool psram) {
+    if (s_arena_count >= MAX_ARENAS) return nullptr;
+    uint32_t caps = psram ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    uint8_t* base = (uint8_t*)heap_caps_malloc(size, caps);
+    if (!base) {
+        ESP_LOGE(TAG, "Failed to allocate %u byte arena%s", (unsigned)size, psram ? " in PSRAM" : "");
+        return nullptr;
+    }
+    JsonArena* a = &s_arenas[s_arena_count];
+    a->base = base;
+    a->size = size;
+    a->used = 0;
+    a->owner = nullptr;
+    // in_arena が base を読むので、初期化を終えてから数に含める
+    s_arena_count++;
+    return a;
+}
+
+void json_arena_begin(JsonArena* arena) {
+    if (!arena) return;
+    arena->used = 0;
+    arena->scopes++;
+    arena->owner = xTaskGetCurrentTaskHandle();
+}
+
+void json_arena_end(JsonArena* arena) {
+    if (!arena) return;
+    arena->owner = nullptr;
+    arena->used = 0;
+}
+
+cJSON* json_arena_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "unscoped", s_unscoped);
+
+    cJSON* arenas = cJSON_CreateArray();
+    for (int i = 0; i < s_arena_count; i++) {
+        const JsonArena* a = &s_arenas[i];
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "size", a->size);
+        cJSON_AddNumberToObject(item, "high_water", a->high_water);
+        cJSON_AddNumberToObject(item, "scopes", a->scopes);
+        cJSON_AddNumberToObject(item, "allocs", a->allocs);
+        cJSON_AddNumberToObject(item, "overflows", a->overflows);
+        cJSON_AddItemToArray(arenas, item);
+    }
+    cJSON_AddItemToObject(root, "arenas", arenas);
+    return root;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <esp_err.h>
+#include <cJSON.h>
+
+// リクエスト単位のバンプアロケータ (cJSON とリクエストボディ用)
+// ハンドラ実行中に確保したメモリは解放せず、終了時に先頭へ戻すだけ (O(1))
+// 細かい malloc/free を共有ヒープに出さないことで、長期稼働時の断片化を防ぐ
+//
+// cJSON_InitHooks で全タスクの cJSON 確保を横取りする。
+// 呼び出しタスクがアリーナのスコープ内ならアリーナから、そうでなければ通常のヒープから確保
+// アリーナが溢れた分はヒープに回し、overflow として数える
+
+struct JsonArena;
+
+// cJSON のフックを登録 (cJSON を使う前に 1 回だけ呼ぶ)
+void json_arena_init(void);
+
+// アリーナを作成 (起動時に 1 回だけ確保し、以後は使い回す)。psram なら PSRAM から確保する
+JsonArena* json_arena_create(size_t size, bool psram = false);
+
+// 呼び出しタスクでスコープを開始 / 終了 (終了時に使用量を 0 に戻す)
+// スコープ内で確保した cJSON ツリーや文字列をスコープ外に持ち出さないこと
+void json_arena_begin(JsonArena* arena);
+void json_arena_end(JsonArena* arena);
+
+// cJSON 以外のバッファ用 (スコープ外ではヒープから確保)。解放は json_arena_free
+void* json_arena_alloc(size_t size);
+void json_arena_free(void* ptr);
+
+// 確保数・溢れ数・最大使用量 (GET /stats 用)
+cJSON* json_arena_stats_to_json(void);
@@ -0,0 +1,159 @@
+#include "lz_codec.h"
+
+#include <cstring>
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 15 以上の長さの残りを 255 単位で書く
+static uint8_t* put_length(uint8_t* op, size_t n) {
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// リテラル lit バイトと (mlen > 0 なら) 一致を 1 シーケンスとして書く。収まらなければ nullptr
+static uint8_t* put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit, size_t lit_len,
+                             size_t offset, size_t mlen) {
+    if ((size_t)(oend - op) < 1 + lit_len + lit_len / 255 + 1 + (mlen ? 2 + mlen / 255 + 1 : 0)) {
+        return nullptr;
+    }
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) op = put_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (mlen == 0) return op;
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    size_t m = mlen - LZ_MIN_MATCH;
+    *token |= (uint8_t)(m >= 15 ? 15 : m);
+    if (m >= 15) op = put_length(op, m - 15);
+    return op;
+}
+
+// 辞書 + 入力をつなげた仮想の位置 v から読む
+struct LzSource {
+    const uint8_t* dict;
+    size_t dict_len;
+    const uint8_t* src;
+
+    uint8_t at(size_t v) const { return v < dict_len ? dict[v] : src[v - dict_len]; }
+    uint32_t read32v(size_t v) const {
+        if (v >= dict_len) return read32(src + v - dict_len);
+        if (v + 4 <= dict_len) return read32(dict + v);
+        uint8_t b[4] = { at(v), at(v + 1), at(v + 2), at(v + 3) };
+        return read32(b);
+    }
+};
+
+size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap, uint16_t* table,
+                   const uint8_t* dict, size_t dict_len) {
+    if (!dict) dict_len = 0;
+    if (dict_len + len > LZ_MAX_INPUT) return 0;
+    memset(table, 0, sizeof(uint16_t) * LZ_HASH_SIZE);
+
+    // 表には仮想の位置 + 1 を入れる (0 = 空き)。辞書の位置を先に入れておく
+    LzSource in = { dict, dict_len, src };
+    for (size_t v = 0; v + LZ_MIN_MATCH <= dict_len; v++) {
+        table[hash4(read32(dict + v))] = (uint16_t)(v + 1);
+    }
+
+    uint8_t* op = dst;
+    uint8_t* oend = dst + cap;
+    size_t anchor = 0;
+    size_t pos = 0;
+    // 4 バイト読める位置まで探す
+    while (len >= LZ_MIN_MATCH && pos <= len - LZ_MIN_MATCH) {
+        size_t vpos = dict_len + pos;
+        uint32_t seq = read32(src + pos);
+        uint32_t h = hash4(seq);
+        size_t cand = table[h];
+        table[h] = (uint16_t)(vpos + 1);
+        if (cand == 0 || in.read32v(cand - 1) != seq) {
+            pos++;
+            continue;
+        }
+        size_t ref = cand - 1;
+        size_t mlen = LZ_MIN_MATCH;
+        while (pos + mlen < len && src[pos + mlen] == in.at(ref + mlen)) mlen++;
+
+        op = put_sequence(op, oend, src + anchor, pos - anchor, vpos - ref, mlen);
+        if (!op) return 0;
+
+        // 一致の中の位置も表に入れる (短いブロックでは後ろの一致が見つかりやすくなる)
+        for (size_t p = pos + 1; p < pos + mlen && p <= len - LZ_MIN_MATCH; p++) {
+            table[hash4(read32(src + p))] = (uint16_t)(dict_len + p + 1);
+        }
+        pos += mlen;
+        anchor = pos;
+    }
+
+    op = put_sequence(op, oend, src + anchor, len - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+// 15 の続きの長さを足す
+static bool get_length(const uint8_t** ip, const uint8_t* iend, size_t* n) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return false;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+int lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap,
+                  const uint8_t* dict, size_t dict_len) {
+    if (!dict) dict_len = 0;
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_length(&ip, iend, &lit)) return -1;
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break;      // 最後のシーケンス
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t produced = (size_t)(op - dst);
+        if (offset == 0 || offset > produced + dict_len) return -1;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !get_length(&ip, iend, &mlen)) return -1;
+        mlen += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < mlen) return -1;
+
+        size_t i = 0;
+        // 辞書にかかる部分 (辞書の末尾が出力の先頭に続いているものとして読む)
+        if (offset > produced) {
+            size_t n = offset - produced;
+            if (n > mlen) n = mlen;
+            memcpy(op, dict + dict_len - (offset - produced), n);
+            i = n;
+        }
+        // 距離が一致長より短いと自分の出力を読むので 1 バイトずつ
+        for (; i < mlen; i++) op[i] = dst[produced + i - offset];
+        op += mlen;
+    }
+    return (int)(op - dst);
+}
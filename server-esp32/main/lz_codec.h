@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ77 系のバイト列の圧縮 (並びは LZ4 のブロック形式と同じ。フレームやチェックサムは持たない)
+//
+// 1 回の圧縮・展開は 1 ブロックで完結し、前のブロックを辞書に使わない (どのブロックも単独で展開できる)。
+// 圧縮は 4 バイトのハッシュで直近の一致を 1 つだけ引く貪欲法で、作業領域は呼び出し側の表 (LZ_HASH_SIZE 個)。
+// 展開は作業領域なしで、壊れた入力でも dst の範囲外には書かない
+//
+// シーケンス: トークン (上位 4bit = リテラル長、下位 4bit = 一致長 - 4。15 なら後ろに 255 単位で足す)、
+// リテラル、一致の距離 (2 バイト LE)、一致長の続き。最後のシーケンスはリテラルだけで終わる
+
+#define LZ_HASH_BITS 10
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_INPUT 65535                      // 辞書 + 入力。表の位置と距離を 16bit で持つ
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)      // 縮まない入力を圧縮したときの最大長
+
+// 辞書 (dict) を渡すと、入力の直前に辞書が続いているものとして辞書の中の一致も使う
+// (短いブロックでも縮む)。展開には圧縮と同じ辞書が要る。辞書はフラッシュに置いたままでよい
+//
+// 戻り値: 圧縮後の長さ (0 = cap に収まらない・辞書 + 入力が長すぎる)
+size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap, uint16_t* table,
+                   const uint8_t* dict = nullptr, size_t dict_len = 0);
+
+// 戻り値: 展開後の長さ (-1 = 壊れている・cap に収まらない)
+int lz_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap,
+                  const uint8_t* dict = nullptr, size_t dict_len = 0);
@@ -8,9 +8,17 @@
 #include "wifi_setup.h"
 #include "mdns_service.h"
 #include "request_store.h"
+#include "request_detail.h"
 #include "http_server.h"
 #include "display_manager.h"
+#include "notify_queue.h"
 #include "button_handler.h"
+#include "relay_mirror.h"
+#include "deferred_log.h"
+#include "json_arena.h"
+#include "heap_monitor.h"
+#include "policy.h"
+#include "board_budget.h"
 
 static const char* TAG = "main";
 
@@ -27,6 +35,8 @@ extern "C" void app_main(void) {
     auto cfg = M5.config();
     M5.begin(cfg);
     ESP_LOGI(TAG, "M5Unified initialized");
+    ESP_LOGI(TAG, "Board profile %s: %d slots, %d KB static (budget %d KB)", Board::NAME, MAX_REQUESTS,
+             (int)(BoardBudget<Board>::TOTAL / 1024), (int)(Board::RAM_BUDGET / 1024));
 
     // 画面初期化
     display_init();
@@ -51,12 +61,30 @@ extern "C" void app_main(void) {
     // mDNS 登録
     mdns_service_start();
 
+    // 遅延ログ (リクエスト処理中のログはリング経由で出力)
+    dlog_start();
+
+    // cJSON の確保をリクエスト単位のアリーナに向ける (cJSON を使う前に)
+    json_arena_init();
+    heap_monitor_start();
+
     // リクエストストア初期化
     request_store_init();
+    request_detail_init();
+    notify_queue_init();
+
+    // 自動判断ポリシー (NVS に保存したルールをコンパイル)
+    policy_init();
+
+    // ボタン入力 (GPIO 割り込み → ジェスチャー認識タスク)
+    button_handler_start();
 
     // HTTP サーバ起動
     http_server_start();
 
+    // 上流サーバのミラー開始 (設定時のみ)
+    relay_mirror_start();
+
     // 待機画面表示
     display_show_idle(wifi_get_ip_str());
 
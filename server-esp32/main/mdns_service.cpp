@@ -1,10 +1,64 @@
 #include "mdns_service.h"
+#include "request_store.h"
 
+#include <cstdio>
+#include <cstring>
 #include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
 #include <mdns.h>
+#include "sdkconfig.h"
 
 static const char* TAG = "mdns";
 
+// フックの探索 (hook/relayd の discover) が問い合わせるサービス
+#define RELAY_SERVICE "_prompt-relay"
+#define RELAY_PROTO "_tcp"
+#define RELAY_PORT 3939
+
+static esp_timer_handle_t s_txt_timer = nullptr;
+static int64_t s_last_publish_us = 0;
+static int s_published_pending = -1;
+static int s_published_used = -1;
+static uint32_t s_publishes = 0;
+
+// 機能フラグ (クライアントが使う API を選ぶ目安。tls なら https:// で接続する)
+#ifdef CONFIG_HTTPS_SERVER
+#define CAPS_TLS ",tls"
+#else
+#define CAPS_TLS ""
+#endif
+
+static const char* capabilities(void) {
+    return CONFIG_UPSTREAM_URL[0] ? "cbor,ws,policy,mirror" CAPS_TLS : "cbor,ws,policy" CAPS_TLS;
+}
+
+// 負荷 (未応答件数・スロットの使用数) が変わっていれば TXT を書き換える
+static void publish_load(void* arg) {
+    PermissionRequest* reqs[MAX_REQUESTS];
+    int used = request_store_get_all(reqs, MAX_REQUESTS);
+    int pending = request_store_pending_count();
+    s_last_publish_us = esp_timer_get_time();
+    if (pending == s_published_pending && used == s_published_used) return;
+
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%d", pending);
+    mdns_service_txt_item_set(RELAY_SERVICE, RELAY_PROTO, "pending", buf);
+    snprintf(buf, sizeof(buf), "%d", used);
+    mdns_service_txt_item_set(RELAY_SERVICE, RELAY_PROTO, "used", buf);
+    s_published_pending = pending;
+    s_published_used = used;
+    s_publishes++;
+}
+
+// ストアの変更通知 (ストアのロック内で呼ばれる): タイマーを仕掛けるだけ
+// 前回の書き換えから CONFIG_MDNS_TXT_INTERVAL_MS 経つまでは待ち、間の変更は 1 回にまとめる
+static void on_store_changed(void) {
+    if (!s_txt_timer || esp_timer_is_active(s_txt_timer)) return;
+    int64_t wait_us = s_last_publish_us + (int64_t)CONFIG_MDNS_TXT_INTERVAL_MS * 1000 - esp_timer_get_time();
+    esp_timer_start_once(s_txt_timer, wait_us > 0 ? wait_us : 1);
+}
+
 esp_err_t mdns_service_start(void) {
     esp_err_t err = mdns_init();
     if (err != ESP_OK) {
@@ -12,20 +66,65 @@ esp_err_t mdns_service_start(void) {
         return err;
     }
 
+    // 同じフロアに複数台置けるよう、インスタンス名と TXT に MAC の下位 3 バイトを入れる
+    // (ホスト名が重なった場合は mDNS の衝突解決で prompt-relay-2.local などになる)
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    char id[8];
+    snprintf(id, sizeof(id), "%02x%02x%02x", mac[3], mac[4], mac[5]);
+    char instance[40];
+    snprintf(instance, sizeof(instance), "Prompt Relay ESP32 %s", id);
+
     mdns_hostname_set("prompt-relay");
-    mdns_instance_name_set("Prompt Relay ESP32");
+    mdns_instance_name_set(instance);
 
     mdns_txt_item_t txt[] = {
-        { "board", "m5stack" },
+        { "board", Board::NAME },
         { "version", "0.1.0" },
     };
 
-    err = mdns_service_add(nullptr, "_http", "_tcp", 3939, txt, 2);
+    err = mdns_service_add(nullptr, "_http", "_tcp", RELAY_PORT, txt, 2);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "mdns_service_add failed: %s", esp_err_to_name(err));
         return err;
     }
 
-    ESP_LOGI(TAG, "mDNS registered: prompt-relay.local:3939");
+    char slots[8];
+    snprintf(slots, sizeof(slots), "%d", MAX_REQUESTS);
+    mdns_txt_item_t relay_txt[] = {
+        { "board", Board::NAME },
+        { "version", "0.1.0" },
+        { "id", id },
+        { "caps", capabilities() },
+        { "slots", slots },
+        { "pending", "0" },
+        { "used", "0" },
+    };
+    err = mdns_service_add(instance, RELAY_SERVICE, RELAY_PROTO, RELAY_PORT,
+                           relay_txt, sizeof(relay_txt) / sizeof(relay_txt[0]));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "mdns_service_add %s failed: %s", RELAY_SERVICE, esp_err_to_name(err));
+        return err;
+    }
+    s_published_pending = 0;
+    s_published_used = 0;
+
+    // TXT の書き換えは esp_timer タスクで行う (変更したハンドラに mDNS の処理をさせない)
+    esp_timer_create_args_t args = {};
+    args.callback = publish_load;
+    args.name = "mdns_txt";
+    err = esp_timer_create(&args, &s_txt_timer);
+    if (err != ESP_OK) return err;
+    request_store_add_listener(on_store_changed);
+
+    ESP_LOGI(TAG, "mDNS registered: prompt-relay.local:%d (%s)", RELAY_PORT, instance);
     return ESP_OK;
 }
+
+cJSON* mdns_service_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "txt_updates", s_publishes);
+    cJSON_AddNumberToObject(root, "pending", s_published_pending);
+    cJSON_AddNumberToObject(root, "used", s_published_used);
+    return root;
+}
@@ -1,6 +1,13 @@
 #pragma once
 
 #include <esp_err.h>
+#include <cJSON.h>
 
 // mDNS サービスを開始し、prompt-relay.local を登録する
+// _http._tcp に加えて、フックの探索用に _prompt-relay._tcp を載せる。
+// TXT の pending (未応答件数) / used (スロットの使用数) はストアの変更に合わせて
+// CONFIG_MDNS_TXT_INTERVAL_MS に 1 回まで書き換える
 esp_err_t mdns_service_start(void);
+
+// TXT を書き換えた回数と、最後に載せた負荷 (GET /stats 用)
+cJSON* mdns_service_stats_to_json(void);
@@ -0,0 +1,150 @@
+#include "notify_queue.h"
+
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static SemaphoreHandle_t s_lock = nullptr;
+
+static bool s_has_shown = false;
+static NotifyItem s_shown;                      // 表示中
+static NotifyItem s_waiting[NOTIFY_QUEUE_LEN];  // 表示待ち (先頭が次)
+static int s_waiting_count = 0;
+static uint32_t s_next_seq = 1;
+static volatile uint32_t s_generation = 0;
+
+static uint32_t s_beep_requests = 0;
+static int64_t s_last_beep_ms = 0;
+
+static uint32_t s_pushed = 0;
+static uint32_t s_coalesced = 0;
+static uint32_t s_dropped = 0;
+static uint32_t s_shown_count = 0;
+static uint32_t s_beeps = 0;
+static uint32_t s_beeps_merged = 0;
+static int s_max_waiting = 0;
+
+static void copy_str(char* dst, size_t size, const char* src) {
+    strncpy(dst, src ? src : "", size - 1);
+    dst[size - 1] = '\0';
+}
+
+static bool same_source(const NotifyItem* item, const char* title, const char* hostname) {
+    return strcmp(item->title, title) == 0 && strcmp(item->hostname, hostname) == 0;
+}
+
+void notify_queue_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+}
+
+void notify_queue_push(const char* title, const char* message, const char* hostname) {
+    if (!s_lock) return;
+    // 比較はロックの外で切り詰めた値で行う (保存されている値と同じ長さにそろえる)
+    char t[sizeof(NotifyItem::title)];
+    char h[sizeof(NotifyItem::hostname)];
+    copy_str(t, sizeof(t), title);
+    copy_str(h, sizeof(h), hostname);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_pushed++;
+
+    // 同じホスト・タイトルがあれば本文だけ差し替える (表示中も含む)
+    NotifyItem* same = nullptr;
+    if (s_has_shown && same_source(&s_shown, t, h)) same = &s_shown;
+    for (int i = 0; !same && i < s_waiting_count; i++) {
+        if (same_source(&s_waiting[i], t, h)) same = &s_waiting[i];
+    }
+
+    if (same) {
+        copy_str(same->message, sizeof(same->message), message);
+        if (same->repeat < UINT16_MAX) same->repeat++;
+        s_coalesced++;
+    } else {
+        if (s_waiting_count == NOTIFY_QUEUE_LEN) {
+            // 満杯: 最も古い待ちを捨てる (新しい通知ほど今の状況に近い)
+            memmove(&s_waiting[0], &s_waiting[1], sizeof(NotifyItem) * (NOTIFY_QUEUE_LEN - 1));
+            s_waiting_count--;
+            s_dropped++;
+        }
+        NotifyItem* item = &s_waiting[s_waiting_count++];
+        item->seq = s_next_seq++;
+        item->repeat = 1;
+        strcpy(item->title, t);
+        strcpy(item->hostname, h);
+        copy_str(item->message, sizeof(item->message), message);
+        if (s_waiting_count > s_max_waiting) s_max_waiting = s_waiting_count;
+    }
+    s_generation = s_generation + 1;
+    xSemaphoreGive(s_lock);
+}
+
+void notify_queue_beep(void) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_beep_requests++;
+    xSemaphoreGive(s_lock);
+}
+
+uint32_t notify_queue_generation(void) {
+    return s_generation;
+}
+
+bool notify_queue_current(NotifyItem* out, int* waiting) {
+    if (!s_lock) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_has_shown && s_waiting_count > 0) {
+        s_shown = s_waiting[0];
+        memmove(&s_waiting[0], &s_waiting[1], sizeof(NotifyItem) * (s_waiting_count - 1));
+        s_waiting_count--;
+        s_has_shown = true;
+        s_shown_count++;
+    }
+    bool found = s_has_shown;
+    if (found) *out = s_shown;
+    *waiting = s_waiting_count;
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+void notify_queue_advance(void) {
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_has_shown) {
+        s_has_shown = false;
+        s_generation = s_generation + 1;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool notify_queue_take_beep(int64_t now_ms) {
+    if (!s_lock) return false;
+    bool beep = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // 間隔内に来た要求は次の 1 回にまとめる (連続したリクエストで鳴り続けない)
+    if (s_beep_requests > 0 &&
+        (s_beeps == 0 || now_ms - s_last_beep_ms >= CONFIG_NOTIFY_BEEP_INTERVAL_MS)) {
+        s_beeps++;
+        s_beeps_merged += s_beep_requests - 1;
+        s_beep_requests = 0;
+        s_last_beep_ms = now_ms;
+        beep = true;
+    }
+    xSemaphoreGive(s_lock);
+    return beep;
+}
+
+cJSON* notify_queue_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON_AddNumberToObject(root, "pushed", s_pushed);
+    cJSON_AddNumberToObject(root, "coalesced", s_coalesced);
+    cJSON_AddNumberToObject(root, "dropped", s_dropped);
+    cJSON_AddNumberToObject(root, "shown", s_shown_count);
+    cJSON_AddNumberToObject(root, "waiting", s_waiting_count);
+    cJSON_AddNumberToObject(root, "max_waiting", s_max_waiting);
+    cJSON_AddNumberToObject(root, "beeps", s_beeps);
+    cJSON_AddNumberToObject(root, "beeps_merged", s_beeps_merged);
+    if (s_lock) xSemaphoreGive(s_lock);
+    return root;
+}
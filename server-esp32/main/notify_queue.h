@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cJSON.h>
+#include "board_profile.h"
+
+// 通知キュー: HTTP ハンドラは積むだけ、画面への表示とビープは表示側 (メインループ) が行う
+//
+// 同じホスト・同じタイトルの通知は 1 件にまとめる (本文を最新に差し替え、回数を数える)。
+// 表示中の通知もまとめる対象。満杯なら最も古い待ちを捨てる
+// ビープも要求を数えるだけで、鳴らすのは表示側 (CONFIG_NOTIFY_BEEP_INTERVAL_MS に 1 回まで)
+
+static constexpr int NOTIFY_QUEUE_LEN = Board::NOTIFY_QUEUE_LEN;
+
+struct NotifyItem {
+    uint32_t seq;           // 積んだ順の番号 (まとめても変わらない)
+    uint16_t repeat;        // まとめた件数 (1 = まとめていない)
+    char title[64];
+    char message[128];
+    char hostname[64];
+};
+
+void notify_queue_init(void);
+
+// 通知を積む (どのタスクからでも可。ロックはコピーの間だけ)
+void notify_queue_push(const char* title, const char* message, const char* hostname);
+
+// ビープを要求する (どのタスクからでも可)
+void notify_queue_beep(void);
+
+// ── 表示側 ──
+
+// 内容が変わるたびに進む (変わっていなければロックを取らずに済ませる)
+uint32_t notify_queue_generation(void);
+
+// 表示中の通知をコピーし、その後ろで待っている件数を返す。表示中がなければ待ちの先頭を表示中にする
+// 通知が 1 件もなければ false
+bool notify_queue_current(NotifyItem* out, int* waiting);
+
+// 表示中の通知を終える (時間切れ・ボタン C・別の画面に切り替わった)
+void notify_queue_advance(void);
+
+// 今ビープを鳴らすべきか (要求があり、前回から間隔が空いていれば true)
+bool notify_queue_take_beep(int64_t now_ms);
+
+// 積んだ・まとめた・捨てた件数とビープの回数 (GET /stats 用)
+cJSON* notify_queue_stats_to_json(void);
@@ -0,0 +1,265 @@
+#include "policy.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const char* TAG = "policy";
+
+#define NVS_NAMESPACE "policy"
+#define NVS_KEY "rules"
+
+static const char* const FIELD_KEYS[PF_COUNT] = { "host", "tool", "command", "file_path" };
+
+static PolicyAutomaton s_automaton = {};
+static char* s_source = nullptr;            // 正規化したルールの JSON (NVS に保存したもの)
+static uint32_t s_hits[POLICY_MAX_RULES];
+static uint32_t s_evaluated = 0;
+static uint32_t s_matched[3];               // PolicyAction ごとの一致数
+static int64_t s_compile_us = 0;
+
+// 評価と入れ替えの排他 (評価は表引きだけなので保持時間は入力長に比例する短さ)
+static SemaphoreHandle_t s_lock = nullptr;
+// コンパイルは入れ替えより長くかかるので、評価を止めないよう別のロックで直列化する
+static SemaphoreHandle_t s_compile_lock = nullptr;
+
+const char* policy_action_name(PolicyAction action) {
+    switch (action) {
+        case POLICY_ALLOW: return "allow";
+        case POLICY_DENY:  return "deny";
+        default:           return "ask";
+    }
+}
+
+static bool parse_action(const char* s, PolicyAction* out) {
+    if (strcmp(s, "allow") == 0) *out = POLICY_ALLOW;
+    else if (strcmp(s, "deny") == 0) *out = POLICY_DENY;
+    else if (strcmp(s, "ask") == 0) *out = POLICY_ASK;
+    else return false;
+    return true;
+}
+
+// {"rules":[...]} を検証して PolicyRule に取り出す (文字列は root 内を指す)
+// 知らないキーは打ち間違いで条件が消える (= 広く一致する) のを防ぐためエラーにする
+static bool parse_rules(const cJSON* root, PolicyRule* rules, int* count, char* err, size_t err_len) {
+    const cJSON* list = cJSON_GetObjectItem(root, "rules");
+    if (!cJSON_IsObject(root) || !cJSON_IsArray(list)) {
+        snprintf(err, err_len, "rules array is required");
+        return false;
+    }
+    int n = 0;
+    const cJSON* item;
+    cJSON_ArrayForEach(item, list) {
+        if (n >= POLICY_MAX_RULES) {
+            snprintf(err, err_len, "too many rules (max %d)", POLICY_MAX_RULES);
+            return false;
+        }
+        if (!cJSON_IsObject(item)) {
+            snprintf(err, err_len, "rule %d: not an object", n);
+            return false;
+        }
+        PolicyRule* rule = &rules[n];
+        memset(rule, 0, sizeof(*rule));
+        bool has_action = false;
+        const cJSON* field;
+        cJSON_ArrayForEach(field, item) {
+            if (!cJSON_IsString(field)) {
+                snprintf(err, err_len, "rule %d: values must be strings", n);
+                return false;
+            }
+            if (strcmp(field->string, "action") == 0) {
+                if (!parse_action(field->valuestring, &rule->action)) {
+                    snprintf(err, err_len, "rule %d: action must be allow, deny or ask", n);
+                    return false;
+                }
+                has_action = true;
+                continue;
+            }
+            int f = 0;
+            while (f < PF_COUNT && strcmp(field->string, FIELD_KEYS[f]) != 0) f++;
+            if (f == PF_COUNT) {
+                snprintf(err, err_len, "rule %d: unknown key", n);
+                return false;
+            }
+            rule->pattern[f] = field->valuestring;
+        }
+        if (!has_action) {
+            snprintf(err, err_len, "rule %d: action is required", n);
+            return false;
+        }
+        n++;
+    }
+    *count = n;
+    return true;
+}
+
+// JSON をコンパイルする。成功時は *source に正規化した JSON (malloc) を返す
+static bool compile_json(const char* json, PolicyAutomaton* out, char** source, int64_t* compile_us,
+                         char* err, size_t err_len) {
+    cJSON* root = cJSON_Parse(json);
+    if (!root) {
+        snprintf(err, err_len, "invalid json");
+        return false;
+    }
+    static PolicyRule rules[POLICY_MAX_RULES];  // 呼び出しは s_compile_lock 内のみ
+    int count = 0;
+    bool ok = parse_rules(root, rules, &count, err, err_len);
+    int64_t start = esp_timer_get_time();
+    if (ok) ok = policy_automaton_compile(rules, count, out, err, err_len);
+    if (ok) {
+        *compile_us = esp_timer_get_time() - start;
+        // cJSON の文字列はリクエストのアリーナにあるので、残す分はヒープにコピーする
+        char* printed = cJSON_PrintUnformatted(root);
+        *source = printed ? strdup(printed) : nullptr;
+        cJSON_free(printed);
+        if (!*source) {
+            policy_automaton_free(out);
+            snprintf(err, err_len, "out of memory");
+            ok = false;
+        }
+    }
+    cJSON_Delete(root);
+    return ok;
+}
+
+static void install(PolicyAutomaton* automaton, char* source, int64_t compile_us) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    PolicyAutomaton old = s_automaton;
+    char* old_source = s_source;
+    s_automaton = *automaton;
+    s_source = source;
+    s_compile_us = compile_us;
+    memset(s_hits, 0, sizeof(s_hits));
+    xSemaphoreGive(s_lock);
+    policy_automaton_free(&old);
+    free(old_source);
+}
+
+void policy_init(void) {
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+    s_compile_lock = xSemaphoreCreateMutex();
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        ESP_LOGI(TAG, "No policy rules stored");
+        return;
+    }
+    size_t len = 0;
+    char* json = nullptr;
+    if (nvs_get_blob(nvs, NVS_KEY, nullptr, &len) == ESP_OK && len > 0) {
+        json = (char*)malloc(len + 1);
+        if (json && nvs_get_blob(nvs, NVS_KEY, json, &len) == ESP_OK) {
+            json[len] = '\0';
+        } else {
+            free(json);
+            json = nullptr;
+        }
+    }
+    nvs_close(nvs);
+    if (!json) return;
+
+    PolicyAutomaton automaton;
+    char* source = nullptr;
+    int64_t compile_us = 0;
+    char err[96];
+    xSemaphoreTake(s_compile_lock, portMAX_DELAY);
+    bool ok = compile_json(json, &automaton, &source, &compile_us, err, sizeof(err));
+    xSemaphoreGive(s_compile_lock);
+    free(json);
+    if (!ok) {
+        ESP_LOGE(TAG, "Stored policy rejected: %s", err);
+        return;
+    }
+    install(&automaton, source, compile_us);
+    ESP_LOGI(TAG, "Policy loaded: %u rules, %u states x %u classes (%u bytes)",
+             (unsigned)automaton.rule_count, (unsigned)automaton.state_count,
+             (unsigned)automaton.class_count, (unsigned)policy_automaton_bytes(&automaton));
+}
+
+PolicyAction policy_evaluate(const char* hostname, const char* tool_name, const char* command,
+                             const char* file_path, int* rule) {
+    const char* fields[PF_COUNT] = { hostname, tool_name, command, file_path };
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int r = policy_automaton_match(&s_automaton, fields);
+    PolicyAction action = r >= 0 ? s_automaton.actions[r] : POLICY_ASK;
+    s_evaluated++;
+    if (r >= 0) {
+        s_hits[r]++;
+        s_matched[action]++;
+    }
+    xSemaphoreGive(s_lock);
+    *rule = r;
+    return action;
+}
+
+bool policy_replace(const char* json, char* err, size_t err_len) {
+    PolicyAutomaton automaton;
+    char* source = nullptr;
+    int64_t compile_us = 0;
+    xSemaphoreTake(s_compile_lock, portMAX_DELAY);
+    bool ok = compile_json(json, &automaton, &source, &compile_us, err, err_len);
+    if (ok) {
+        // 保存できてから入れ替える (再起動で戻らないように)
+        nvs_handle_t nvs;
+        esp_err_t e = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (e == ESP_OK) {
+            e = nvs_set_blob(nvs, NVS_KEY, source, strlen(source));
+            if (e == ESP_OK) e = nvs_commit(nvs);
+            nvs_close(nvs);
+        }
+        if (e != ESP_OK) {
+            snprintf(err, err_len, "nvs write failed: %s", esp_err_to_name(e));
+            policy_automaton_free(&automaton);
+            free(source);
+            ok = false;
+        } else {
+            install(&automaton, source, compile_us);
+        }
+    }
+    xSemaphoreGive(s_compile_lock);
+    if (ok) {
+        ESP_LOGI(TAG, "Policy replaced: %u rules, %u states x %u classes",
+                 (unsigned)automaton.rule_count, (unsigned)automaton.state_count,
+                 (unsigned)automaton.class_count);
+    }
+    return ok;
+}
+
+cJSON* policy_to_json(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON* root = s_source ? cJSON_Parse(s_source) : nullptr;
+    if (!root) {
+        root = cJSON_CreateObject();
+        cJSON_AddArrayToObject(root, "rules");
+    }
+    // ルールごとの一致数 (rules と同じ順)
+    cJSON* hits = cJSON_AddArrayToObject(root, "hits");
+    for (int r = 0; r < s_automaton.rule_count; r++) {
+        cJSON_AddItemToArray(hits, cJSON_CreateNumber(s_hits[r]));
+    }
+    cJSON* compiled = cJSON_AddObjectToObject(root, "compiled");
+    cJSON_AddNumberToObject(compiled, "states", s_automaton.state_count);
+    cJSON_AddNumberToObject(compiled, "classes", s_automaton.class_count);
+    cJSON_AddNumberToObject(compiled, "bytes", (double)policy_automaton_bytes(&s_automaton));
+    cJSON_AddNumberToObject(compiled, "compile_us", (double)s_compile_us);
+    xSemaphoreGive(s_lock);
+    return root;
+}
+
+cJSON* policy_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON_AddNumberToObject(root, "rules", s_automaton.rule_count);
+    cJSON_AddNumberToObject(root, "evaluated", s_evaluated);
+    cJSON_AddNumberToObject(root, "allowed", s_matched[POLICY_ALLOW]);
+    cJSON_AddNumberToObject(root, "denied", s_matched[POLICY_DENY]);
+    cJSON_AddNumberToObject(root, "asked", s_evaluated - s_matched[POLICY_ALLOW] - s_matched[POLICY_DENY]);
+    xSemaphoreGive(s_lock);
+    return root;
+}
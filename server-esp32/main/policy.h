@@ -0,0 +1,32 @@
+#pragma once
+
+#include "policy_automaton.h"
+
+#include <cstddef>
+#include <cJSON.h>
+
+// 自動判断ポリシー: POST /permission-request の時点でルールに一致したリクエストを
+// 人に見せずに allow / deny で確定する
+//
+// ルールは JSON ({"rules":[{"action":"allow","tool":"Bash","command":"git status*"}, ...]}) で
+// 受け取り、NVS に保存する。起動時と PUT /policy のたびに 1 つの DFA にコンパイルし、
+// 評価は DFA の表引きだけ (policy_automaton.h)
+
+// NVS から読み込んでコンパイル (nvs_flash_init の後に 1 回だけ呼ぶ)
+void policy_init(void);
+
+// リクエストを評価する。*rule = 一致したルールの添字 (-1 = なし、その場合は POLICY_ASK)
+PolicyAction policy_evaluate(const char* hostname, const char* tool_name, const char* command,
+                             const char* file_path, int* rule);
+
+// ルールの JSON を検証・コンパイルして入れ替え、NVS に保存する
+// 失敗時は err に理由を書き、現在のルールはそのまま
+bool policy_replace(const char* json, char* err, size_t err_len);
+
+// 現在のルール (PUT /policy と同じ形) + コンパイル結果と評価回数 (GET /policy 用)
+cJSON* policy_to_json(void);
+
+// 評価・一致の回数 (GET /stats 用)
+cJSON* policy_stats_to_json(void);
+
+const char* policy_action_name(PolicyAction action);
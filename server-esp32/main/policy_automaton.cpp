@@ -0,0 +1,288 @@
+#include "policy_automaton.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#define FIELD_SEP 0x1f
+#define OTHER_BYTE 256          // パターンに現れないバイト (文字クラス 0) の代表
+
+// 遷移表には次の状態の番号ではなく行の先頭 (状態 × クラス数) を入れる。
+// 照合の 1 バイトごとの依存の連鎖から掛け算が抜け、表引き 1 回だけになる
+static_assert(POLICY_MAX_TABLE_BYTES / sizeof(uint16_t) <= UINT16_MAX + 1,
+              "row offsets must fit in uint16_t");
+
+enum TokenKind : uint8_t {
+    TOK_LITERAL,
+    TOK_ANY,                    // ?
+    TOK_STAR,                   // * / **
+};
+
+struct Token {
+    TokenKind kind;
+    bool slash;                 // ANY / STAR が '/' にも一致する
+    bool shell;                 // ANY / STAR がシェルの区切り・展開の文字にも一致する
+    uint8_t byte;               // TOK_LITERAL の文字
+};
+
+// allow ルールの command のワイルドカードが一致しない文字
+// (git status* が "git status; rm -rf ~" や "git status && curl ... | sh" に一致しないように。
+// $ は $( と ${ を、< > はリダイレクトを止める)。パターンに直接書いた文字は比較する
+static const char SHELL_META[] = ";&|`$<>\n\r";
+
+static inline bool is_shell_meta(int c) {
+    return c > 0 && c < 256 && strchr(SHELL_META, c) != nullptr;
+}
+
+// NFA の位置 = (ルール, トークン列の添字)。ルールが若いほど値が小さい
+typedef uint32_t Position;
+static inline Position make_pos(int rule, int index) { return ((Position)rule << 16) | (Position)index; }
+static inline int pos_rule(Position p) { return (int)(p >> 16); }
+static inline int pos_index(Position p) { return (int)(p & 0xffff); }
+
+static bool tokenize(const char* pattern, PolicyField field, PolicyAction action,
+                     std::vector<Token>* out, char* err, size_t err_len) {
+    if (!pattern) {
+        out->push_back({ TOK_STAR, true, true, 0 });
+        return true;
+    }
+    if (strlen(pattern) > POLICY_MAX_PATTERN) {
+        snprintf(err, err_len, "pattern too long");
+        return false;
+    }
+    // file_path の * と ? だけが '/' で止まる。allow の command の * と ? はシェルの区切りで止まる
+    bool path = field == PF_PATH;
+    bool shell = !(field == PF_COMMAND && action == POLICY_ALLOW);
+    for (const char* p = pattern; *p; p++) {
+        uint8_t c = (uint8_t)*p;
+        if (c == FIELD_SEP) {
+            snprintf(err, err_len, "invalid character in pattern");
+            return false;
+        }
+        if (c == '\\' && p[1] != '\0') {
+            p++;
+            if ((uint8_t)*p == FIELD_SEP) {
+                snprintf(err, err_len, "invalid character in pattern");
+                return false;
+            }
+            out->push_back({ TOK_LITERAL, false, false, (uint8_t)*p });
+        } else if (c == '*') {
+            bool slash = !path;
+            if (path && p[1] == '*') {
+                slash = true;
+                p++;
+            }
+            // 連続する * は 1 つにまとめる (** の方が広い)
+            while (p[1] == '*') {
+                p++;
+                if (path) slash = true;
+            }
+            if (!out->empty() && out->back().kind == TOK_STAR) {
+                out->back().slash = out->back().slash || slash;
+            } else {
+                out->push_back({ TOK_STAR, slash, shell, 0 });
+            }
+        } else if (c == '?') {
+            out->push_back({ TOK_ANY, !path, shell, 0 });
+        } else {
+            out->push_back({ TOK_LITERAL, false, false, c });
+        }
+    }
+    return true;
+}
+
+static inline bool wildcard_matches(const Token& t, int c) {
+    return c != FIELD_SEP && (t.slash || c != '/') && (t.shell || !is_shell_meta(c));
+}
+
+// * は空文字列にも一致するので、* の手前にいれば * の後ろにもいる
+static void closure(const std::vector<std::vector<Token>>& rules, std::vector<Position>* set) {
+    for (size_t k = 0; k < set->size(); k++) {
+        Position p = (*set)[k];
+        const std::vector<Token>& toks = rules[pos_rule(p)];
+        int i = pos_index(p);
+        if (i < (int)toks.size() && toks[i].kind == TOK_STAR) {
+            set->push_back(make_pos(pos_rule(p), i + 1));
+        }
+    }
+    std::sort(set->begin(), set->end());
+    set->erase(std::unique(set->begin(), set->end()), set->end());
+}
+
+static void step(const std::vector<std::vector<Token>>& rules, const std::vector<Position>& from,
+                 int c, std::vector<Position>* to) {
+    to->clear();
+    for (Position p : from) {
+        const std::vector<Token>& toks = rules[pos_rule(p)];
+        int i = pos_index(p);
+        if (i >= (int)toks.size()) continue;
+        const Token& t = toks[i];
+        switch (t.kind) {
+            case TOK_LITERAL:
+                if (t.byte == c) to->push_back(make_pos(pos_rule(p), i + 1));
+                break;
+            case TOK_ANY:
+                if (wildcard_matches(t, c)) to->push_back(make_pos(pos_rule(p), i + 1));
+                break;
+            case TOK_STAR:
+                if (wildcard_matches(t, c)) to->push_back(p);
+                break;
+        }
+    }
+    closure(rules, to);
+}
+
+bool policy_automaton_compile(const PolicyRule* rules, int count, PolicyAutomaton* out,
+                              char* err, size_t err_len) {
+    memset(out, 0, sizeof(*out));
+    if (count == 0) return true;
+    if (count > POLICY_MAX_RULES) {
+        snprintf(err, err_len, "too many rules (max %d)", POLICY_MAX_RULES);
+        return false;
+    }
+
+    // ルールごとに 4 フィールドを区切り文字でつないだトークン列にする
+    std::vector<std::vector<Token>> toks(count);
+    for (int r = 0; r < count; r++) {
+        for (int f = 0; f < PF_COUNT; f++) {
+            if (f > 0) toks[r].push_back({ TOK_LITERAL, false, false, FIELD_SEP });
+            if (!tokenize(rules[r].pattern[f], (PolicyField)f, rules[r].action, &toks[r], err, err_len)) {
+                char reason[64];
+                snprintf(reason, sizeof(reason), "%s", err);
+                snprintf(err, err_len, "rule %d: %s", r, reason);
+                return false;
+            }
+        }
+    }
+
+    // 文字クラス: パターン中のリテラル・'/'・区切り文字はそれぞれ 1 クラス、残りはまとめて 0
+    // シェルの区切りで止まるワイルドカードがあれば、リテラルに現れないシェルの区切りをまとめて 1 クラス
+    std::vector<int> reps(1, OTHER_BYTE);
+    uint8_t byte_class[256] = {};
+    auto add_class = [&](uint8_t b) {
+        if (byte_class[b] != 0 || reps.size() > UINT8_MAX) return;
+        byte_class[b] = (uint8_t)reps.size();
+        reps.push_back(b);
+    };
+    add_class('/');
+    add_class(FIELD_SEP);
+    bool stops_at_shell = false;
+    for (const auto& t : toks) {
+        for (const Token& k : t) {
+            if (k.kind == TOK_LITERAL) add_class(k.byte);
+            else if (!k.shell) stops_at_shell = true;
+        }
+    }
+    if (stops_at_shell && reps.size() <= UINT8_MAX) {
+        uint8_t meta_class = 0;
+        for (const char* m = SHELL_META; *m; m++) {
+            uint8_t b = (uint8_t)*m;
+            if (byte_class[b] != 0) continue;
+            if (meta_class == 0) {
+                meta_class = (uint8_t)reps.size();
+                reps.push_back(b);
+            }
+            byte_class[b] = meta_class;
+        }
+    }
+    if (reps.size() > UINT8_MAX) {
+        snprintf(err, err_len, "too many distinct characters");
+        return false;
+    }
+    int classes = (int)reps.size();
+
+    // 部分集合構成 (状態 0 = 空集合 = 行き止まり)
+    std::map<std::vector<Position>, uint16_t> ids;
+    std::vector<std::vector<Position>> sets;
+    std::vector<uint16_t> next;
+    sets.push_back({});
+    ids[sets[0]] = 0;
+    std::vector<Position> start;
+    for (int r = 0; r < count; r++) start.push_back(make_pos(r, 0));
+    closure(toks, &start);
+    ids[start] = 1;
+    sets.push_back(start);
+
+    std::vector<Position> to;
+    for (size_t s = 0; s < sets.size(); s++) {
+        next.resize((s + 1) * classes, 0);
+        if (s == 0) continue;
+        for (int c = 0; c < classes; c++) {
+            step(toks, sets[s], reps[c], &to);
+            auto it = ids.find(to);
+            uint16_t id;
+            if (it != ids.end()) {
+                id = it->second;
+            } else {
+                if (sets.size() >= POLICY_MAX_STATES ||
+                    (sets.size() + 1) * classes * sizeof(uint16_t) > POLICY_MAX_TABLE_BYTES) {
+                    snprintf(err, err_len, "policy too complex (over %d states)",
+                             (int)sets.size());
+                    return false;
+                }
+                id = (uint16_t)sets.size();
+                ids[to] = id;
+                sets.push_back(to);
+            }
+            next[s * classes + c] = id;
+        }
+    }
+
+    size_t table = sets.size() * classes * sizeof(uint16_t);
+    uint8_t* block = (uint8_t*)malloc(table + sets.size());
+    if (!block) {
+        snprintf(err, err_len, "out of memory");
+        return false;
+    }
+    out->next = (uint16_t*)block;
+    out->accept = block + table;
+    for (size_t i = 0; i < next.size(); i++) out->next[i] = (uint16_t)(next[i] * classes);
+    for (size_t s = 0; s < sets.size(); s++) {
+        // 集合は昇順なので、末尾まで進んだ位置のうち最初のものが最も若いルール
+        out->accept[s] = 0;
+        for (Position p : sets[s]) {
+            if (pos_index(p) == (int)toks[pos_rule(p)].size()) {
+                out->accept[s] = (uint8_t)(pos_rule(p) + 1);
+                break;
+            }
+        }
+    }
+    memcpy(out->byte_class, byte_class, sizeof(byte_class));
+    out->state_count = (uint16_t)sets.size();
+    out->class_count = (uint16_t)classes;
+    out->rule_count = (uint16_t)count;
+    for (int r = 0; r < count; r++) out->actions[r] = rules[r].action;
+    return true;
+}
+
+void policy_automaton_free(PolicyAutomaton* a) {
+    free(a->next);
+    memset(a, 0, sizeof(*a));
+}
+
+int policy_automaton_match(const PolicyAutomaton* a, const char* const fields[PF_COUNT]) {
+    if (a->state_count == 0) return -1;
+    const int classes = a->class_count;
+    uint32_t row = classes;     // 状態 1 (開始) の行
+    for (int f = 0; f < PF_COUNT; f++) {
+        if (f > 0) row = a->next[row + a->byte_class[FIELD_SEP]];
+        const char* p = fields[f];
+        if (p) {
+            for (; *p; p++) {
+                uint8_t b = (uint8_t)*p;
+                // 入力中の区切り文字は普通の文字として扱う (フィールドをずらさせない)
+                int c = b == FIELD_SEP ? 0 : a->byte_class[b];
+                row = a->next[row + c];
+                if (row == 0) return -1;
+            }
+        }
+    }
+    return (int)a->accept[row / classes] - 1;
+}
+
+size_t policy_automaton_bytes(const PolicyAutomaton* a) {
+    return (size_t)a->state_count * a->class_count * sizeof(uint16_t) + a->state_count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 自動判断ルールの照合オートマトン
+//
+// ルールはフィールド (host / tool / command / file_path) ごとのグロブの組。
+// 全ルールを「host US tool US command US file_path」(US = 0x1f) という 1 本の文字列に対する
+// パターンとみなし、部分集合構成で 1 つの DFA にまとめる。状態ごとに「そこで入力が終われば
+// 一致する最も若いルール」を持たせるので、照合は入力を 1 バイトずつ表引きするだけで
+// ルール数によらず O(入力長) になる
+//
+// グロブ:
+//   host / tool / command: * は任意の文字列、? は任意の 1 文字 (command="git status*" で前方一致)
+//   allow ルールの command:  * と ? はシェルの区切り・展開の文字 (; & | ` $ < > 改行) に一致しない。
+//                           "git status*" は "git status; rm -rf ~" に一致せず、ask に回る
+//   file_path:             * と ? は '/' を越えない。** は '/' も含めた任意の文字列
+//   \ は次の 1 文字をそのまま比較する。大文字小文字は区別する
+//   パターンを省略したフィールドは何にでも (空文字列にも) 一致する
+
+#define POLICY_MAX_RULES 64
+#define POLICY_MAX_PATTERN 128
+#define POLICY_MAX_STATES 512
+#define POLICY_MAX_TABLE_BYTES 32768    // 遷移表の上限 (状態数 × 文字クラス数 × 2)
+
+enum PolicyAction : uint8_t {
+    POLICY_ASK,         // 人に聞く (どのルールにも一致しない場合も同じ)
+    POLICY_ALLOW,
+    POLICY_DENY,
+};
+
+enum PolicyField {
+    PF_HOST,
+    PF_TOOL,
+    PF_COMMAND,
+    PF_PATH,
+    PF_COUNT,
+};
+
+struct PolicyRule {
+    PolicyAction action;
+    const char* pattern[PF_COUNT];  // nullptr = 任意
+};
+
+struct PolicyAutomaton {
+    uint16_t state_count;           // 0 = 空 (ルールなし)。状態 0 は行き止まり、1 が開始
+    uint16_t class_count;
+    uint16_t rule_count;
+    uint8_t byte_class[256];        // バイト → 文字クラス (パターンに現れないバイトはすべて 0)
+    uint16_t* next;                 // [row + class] → 次の状態の行 (row = 状態 × class_count)
+    uint8_t* accept;                // [state] → 一致するルールの添字 + 1 (0 = なし)
+    PolicyAction actions[POLICY_MAX_RULES];
+};
+
+// rules を先頭から優先の順にコンパイルする (失敗時は err に理由を書き、out は空のまま)
+bool policy_automaton_compile(const PolicyRule* rules, int count, PolicyAutomaton* out,
+                              char* err, size_t err_len);
+
+void policy_automaton_free(PolicyAutomaton* a);
+
+// 一致した最初のルールの添字 (-1 = なし)。fields の nullptr は空文字列として扱う
+int policy_automaton_match(const PolicyAutomaton* a, const char* const fields[PF_COUNT]);
+
+// 遷移表と受理表のバイト数 (GET /policy 用)
+size_t policy_automaton_bytes(const PolicyAutomaton* a);
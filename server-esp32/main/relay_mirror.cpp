@@ -0,0 +1,338 @@
+#include "relay_mirror.h"
+#include "request_store.h"
+#include "display_manager.h"
+#include "notify_queue.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_client.h>
+#include <esp_websocket_client.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+
+static const char* TAG = "mirror";
+
+#define MAX_FRAME_LEN (16 * 1024)   // 受け付けるスナップショットの最大長
+#define FORWARD_QUEUE_LEN 8
+#define FORWARD_RETRY 3
+#define MIN_KEY_LENGTH 8
+#define MAX_KEY_LENGTH 128
+
+struct ForwardItem {
+    char id[UUID_STR_LEN];
+    int choice;
+    char response[16];
+};
+
+static bool s_enabled = false;
+static esp_websocket_client_handle_t s_ws = nullptr;
+static QueueHandle_t s_forward_queue = nullptr;
+
+static char s_base_url[128] = {0};      // 例: http://192.168.1.10:3939
+static char s_ws_url[136] = {0};        // 例: ws://192.168.1.10:3939/ws
+static char s_bearer[8 + MAX_KEY_LENGTH] = {0};
+static char s_ws_headers[32 + MAX_KEY_LENGTH] = {0};
+
+// 受信中のフレーム (分割受信を結合)
+static char* s_frame = nullptr;
+static int s_frame_len = 0;
+
+// 上流時刻 (エポック ms) → ローカル時刻 (boot 相対 ms) のオフセット
+// 観測した上流タイムスタンプは常に上流の現在時刻以前なので、
+// (ローカル現在時刻 - 上流タイムスタンプ) の最小値が真のオフセットに最も近い
+static int64_t s_clock_offset = INT64_MAX;
+
+// WebSocket タスクからのみ使う作業領域 (スタック節約)
+static PermissionRequest s_scratch;
+
+static int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+bool relay_mirror_enabled(void) {
+    return s_enabled;
+}
+
+static void observe_remote_time(const cJSON* ts) {
+    if (!cJSON_IsNumber(ts)) return;
+    int64_t candidate = now_ms() - (int64_t)ts->valuedouble;
+    if (candidate < s_clock_offset) s_clock_offset = candidate;
+}
+
+static int64_t to_local_time(const cJSON* ts) {
+    if (!cJSON_IsNumber(ts)) return 0;
+    return (int64_t)ts->valuedouble + s_clock_offset;
+}
+
+static void copy_str(char* dst, size_t dst_len, const cJSON* item) {
+    const char* s = cJSON_GetStringValue(item);
+    if (s) strncpy(dst, s, dst_len - 1);
+}
+
+// serializeRequest (server/src/store.ts) 形式の JSON を PermissionRequest に変換
+static bool parse_request(const cJSON* item, PermissionRequest* out) {
+    const char* id = cJSON_GetStringValue(cJSON_GetObjectItem(item, "id"));
+    if (!id || id[0] == '\0' || strlen(id) >= UUID_STR_LEN) return false;
+
+    memset(out, 0, sizeof(PermissionRequest));
+    strcpy(out->id, id);
+    copy_str(out->tool_name, sizeof(out->tool_name), cJSON_GetObjectItem(item, "tool_name"));
+    copy_str(out->message, sizeof(out->message), cJSON_GetObjectItem(item, "message"));
+    copy_str(out->hostname, sizeof(out->hostname), cJSON_GetObjectItem(item, "hostname"));
+    copy_str(out->response, sizeof(out->response), cJSON_GetObjectItem(item, "response"));
+    copy_str(out->send_key, sizeof(out->send_key), cJSON_GetObjectItem(item, "send_key"));
+    // Node.js 版は subtitle を配信しないので tool_name で代用
+    strncpy(out->subtitle, out->tool_name, sizeof(out->subtitle) - 1);
+
+    const cJSON* choices = cJSON_GetObjectItem(item, "choices");
+    const cJSON* c;
+    cJSON_ArrayForEach(c, choices) {
+        if (out->choice_count >= MAX_CHOICES) break;
+        const cJSON* num = cJSON_GetObjectItem(c, "number");
+        if (!cJSON_IsNumber(num)) continue;
+        Choice* dst = &out->choices[out->choice_count++];
+        dst->number = (uint8_t)num->valueint;
+        copy_str(dst->text, sizeof(dst->text), cJSON_GetObjectItem(c, "text"));
+    }
+
+    out->created_at = to_local_time(cJSON_GetObjectItem(item, "created_at"));
+    out->expires_at = to_local_time(cJSON_GetObjectItem(item, "expires_at"));
+    out->responded_at = to_local_time(cJSON_GetObjectItem(item, "responded_at"));
+    return true;
+}
+
+// スナップショットをストアに反映 (差分のみ書き込み、消えたものは削除)
+static void apply_snapshot(const cJSON* requests) {
+    const cJSON* item;
+    cJSON_ArrayForEach(item, requests) {
+        observe_remote_time(cJSON_GetObjectItem(item, "created_at"));
+        observe_remote_time(cJSON_GetObjectItem(item, "responded_at"));
+    }
+
+    const char* keep_ids[MAX_REQUESTS];
+    int keep_count = 0;
+    bool changed = false;
+    bool new_pending = false;
+
+    // 未応答を優先してスロットを割り当てる (上流の保持件数が 8 を超える場合)
+    // ハンドラ・ボタンのタスクと同じストアを書き換えるので、反映と削除を 1 回のロックで行う
+    request_store_lock();
+    for (int pass = 0; pass < 2 && keep_count < MAX_REQUESTS; pass++) {
+        cJSON_ArrayForEach(item, requests) {
+            if (keep_count >= MAX_REQUESTS) break;
+            bool pending = cJSON_IsNull(cJSON_GetObjectItem(item, "response"));
+            if (pending != (pass == 0)) continue;
+            if (!parse_request(item, &s_scratch)) continue;
+
+            MirrorResult r = request_store_mirror(&s_scratch);
+            if (r == MIRROR_NO_SLOT) continue;
+            keep_ids[keep_count++] = cJSON_GetStringValue(cJSON_GetObjectItem(item, "id"));
+            if (r != MIRROR_UNCHANGED) changed = true;
+            if (r == MIRROR_CREATED && pending) new_pending = true;
+        }
+    }
+
+    if (request_store_prune_mirrored(keep_ids, keep_count) > 0) changed = true;
+    request_store_unlock();
+
+    if (changed) display_notify_new_request();
+    if (new_pending) notify_queue_beep();
+}
+
+static void handle_message(const char* text, int len) {
+    cJSON* root = cJSON_ParseWithLength(text, len);
+    if (!root) {
+        ESP_LOGW(TAG, "Invalid JSON from upstream (%d bytes)", len);
+        return;
+    }
+    const char* type = cJSON_GetStringValue(cJSON_GetObjectItem(root, "type"));
+    cJSON* requests = cJSON_GetObjectItem(root, "requests");
+    if (type && strcmp(type, "update") == 0 && cJSON_IsArray(requests)) {
+        apply_snapshot(requests);
+    }
+    cJSON_Delete(root);
+}
+
+static void on_ws_data(const esp_websocket_event_data_t* data) {
+    // テキストフレームのみ処理 (ping/pong/close は websocket client が処理)
+    if (data->op_code != 0x1) return;
+
+    // 大きなフレームは payload_offset 付きで分割配信される
+    if (data->payload_offset == 0) {
+        free(s_frame);
+        s_frame = nullptr;
+        s_frame_len = 0;
+        if (data->payload_len > MAX_FRAME_LEN) {
+            ESP_LOGW(TAG, "Upstream frame too large (%d bytes), dropped", data->payload_len);
+            return;
+        }
+        s_frame = (char*)malloc(data->payload_len + 1);
+        if (!s_frame) {
+            ESP_LOGE(TAG, "Out of memory for upstream frame");
+            return;
+        }
+    }
+    if (!s_frame || s_frame_len + data->data_len > data->payload_len) return;
+
+    memcpy(s_frame + s_frame_len, data->data_ptr, data->data_len);
+    s_frame_len += data->data_len;
+
+    if (s_frame_len == data->payload_len) {
+        s_frame[s_frame_len] = '\0';
+        handle_message(s_frame, s_frame_len);
+        free(s_frame);
+        s_frame = nullptr;
+        s_frame_len = 0;
+    }
+}
+
+static void ws_event_handler(void* arg, esp_event_base_t base, int32_t event_id, void* event_data) {
+    auto* data = (esp_websocket_event_data_t*)event_data;
+    switch (event_id) {
+        case WEBSOCKET_EVENT_CONNECTED:
+            // 上流は接続直後に全件スナップショットを送るので、それで再同期される
+            ESP_LOGI(TAG, "Connected to %s", s_ws_url);
+            break;
+        case WEBSOCKET_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "Disconnected from upstream, reconnecting...");
+            free(s_frame);
+            s_frame = nullptr;
+            s_frame_len = 0;
+            break;
+        case WEBSOCKET_EVENT_DATA:
+            on_ws_data(data);
+            break;
+        case WEBSOCKET_EVENT_ERROR:
+            ESP_LOGW(TAG, "WebSocket error");
+            break;
+        default:
+            break;
+    }
+}
+
+// 応答転送タスク: keep-alive の HTTP クライアントを使い回す
+static void forward_task(void* arg) {
+    esp_http_client_config_t cfg = {};
+    cfg.url = s_base_url;
+    cfg.method = HTTP_METHOD_POST;
+    cfg.timeout_ms = 5000;
+    cfg.keep_alive_enable = true;
+    esp_http_client_handle_t client = esp_http_client_init(&cfg);
+
+    ForwardItem item;
+    char url[192];
+    char body[96];
+
+    while (true) {
+        if (xQueueReceive(s_forward_queue, &item, portMAX_DELAY) != pdTRUE) continue;
+
+        snprintf(url, sizeof(url), "%s/permission-request/%s/respond", s_base_url, item.id);
+        if (item.choice > 0) {
+            snprintf(body, sizeof(body), "{\"choice\":%d,\"source\":\"esp32\"}", item.choice);
+        } else {
+            snprintf(body, sizeof(body), "{\"response\":\"%s\",\"source\":\"esp32\"}", item.response);
+        }
+
+        for (int attempt = 0; attempt < FORWARD_RETRY; attempt++) {
+            esp_http_client_set_url(client, url);
+            esp_http_client_set_method(client, HTTP_METHOD_POST);
+            esp_http_client_set_header(client, "Content-Type", "application/json");
+            esp_http_client_set_header(client, "Authorization", s_bearer);
+            esp_http_client_set_post_field(client, body, strlen(body));
+
+            esp_err_t err = esp_http_client_perform(client);
+            int status = esp_http_client_get_status_code(client);
+            // 404 = 上流で応答済み/削除済み → 再送しても無意味
+            if (err == ESP_OK && (status == 200 || status == 404)) {
+                ESP_LOGI(TAG, "Forwarded %s: %s (HTTP %d)", item.id, body, status);
+                break;
+            }
+            ESP_LOGW(TAG, "Forward %s failed: %s (HTTP %d), attempt %d",
+                item.id, esp_err_to_name(err), status, attempt + 1);
+            esp_http_client_close(client);
+            vTaskDelay(pdMS_TO_TICKS(500 << attempt));
+        }
+    }
+}
+
+bool relay_mirror_forward_respond(const char* id, int choice, const char* response) {
+    if (!s_enabled) return false;
+
+    ForwardItem item = {};
+    strncpy(item.id, id, sizeof(item.id) - 1);
+    item.choice = choice;
+    if (response) strncpy(item.response, response, sizeof(item.response) - 1);
+
+    if (xQueueSend(s_forward_queue, &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Forward queue full, dropped %s", id);
+        return false;
+    }
+    return true;
+}
+
+esp_err_t relay_mirror_start(void) {
+    const char* url = CONFIG_UPSTREAM_URL;
+    const char* key = CONFIG_UPSTREAM_API_KEY;
+
+    if (url[0] == '\0') {
+        ESP_LOGI(TAG, "Upstream not configured, standalone mode");
+        return ESP_OK;
+    }
+
+    int key_len = strlen(key);
+    if (key_len < MIN_KEY_LENGTH || key_len > MAX_KEY_LENGTH) {
+        ESP_LOGE(TAG, "UPSTREAM_API_KEY must be %d-%d characters", MIN_KEY_LENGTH, MAX_KEY_LENGTH);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 末尾の "/" を除去してベース URL とする
+    strncpy(s_base_url, url, sizeof(s_base_url) - 1);
+    int len = strlen(s_base_url);
+    while (len > 0 && s_base_url[len - 1] == '/') s_base_url[--len] = '\0';
+
+    // http(s):// → ws(s):// に置き換えて /ws を付加
+    if (strncmp(s_base_url, "https://", 8) == 0) {
+        snprintf(s_ws_url, sizeof(s_ws_url), "wss://%s/ws", s_base_url + 8);
+    } else if (strncmp(s_base_url, "http://", 7) == 0) {
+        snprintf(s_ws_url, sizeof(s_ws_url), "ws://%s/ws", s_base_url + 7);
+    } else {
+        ESP_LOGE(TAG, "UPSTREAM_URL must start with http:// or https://");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    snprintf(s_bearer, sizeof(s_bearer), "Bearer %s", key);
+    snprintf(s_ws_headers, sizeof(s_ws_headers), "Authorization: %s\r\n", s_bearer);
+
+    s_forward_queue = xQueueCreate(FORWARD_QUEUE_LEN, sizeof(ForwardItem));
+    if (!s_forward_queue) return ESP_ERR_NO_MEM;
+    xTaskCreate(forward_task, "mirror_fwd", 4096, nullptr, 4, nullptr);
+
+    esp_websocket_client_config_t ws_cfg = {};
+    ws_cfg.uri = s_ws_url;
+    ws_cfg.headers = s_ws_headers;
+    ws_cfg.reconnect_timeout_ms = 5000;
+    ws_cfg.network_timeout_ms = 10000;
+    ws_cfg.task_stack = 6144;
+
+    s_ws = esp_websocket_client_init(&ws_cfg);
+    if (!s_ws) {
+        ESP_LOGE(TAG, "esp_websocket_client_init failed");
+        return ESP_FAIL;
+    }
+    esp_websocket_register_events(s_ws, WEBSOCKET_EVENT_ANY, ws_event_handler, nullptr);
+
+    esp_err_t err = esp_websocket_client_start(s_ws);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_websocket_client_start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    s_enabled = true;
+    ESP_LOGI(TAG, "Mirroring upstream %s", s_base_url);
+    return ESP_OK;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <esp_err.h>
+
+// 上流サーバ (Node.js) の /ws を購読し、リクエスト状態をローカルストアへミラーする
+// CONFIG_UPSTREAM_URL が空の場合は何もしない (単独動作)
+esp_err_t relay_mirror_start(void);
+
+// ミラーモードで動作中か
+bool relay_mirror_enabled(void);
+
+// ローカルでの応答を上流サーバへ転送 (キュー投入のみ、送信は専用タスク)
+// choice > 0 なら選択肢番号、それ以外は response ("allow" / "deny" / "allow_all") を送る
+bool relay_mirror_forward_respond(const char* id, int choice, const char* response);
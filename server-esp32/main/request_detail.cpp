@@ -0,0 +1,386 @@
+#include "request_detail.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const char* TAG = "detail";
+
+static constexpr int BLOCKS = Board::DETAIL_POOL_SIZE / DETAIL_BLOCK_LEN;
+static constexpr uint16_t BLOCK_NONE = 0xffff;
+static constexpr uint16_t STORED_RAW = 0x8000;     // 圧縮しても縮まなかったページはそのまま置く
+static constexpr uint32_t POOL_BYTES_PER_BLOCK = DETAIL_BLOCK_LEN + sizeof(uint16_t);   // ブロック + 連結リスト
+static_assert(BLOCKS < BLOCK_NONE, "block index must fit in 16 bits");
+static_assert(LZ_BOUND(DETAIL_PAGE_LEN) < STORED_RAW, "stored length must leave the raw flag bit");
+
+// 全ページ共通の圧縮辞書 (フラッシュに置く)。ページの直前に続いているものとして一致を探すので、
+// 1KB のページや数百バイトのコマンドでもキー名・よく出るコマンド・コードの断片が参照で済む。
+// 同じハッシュは後ろの位置で上書きされるので、よく出るものほど後ろに置く。
+// 中身を変えると保存済みのページを展開できなくなる (再起動で消えるプールなので互換は要らない)
+static const char DETAIL_DICT[] =
+    // コード (C/C++・Python・JS/TS・シェル)
+    "#include <cstring>\n#include \"esp_log.h\"\n#pragma once\n\nstatic const char* TAG = \""
+    "static constexpr int \nstatic void \nstatic bool \nconst char* \nuint8_t* \nsize_t len\n"
+    "    if (!\n        return nullptr;\n    }\n\n    for (int i = 0; i < \n; i++) {\n"
+    "        } else {\n            \n    return true;\n}\n\n"
+    "std::string \nstd::vector<\nauto \n#define \n// \n/* \n */\n"
+    "import os\nimport sys\nfrom typing import \ndef __init__(self, \n        self.\n    def \nclass \n"
+    "    print(f\"\nif __name__ == \"__main__\":\n    return None\n    raise \n"
+    "import { \n} from \"\nexport default function \nexport const \nconst { \n} = \nawait \n"
+    "async \n=> {\n  return (\n    <div className=\"\n  );\n}\n\nconsole.log(\n});\n"
+    "#!/usr/bin/env bash\nset -euo pipefail\n\"$@\"\n\"${\n}\"\n$(\n) \nfi\ndone\nthen\n"
+    "echo \"\nexport \nmkdir -p \nrm -rf \ncp -r \nfind . -name \"\ngrep -rn \"\nsed -n '\n"
+    "cat \nls -la \ncurl -s \n | head -n \n | tail -n \n 2>&1\n > /dev/null\n || true\n && \n"
+    "python3 -m pytest \npip install \nnpm run build\nnpm run test\nnpm install \nnpx \n"
+    "cargo build --release\ncargo test\ngo test ./...\nmake -j\ncmake -S . -B build\ncmake --build build -j\n"
+    "docker compose up -d\nkubectl get pods\n"
+    "git log --oneline -\ngit diff --stat\ngit status --short\ngit add \ngit commit -m \"\ngit push origin \n"
+    "git checkout -b \ngit rebase \n"
+    // パスと拡張子
+    ".cpp\n.h\n.py\n.ts\n.tsx\n.js\n.json\n.md\n.yml\n.toml\n.txt\n"
+    "/usr/local/bin/\n/tmp/\n/src/\n/home/\n/Users/\n"
+    // tool_input のキー (request_parse の detail_field が書く形)
+    "\nreplace_all: false\n\nreplace_all: true\n\nedits: [{\"old_string\":\"\",\"new_string\":\"\"}]\n"
+    "\ntimeout: \n\nrun_in_background: \n\npattern: \n\npath: \n\nurl: https://\n\nprompt:\n\nquery: \n"
+    "\ncontent:\n\nold_string:\n\nnew_string:\n\nfile_path: /\n\ndescription: \n\ncommand: \n\ncommand:\n"
+    "\nprompt_question: Do you want to proceed?\n\nmessage: Claude needs your permission to use \n";
+static constexpr size_t DETAIL_DICT_LEN = sizeof(DETAIL_DICT) - 1;
+static_assert(DETAIL_DICT_LEN + DETAIL_PAGE_LEN <= LZ_MAX_INPUT, "dictionary and page must fit the codec's window");
+
+static DetailEntry s_entries[MAX_REQUESTS];
+static uint8_t* s_pool = nullptr;       // BLOCKS 個のブロック + 連結リスト (同じ領域に続けて置く)
+static uint16_t* s_next = nullptr;      // チェーンの次のブロック (空きブロックは空きリストでつなぐ)
+static uint16_t s_free_head = BLOCK_NONE;
+static int s_free_blocks = 0;
+static bool s_in_psram = false;
+static uint32_t s_seq = 0;
+static SemaphoreHandle_t s_lock = nullptr;
+
+// 件数 (ロック内で数える)
+static uint32_t s_committed = 0;
+static uint32_t s_evicted = 0;
+static uint32_t s_truncated = 0;
+static uint32_t s_dropped = 0;          // プールがない・エントリが空かなかった
+static uint32_t s_pages_read = 0;
+static uint32_t s_corrupt = 0;
+
+void request_detail_init(void) {
+    if (s_lock) return;
+    s_lock = xSemaphoreCreateMutex();
+
+    size_t bytes = (size_t)BLOCKS * POOL_BYTES_PER_BLOCK;
+    uint32_t caps = Board::DETAIL_IN_PSRAM ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    uint8_t* pool = (uint8_t*)heap_caps_malloc(bytes, caps);
+    if (!pool) {
+        ESP_LOGW(TAG, "Detail pool (%u bytes) not allocated; requests keep only the summary", (unsigned)bytes);
+        return;
+    }
+    s_next = (uint16_t*)(pool + (size_t)BLOCKS * DETAIL_BLOCK_LEN);
+    for (int i = 0; i < BLOCKS; i++) s_next[i] = i + 1 < BLOCKS ? (uint16_t)(i + 1) : BLOCK_NONE;
+    s_free_head = 0;
+    s_free_blocks = BLOCKS;
+    s_in_psram = Board::DETAIL_IN_PSRAM;
+    s_pool = pool;
+    ESP_LOGI(TAG, "Detail pool: %d x %d bytes (%s)", BLOCKS, DETAIL_BLOCK_LEN,
+             s_in_psram ? "PSRAM" : "internal");
+}
+
+// ── ブロックのチェーン (ロック内) ──
+
+static uint16_t chain_alloc(int n) {
+    uint16_t head = s_free_head;
+    uint16_t b = head;
+    for (int i = 1; i < n; i++) b = s_next[b];
+    s_free_head = s_next[b];
+    s_next[b] = BLOCK_NONE;
+    s_free_blocks -= n;
+    return head;
+}
+
+static void chain_free(uint16_t head) {
+    while (head != BLOCK_NONE) {
+        uint16_t next = s_next[head];
+        s_next[head] = s_free_head;
+        s_free_head = head;
+        s_free_blocks++;
+        head = next;
+    }
+}
+
+// チェーンの off バイト目から len バイトを書く / 読む
+static void chain_copy(uint16_t head, size_t off, uint8_t* data, size_t len, bool write) {
+    uint16_t b = head;
+    while (off >= DETAIL_BLOCK_LEN) {
+        b = s_next[b];
+        off -= DETAIL_BLOCK_LEN;
+    }
+    while (len > 0) {
+        size_t n = DETAIL_BLOCK_LEN - off;
+        if (n > len) n = len;
+        uint8_t* block = s_pool + (size_t)b * DETAIL_BLOCK_LEN + off;
+        if (write) memcpy(block, data, n);
+        else memcpy(data, block, n);
+        data += n;
+        len -= n;
+        off = 0;
+        b = s_next[b];
+    }
+}
+
+static void entry_free(DetailEntry* e) {
+    for (int i = 0; i < e->page_count; i++) chain_free(e->pages[i]);
+    memset(e, 0, sizeof(*e));
+}
+
+// 確定済みで最も古い詳細を追い出す。追い出せるものがなければ false
+static bool evict_oldest(void) {
+    DetailEntry* victim = nullptr;
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        DetailEntry* e = &s_entries[i];
+        if (!e->id[0]) continue;
+        if (!victim || e->seq < victim->seq) victim = e;
+    }
+    if (!victim) return false;
+    ESP_LOGD(TAG, "Evicting detail %s", victim->id);
+    entry_free(victim);
+    s_evicted++;
+    return true;
+}
+
+static DetailEntry* find_entry(const char* id) {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        if (s_entries[i].id[0] && strcmp(s_entries[i].id, id) == 0) return &s_entries[i];
+    }
+    return nullptr;
+}
+
+// ── 書き込み ──
+
+void request_detail_begin(DetailWriter* w) {
+    w->entry = -1;
+    w->len = 0;
+    if (!s_pool) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int pass = 0; pass < 2 && w->entry < 0; pass++) {
+        for (int i = 0; i < MAX_REQUESTS; i++) {
+            DetailEntry* e = &s_entries[i];
+            if (e->id[0] || e->writing) continue;
+            memset(e, 0, sizeof(*e));
+            e->writing = true;
+            w->entry = i;
+            break;
+        }
+        // 全部埋まっていたら最も古いものを追い出してもう一度
+        if (w->entry < 0 && !evict_oldest()) break;
+    }
+    if (w->entry < 0) s_dropped++;
+    xSemaphoreGive(s_lock);
+}
+
+// 末尾で切れている UTF-8 の文字の手前までの長さ (切れた文字は次のページに回す)
+static size_t utf8_cut(const char* s, size_t len) {
+    for (size_t back = 1; back <= 3 && back <= len; back++) {
+        uint8_t c = (uint8_t)s[len - back];
+        if ((c & 0xc0) == 0x80) continue;
+        size_t need = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+        return need > back ? len - back : len;
+    }
+    return len;
+}
+
+// page の先頭 n バイトを圧縮してエントリの次のページにする (圧縮はロックの外)
+static void store_page(DetailWriter* w, size_t n) {
+    DetailEntry* e = &s_entries[w->entry];
+    size_t clen = lz_compress((const uint8_t*)w->page, n, w->out, sizeof(w->out), w->table,
+                              (const uint8_t*)DETAIL_DICT, DETAIL_DICT_LEN);
+    bool raw = clen == 0 || clen >= n;
+    const uint8_t* data = raw ? (const uint8_t*)w->page : w->out;
+    size_t dlen = raw ? n : clen;
+    int need = (int)((2 + dlen + DETAIL_BLOCK_LEN - 1) / DETAIL_BLOCK_LEN);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!e->truncated && e->page_count == DETAIL_MAX_PAGES) {
+        e->truncated = true;
+    }
+    while (!e->truncated && s_free_blocks < need) {
+        if (!evict_oldest()) e->truncated = true;
+    }
+    if (e->truncated) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    uint16_t head = chain_alloc(need);
+    uint8_t header[2] = { (uint8_t)(dlen & 0xff), (uint8_t)((dlen >> 8) | (raw ? STORED_RAW >> 8 : 0)) };
+    chain_copy(head, 0, header, sizeof(header), true);
+    chain_copy(head, sizeof(header), (uint8_t*)data, dlen, true);
+    e->pages[e->page_count++] = head;
+    e->raw_len += n;
+    e->stored_len += 2 + dlen;
+    e->blocks += need;
+    xSemaphoreGive(s_lock);
+}
+
+void request_detail_write(DetailWriter* w, const char* data, size_t len) {
+    if (!w || w->entry < 0) return;
+    while (len > 0) {
+        size_t n = DETAIL_PAGE_LEN - w->len;
+        if (n > len) n = len;
+        memcpy(w->page + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+        if (w->len < DETAIL_PAGE_LEN) break;
+
+        if (s_entries[w->entry].truncated) {
+            w->len = 0;
+            continue;
+        }
+        size_t cut = utf8_cut(w->page, w->len);
+        if (cut == 0) cut = w->len;     // 文字になっていないバイト列はそのまま切る
+        store_page(w, cut);
+        memmove(w->page, w->page + cut, w->len - cut);
+        w->len -= cut;
+    }
+}
+
+void request_detail_puts(DetailWriter* w, const char* s) {
+    if (s) request_detail_write(w, s, strlen(s));
+}
+
+void request_detail_commit(DetailWriter* w, const char* id) {
+    if (!w || w->entry < 0) return;
+    if (w->len > 0 && !s_entries[w->entry].truncated) store_page(w, w->len);
+    w->len = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    DetailEntry* e = &s_entries[w->entry];
+    if (e->truncated) s_truncated++;
+    if (e->page_count == 0) {
+        entry_free(e);
+    } else {
+        strncpy(e->id, id, sizeof(e->id) - 1);
+        e->id[sizeof(e->id) - 1] = '\0';
+        e->seq = ++s_seq;
+        e->writing = false;
+        s_committed++;
+    }
+    xSemaphoreGive(s_lock);
+    w->entry = -1;
+}
+
+void request_detail_abort(DetailWriter* w) {
+    if (!w || w->entry < 0) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry_free(&s_entries[w->entry]);
+    xSemaphoreGive(s_lock);
+    w->entry = -1;
+    w->len = 0;
+}
+
+void request_detail_drop(const char* id) {
+    if (!s_pool || !id[0]) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    DetailEntry* e = find_entry(id);
+    if (e) entry_free(e);
+    xSemaphoreGive(s_lock);
+}
+
+// ── 読み出し ──
+
+bool request_detail_info(const char* id, DetailInfo* out) {
+    if (!s_pool) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const DetailEntry* e = find_entry(id);
+    if (e) {
+        out->raw_len = e->raw_len;
+        out->stored_len = e->stored_len;
+        out->pool_len = e->blocks * POOL_BYTES_PER_BLOCK;
+        out->pages = e->page_count;
+        out->truncated = e->truncated;
+    }
+    xSemaphoreGive(s_lock);
+    return e != nullptr;
+}
+
+int request_detail_read_page(const char* id, int page, char* out, size_t cap) {
+    if (!s_pool || cap < DETAIL_READ_LEN) return -1;
+
+    // 圧縮データをロック内で展開先の後ろに写し、展開はロックの外で行う
+    uint8_t* tmp = (uint8_t*)out + DETAIL_PAGE_LEN + 1;
+    size_t dlen = 0;
+    bool raw = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const DetailEntry* e = find_entry(id);
+    if (!e || page < 0 || page >= e->page_count) {
+        xSemaphoreGive(s_lock);
+        return -1;
+    }
+    uint8_t header[2];
+    chain_copy(e->pages[page], 0, header, sizeof(header), false);
+    uint16_t stored = (uint16_t)(header[0] | header[1] << 8);
+    raw = (stored & STORED_RAW) != 0;
+    dlen = stored & ~STORED_RAW;
+    if (dlen <= LZ_BOUND(DETAIL_PAGE_LEN)) chain_copy(e->pages[page], sizeof(header), tmp, dlen, false);
+    s_pages_read++;
+    xSemaphoreGive(s_lock);
+
+    int n;
+    if (dlen > LZ_BOUND(DETAIL_PAGE_LEN) || (raw && dlen > DETAIL_PAGE_LEN)) {
+        n = -1;
+    } else if (raw) {
+        memcpy(out, tmp, dlen);
+        n = (int)dlen;
+    } else {
+        n = lz_decompress(tmp, dlen, (uint8_t*)out, DETAIL_PAGE_LEN, (const uint8_t*)DETAIL_DICT, DETAIL_DICT_LEN);
+    }
+    if (n < 0) {
+        ESP_LOGE(TAG, "Detail %s page %d is corrupt", id, page);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_corrupt++;
+        xSemaphoreGive(s_lock);
+        return -1;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+cJSON* request_detail_stats_to_json(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "enabled", s_pool != nullptr);
+    if (!s_pool) return root;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int stored = 0;
+    uint32_t raw_bytes = 0;
+    uint32_t stored_bytes = 0;
+    uint32_t pool_bytes = 0;
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        const DetailEntry* e = &s_entries[i];
+        if (!e->id[0]) continue;
+        stored++;
+        raw_bytes += e->raw_len;
+        stored_bytes += e->stored_len;
+        pool_bytes += e->blocks * POOL_BYTES_PER_BLOCK;
+    }
+    cJSON_AddBoolToObject(root, "psram", s_in_psram);
+    cJSON_AddNumberToObject(root, "block_len", DETAIL_BLOCK_LEN);
+    cJSON_AddNumberToObject(root, "blocks", BLOCKS);
+    cJSON_AddNumberToObject(root, "free_blocks", s_free_blocks);
+    cJSON_AddNumberToObject(root, "stored", stored);
+    cJSON_AddNumberToObject(root, "raw_bytes", raw_bytes);
+    cJSON_AddNumberToObject(root, "stored_bytes", stored_bytes);
+    cJSON_AddNumberToObject(root, "pool_bytes", pool_bytes);
+    // 展開後 / 実際に使っているプール (x100 の整数を 2 桁の小数にする)
+    cJSON_AddNumberToObject(root, "ratio", pool_bytes ? (raw_bytes * 100 / pool_bytes) / 100.0 : 0);
+    cJSON_AddNumberToObject(root, "committed", s_committed);
+    cJSON_AddNumberToObject(root, "evicted", s_evicted);
+    cJSON_AddNumberToObject(root, "truncated", s_truncated);
+    cJSON_AddNumberToObject(root, "dropped", s_dropped);
+    cJSON_AddNumberToObject(root, "pages_read", s_pages_read);
+    cJSON_AddNumberToObject(root, "corrupt", s_corrupt);
+    xSemaphoreGive(s_lock);
+    return root;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cJSON.h>
+#include "request_store.h"
+#include "lz_codec.h"
+
+// リクエストの詳細: tool_input とプロンプトの全文をページ単位に圧縮して、全リクエスト共有のプールに持つ
+//
+// 本文 (PermissionRequest::message) は一覧と画面のための要約で MESSAGE_LEN で切れる。
+// 詳細は作成時にボディを "key: value" の行に書き出したもので、DETAIL_PAGE_LEN ごとに独立に圧縮する
+// (どのページも単独で展開できる)。読む側 (画面の詳細表示・GET /permission-request/:id/detail) は
+// 表示・送信するページだけを展開する。
+//
+// 圧縮は全ページ共通の辞書 (キー名・よく出るコマンドやコードの断片) を前に置いて一致を探す。
+// プールの使用量はコマンド・ソースコードで平文の 5〜8 割程度 (bench_detail.cpp。数分の 1 にはならない)。
+//
+// プール (Board::DETAIL_POOL_SIZE) は DETAIL_BLOCK_LEN のブロックを連結リストでつなぐので断片化しない。
+// 足りなければ確定の古い詳細から追い出し、1 件がプールに収まらなければ入ったページまでで切る (truncated)。
+// リクエストがストアから消えたら request_store が request_detail_drop で解放する
+
+#define DETAIL_PAGE_LEN 1024        // 展開後の 1 ページ (UTF-8 の文字の途中では切らない)
+#define DETAIL_MAX_PAGES 16         // 1 件の上限 (超えた分は truncated)
+#define DETAIL_BLOCK_LEN 64         // プールの割り当て単位
+
+// request_detail_read_page の出力バッファの大きさ (展開先 + NUL + 圧縮データの一時置き場)
+#define DETAIL_READ_LEN (DETAIL_PAGE_LEN + 1 + LZ_BOUND(DETAIL_PAGE_LEN))
+
+// 1 件の詳細。各ページはブロックのチェーンで、先頭 2 バイトに格納長 (最上位ビット = 無圧縮)
+struct DetailEntry {
+    char id[UUID_STR_LEN];      // 空 = 未使用 (書き込み中も空)
+    bool writing;
+    bool truncated;
+    uint8_t page_count;
+    uint32_t seq;               // 確定した順 (古いものから追い出す)
+    uint32_t raw_len;           // 展開後の長さの合計
+    uint32_t stored_len;        // 格納長の合計 (ページの頭 2 バイトを含む)
+    uint16_t blocks;            // 使っているプールのブロック数 (ページごとにブロック単位に切り上げる)
+    uint16_t pages[DETAIL_MAX_PAGES];   // 各ページの先頭ブロック
+};
+
+// 作成ハンドラが組み立て中の詳細 (呼び出し側のアリーナに置く)
+// ページが埋まるたびに圧縮してプールへ移すので、詳細全体を平文で持つ領域は要らない
+struct DetailWriter {
+    int entry;                  // 書き込み先 (-1 = プールがない・空きがなく捨てる)
+    size_t len;                 // page に溜まっているバイト数
+    char page[DETAIL_PAGE_LEN];
+    uint16_t table[LZ_HASH_SIZE];
+    uint8_t out[LZ_BOUND(DETAIL_PAGE_LEN)];
+};
+
+struct DetailInfo {
+    uint32_t raw_len;
+    uint32_t stored_len;        // 圧縮後 (ページの頭を含む)
+    uint32_t pool_len;          // 実際に使っているプール (ブロック + 連結リストの分)
+    uint8_t pages;
+    bool truncated;
+};
+
+// プールを確保する (起動時に 1 回。確保できなければ詳細を持たず、本文の要約だけになる)
+void request_detail_init(void);
+
+// 書き込みを始める (確定・破棄するまでエントリを押さえる)
+void request_detail_begin(DetailWriter* w);
+
+// 書き足す (w が nullptr なら何もしない)
+void request_detail_write(DetailWriter* w, const char* data, size_t len);
+void request_detail_puts(DetailWriter* w, const char* s);
+
+// 残りのページを圧縮して id の詳細として確定する / 書いたページを捨てる
+void request_detail_commit(DetailWriter* w, const char* id);
+void request_detail_abort(DetailWriter* w);
+
+// id の詳細を解放する (ストアから消えたとき。request_store のロック内から呼ばれる)
+void request_detail_drop(const char* id);
+
+// ページ数と長さ。なければ false
+bool request_detail_info(const char* id, DetailInfo* out);
+
+// ページ page を out に展開して NUL 終端する (cap は DETAIL_READ_LEN 以上)
+// 戻り値: 展開したバイト数 (-1 = 詳細・ページがない、壊れている)
+int request_detail_read_page(const char* id, int page, char* out, size_t cap);
+
+// プールの使用量・圧縮率・追い出しの件数 (GET /stats 用)
+cJSON* request_detail_stats_to_json(void);
@@ -0,0 +1,97 @@
+#include "request_json.h"
+
+cJSON* request_to_json(const PermissionRequest* r) {
+    cJSON* item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "id", r->id);
+    cJSON_AddStringToObject(item, "tool_name", r->tool_name);
+    cJSON_AddStringToObject(item, "message", r->message);
+
+    if (r->choice_count > 0) {
+        cJSON* choices = cJSON_CreateArray();
+        for (int j = 0; j < r->choice_count; j++) {
+            cJSON* c = cJSON_CreateObject();
+            cJSON_AddNumberToObject(c, "number", r->choices[j].number);
+            cJSON_AddStringToObject(c, "text", r->choices[j].text);
+            cJSON_AddItemToArray(choices, c);
+        }
+        cJSON_AddItemToObject(item, "choices", choices);
+    } else {
+        cJSON_AddNullToObject(item, "choices");
+    }
+
+    cJSON_AddNumberToObject(item, "created_at", (double)r->created_at);
+    cJSON_AddNumberToObject(item, "expires_at", (double)r->expires_at);
+
+    if (r->response[0] != '\0') {
+        cJSON_AddStringToObject(item, "response", r->response);
+        cJSON_AddNumberToObject(item, "responded_at", (double)r->responded_at);
+    } else {
+        cJSON_AddNullToObject(item, "response");
+        cJSON_AddNullToObject(item, "responded_at");
+    }
+
+    if (r->send_key[0] != '\0') {
+        cJSON_AddStringToObject(item, "send_key", r->send_key);
+    } else {
+        cJSON_AddNullToObject(item, "send_key");
+    }
+
+    if (r->hostname[0] != '\0') {
+        cJSON_AddStringToObject(item, "hostname", r->hostname);
+    } else {
+        cJSON_AddNullToObject(item, "hostname");
+    }
+    return item;
+}
+
+cJSON* request_list_to_json(PermissionRequest* const* reqs, int count) {
+    cJSON* arr = cJSON_CreateArray();
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(arr, request_to_json(reqs[i]));
+    }
+    return arr;
+}
+
+void request_list_to_cbor(CborWriter* w, PermissionRequest* const* reqs, int count) {
+    cbor_put_array(w, count);
+    for (int i = 0; i < count; i++) {
+        const PermissionRequest* r = reqs[i];
+        bool responded = r->response[0] != '\0';
+        cbor_put_map(w, 10);
+        cbor_put_uint(w, CK_ID);
+        cbor_put_text(w, r->id);
+        cbor_put_uint(w, CK_TOOL_NAME);
+        cbor_put_text(w, r->tool_name);
+        cbor_put_uint(w, CK_MESSAGE);
+        cbor_put_text(w, r->message);
+        cbor_put_uint(w, CK_CHOICES);
+        if (r->choice_count > 0) {
+            cbor_put_array(w, r->choice_count);
+            for (int j = 0; j < r->choice_count; j++) {
+                cbor_put_map(w, 2);
+                cbor_put_uint(w, CK_NUMBER);
+                cbor_put_uint(w, r->choices[j].number);
+                cbor_put_uint(w, CK_TEXT);
+                cbor_put_text(w, r->choices[j].text);
+            }
+        } else {
+            cbor_put_null(w);
+        }
+        cbor_put_uint(w, CK_CREATED_AT);
+        cbor_put_int(w, r->created_at);
+        cbor_put_uint(w, CK_EXPIRES_AT);
+        cbor_put_int(w, r->expires_at);
+        cbor_put_uint(w, CK_RESPONSE);
+        cbor_put_text_or_null(w, r->response);
+        cbor_put_uint(w, CK_RESPONDED_AT);
+        if (responded) {
+            cbor_put_int(w, r->responded_at);
+        } else {
+            cbor_put_null(w);
+        }
+        cbor_put_uint(w, CK_SEND_KEY);
+        cbor_put_text_or_null(w, r->send_key);
+        cbor_put_uint(w, CK_HOSTNAME);
+        cbor_put_text_or_null(w, r->hostname);
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "request_store.h"
+#include "cbor.h"
+#include <cJSON.h>
+
+// serializeRequest (server/src/store.ts) と同じフィールド構成の JSON オブジェクトを作る
+// GET /permission-requests と /ws の update メッセージで共用
+cJSON* request_to_json(const PermissionRequest* r);
+
+// 全リクエストの JSON 配列 (created_at 降順)
+cJSON* request_list_to_json(PermissionRequest* const* reqs, int count);
+
+// 同じ一覧を CBOR (整数キー) で書き出す
+void request_list_to_cbor(CborWriter* w, PermissionRequest* const* reqs, int count);
@@ -0,0 +1,327 @@
+#include "request_parse.h"
+
+#include <cstring>
+#include <cstdio>
+
+// これより長い値と改行を含む値は "key:" の次の行から書く
+#define DETAIL_INLINE_MAX 48
+// CBOR の入れ子の値を JSON にするときの深さ (超えた分は null)
+#define DETAIL_CBOR_DEPTH 4
+
+// 詳細の 1 フィールド (value は文字列の値そのもの、または JSON の表記)
+static void detail_field(DetailWriter* w, const char* name, const char* value) {
+    if (!w) return;
+    if (!value) value = "null";
+    request_detail_puts(w, name && name[0] ? name : "?");
+    request_detail_puts(w, strchr(value, '\n') || strlen(value) > DETAIL_INLINE_MAX ? ":\n" : ": ");
+    request_detail_puts(w, value);
+    request_detail_puts(w, "\n");
+}
+
+// 文字列でない値はツリーをそのまま JSON にする (MultiEdit の edits など)
+static void detail_field_json(DetailWriter* w, const cJSON* item) {
+    if (!w) return;
+    if (cJSON_IsString(item)) {
+        detail_field(w, item->string, item->valuestring);
+        return;
+    }
+    char* text = cJSON_PrintUnformatted(item);
+    detail_field(w, item->string, text);
+    cJSON_free(text);
+}
+
+void parse_create_json(const cJSON* root, CreateFields* f, DetailWriter* detail) {
+    f->tool_name = cJSON_GetStringValue(cJSON_GetObjectItem(root, "tool_name"));
+    f->message = cJSON_GetStringValue(cJSON_GetObjectItem(root, "message"));
+    f->header = cJSON_GetStringValue(cJSON_GetObjectItem(root, "header"));
+    f->description = cJSON_GetStringValue(cJSON_GetObjectItem(root, "description"));
+    f->prompt_question = cJSON_GetStringValue(cJSON_GetObjectItem(root, "prompt_question"));
+    f->tmux_target = cJSON_GetStringValue(cJSON_GetObjectItem(root, "tmux_target"));
+    f->hostname = cJSON_GetStringValue(cJSON_GetObjectItem(root, "hostname"));
+
+    cJSON* has_tmux_json = cJSON_GetObjectItem(root, "has_tmux");
+    f->no_tmux = has_tmux_json && cJSON_IsFalse(has_tmux_json);
+
+    cJSON* tool_input_json = cJSON_GetObjectItem(root, "tool_input");
+    if (tool_input_json) {
+        f->has_tool_input = true;
+        f->command = cJSON_GetStringValue(cJSON_GetObjectItem(tool_input_json, "command"));
+        f->file_path = cJSON_GetStringValue(cJSON_GetObjectItem(tool_input_json, "file_path"));
+        const cJSON* item;
+        cJSON_ArrayForEach(item, tool_input_json) detail_field_json(detail, item);
+    }
+
+    cJSON* choices_json = cJSON_GetObjectItem(root, "choices");
+    if (cJSON_IsArray(choices_json)) {
+        int arr_size = cJSON_GetArraySize(choices_json);
+        for (int i = 0; i < arr_size && i < MAX_CHOICES; i++) {
+            cJSON* item = cJSON_GetArrayItem(choices_json, i);
+            cJSON* num = cJSON_GetObjectItem(item, "number");
+            cJSON* txt = cJSON_GetObjectItem(item, "text");
+            if (cJSON_IsNumber(num) && txt) {
+                Choice* c = &f->choices[f->choice_count];
+                c->number = (uint8_t)num->valueint;
+                const char* txt_str = cJSON_GetStringValue(txt);
+                if (txt_str) {
+                    strncpy(c->text, txt_str, sizeof(c->text) - 1);
+                }
+                f->choice_count++;
+            }
+        }
+    }
+
+    cJSON* timeout_json = cJSON_GetObjectItem(root, "timeout");
+    if (cJSON_IsNumber(timeout_json)) {
+        f->timeout_sec = timeout_json->valuedouble;
+    }
+}
+
+static bool parse_choice_cbor(CborReader* r, Choice* out) {
+    size_t n;
+    if (!cbor_get_map(r, &n)) return false;
+    bool has_number = false;
+    for (size_t i = 0; i < n; i++) {
+        int key;
+        if (!cbor_get_key(r, &key)) return false;
+        if (key == CK_NUMBER) {
+            int64_t v;
+            if (!cbor_get_int(r, &v)) return false;
+            out->number = (uint8_t)v;
+            has_number = true;
+        } else if (key == CK_TEXT) {
+            const char* t;
+            if (!cbor_get_text(r, &t)) return false;
+            if (t) strncpy(out->text, t, sizeof(out->text) - 1);
+        } else if (!cbor_skip(r)) {
+            return false;
+        }
+    }
+    return has_number;
+}
+
+static void put_json_string(DetailWriter* w, const char* s) {
+    request_detail_puts(w, "\"");
+    const char* run = s;
+    for (const char* p = s; *p; p++) {
+        uint8_t c = (uint8_t)*p;
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        request_detail_write(w, run, p - run);
+        run = p + 1;
+        char esc[8];
+        if (c == '\n') strcpy(esc, "\\n");
+        else if (c < 0x20) snprintf(esc, sizeof(esc), "\\u%04x", c);
+        else snprintf(esc, sizeof(esc), "\\%c", c);
+        request_detail_puts(w, esc);
+    }
+    request_detail_puts(w, run);
+    request_detail_puts(w, "\"");
+}
+
+// tool_input のキー (整数キーは対応表の名前)。*key は既知のキーなら CborKey
+static bool get_input_key(CborReader* r, int* key, const char** name) {
+    if (cbor_peek_type(r) != CBOR_TYPE_TEXT) {
+        if (!cbor_get_key(r, key)) return false;
+        *name = cbor_key_name(*key);
+        return true;
+    }
+    if (!cbor_get_text(r, name)) return false;
+    *key = CK_UNKNOWN;
+    for (int i = 0; i < CK_COUNT; i++) {
+        if (strcmp(*name, cbor_key_name(i)) == 0) {
+            *key = i;
+            break;
+        }
+    }
+    return true;
+}
+
+// CBOR の値を 1 つ読んで JSON の表記で書く (w が nullptr なら読み飛ばすだけ)
+static bool cbor_value_json(CborReader* r, DetailWriter* w, int depth) {
+    if (!w) return cbor_skip(r);
+    char num[32];
+    switch (cbor_peek_type(r)) {
+        case CBOR_TYPE_UINT:
+        case CBOR_TYPE_NEGINT: {
+            int64_t v;
+            if (!cbor_get_int(r, &v)) return false;
+            snprintf(num, sizeof(num), "%lld", (long long)v);
+            request_detail_puts(w, num);
+            return true;
+        }
+        case CBOR_TYPE_TEXT: {
+            const char* s;
+            if (!cbor_get_text(r, &s)) return false;
+            put_json_string(w, s);
+            return true;
+        }
+        case CBOR_TYPE_ARRAY:
+        case CBOR_TYPE_MAP: {
+            if (depth >= DETAIL_CBOR_DEPTH) {
+                request_detail_puts(w, "null");
+                return cbor_skip(r);
+            }
+            bool map = cbor_peek_type(r) == CBOR_TYPE_MAP;
+            size_t n;
+            if (!(map ? cbor_get_map(r, &n) : cbor_get_array(r, &n))) return false;
+            request_detail_puts(w, map ? "{" : "[");
+            for (size_t i = 0; i < n; i++) {
+                if (i > 0) request_detail_puts(w, ",");
+                if (map) {
+                    int key;
+                    const char* name;
+                    if (!get_input_key(r, &key, &name)) return false;
+                    put_json_string(w, name ? name : "?");
+                    request_detail_puts(w, ":");
+                }
+                if (!cbor_value_json(r, w, depth + 1)) return false;
+            }
+            request_detail_puts(w, map ? "}" : "]");
+            return true;
+        }
+        case CBOR_TYPE_SIMPLE: {
+            // false / true / null は 1 バイト、それ以外は浮動小数点
+            uint8_t b = *r->p;
+            if (b == 0xf4 || b == 0xf5) {
+                bool v;
+                if (!cbor_get_bool(r, &v)) return false;
+                request_detail_puts(w, v ? "true" : "false");
+                return true;
+            }
+            if (b == 0xf6) {
+                const char* s;
+                if (!cbor_get_text(r, &s)) return false;
+                request_detail_puts(w, "null");
+                return true;
+            }
+            double v;
+            if (!cbor_get_number(r, &v)) return false;
+            snprintf(num, sizeof(num), "%g", v);
+            request_detail_puts(w, num);
+            return true;
+        }
+        default:
+            request_detail_puts(w, "null");
+            return cbor_skip(r);
+    }
+}
+
+bool parse_create_cbor(CborReader* r, CreateFields* f, DetailWriter* detail) {
+    size_t n;
+    if (!cbor_get_map(r, &n)) return false;
+    for (size_t i = 0; i < n; i++) {
+        int key;
+        if (!cbor_get_key(r, &key)) return false;
+        bool ok = true;
+        switch (key) {
+            case CK_TOOL_NAME:       ok = cbor_get_text(r, &f->tool_name); break;
+            case CK_MESSAGE:         ok = cbor_get_text(r, &f->message); break;
+            case CK_HEADER:          ok = cbor_get_text(r, &f->header); break;
+            case CK_DESCRIPTION:     ok = cbor_get_text(r, &f->description); break;
+            case CK_PROMPT_QUESTION: ok = cbor_get_text(r, &f->prompt_question); break;
+            case CK_TMUX_TARGET:     ok = cbor_get_text(r, &f->tmux_target); break;
+            case CK_HOSTNAME:        ok = cbor_get_text(r, &f->hostname); break;
+            case CK_TIMEOUT:         ok = cbor_get_number(r, &f->timeout_sec); break;
+            case CK_HAS_TMUX: {
+                bool v;
+                ok = cbor_get_bool(r, &v);
+                f->no_tmux = ok && !v;
+                break;
+            }
+            case CK_TOOL_INPUT: {
+                size_t m;
+                ok = cbor_get_map(r, &m);
+                f->has_tool_input = ok;
+                for (size_t j = 0; ok && j < m; j++) {
+                    int sub;
+                    const char* name;
+                    ok = get_input_key(r, &sub, &name);
+                    if (!ok) break;
+                    if (cbor_peek_type(r) == CBOR_TYPE_TEXT) {
+                        const char* text;
+                        ok = cbor_get_text(r, &text);
+                        if (!ok) break;
+                        if (sub == CK_COMMAND) f->command = text;
+                        else if (sub == CK_FILE_PATH) f->file_path = text;
+                        detail_field(detail, name, text);
+                    } else if (detail) {
+                        request_detail_puts(detail, name ? name : "?");
+                        request_detail_puts(detail, ": ");
+                        ok = cbor_value_json(r, detail, 0);
+                        request_detail_puts(detail, "\n");
+                    } else {
+                        ok = cbor_skip(r);
+                    }
+                }
+                break;
+            }
+            case CK_CHOICES: {
+                size_t m;
+                ok = cbor_get_array(r, &m);
+                for (size_t j = 0; ok && j < m; j++) {
+                    if (f->choice_count < MAX_CHOICES) {
+                        Choice c = {};
+                        if (parse_choice_cbor(r, &c)) {
+                            f->choices[f->choice_count++] = c;
+                        }
+                        ok = !r->error;
+                    } else {
+                        ok = cbor_skip(r);
+                    }
+                }
+                break;
+            }
+            default:
+                ok = cbor_skip(r);
+                break;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// out の末尾に書き足す (満杯なら何もしない。out は常に NUL 終端されている)
+static void append_text(char* out, size_t out_len, const char* fmt, const char* s) {
+    size_t cur = strnlen(out, out_len - 1);
+    snprintf(out + cur, out_len - cur, fmt, s);
+}
+
+// detailText 構築 (index.ts ロジック移植)
+// 長い description / message は out_len - 1 で切る (snprintf で常に NUL 終端する)
+void build_detail_text(const CreateFields* f, const char* tool_display, char* out, size_t out_len) {
+    if (out_len == 0) return;
+    out[0] = '\0';
+    if (f->description && f->description[0]) {
+        snprintf(out, out_len, "%s", f->description);
+    } else if (f->has_tool_input) {
+        if (f->command && f->command[0]) {
+            snprintf(out, out_len, "$ %s", f->command);
+        } else if (f->file_path && f->file_path[0]) {
+            snprintf(out, out_len, "%s", f->file_path);
+        } else if (f->message && f->message[0]) {
+            snprintf(out, out_len, "%s", f->message);
+        } else {
+            snprintf(out, out_len, "%s の実行を許可しますか？", tool_display);
+        }
+    } else if (f->message && f->message[0]) {
+        snprintf(out, out_len, "%s", f->message);
+    } else {
+        snprintf(out, out_len, "%s の実行を許可しますか？", tool_display);
+    }
+
+    // prompt_question 追加
+    if (f->prompt_question && f->prompt_question[0]) {
+        append_text(out, out_len, "\n%s", f->prompt_question);
+    }
+
+    // 非 tmux の注記
+    if (f->no_tmux) {
+        append_text(out, out_len, "\n%s", "⚠ tmux未経由");
+    }
+}
+
+void build_detail_context(const CreateFields* f, DetailWriter* detail) {
+    if (!detail) return;
+    if (f->description && f->description[0]) detail_field(detail, "description", f->description);
+    if (f->prompt_question && f->prompt_question[0]) detail_field(detail, "prompt_question", f->prompt_question);
+    if (f->message && f->message[0]) detail_field(detail, "message", f->message);
+}
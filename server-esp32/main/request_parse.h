@@ -0,0 +1,40 @@
+#pragma once
+
+#include "request_store.h"
+#include "cbor.h"
+#include "request_detail.h"
+#include <cJSON.h>
+
+// POST /permission-request のボディから取り出すフィールド
+// 文字列はボディバッファ (CBOR) または cJSON ツリー内を指す
+struct CreateFields {
+    const char* tool_name;
+    const char* message;
+    const char* header;
+    const char* description;
+    const char* prompt_question;
+    const char* tmux_target;
+    const char* hostname;
+    const char* command;
+    const char* file_path;
+    bool has_tool_input;
+    bool no_tmux;               // has_tmux: false が明示された
+    Choice choices[MAX_CHOICES];
+    uint8_t choice_count;
+    double timeout_sec;
+};
+
+// JSON ボディ (cJSON ツリー) からフィールドを取り出す
+// detail を渡すと tool_input の全フィールドを "key: value" の行で書き出す
+void parse_create_json(const cJSON* root, CreateFields* f, DetailWriter* detail = nullptr);
+
+// CBOR ボディからフィールドを取り出す (文字列は r のバッファを直接指す)
+// 文字列はその場で NUL 終端されて読み直せないので、詳細 (detail) も読みながら書き出す
+// 戻り値: false = 不正な CBOR
+bool parse_create_cbor(CborReader* r, CreateFields* f, DetailWriter* detail = nullptr);
+
+// 画面・一覧に出す本文 (detailText) を組み立てる
+void build_detail_text(const CreateFields* f, const char* tool_display, char* out, size_t out_len);
+
+// 詳細の tool_input の後ろにプロンプトの文脈 (description・prompt_question・message) を書き足す
+void build_detail_context(const CreateFields* f, DetailWriter* detail);
@@ -1,4 +1,8 @@
 #include "request_store.h"
+#include "cbor.h"
+#include "decision_history.h"
+#include "request_detail.h"
+#include "deferred_log.h"
 
 #include <cstring>
 #include <cstdio>
@@ -6,13 +10,24 @@
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <esp_random.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <cJSON.h>
 
 static const char* TAG = "store";
 
 static const int64_t PENDING_TIMEOUT_MS = 120 * 1000;  // 120秒で expired
 static const int64_t CLEANUP_AGE_MS = 5 * 60 * 1000;   // 5分で削除
 
+#define MAX_LISTENERS 4
+
 static PermissionRequest s_requests[MAX_REQUESTS];
+static SemaphoreHandle_t s_lock = nullptr;
+// 反映中のスナップショットに含まれたミラーのスロット (prune で 0 に戻す)
+static uint32_t s_mirror_seen = 0;
+static_assert(MAX_REQUESTS <= 32, "s_mirror_seen holds one bit per slot");
+static RequestStoreListener s_listeners[MAX_LISTENERS];
+static int s_listener_count = 0;
 
 static int64_t now_ms(void) {
     return esp_timer_get_time() / 1000;
@@ -34,11 +49,83 @@ void generate_uuid_v4(char* out) {
         bytes[10], bytes[11], bytes[12], bytes[13], bytes[14], bytes[15]);
 }
 
+static void notify_changed(void) {
+    for (int i = 0; i < s_listener_count; i++) {
+        s_listeners[i]();
+    }
+}
+
+bool request_store_add_listener(RequestStoreListener listener) {
+    if (s_listener_count >= MAX_LISTENERS) return false;
+    s_listeners[s_listener_count++] = listener;
+    return true;
+}
+
+void request_store_lock(void) {
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+}
+
+void request_store_unlock(void) {
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+// スコープを抜けるときに解放するロック
+struct StoreLock {
+    StoreLock() { request_store_lock(); }
+    ~StoreLock() { request_store_unlock(); }
+};
+
 void request_store_init(void) {
+    s_lock = xSemaphoreCreateRecursiveMutex();
     memset(s_requests, 0, sizeof(s_requests));
+    decision_history_init();
     ESP_LOGI(TAG, "Request store initialized (max %d slots)", MAX_REQUESTS);
 }
 
+// ポーリング応答の本文を JSON / CBOR の両方で作り直す
+// フックは毎秒ポーリングするので、ハンドラはこのバイト列を送るだけにする
+static void render_poll_response(PermissionRequest* req) {
+    bool responded = req->response[0] != '\0';
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "id", req->id);
+    if (responded) {
+        cJSON_AddStringToObject(root, "response", req->response);
+        cJSON_AddNumberToObject(root, "responded_at", (double)req->responded_at);
+        if (req->send_key[0] != '\0') {
+            cJSON_AddStringToObject(root, "send_key", req->send_key);
+        } else {
+            cJSON_AddNullToObject(root, "send_key");
+        }
+    } else {
+        cJSON_AddNullToObject(root, "response");
+        cJSON_AddNullToObject(root, "responded_at");
+        cJSON_AddNullToObject(root, "send_key");
+    }
+    bool ok = cJSON_PrintPreallocated(root, req->poll_json, sizeof(req->poll_json), false);
+    req->poll_json_len = ok ? strlen(req->poll_json) : 0;
+    cJSON_Delete(root);
+
+    CborWriter w;
+    cbor_writer_init(&w, req->poll_cbor, sizeof(req->poll_cbor));
+    cbor_put_map(&w, 4);
+    cbor_put_uint(&w, CK_ID);
+    cbor_put_text(&w, req->id);
+    cbor_put_uint(&w, CK_RESPONSE);
+    cbor_put_text_or_null(&w, req->response);
+    cbor_put_uint(&w, CK_RESPONDED_AT);
+    if (responded) {
+        cbor_put_int(&w, req->responded_at);
+    } else {
+        cbor_put_null(&w);
+    }
+    cbor_put_uint(&w, CK_SEND_KEY);
+    cbor_put_text_or_null(&w, responded ? req->send_key : nullptr);
+    req->poll_cbor_len = w.error ? 0 : w.len;
+
+    if (!ok || w.error) ESP_LOGE(TAG, "Poll response for %s does not fit", req->id);
+}
+
 // 同じ tmux ペインの未応答リクエストをキャンセル
 static void cancel_pending_by_target(const char* tmux_target) {
     if (!tmux_target || tmux_target[0] == '\0') return;
@@ -49,7 +136,9 @@ static void cancel_pending_by_target(const char* tmux_target) {
             strcmp(r->tmux_target, tmux_target) == 0) {
             strncpy(r->response, "cancelled", sizeof(r->response) - 1);
             r->responded_at = ts;
-            ESP_LOGI(TAG, "Auto-cancelled %s (same tmux target)", r->id);
+            render_poll_response(r);
+            decision_history_record(r, DECISION_AUTO);
+            dlog(DL_STORE_AUTO_CANCELLED, r->id);
         }
     }
 }
@@ -58,9 +147,79 @@ static void expire_if_stale(PermissionRequest* req) {
     if (req->response[0] == '\0' && now_ms() > req->expires_at) {
         strncpy(req->response, "expired", sizeof(req->response) - 1);
         req->responded_at = now_ms();
+        render_poll_response(req);
+        decision_history_record(req, DECISION_AUTO);
+        notify_changed();
     }
 }
 
+// 書き込み先スロットを確保 (空き → 最古の応答済み → 同じホストの最古の未応答)
+// ホストの未応答が MAX_PENDING_PER_HOST 件に達していれば、空きより先にそのホストの最古のものを使う。
+// 他のホストの未応答とミラーの未応答は追い出さない (置き換えられるものがなければ nullptr)
+static PermissionRequest* acquire_slot(const char* hostname) {
+    const char* host = hostname ? hostname : "";
+    int own_pending = 0;
+    PermissionRequest* own_oldest = nullptr;
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        PermissionRequest* r = &s_requests[i];
+        if (!r->active || r->mirrored || r->response[0] != '\0') continue;
+        if (strncmp(r->hostname, host, sizeof(r->hostname) - 1) != 0) continue;
+        own_pending++;
+        if (!own_oldest || r->created_at < own_oldest->created_at) own_oldest = r;
+    }
+
+    PermissionRequest* slot = nullptr;
+    if (own_pending < MAX_PENDING_PER_HOST) {
+        // 空きスロットを探す
+        for (int i = 0; i < MAX_REQUESTS; i++) {
+            if (!s_requests[i].active) {
+                slot = &s_requests[i];
+                break;
+            }
+        }
+        if (!slot) {
+            // 最も古い応答済みリクエストを上書き
+            int64_t oldest = INT64_MAX;
+            for (int i = 0; i < MAX_REQUESTS; i++) {
+                if (s_requests[i].response[0] != '\0' && s_requests[i].created_at < oldest) {
+                    oldest = s_requests[i].created_at;
+                    slot = &s_requests[i];
+                }
+            }
+        }
+    }
+    if (!slot && own_oldest) {
+        // 未応答のまま消えるので履歴に残す
+        slot = own_oldest;
+        decision_history_record(slot, DECISION_AUTO);
+        dlog(DL_STORE_HOST_CAPPED, slot->id, host, own_pending);
+    }
+    if (!slot) {
+        ESP_LOGW(TAG, "Request store full of other hosts' pending requests, rejecting %s", host);
+        return nullptr;
+    }
+    // 上書きするリクエストの詳細を解放する
+    if (slot->active) request_detail_drop(slot->id);
+    return slot;
+}
+
+// ミラーの書き込み先 (空き → 最古のミラーの応答済み)。ローカルのリクエストと、
+// 同じスナップショットで反映済みのミラーは使わない (スナップショットごとに入れ替わり続けないように)
+static PermissionRequest* acquire_mirror_slot(void) {
+    PermissionRequest* slot = nullptr;
+    int64_t oldest = INT64_MAX;
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        PermissionRequest* r = &s_requests[i];
+        if (!r->active) return r;
+        if (s_mirror_seen & (1u << i)) continue;
+        if (r->mirrored && r->response[0] != '\0' && r->created_at < oldest) {
+            oldest = r->created_at;
+            slot = r;
+        }
+    }
+    return slot;
+}
+
 PermissionRequest* request_store_create(
     const char* tool_name,
     const char* message,
@@ -70,38 +229,12 @@ PermissionRequest* request_store_create(
     const char* hostname,
     int64_t timeout_ms
 ) {
+    StoreLock lock;
     // 同じ tmux ペインからの未応答リクエストをキャンセル
     cancel_pending_by_target(tmux_target);
 
-    // 空きスロットを探す
-    PermissionRequest* slot = nullptr;
-    for (int i = 0; i < MAX_REQUESTS; i++) {
-        if (!s_requests[i].active) {
-            slot = &s_requests[i];
-            break;
-        }
-    }
-    if (!slot) {
-        // 最も古い応答済みリクエストを上書き
-        int64_t oldest = INT64_MAX;
-        for (int i = 0; i < MAX_REQUESTS; i++) {
-            if (s_requests[i].response[0] != '\0' && s_requests[i].created_at < oldest) {
-                oldest = s_requests[i].created_at;
-                slot = &s_requests[i];
-            }
-        }
-    }
-    if (!slot) {
-        ESP_LOGW(TAG, "Request store full, dropping oldest");
-        // 最も古いものを上書き
-        int64_t oldest = INT64_MAX;
-        for (int i = 0; i < MAX_REQUESTS; i++) {
-            if (s_requests[i].created_at < oldest) {
-                oldest = s_requests[i].created_at;
-                slot = &s_requests[i];
-            }
-        }
-    }
+    PermissionRequest* slot = acquire_slot(hostname);
+    if (!slot) return nullptr;
 
     memset(slot, 0, sizeof(PermissionRequest));
     slot->active = true;
@@ -123,39 +256,59 @@ PermissionRequest* request_store_create(
     // タイムアウト: フックから指定された値を優先、なければデフォルト
     slot->expires_at = now + (timeout_ms > 0 ? timeout_ms : PENDING_TIMEOUT_MS);
 
-    ESP_LOGI(TAG, "Created request %s: %s", slot->id, slot->tool_name);
+    render_poll_response(slot);
+
+    dlog(DL_STORE_CREATED, slot->id, slot->tool_name);
+    notify_changed();
     return slot;
 }
 
-PermissionRequest* request_store_get(const char* id) {
+static PermissionRequest* find_by_id(const char* id) {
     for (int i = 0; i < MAX_REQUESTS; i++) {
         if (s_requests[i].active && strcmp(s_requests[i].id, id) == 0) {
-            expire_if_stale(&s_requests[i]);
             return &s_requests[i];
         }
     }
     return nullptr;
 }
 
-bool request_store_respond(const char* id, const char* response) {
+PermissionRequest* request_store_get(const char* id) {
+    StoreLock lock;
+    PermissionRequest* req = find_by_id(id);
+    if (req) expire_if_stale(req);
+    return req;
+}
+
+bool request_store_respond(const char* id, const char* response, const char* send_key,
+                           DecisionSource source) {
+    StoreLock lock;
     PermissionRequest* req = request_store_get(id);
     if (!req || req->response[0] != '\0') return false;
     strncpy(req->response, response, sizeof(req->response) - 1);
+    if (send_key) strncpy(req->send_key, send_key, sizeof(req->send_key) - 1);
     req->responded_at = now_ms();
-    ESP_LOGI(TAG, "Responded to %s: %s", id, response);
+    render_poll_response(req);
+    decision_history_record(req, source);
+    dlog(DL_STORE_RESPONDED, id, response);
+    notify_changed();
     return true;
 }
 
 bool request_store_cancel(const char* id) {
+    StoreLock lock;
     PermissionRequest* req = request_store_get(id);
     if (!req || req->response[0] != '\0') return false;
     strncpy(req->response, "cancelled", sizeof(req->response) - 1);
     req->responded_at = now_ms();
-    ESP_LOGI(TAG, "Cancelled %s", id);
+    render_poll_response(req);
+    decision_history_record(req, DECISION_HOOK);
+    dlog(DL_STORE_CANCELLED, id);
+    notify_changed();
     return true;
 }
 
 int request_store_get_all(PermissionRequest** out, int max_count) {
+    StoreLock lock;
     int count = 0;
     for (int i = 0; i < MAX_REQUESTS && count < max_count; i++) {
         if (s_requests[i].active) {
@@ -170,6 +323,16 @@ int request_store_get_all(PermissionRequest** out, int max_count) {
     return count;
 }
 
+int request_store_snapshot(PermissionRequest* out, int max_count) {
+    StoreLock lock;
+    PermissionRequest* reqs[MAX_REQUESTS];
+    int count = request_store_get_all(reqs, max_count < MAX_REQUESTS ? max_count : MAX_REQUESTS);
+    for (int i = 0; i < count; i++) {
+        out[i] = *reqs[i];
+    }
+    return count;
+}
+
 void request_store_resolve_send_key(PermissionRequest* req, const char* response, char* out_key, int out_key_len) {
     if (req->choice_count == 0) {
         // choices がない場合のフォールバック
@@ -202,16 +365,26 @@ void request_store_resolve_send_key(PermissionRequest* req, const char* response
 }
 
 void request_store_cleanup(void) {
+    StoreLock lock;
     int64_t cutoff = now_ms() - CLEANUP_AGE_MS;
+    bool removed = false;
     for (int i = 0; i < MAX_REQUESTS; i++) {
         if (s_requests[i].active && s_requests[i].created_at < cutoff) {
-            ESP_LOGI(TAG, "Cleaned up %s", s_requests[i].id);
+            // 応答済みは確定時に記録済み。未応答 (5 分を超えるタイムアウト) はここで残す
+            if (s_requests[i].response[0] == '\0') {
+                decision_history_record(&s_requests[i], DECISION_AUTO);
+            }
+            dlog(DL_STORE_CLEANED_UP, s_requests[i].id);
+            request_detail_drop(s_requests[i].id);
             s_requests[i].active = false;
+            removed = true;
         }
     }
+    if (removed) notify_changed();
 }
 
 void request_store_tick(void) {
+    StoreLock lock;
     // expire チェック + cleanup を定期的に実行
     static int64_t last_cleanup = 0;
     int64_t now = now_ms();
@@ -229,6 +402,7 @@ void request_store_tick(void) {
 }
 
 int request_store_pending_count(void) {
+    StoreLock lock;
     int count = 0;
     for (int i = 0; i < MAX_REQUESTS; i++) {
         if (s_requests[i].active && s_requests[i].response[0] == '\0') {
@@ -237,3 +411,76 @@ int request_store_pending_count(void) {
     }
     return count;
 }
+
+MirrorResult request_store_mirror(const PermissionRequest* src) {
+    StoreLock lock;
+    PermissionRequest* req = find_by_id(src->id);
+    if (req) {
+        // ローカル作成のリクエストとは ID 空間が別なので上書きしない
+        if (!req->mirrored) return MIRROR_UNCHANGED;
+        s_mirror_seen |= 1u << (req - s_requests);
+
+        bool changed = false;
+        bool decided = false;
+        if (req->response[0] == '\0' && src->response[0] != '\0') {
+            snprintf(req->response, sizeof(req->response), "%s", src->response);
+            req->responded_at = src->responded_at;
+            changed = decided = true;
+        }
+        if (req->send_key[0] == '\0' && src->send_key[0] != '\0') {
+            snprintf(req->send_key, sizeof(req->send_key), "%s", src->send_key);
+            changed = true;
+        }
+        if (!changed) return MIRROR_UNCHANGED;
+        render_poll_response(req);
+        if (decided) decision_history_record(req, DECISION_UPSTREAM);
+        notify_changed();
+        return MIRROR_UPDATED;
+    }
+
+    // ローカルで cleanup 済みの応答済みリクエストを復活させない
+    if (src->response[0] != '\0' && src->created_at < now_ms() - CLEANUP_AGE_MS) {
+        return MIRROR_UNCHANGED;
+    }
+
+    PermissionRequest* slot = acquire_mirror_slot();
+    if (!slot) {
+        ESP_LOGW(TAG, "No slot for mirrored request %s", src->id);
+        return MIRROR_NO_SLOT;
+    }
+    memcpy(slot, src, sizeof(PermissionRequest));
+    slot->active = true;
+    slot->mirrored = true;
+    s_mirror_seen |= 1u << (slot - s_requests);
+    render_poll_response(slot);
+    // 接続前に上流で確定していたもの
+    if (slot->response[0] != '\0') decision_history_record(slot, DECISION_UPSTREAM);
+
+    dlog(DL_STORE_MIRRORED, slot->id, slot->tool_name);
+    notify_changed();
+    return MIRROR_CREATED;
+}
+
+int request_store_prune_mirrored(const char* const* keep_ids, int keep_count) {
+    StoreLock lock;
+    int removed = 0;
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        PermissionRequest* r = &s_requests[i];
+        if (!r->active || !r->mirrored) continue;
+        bool keep = false;
+        for (int j = 0; j < keep_count; j++) {
+            if (strcmp(r->id, keep_ids[j]) == 0) {
+                keep = true;
+                break;
+            }
+        }
+        if (!keep) {
+            if (r->response[0] == '\0') decision_history_record(r, DECISION_UPSTREAM);
+            r->active = false;
+            removed++;
+        }
+    }
+    s_mirror_seen = 0;
+    if (removed > 0) notify_changed();
+    return removed;
+}
@@ -1,21 +1,30 @@
 #pragma once
 
 #include <cstdint>
+#include "board_profile.h"
 
-#define MAX_REQUESTS 8
+static constexpr int MAX_REQUESTS = Board::MAX_REQUESTS;   // 機種ごとのスロット数 (board_profile.h)
+// 1 ホスト (hostname) が同時に持てる未応答リクエスト数。超えた分は同じホストの最も古いものを置き換えるので、
+// 暴走したホストが何件送っても他のホストの未応答リクエストは追い出されない
+static constexpr int MAX_PENDING_PER_HOST = MAX_REQUESTS / 2;
+static_assert(MAX_PENDING_PER_HOST >= 1, "each host needs at least one pending slot");
 #define MAX_CHOICES 8
 #define UUID_STR_LEN 37
+#define POLL_JSON_MAX 160
+#define POLL_CBOR_MAX 96
 
 struct Choice {
     uint8_t number;
     char text[32];
 };
 
-struct PermissionRequest {
+// 本文の長さは機種ごと (B::MESSAGE_LEN)。機種ごとの大きさは board_budget.h で検査する
+template <class B>
+struct PermissionRequestFor {
     bool active;
     char id[UUID_STR_LEN];
     char tool_name[64];
-    char message[512];
+    char message[B::MESSAGE_LEN];
     char subtitle[64];
     uint8_t choice_count;
     Choice choices[MAX_CHOICES];
@@ -26,13 +35,55 @@ struct PermissionRequest {
     char response[16];          // "" / "allow" / "deny" / "cancelled" / "expired"
     int64_t responded_at;       // 0 = 未応答
     char send_key[8];
+    bool mirrored;              // 上流サーバ (Node.js) からミラーしたリクエスト
+
+    // GET /permission-request/:id/response の応答本文 (状態遷移時にだけ作り直す)
+    char poll_json[POLL_JSON_MAX];
+    uint8_t poll_json_len;
+    uint8_t poll_cbor[POLL_CBOR_MAX];
+    uint8_t poll_cbor_len;
+};
+
+using PermissionRequest = PermissionRequestFor<Board>;
+
+// 応答・キャンセルの出どころ (判断履歴に残す)
+enum DecisionSource : uint8_t {
+    DECISION_API,           // POST /permission-request/:id/respond (PWA など)
+    DECISION_BUTTON,        // 本体のボタン
+    DECISION_UPSTREAM,      // 上流サーバ (Node.js) でされた応答のミラー
+    DECISION_HOOK,          // POST /permission-request/:id/cancel (tmux での手動回答・タイムアウト)
+    DECISION_AUTO,          // ストアが自動で確定 (期限切れ・同じペインの新しいリクエスト)
+    DECISION_POLICY,        // 自動判断ポリシーのルールに一致 (policy.h)
+};
+
+// request_store_mirror の結果
+enum MirrorResult {
+    MIRROR_UNCHANGED,
+    MIRROR_UPDATED,
+    MIRROR_CREATED,
+    MIRROR_NO_SLOT,     // 空きも置き換えられるミラーもない (ローカルの未応答は追い出さない)
 };
 
+// 変更通知リスナ (作成・応答・キャンセル・期限切れ・削除で呼ばれる)
+// 変更したタスクのコンテキストで同期的に呼ばれるので、起床通知程度に留めること
+typedef void (*RequestStoreListener)(void);
+
 // 初期化
 void request_store_init(void);
 
+// 変更通知リスナを登録 (最大 4 個)
+bool request_store_add_listener(RequestStoreListener listener);
+
+// ストアのロック (再帰可)
+// 公開関数は内部でロックするが、返したポインタの複数フィールドを読む間は呼び出し側でロックする
+// ロック中にネットワーク送信や描画をしないこと (他のハンドラが待たされる)
+void request_store_lock(void);
+void request_store_unlock(void);
+
 // リクエスト作成 (cancelPendingByTarget 込み)
-// 戻り値: 作成されたリクエストへのポインタ (nullptr = 空きなし)
+// スロットは 空き → 最古の応答済み → 同じホストの最古の未応答 の順に使う。同じホストの未応答が
+// MAX_PENDING_PER_HOST 件あれば空きがあってもそのうち最古のものを置き換える
+// 戻り値: 作成されたリクエストへのポインタ (nullptr = 空きなし。他のホストの未応答は追い出さない)
 PermissionRequest* request_store_create(
     const char* tool_name,
     const char* message,
@@ -46,8 +97,9 @@ PermissionRequest* request_store_create(
 // ID でリクエスト取得 (expireIfStale 込み)
 PermissionRequest* request_store_get(const char* id);
 
-// 応答を記録
-bool request_store_respond(const char* id, const char* response);
+// 応答を記録 (send_key はターミナルに送るキー、nullptr = 未決定)
+bool request_store_respond(const char* id, const char* response, const char* send_key = nullptr,
+                           DecisionSource source = DECISION_API);
 
 // キャンセル
 bool request_store_cancel(const char* id);
@@ -56,10 +108,14 @@ bool request_store_cancel(const char* id);
 // 戻り値: 取得数
 int request_store_get_all(PermissionRequest** out, int max_count);
 
+// 全リクエストのコピーを取得 (created_at 降順)
+// ロックを保持せずにシリアライズ・送信したいときに使う
+int request_store_snapshot(PermissionRequest* out, int max_count);
+
 // send_key を決定
 void request_store_resolve_send_key(PermissionRequest* req, const char* response, char* out_key, int out_key_len);
 
-// 古いリクエストをクリーンアップ (5分超過で非アクティブ化)
+// 古いリクエストをクリーンアップ (5分超過で非アクティブ化、判断は decision_history に残る)
 void request_store_cleanup(void);
 
 // タイムアウトチェック (メインループから呼ぶ)
@@ -70,3 +126,15 @@ void generate_uuid_v4(char* out);
 
 // 未応答のリクエスト数を取得
 int request_store_pending_count(void);
+
+// 上流サーバのリクエストをミラー (id 一致なら更新、なければ作成)
+// src の時刻はローカル時刻 (boot 相対 ms) に変換済みであること
+// 応答は単調: ローカルで応答済みのものを未応答に戻さない
+// 新規は空きかミラーの応答済みのスロットにだけ入れる (ローカルのリクエストは追い出さない)
+MirrorResult request_store_mirror(const PermissionRequest* src);
+
+// keep_ids に含まれないミラー済みリクエストを削除
+// 戻り値: 削除数
+// スナップショット 1 回分の mirror と prune は request_store_lock の中でまとめて呼ぶこと
+// (途中の状態をハンドラ・ボタンから見せない)
+int request_store_prune_mirrored(const char* const* keep_ids, int keep_count);
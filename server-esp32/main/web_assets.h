@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// ビルド時に埋め込まれた PWA 静的ファイル (server/public/)
+// 実体は tools/embed_web_assets.py が生成する web_assets_data.cpp
+struct WebAsset {
+    const char* path;           // "/app.js"
+    const char* mime;
+    const uint8_t* data;        // フラッシュ上のデータ (gzipped なら圧縮済み)
+    uint32_t len;
+    const char* etag;           // "\"<sha256 先頭 16 桁>\""
+    const char* version;        // index.html が付与する ?v= の値
+    bool gzipped;
+};
+
+extern const WebAsset WEB_ASSETS[];
+extern const int WEB_ASSET_COUNT;
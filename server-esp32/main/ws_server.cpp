@@ -0,0 +1,426 @@
+#include "ws_server.h"
+#include "request_store.h"
+#include "request_json.h"
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <cJSON.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_HTTPS_SERVER
+#include <esp_tls.h>
+#endif
+
+static const char* TAG = "ws";
+
+#define MIN_KEY_LENGTH 8
+#define MAX_KEY_LENGTH 128
+#define COALESCE_MS 20              // 連続した変更 (auto-cancel + create 等) をまとめる待ち時間
+#define PING_INTERVAL_MS 30000      // ws.ts と同じ 30 秒ごとの ping
+#define RETRY_MS 20                 // 送信途中のクライアントがいる間の再送間隔
+#define SEND_TIMEOUT_MS 2000        // これだけ 1 バイトも送れないクライアントは切断
+#define SEND_SLICE_MS 10            // TLS の送信が 1 回に待つ上限 (SO_SNDTIMEO)
+#define MAX_WS_FRAMES 3             // 同時に持つ世代のフレーム数 (最新 + 送信途中の古いもの)
+#define MAX_RX_FRAME 128            // クライアントからの受信は読み捨てる
+
+// 送信するフレーム (WebSocket ヘッダー + ペイロード)
+// 世代ごとに 1 回だけ組み立て、送信途中のクライアントが参照している間は残す
+struct WsFrame {
+    uint32_t gen;                   // 0 = ping
+    uint8_t* data;
+    size_t len;
+    int refs;
+};
+
+// 送信はすべてブロックしない。送れなかった残りはクライアントごとに (フレーム, 送信済みバイト数) で持ち、
+// 次のパスで続きから送る。キューの深さは 1 (最新スナップショットのみ): 送信途中のフレームを
+// 送り終えたら、その間に進んだ世代は飛ばして最新を送る
+struct WsClient {
+    bool active;
+    int fd;
+    uint32_t sent_gen;
+    WsFrame* frame;                 // 送信途中のフレーム (nullptr = なし)
+    size_t offset;
+    int64_t progress_at;            // 最後に 1 バイト以上送れた時刻 (us)
+    uint32_t sent;
+};
+
+static httpd_handle_t s_server = nullptr;
+static TaskHandle_t s_tx_task = nullptr;
+static SemaphoreHandle_t s_lock = nullptr;     // s_clients と s_frames の参照数
+static WsClient s_clients[MAX_WS_CLIENTS];
+static WsFrame s_frames[MAX_WS_FRAMES];
+static WsFrame* s_latest = nullptr;            // 最新世代のフレーム (ws_tx だけが差し替える)
+static uint8_t s_ping_data[] = { 0x89, 0x00 };  // FIN + ping、ペイロードなし
+static WsFrame s_ping = { 0, s_ping_data, sizeof(s_ping_data), 0 };
+static volatile uint32_t s_gen = 1;  // ストアの変更世代 (0 = 未送信)
+
+static void on_store_changed(void) {
+    s_gen++;
+    if (s_tx_task) xTaskNotifyGive(s_tx_task);
+}
+
+// s_lock 中に呼ぶ
+static void attach_frame(WsClient* c, WsFrame* frame) {
+    c->frame = frame;
+    c->offset = 0;
+    c->progress_at = esp_timer_get_time();
+    if (frame != &s_ping) frame->refs++;
+}
+
+// s_lock 中に呼ぶ (フレームの解放は ws_tx が次に新しい世代を組み立てるときに行う)
+static void release_frame(WsClient* c) {
+    if (c->frame && c->frame != &s_ping) c->frame->refs--;
+    c->frame = nullptr;
+    c->offset = 0;
+}
+
+// 認証: Authorization ヘッダー優先、?key= をフォールバック (ブラウザ WebSocket 用)
+static bool check_ws_auth(httpd_req_t* req) {
+    char buf[MAX_KEY_LENGTH + 16] = {0};
+    const char* key = nullptr;
+    if (httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) == ESP_OK &&
+        strncmp(buf, "Bearer ", 7) == 0) {
+        key = buf + 7;
+    } else {
+        char query[MAX_KEY_LENGTH + 32];
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+            httpd_query_key_value(query, "key", buf, sizeof(buf)) == ESP_OK) {
+            key = buf;
+        }
+    }
+    if (!key) return false;
+    int len = strlen(key);
+    return len >= MIN_KEY_LENGTH && len <= MAX_KEY_LENGTH;
+}
+
+// クローズフレーム (ステータスコード + 理由) を送って切断
+static void close_with_code(httpd_req_t* req, uint16_t code, const char* reason) {
+    uint8_t payload[2 + 32];
+    size_t reason_len = strnlen(reason, sizeof(payload) - 2);
+    payload[0] = code >> 8;
+    payload[1] = code & 0xff;
+    memcpy(payload + 2, reason, reason_len);
+
+    httpd_ws_frame_t frame = {};
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_CLOSE;
+    frame.payload = payload;
+    frame.len = 2 + reason_len;
+    httpd_ws_send_frame(req, &frame);
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+}
+
+static bool add_client(int fd) {
+    WsClient* slot = nullptr;
+    int total = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // 同じ fd が残っていれば再利用 (切断検知前に fd が使い回された場合)
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (s_clients[i].active && s_clients[i].fd == fd) slot = &s_clients[i];
+    }
+    for (int i = 0; i < MAX_WS_CLIENTS && !slot; i++) {
+        if (!s_clients[i].active) slot = &s_clients[i];
+    }
+    if (slot) {
+        release_frame(slot);
+        memset(slot, 0, sizeof(WsClient));
+        slot->active = true;
+        slot->fd = fd;
+    }
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (s_clients[i].active) total++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!slot) return false;
+    ESP_LOGI(TAG, "Client connected (fd=%d, total: %d)", fd, total);
+    // 接続直後のスナップショットを送信タスクに依頼 (sent_gen = 0 なので必ず送られる)
+    xTaskNotifyGive(s_tx_task);
+    return true;
+}
+
+static void remove_client(int index, int fd, const char* reason) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    WsClient* c = &s_clients[index];
+    bool removed = c->active && c->fd == fd;
+    uint32_t sent = c->sent;
+    if (removed) {
+        c->active = false;
+        release_frame(c);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (removed) {
+        ESP_LOGI(TAG, "Client disconnected (fd=%d, %s, sent %u)", fd, reason, (unsigned)sent);
+    }
+}
+
+// ── GET /ws ──
+static esp_err_t handle_ws(httpd_req_t* req) {
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        // ハンドシェイク完了直後に 1 回呼ばれる (101 送信済みなので close で拒否)
+        if (!check_ws_auth(req)) {
+            close_with_code(req, 4001, "unauthorized");
+            return ESP_OK;
+        }
+        // TLS の送信は MSG_DONTWAIT を使えないので、1 回の待ちをこの時間で打ち切る
+        // (送れなかった残りは ws_tx が次のパスで送る。平文は MSG_DONTWAIT で待たない)
+        struct timeval tv = {};
+        tv.tv_usec = SEND_SLICE_MS * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (!add_client(fd)) {
+            ESP_LOGW(TAG, "Too many clients, rejected fd=%d", fd);
+            close_with_code(req, 1013, "too many clients");
+        }
+        return ESP_OK;
+    }
+
+    // クライアント → サーバのメッセージは使わないので読み捨てる
+    httpd_ws_frame_t frame = {};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) return err;
+    if (frame.len > MAX_RX_FRAME) return ESP_FAIL;  // セッションを閉じる
+    if (frame.len > 0) {
+        uint8_t buf[MAX_RX_FRAME];
+        frame.payload = buf;
+        return httpd_ws_recv_frame(req, &frame, frame.len);
+    }
+    return ESP_OK;
+}
+
+static char* build_payload(void) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "update");
+
+    // ツリーの構築中だけロック (文字列化と送信はロック外)
+    request_store_lock();
+    PermissionRequest* reqs[MAX_REQUESTS];
+    int count = request_store_get_all(reqs, MAX_REQUESTS);
+    cJSON_AddItemToObject(root, "requests", request_list_to_json(reqs, count));
+    request_store_unlock();
+
+    char* payload = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return payload;
+}
+
+// 世代 gen のテキストフレームを組み立てて s_latest にする
+// 空きがなければ最も古い世代を送信途中のクライアント (もっとも遅れている) ごと切り捨てる
+static void build_latest(uint32_t gen) {
+    char* payload = build_payload();
+    if (!payload) {
+        ESP_LOGE(TAG, "Out of memory for payload");
+        return;
+    }
+    size_t len = strlen(payload);
+    uint8_t head[10];
+    size_t head_len = 0;
+    head[head_len++] = 0x81;        // FIN + テキスト (サーバ → クライアントはマスクなし)
+    if (len < 126) {
+        head[head_len++] = (uint8_t)len;
+    } else if (len <= 0xffff) {
+        head[head_len++] = 126;
+        head[head_len++] = (uint8_t)(len >> 8);
+        head[head_len++] = (uint8_t)len;
+    } else {
+        head[head_len++] = 127;
+        for (int i = 7; i >= 0; i--) head[head_len++] = (uint8_t)((uint64_t)len >> (i * 8));
+    }
+    uint8_t* data = (uint8_t*)malloc(head_len + len);
+    if (!data) {
+        cJSON_free(payload);
+        ESP_LOGE(TAG, "Out of memory for frame");
+        return;
+    }
+    memcpy(data, head, head_len);
+    memcpy(data + head_len, payload, len);
+    cJSON_free(payload);
+
+    int evict[MAX_WS_CLIENTS];
+    int evict_count = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    WsFrame* slot = nullptr;
+    WsFrame* oldest = nullptr;
+    for (int i = 0; i < MAX_WS_FRAMES; i++) {
+        WsFrame* f = &s_frames[i];
+        if (f == s_latest) continue;
+        if (f->refs == 0) {
+            slot = f;
+            break;
+        }
+        if (!oldest || f->gen < oldest->gen) oldest = f;
+    }
+    if (!slot) {
+        slot = oldest;
+        for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+            WsClient* c = &s_clients[i];
+            if (c->active && c->frame == slot) {
+                release_frame(c);
+                c->active = false;
+                evict[evict_count++] = c->fd;
+            }
+        }
+    }
+    free(slot->data);
+    slot->gen = gen;
+    slot->data = data;
+    slot->len = head_len + len;
+    slot->refs = 0;
+    s_latest = slot;
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < evict_count; i++) {
+        ESP_LOGW(TAG, "Client fd=%d is %d updates behind, disconnecting", evict[i], MAX_WS_FRAMES);
+        httpd_sess_trigger_close(s_server, evict[i]);
+    }
+}
+
+// ブロックせずに送れるだけ送る。戻り値: 送ったバイト数 (0 = 今は送れない)、負 = エラー
+static int send_some(int fd, const uint8_t* data, size_t len) {
+#ifdef CONFIG_HTTPS_SERVER
+    // TLS のセッションは httpd の送信関数を通す (SO_SNDTIMEO = SEND_SLICE_MS で戻る)
+    // 途中で止まったレコードは mbedtls が保持していて、同じ位置からの再送で続きが出る
+    int n = httpd_socket_send(s_server, fd, (const char*)data, len, 0);
+    if (n == ESP_TLS_ERR_SSL_WANT_WRITE || n == ESP_TLS_ERR_SSL_WANT_READ ||
+        n == HTTPD_SOCK_ERR_TIMEOUT) {
+        return 0;
+    }
+    return n;
+#else
+    int n = send(fd, data, len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    return n;
+#endif
+}
+
+// 1 クライアント分: 送信途中の残りを送り、送り終えたら最新の世代に付け替えて続ける
+// 戻り値: まだ送り残しがある
+static bool service_client(int index) {
+    while (true) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        WsClient* c = &s_clients[index];
+        if (c->active && !c->frame && s_latest && c->sent_gen != s_latest->gen) {
+            attach_frame(c, s_latest);
+        }
+        if (!c->active || !c->frame) {
+            xSemaphoreGive(s_lock);
+            return false;
+        }
+        int fd = c->fd;
+        WsFrame* frame = c->frame;
+        size_t offset = c->offset;
+        int64_t progress_at = c->progress_at;
+        xSemaphoreGive(s_lock);
+
+        if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            remove_client(index, fd, "closed");
+            return false;
+        }
+        // フレームは参照中なので解放されない (ロック外で送ってよい)
+        int n = send_some(fd, frame->data + offset, frame->len - offset);
+        int64_t now = esp_timer_get_time();
+        if (n < 0 || (n == 0 && now - progress_at >= (int64_t)SEND_TIMEOUT_MS * 1000)) {
+            httpd_sess_trigger_close(s_server, fd);
+            remove_client(index, fd, n < 0 ? "send error" : "send timeout");
+            return false;
+        }
+        if (n == 0) return true;
+
+        // 一部だけ送れたら続きを、送り終えたら次の世代を試す (送れなければ次の send_some が 0)
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (c->active && c->fd == fd && c->frame == frame) {
+            c->offset += n;
+            c->progress_at = now;
+            if (c->offset == frame->len) {
+                if (frame->gen != 0) {
+                    c->sent_gen = frame->gen;
+                    c->sent++;
+                }
+                release_frame(c);
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+// 全クライアントの送信を 1 巡進める。戻り値: 送り残しのあるクライアントがいる
+static bool service_all(void) {
+    // 最新を受け取っていないクライアントがいれば、その世代のフレームを作る (世代ごとに 1 回)
+    uint32_t gen = s_gen;
+    bool need = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        const WsClient* c = &s_clients[i];
+        if (c->active && c->sent_gen != gen) need = true;
+    }
+    bool have = s_latest && s_latest->gen == gen;
+    xSemaphoreGive(s_lock);
+    if (need && !have) build_latest(gen);
+
+    bool backlog = false;
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (service_client(i)) backlog = true;
+    }
+    return backlog;
+}
+
+// 送信途中でないクライアントに ping を付ける (送信途中なら送れているかどうかはタイムアウトで分かる)
+static void queue_ping_all(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        WsClient* c = &s_clients[i];
+        if (c->active && !c->frame) attach_frame(c, &s_ping);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+// どのクライアントの送信も待たない: 詰まったクライアントは送り残しを持ったまま後回しにし、
+// RETRY_MS ごとに続きを試す。SEND_TIMEOUT_MS 進まなければ切断する
+static void ws_tx_task(void* arg) {
+    (void)arg;
+    int64_t last_ping = esp_timer_get_time();
+    bool backlog = false;
+    while (true) {
+        TickType_t wait = pdMS_TO_TICKS(backlog ? RETRY_MS : PING_INTERVAL_MS);
+        if (ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            vTaskDelay(pdMS_TO_TICKS(COALESCE_MS));
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now - last_ping >= (int64_t)PING_INTERVAL_MS * 1000) {
+            queue_ping_all();
+            last_ping = now;
+        }
+        backlog = service_all();
+    }
+}
+
+esp_err_t ws_server_register(httpd_handle_t server) {
+    s_server = server;
+    memset(s_clients, 0, sizeof(s_clients));
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(ws_tx_task, "ws_tx", 4096, nullptr, 5, &s_tx_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    request_store_add_listener(on_store_changed);
+
+    httpd_uri_t uri_ws = {};
+    uri_ws.uri = "/ws";
+    uri_ws.method = HTTP_GET;
+    uri_ws.handler = handle_ws;
+    uri_ws.is_websocket = true;
+    return httpd_register_uri_handler(server, &uri_ws);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// /ws の最大同時接続数
+#define MAX_WS_CLIENTS 12
+
+// GET /ws (WebSocket) を登録し、送信タスクを起動する
+// server/src/ws.ts と同じ {"type":"update","requests":[...]} をストア変更時に配信
+esp_err_t ws_server_register(httpd_handle_t server);
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""ホストベンチマーク (server-esp32/bench) の結果を比較して劣化を検出する
+
+Google Benchmark の JSON 出力 (--benchmark_out_format=json) を 2 つ受け取り、
+ベンチマークごとの時間の変化率を表示する。しきい値を超えて遅くなったものがあれば
+終了コード 1 を返す (CI やフラッシュ前の確認用)。
+
+--benchmark_repetitions を使った結果は median の集計値を比較する。
+
+使い方:
+  python3 compare_bench.py baseline.json current.json
+  python3 compare_bench.py baseline.json current.json --threshold 5 --metric real_time
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path, metric):
+    """{名前: 時間 (ns)} を返す"""
+    with open(path, encoding="utf-8") as f:
+        data = json.load(f)
+
+    scale = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+    runs = data.get("benchmarks", [])
+    has_aggregates = any(b.get("run_type") == "aggregate" for b in runs)
+
+    results = {}
+    for b in runs:
+        if has_aggregates:
+            if b.get("run_type") != "aggregate" or b.get("aggregate_name") != "median":
+                continue
+            name = b.get("run_name", b["name"])
+        else:
+            name = b["name"]
+        results[name] = b[metric] * scale[b.get("time_unit", "ns")]
+    return results
+
+
+def format_ns(ns):
+    if ns >= 1e6:
+        return f"{ns / 1e6:.2f}ms"
+    if ns >= 1e3:
+        return f"{ns / 1e3:.2f}us"
+    return f"{ns:.1f}ns"
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compare two Google Benchmark JSON results")
+    ap.add_argument("baseline", help="基準となる結果 (変更前)")
+    ap.add_argument("current", help="比較する結果 (変更後)")
+    ap.add_argument("--threshold", type=float, default=10.0,
+                    help="劣化とみなす変化率 %% (既定 10)")
+    ap.add_argument("--metric", choices=("cpu_time", "real_time"), default="cpu_time")
+    args = ap.parse_args()
+
+    base = load(args.baseline, args.metric)
+    cur = load(args.current, args.metric)
+
+    regressions = []
+    width = max((len(n) for n in cur), default=10)
+    print(f"{'benchmark':{width}s}  {'baseline':>10s}  {'current':>10s}  {'change':>8s}")
+    for name, t in cur.items():
+        if name not in base:
+            print(f"{name:{width}s}  {'-':>10s}  {format_ns(t):>10s}  {'new':>8s}")
+            continue
+        b = base[name]
+        change = (t - b) / b * 100 if b > 0 else 0.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions.append(name)
+        elif change < -args.threshold:
+            mark = "  improved"
+        print(f"{name:{width}s}  {format_ns(b):>10s}  {format_ns(t):>10s}  {change:+7.1f}%{mark}")
+
+    removed = [n for n in base if n not in cur]
+    for name in removed:
+        print(f"{name:{width}s}  {format_ns(base[name]):>10s}  {'-':>10s}  {'removed':>8s}")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) slower than {args.threshold:g}%:", file=sys.stderr)
+        for name in regressions:
+            print(f"  {name}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""一覧取得の負荷下で応答操作 (respond) の遅延を計測する
+
+まず負荷なしで POST /permission-request/:id/respond の遅延を測り、
+次に GET /permission-requests を並列で叩き続けながら同じ計測を行う。
+ワーカープールの優先度クラスが効いていれば、p99 はほぼ変わらない。
+
+使い方:
+  python3 decision_latency_test.py --url http://prompt-relay.local:3939 --key <API_KEY>
+  python3 decision_latency_test.py --url ... --key ... --list-threads 4 --samples 50
+"""
+
+import argparse
+import json
+import sys
+import threading
+import time
+import urllib.error
+import urllib.request
+
+
+def request(base, key, method, path, body=None, timeout=10):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(
+        base + path,
+        data=data,
+        headers={"Content-Type": "application/json", "Authorization": f"Bearer {key}"},
+        method=method,
+    )
+    while True:
+        try:
+            with urllib.request.urlopen(req, timeout=timeout) as resp:
+                return resp.read()
+        except urllib.error.HTTPError as e:
+            # ESP32 版の流量制御 (429) は Retry-After に従って待つ
+            if e.code != 429:
+                raise
+            time.sleep(int(e.headers.get("Retry-After", "1")))
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    return s[min(len(s) - 1, int(round(p / 100 * (len(s) - 1))))]
+
+
+def fill_store(base, key):
+    # 一覧を大きくするため、長いメッセージのリクエストを上限 (8 件) まで作る
+    # tmux_target を分けないと同一ペイン扱いで自動キャンセルされる
+    for i in range(8):
+        request(base, key, "POST", "/permission-request", {
+            "tool_name": "Bash",
+            "message": "x" * 400,
+            "choices": [{"number": n, "text": f"choice {n}"} for n in range(1, 4)],
+            "tmux_target": f"latency-test:filler.{i}",
+            "hostname": "latency-test",
+        })
+
+
+def measure_decisions(base, key, samples):
+    latencies = []
+    for i in range(samples):
+        created = json.loads(request(base, key, "POST", "/permission-request", {
+            "tool_name": "Bash",
+            "message": f"decision {i}",
+            "choices": [{"number": 1, "text": "Yes"}, {"number": 2, "text": "No"}],
+            "tmux_target": "latency-test:decision.0",
+            "hostname": "latency-test",
+        }))
+        t0 = time.monotonic()
+        request(base, key, "POST", f"/permission-request/{created['id']}/respond", {"choice": 1})
+        latencies.append((time.monotonic() - t0) * 1000)
+    return latencies
+
+
+def list_load(base, key, stop, counter):
+    while not stop.is_set():
+        try:
+            request(base, key, "GET", "/permission-requests")
+            counter[0] += 1
+        except OSError:
+            time.sleep(0.05)
+
+
+def report(name, lat):
+    print(f"  {name:10s} n={len(lat):4d}  p50={percentile(lat, 50):7.1f}ms"
+          f"  p99={percentile(lat, 99):7.1f}ms  max={max(lat, default=float('nan')):7.1f}ms")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Measure respond latency under list load")
+    ap.add_argument("--url", required=True, help="例: http://prompt-relay.local:3939")
+    ap.add_argument("--key", required=True, help="API キー (8〜128 文字)")
+    ap.add_argument("--samples", type=int, default=30)
+    ap.add_argument("--list-threads", type=int, default=3, help="一覧を取得し続けるスレッド数")
+    args = ap.parse_args()
+
+    base = args.url.rstrip("/")
+    fill_store(base, args.key)
+
+    idle = measure_decisions(base, args.key, args.samples)
+
+    stop = threading.Event()
+    counter = [0]
+    threads = [threading.Thread(target=list_load, args=(base, args.key, stop, counter), daemon=True)
+               for _ in range(args.list_threads)]
+    for t in threads:
+        t.start()
+    start = time.monotonic()
+    loaded = measure_decisions(base, args.key, args.samples)
+    elapsed = time.monotonic() - start
+    stop.set()
+    for t in threads:
+        t.join()
+
+    print(f"samples={args.samples} list_threads={args.list_threads}"
+          f" (list {counter[0] / elapsed:.1f} req/s during load)")
+    report("idle", idle)
+    report("list load", loaded)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
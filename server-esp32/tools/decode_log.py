@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""遅延ログ (GET /logs) のバイナリをテキストに復号する
+
+イベント表は main/deferred_log.h の DLOG_EVENTS からそのまま読むので、
+ファームウェアと同じリビジョンのソースツリーで実行すること。
+
+使い方:
+  python3 decode_log.py --url http://prompt-relay.local:3939 --key <API_KEY>
+  python3 decode_log.py logs.bin
+  curl -s -H "Authorization: Bearer <API_KEY>" http://prompt-relay.local:3939/logs | python3 decode_log.py -
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import urllib.request
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "main", "deferred_log.h")
+MAGIC = b"DLG1"
+HEADER_SIZE = 7
+
+EVENT_RE = re.compile(r'X\(\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+SPEC_RE = re.compile(r"%(%|[-+ #0]*\d*(?:\.\d+)?)(l{0,2})([sdiuxX])")
+
+
+def load_events(path):
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    start = text.index("#define DLOG_EVENTS(X)")
+    end = text.index("\n\n", start)
+    return [(m.group(1), m.group(2), m.group(3).encode().decode("unicode_escape"))
+            for m in EVENT_RE.finditer(text[start:end])]
+
+
+def parse_args(data):
+    args = []
+    i = 0
+    while i < len(data):
+        t = chr(data[i])
+        if t == "s":
+            n = data[i + 1]
+            args.append(data[i + 2:i + 2 + n].decode("utf-8", errors="replace"))
+            i += 2 + n
+        elif t in "iu":
+            args.append(struct.unpack_from("<i" if t == "i" else "<I", data, i + 1)[0])
+            i += 5
+        elif t in "qQ":
+            args.append(struct.unpack_from("<q" if t == "q" else "<Q", data, i + 1)[0])
+            i += 9
+        else:
+            raise ValueError(f"unknown arg type {t!r}")
+    return args
+
+
+def format_message(fmt, args):
+    it = iter(args)
+
+    def repl(m):
+        if m.group(1) == "%":
+            return "%"
+        try:
+            v = next(it)
+        except StopIteration:
+            return "?"
+        conv = m.group(3)
+        if isinstance(v, str):
+            conv = "s"
+        elif conv == "s":
+            conv = "d"
+        elif conv in "ux" and v < 0:
+            v &= 0xFFFFFFFF  # ファームウェアの snprintf と同じく 32 ビット符号なしで表示
+        return ("%" + m.group(1) + conv) % v
+
+    return SPEC_RE.sub(repl, fmt)
+
+
+def decode(blob, events):
+    if blob[:4] != MAGIC:
+        raise ValueError("not a deferred log dump (missing DLG1 magic)")
+    pos = 4
+    while pos < len(blob):
+        length = blob[pos]
+        if length < HEADER_SIZE or pos + length > len(blob):
+            raise ValueError(f"truncated record at offset {pos}")
+        ts, event = struct.unpack_from("<IH", blob, pos + 1)
+        args = parse_args(blob[pos + HEADER_SIZE:pos + length])
+        if event < len(events):
+            _, tag, fmt = events[event]
+            yield ts, tag, format_message(fmt, args)
+        else:
+            yield ts, "?", f"unknown event {event} {args}"
+        pos += length
+
+
+def fetch(url, key):
+    req = urllib.request.Request(url.rstrip("/") + "/logs",
+                                 headers={"Authorization": f"Bearer {key}"})
+    with urllib.request.urlopen(req, timeout=10) as resp:
+        dropped = resp.headers.get("X-Dlog-Dropped")
+        return resp.read(), dropped
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode deferred log records from GET /logs")
+    ap.add_argument("file", nargs="?", help="ダンプファイル (- で標準入力)")
+    ap.add_argument("--url", help="例: http://prompt-relay.local:3939")
+    ap.add_argument("--key", help="API キー (8〜128 文字)")
+    ap.add_argument("--header", default=HEADER, help="イベント表のヘッダー (既定: main/deferred_log.h)")
+    args = ap.parse_args()
+
+    events = load_events(args.header)
+    dropped = None
+    if args.url:
+        if not args.key:
+            ap.error("--url requires --key")
+        blob, dropped = fetch(args.url, args.key)
+    elif args.file == "-":
+        blob = sys.stdin.buffer.read()
+    elif args.file:
+        with open(args.file, "rb") as f:
+            blob = f.read()
+    else:
+        ap.error("specify a file or --url")
+
+    for ts, tag, msg in decode(blob, events):
+        print(f"({ts}) {tag}: {msg}")
+    if dropped and dropped != "0":
+        print(f"-- {dropped} records dropped (ring full)", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+PWA 静的ファイル埋め込みジェネレータ
+
+server/public/ 以下のファイルをビルド時に gzip 圧縮し、C++ の const 配列
+（フラッシュ上に配置される）として出力する。main/CMakeLists.txt から呼ばれる。
+
+  - ETag: 非圧縮内容の SHA-256 先頭 16 桁
+  - index.html 内の同梱ファイル参照は `?v=<hash>` 付きに書き換える
+    → フィンガープリント付き URL は immutable で長期キャッシュでき、
+      再訪問時は index.html の 304 だけで済む
+  - 圧縮で 10% 以上縮まないファイル（PNG 等）は非圧縮で埋め込む
+
+Usage: embed_web_assets.py <public_dir> <output.cpp>
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+MIME_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.js': 'application/javascript; charset=utf-8',
+    '.css': 'text/css; charset=utf-8',
+    '.json': 'application/manifest+json',
+    '.png': 'image/png',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+}
+
+INDEX = 'index.html'
+MIN_GAIN = 0.9  # 圧縮後サイズがこの比率未満なら gzip を採用
+
+
+def content_hash(data: bytes) -> str:
+    return hashlib.sha256(data).hexdigest()[:16]
+
+
+def fingerprint_refs(html: str, versions: dict) -> str:
+    """index.html の href/src を ?v=<hash> 付きに書き換える"""
+    def repl(m):
+        attr, name = m.group(1), m.group(2)
+        if name in versions:
+            return f'{attr}="{name}?v={versions[name]}"'
+        return m.group(0)
+    return re.sub(r'(href|src)="([^"?#:/]+)"', repl, html)
+
+
+def c_array(data: bytes) -> str:
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('    ' + ', '.join(f'0x{b:02x}' for b in data[i:i + 16]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f'Usage: {sys.argv[0]} <public_dir> <output.cpp>', file=sys.stderr)
+        sys.exit(1)
+    public_dir, out_path = sys.argv[1], sys.argv[2]
+
+    files = {}
+    for name in sorted(os.listdir(public_dir)):
+        ext = os.path.splitext(name)[1]
+        path = os.path.join(public_dir, name)
+        if ext in MIME_TYPES and os.path.isfile(path):
+            with open(path, 'rb') as f:
+                files[name] = f.read()
+
+    versions = {name: content_hash(data)[:8] for name, data in files.items() if name != INDEX}
+    if INDEX in files:
+        files[INDEX] = fingerprint_refs(files[INDEX].decode('utf-8'), versions).encode('utf-8')
+
+    out = [
+        '// 自動生成ファイル (tools/embed_web_assets.py) — 編集しないこと',
+        '#include "web_assets.h"',
+        '',
+    ]
+    entries = []
+    total_raw = total_stored = 0
+    for i, (name, raw) in enumerate(files.items()):
+        # mtime=0 で再現可能なビルドにする
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        gzipped = len(packed) < len(raw) * MIN_GAIN
+        data = packed if gzipped else raw
+        total_raw += len(raw)
+        total_stored += len(data)
+
+        digest = content_hash(raw)
+        out.append(f'static const uint8_t s_asset_{i}[{len(data)}] = {{')
+        out.append(c_array(data))
+        out.append('};')
+        out.append('')
+        entries.append(
+            f'    {{ "/{name}", "{MIME_TYPES[os.path.splitext(name)[1]]}", s_asset_{i}, {len(data)}, '
+            f'"\\"{digest}\\"", "{digest[:8]}", {"true" if gzipped else "false"} }},'
+        )
+
+    out.append('const WebAsset WEB_ASSETS[] = {')
+    out.extend(entries)
+    out.append('};')
+    out.append('')
+    out.append(f'const int WEB_ASSET_COUNT = {len(entries)};')
+    out.append('')
+
+    with open(out_path, 'w') as f:
+        f.write('\n'.join(out))
+
+    print(f'[embed_web_assets] {len(entries)} files, {total_raw} -> {total_stored} bytes')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""ESP32 版の HTTPS 用に ECDSA P-256 のサーバ証明書を作る
+
+Node 版サーバが作ったローカル CA (server/certs/PromptRelay-CA.pem) で署名するので、
+iPhone やフックの実行環境に CA を入れてあればそのまま信頼される。
+RSA 2048 より署名が軽く証明書も小さいので、ESP32 でのハンドシェイクが速くなる。
+出力先は main/certs/ (ビルド時に埋め込まれる。リポジトリには入れない)
+
+使い方:
+  python3 make_cert.py
+  python3 make_cert.py --ip 192.168.1.50 --dns prompt-relay-2.local
+  python3 make_cert.py --ca ../../server/certs/PromptRelay-CA.pem --ca-key ../../server/certs/PromptRelay-CA-key.pem
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_CA_DIR = os.path.join(HERE, "..", "..", "server", "certs")
+DEFAULT_OUT_DIR = os.path.join(HERE, "..", "main", "certs")
+
+
+def openssl(*args):
+    subprocess.run(["openssl", *args], check=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ESP32 版の HTTPS 証明書 (ECDSA P-256) を作る")
+    parser.add_argument("--ca", default=os.path.join(DEFAULT_CA_DIR, "PromptRelay-CA.pem"))
+    parser.add_argument("--ca-key", default=os.path.join(DEFAULT_CA_DIR, "PromptRelay-CA-key.pem"))
+    parser.add_argument("--out", default=DEFAULT_OUT_DIR, help="出力先ディレクトリ")
+    parser.add_argument("--ip", action="append", default=[], help="SAN に加える IP (複数可)")
+    parser.add_argument("--dns", action="append", default=[], help="SAN に加えるホスト名 (複数可)")
+    parser.add_argument("--days", type=int, default=825, help="有効期間 (iOS の上限は 825 日)")
+    args = parser.parse_args()
+
+    for path in (args.ca, args.ca_key):
+        if not os.path.exists(path):
+            sys.exit(f"{path} がありません (Node 版サーバを一度起動すると server/certs/ に作られます)")
+
+    dns = ["prompt-relay.local"] + [d for d in args.dns if d != "prompt-relay.local"]
+    san = ",".join([f"DNS:{d}" for d in dns] + [f"IP:{ip}" for ip in args.ip])
+
+    os.makedirs(args.out, exist_ok=True)
+    key_path = os.path.join(args.out, "server-key.pem")
+    cert_path = os.path.join(args.out, "server.pem")
+
+    with tempfile.TemporaryDirectory() as tmp:
+        csr = os.path.join(tmp, "server.csr")
+        ext = os.path.join(tmp, "ext.cnf")
+        with open(ext, "w") as f:
+            f.write("basicConstraints=CA:FALSE\n")
+            f.write("keyUsage=critical,digitalSignature\n")
+            f.write("extendedKeyUsage=serverAuth\n")
+            f.write(f"subjectAltName={san}\n")
+
+        # mbedTLS が読める SEC1 形式 (BEGIN EC PRIVATE KEY) で書き出す
+        openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", key_path)
+        openssl("req", "-new", "-key", key_path, "-subj", "/CN=prompt-relay.local", "-out", csr)
+        openssl("x509", "-req", "-in", csr, "-CA", args.ca, "-CAkey", args.ca_key,
+                "-CAcreateserial", "-CAserial", os.path.join(tmp, "ca.srl"),
+                "-days", str(args.days), "-sha256", "-extfile", ext, "-out", cert_path)
+    os.chmod(key_path, 0o600)
+
+    print(f"証明書: {cert_path}")
+    print(f"秘密鍵: {key_path}")
+    print(f"SAN   : {san}")
+
+
+if __name__ == "__main__":
+    main()
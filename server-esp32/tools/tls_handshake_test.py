@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""ESP32 版の HTTPS (CONFIG_HTTPS_SERVER) のハンドシェイク時間とセッションあたりのメモリを計測する
+
+1. フルハンドシェイク: 毎回新しい TLS セッションで接続し、接続完了までの時間を測る
+2. 再開ハンドシェイク: 最初に受け取ったセッションチケットで再接続し、同じく測る
+   (session_reused が偽なら、チケットが効いていないので警告する)
+3. keep-alive: 1 本の接続で GET /stats を繰り返し、リクエスト単体の時間を測る
+4. セッションあたりのヒープ: 接続を 1 本ずつ増やしながら /stats の内部 RAM の空きを読む
+
+使い方:
+  python3 tls_handshake_test.py --url https://prompt-relay.local:3939 --key <API_KEY> \\
+      --ca ../../server/certs/PromptRelay-CA.pem
+  python3 tls_handshake_test.py --url ... --key ... --insecure --samples 50 --hold 4
+"""
+
+import argparse
+import json
+import socket
+import ssl
+import sys
+import time
+import urllib.parse
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    return s[min(len(s) - 1, int(round(p / 100 * (len(s) - 1))))]
+
+
+def report(name, lat):
+    print(f"  {name:10s} n={len(lat):4d}  p50={percentile(lat, 50):7.1f}ms"
+          f"  p99={percentile(lat, 99):7.1f}ms  max={max(lat, default=float('nan')):7.1f}ms")
+
+
+class Target:
+    def __init__(self, url, key, ca, insecure):
+        u = urllib.parse.urlsplit(url)
+        if u.scheme != "https":
+            sys.exit("--url は https:// で指定してください")
+        self.host = u.hostname
+        self.port = u.port or 443
+        self.key = key
+        self.ctx = ssl.create_default_context(cafile=ca)
+        if insecure:
+            self.ctx.check_hostname = False
+            self.ctx.verify_mode = ssl.CERT_NONE
+        # チケットは TLS 1.2 の仕組みで受け取る (1.3 はハンドシェイク後に届くため計測がぶれる)
+        self.ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    def connect(self, session=None):
+        """接続し (TLS ソケット, ハンドシェイク完了までの ms) を返す"""
+        t0 = time.monotonic()
+        raw = socket.create_connection((self.host, self.port), timeout=10)
+        raw.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock = self.ctx.wrap_socket(raw, server_hostname=self.host, session=session)
+        return sock, (time.monotonic() - t0) * 1000
+
+    def get(self, sock, path):
+        """keep-alive のまま GET し、本文を返す"""
+        sock.sendall((f"GET {path} HTTP/1.1\r\nHost: {self.host}\r\n"
+                      f"Authorization: Bearer {self.key}\r\nConnection: keep-alive\r\n\r\n").encode())
+        buf = b""
+        while b"\r\n\r\n" not in buf:
+            chunk = sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("接続が閉じられました")
+            buf += chunk
+        head, body = buf.split(b"\r\n\r\n", 1)
+        length = 0
+        for line in head.split(b"\r\n")[1:]:
+            name, _, value = line.partition(b":")
+            if name.strip().lower() == b"content-length":
+                length = int(value.strip())
+        while len(body) < length:
+            chunk = sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("接続が閉じられました")
+            body += chunk
+        return body[:length]
+
+    def stats(self):
+        sock, _ = self.connect()
+        try:
+            return json.loads(self.get(sock, "/stats"))
+        finally:
+            sock.close()
+
+
+def measure_handshakes(target, samples):
+    full, resumed, reused = [], [], 0
+    first, _ = target.connect()
+    target.get(first, "/stats")     # TLS 1.2 ではここまででチケットを受け取っている
+    session = first.session
+    first.close()
+
+    for _ in range(samples):
+        sock, ms = target.connect()
+        full.append(ms)
+        sock.close()
+
+        sock, ms = target.connect(session=session)
+        resumed.append(ms)
+        if sock.session_reused:
+            reused += 1
+        session = sock.session
+        sock.close()
+    return full, resumed, reused
+
+
+def measure_keepalive(target, samples):
+    sock, _ = target.connect()
+    lat = []
+    try:
+        for _ in range(samples):
+            t0 = time.monotonic()
+            target.get(sock, "/stats")
+            lat.append((time.monotonic() - t0) * 1000)
+    finally:
+        sock.close()
+    return lat
+
+
+def measure_heap(target, hold):
+    # 測定用の接続も 1 セッションなので、保持する接続は上限 - 1 本まで
+    base = target.stats()
+    free0 = base["tls"]["internal_free"]
+    held = []
+    print(f"  open=0  internal_free={free0}")
+    try:
+        for n in range(1, hold + 1):
+            sock, _ = target.connect()
+            target.get(sock, "/stats")
+            held.append(sock)
+            free = target.stats()["tls"]["internal_free"]
+            print(f"  open={n}  internal_free={free}  per_session={(free0 - free) / n:8.0f} B")
+    finally:
+        for sock in held:
+            sock.close()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Measure TLS handshake time and per-session heap")
+    ap.add_argument("--url", required=True, help="例: https://prompt-relay.local:3939")
+    ap.add_argument("--key", required=True, help="API キー (8〜128 文字)")
+    ap.add_argument("--ca", help="CA 証明書 (PromptRelay-CA.pem)")
+    ap.add_argument("--insecure", action="store_true", help="証明書を検証しない")
+    ap.add_argument("--samples", type=int, default=20)
+    ap.add_argument("--hold", type=int, default=3, help="ヒープ計測で同時に保持する接続数")
+    args = ap.parse_args()
+
+    target = Target(args.url, args.key, args.ca, args.insecure)
+    if "tls" not in target.stats():
+        sys.exit("/stats に tls がありません (CONFIG_HTTPS_SERVER が無効?)")
+
+    full, resumed, reused = measure_handshakes(target, args.samples)
+    print(f"handshake samples={args.samples} (resumed {reused}/{args.samples})")
+    report("full", full)
+    report("resumed", resumed)
+    if reused < args.samples:
+        print("  warning: セッションが再開されていません (CONFIG_MBEDTLS_SERVER_SSL_SESSION_TICKETS を確認)")
+
+    print("keep-alive GET /stats")
+    report("request", measure_keepalive(target, args.samples))
+
+    print(f"heap (hold {args.hold})")
+    measure_heap(target, args.hold)
+
+    print("server tls stats")
+    print("  " + json.dumps(target.stats()["tls"]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
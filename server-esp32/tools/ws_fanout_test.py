@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+"""/ws のファンアウト遅延を Linux ホストから計測する
+
+N 本の WebSocket クライアントを接続した状態で POST /permission-request と
+/cancel を繰り返し、各クライアントが変更を受信するまでの遅延を集計する。
+ESP32 版・Node.js 版のどちらにも使える (標準ライブラリのみ)。
+
+使い方:
+  python3 ws_fanout_test.py --url http://prompt-relay.local:3939 --key <API_KEY>
+  python3 ws_fanout_test.py --url ... --key ... --clients 12 --rounds 20 --stalled 1
+
+--stalled は受信しないクライアントを追加で接続する (遅いスマホの模擬)。
+まず受信しないクライアントなしで --rounds 回計測し、接続してからもう一度計測する。
+後半の p99 が前半より --tolerance ミリ秒を超えて悪化したら失敗 (終了コード 1)。
+"""
+
+import argparse
+import base64
+import json
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+
+class WsClient:
+    """テキストフレームの受信だけを行う最小限の WebSocket クライアント"""
+
+    def __init__(self, url, key, read=True):
+        parsed = urllib.parse.urlparse(url)
+        self.host = parsed.hostname
+        self.port = parsed.port or 80
+        self.key = key
+        self.read = read
+        self.sock = None
+        self.lock = threading.Lock()
+        self.cond = threading.Condition(self.lock)
+        self.snapshots = 0
+        self.seen = {}      # (id, response) -> 受信時刻
+        self.closed = None  # 切断理由
+        if not read:
+            # 受信バッファを最小にして送信側を詰まらせる
+            self.rcvbuf = 1024
+        else:
+            self.rcvbuf = None
+
+    def connect(self, timeout=5.0):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if self.rcvbuf:
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, self.rcvbuf)
+        sock.settimeout(timeout)
+        sock.connect((self.host, self.port))
+        nonce = base64.b64encode(os.urandom(16)).decode()
+        req = (
+            f"GET /ws HTTP/1.1\r\n"
+            f"Host: {self.host}:{self.port}\r\n"
+            f"Upgrade: websocket\r\n"
+            f"Connection: Upgrade\r\n"
+            f"Sec-WebSocket-Key: {nonce}\r\n"
+            f"Sec-WebSocket-Version: 13\r\n"
+            f"Authorization: Bearer {self.key}\r\n\r\n"
+        )
+        sock.sendall(req.encode())
+        head = b""
+        while b"\r\n\r\n" not in head:
+            chunk = sock.recv(1)
+            if not chunk:
+                raise ConnectionError("connection closed during handshake")
+            head += chunk
+        status = head.split(b"\r\n", 1)[0]
+        if b" 101 " not in status + b" ":
+            raise ConnectionError(f"handshake failed: {status.decode(errors='replace')}")
+        sock.settimeout(None)
+        self.sock = sock
+        if self.read:
+            threading.Thread(target=self._reader, daemon=True).start()
+
+    def _recv_exact(self, n):
+        buf = b""
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise ConnectionError("closed")
+            buf += chunk
+        return buf
+
+    def _send_frame(self, opcode, payload=b""):
+        # クライアント → サーバはマスク必須
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack("!H", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def _reader(self):
+        message = b""
+        try:
+            while True:
+                b0, b1 = self._recv_exact(2)
+                opcode = b0 & 0x0F
+                length = b1 & 0x7F
+                if length == 126:
+                    length = struct.unpack("!H", self._recv_exact(2))[0]
+                elif length == 127:
+                    length = struct.unpack("!Q", self._recv_exact(8))[0]
+                payload = self._recv_exact(length) if length else b""
+                if opcode == 0x9:       # ping → pong
+                    self._send_frame(0xA, payload)
+                    continue
+                if opcode == 0x8:       # close
+                    code = struct.unpack("!H", payload[:2])[0] if len(payload) >= 2 else None
+                    raise ConnectionError(f"close {code}")
+                if opcode in (0x1, 0x0):
+                    message += payload
+                    if b0 & 0x80:
+                        self._on_message(message, time.monotonic())
+                        message = b""
+        except (ConnectionError, OSError) as e:
+            with self.cond:
+                self.closed = str(e)
+                self.cond.notify_all()
+
+    def _on_message(self, data, ts):
+        msg = json.loads(data)
+        if msg.get("type") != "update":
+            return
+        with self.cond:
+            self.snapshots += 1
+            for r in msg.get("requests", []):
+                self.seen.setdefault((r["id"], r.get("response")), ts)
+            self.cond.notify_all()
+
+    def wait_for(self, key, deadline):
+        with self.cond:
+            while key not in self.seen and self.closed is None:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    return None
+                self.cond.wait(remaining)
+            return self.seen.get(key)
+
+    def close(self):
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+
+def http_post(base, key, path, body):
+    """POST して (レスポンス, 成功した試行の送信時刻) を返す"""
+    req = urllib.request.Request(
+        base + path,
+        data=json.dumps(body).encode(),
+        headers={"Content-Type": "application/json", "Authorization": f"Bearer {key}"},
+        method="POST",
+    )
+    while True:
+        sent_at = time.monotonic()
+        try:
+            with urllib.request.urlopen(req, timeout=10) as resp:
+                return json.loads(resp.read() or b"{}"), sent_at
+        except urllib.error.HTTPError as e:
+            # ESP32 版の流量制御 (429) は Retry-After に従って待つ
+            if e.code != 429:
+                raise
+            time.sleep(int(e.headers.get("Retry-After", "1")))
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    return s[min(len(s) - 1, int(round(p / 100 * (len(s) - 1))))]
+
+
+def measure(clients, key, t0, timeout):
+    deadline = t0 + timeout
+    latencies = []
+    missed = 0
+    for c in clients:
+        ts = c.wait_for(key, deadline)
+        if ts is None:
+            missed += 1
+        else:
+            latencies.append((ts - t0) * 1000)
+    return latencies, missed
+
+
+def run_rounds(base, key, clients, rounds, timeout, tag):
+    """作成とキャンセルを rounds 回繰り返し、各クライアントが受信するまでの遅延 (ms) を返す"""
+    create_lat, cancel_lat = [], []
+    missed = 0
+    for i in range(rounds):
+        created, t0 = http_post(base, key, "/permission-request", {
+            "tool_name": "Bash",
+            "message": f"fanout test {tag} {i}",
+            "choices": [{"number": 1, "text": "Yes"}, {"number": 2, "text": "No"}],
+            "hostname": "ws-fanout-test",
+        })
+        rid = created["id"]
+        lat, m = measure(clients, (rid, None), t0, timeout)
+        create_lat += lat
+        missed += m
+
+        _, t0 = http_post(base, key, f"/permission-request/{rid}/cancel", {})
+        lat, m = measure(clients, (rid, "cancelled"), t0, timeout)
+        cancel_lat += lat
+        missed += m
+    return create_lat, cancel_lat, missed
+
+
+def report(title, create_lat, cancel_lat):
+    if title:
+        print(f" {title}")
+    for name, lat in (("create", create_lat), ("cancel", cancel_lat)):
+        print(f"  {name:6s} n={len(lat):4d}  p50={percentile(lat, 50):7.1f}ms"
+              f"  p99={percentile(lat, 99):7.1f}ms  max={max(lat, default=float('nan')):7.1f}ms")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Measure /ws fan-out latency")
+    ap.add_argument("--url", required=True, help="例: http://prompt-relay.local:3939")
+    ap.add_argument("--key", required=True, help="API キー (8〜128 文字)")
+    ap.add_argument("--clients", type=int, default=12, help="受信クライアント数 (既定 12)")
+    ap.add_argument("--stalled", type=int, default=0, help="受信しないクライアント数")
+    ap.add_argument("--rounds", type=int, default=10)
+    ap.add_argument("--timeout", type=float, default=5.0, help="1 配信あたりの待ち時間 (秒)")
+    ap.add_argument("--tolerance", type=float, default=50.0,
+                    help="--stalled のとき許す p99 の悪化 (ms、既定 50)")
+    args = ap.parse_args()
+
+    base = args.url.rstrip("/")
+    clients = [WsClient(base, args.key) for _ in range(args.clients)]
+    stalled = [WsClient(base, args.key, read=False) for _ in range(args.stalled)]
+    for c in clients:
+        c.connect()
+
+    # 接続直後のスナップショットを全員が受け取るまで待つ
+    deadline = time.monotonic() + args.timeout
+    for c in clients:
+        with c.cond:
+            while c.snapshots == 0 and c.closed is None and time.monotonic() < deadline:
+                c.cond.wait(0.1)
+    missing = sum(1 for c in clients if c.snapshots == 0)
+    if missing:
+        print(f"{missing}/{len(clients)} clients got no initial snapshot", file=sys.stderr)
+        return 1
+
+    print(f"clients={args.clients} stalled={args.stalled} rounds={args.rounds}")
+    missed = 0
+    if args.stalled:
+        base_create, base_cancel, m = run_rounds(base, args.key, clients, args.rounds, args.timeout, "base")
+        missed += m
+        report("without stalled clients", base_create, base_cancel)
+        for c in stalled:
+            c.connect()
+    create_lat, cancel_lat, m = run_rounds(base, args.key, clients, args.rounds, args.timeout, "load")
+    missed += m
+
+    for c in clients + stalled:
+        c.close()
+
+    dropped = sum(1 for c in clients if c.closed)
+    report(f"with {args.stalled} stalled clients" if args.stalled else "", create_lat, cancel_lat)
+    print(f"  missed={missed}  disconnected={dropped}")
+    failed = bool(missed or dropped)
+
+    # 受信しないクライアントがいても、他のクライアントの遅延は変わらないこと
+    if args.stalled:
+        for name, before, after in (("create", base_create, create_lat), ("cancel", base_cancel, cancel_lat)):
+            p_before, p_after = percentile(before, 99), percentile(after, 99)
+            flat = p_after <= p_before + args.tolerance
+            print(f"  {name:6s} p99 {p_before:7.1f}ms -> {p_after:7.1f}ms"
+                  f"  ({'flat' if flat else 'REGRESSED'}, tolerance {args.tolerance:.0f}ms)")
+            failed = failed or not flat
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())